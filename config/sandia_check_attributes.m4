@@ -102,3 +102,33 @@ void * f(int i) { while (1) ; __builtin_unreachable(); }]])],
 		   [if the compiler supports __builtin_unreachable()))])
  AS_IF([test "x$sandia_cv_builtin_unreachable" = xyes], [$1], [$2])
 ])
+
+# SANDIA_X86_TARGET_ATTRIBUTE([action-if-found], [action-if-not-found])
+# -------------------------------------------------------------------------
+# Checks that functions using AVX2 and AVX-512F intrinsics can be
+# compiled with __attribute__((target)) and selected at run time with
+# __builtin_cpu_supports(), without changing the global CFLAGS.
+AC_DEFUN([SANDIA_X86_TARGET_ATTRIBUTE],[dnl
+AC_CACHE_CHECK(
+ [support for x86 __attribute__((target)) with runtime dispatch],
+ [sandia_cv_x86_target_attr],
+ [AC_LINK_IFELSE([AC_LANG_SOURCE([[
+#include <immintrin.h>
+__attribute__((target("avx2")))
+int f2(long long *p) { __m256i v = _mm256_loadu_si256((__m256i *)p);
+  return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, v))); }
+__attribute__((target("avx512f")))
+int f5(long long *p) { __m512i v = _mm512_loadu_si512(p);
+  return _mm512_cmpeq_epi64_mask(v, v); }
+int main(void) { long long p[8] = { 0 };
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return f5(p);
+  if (__builtin_cpu_supports("avx2")) return f2(p);
+  return 0; }]])],
+ [sandia_cv_x86_target_attr=yes],
+ [sandia_cv_x86_target_attr=no])])
+ AS_IF([test "x$sandia_cv_x86_target_attr" = xyes],
+ 	   [AC_DEFINE([HAVE_X86_TARGET_ATTRIBUTE], [1],
+		   [if the compiler can build AVX2/AVX-512F functions selected at run time])])
+ AS_IF([test "x$sandia_cv_x86_target_attr" = xyes], [$1], [$2])
+])
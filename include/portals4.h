@@ -587,6 +587,22 @@ int PtlNIFini(ptl_handle_ni_t ni_handle);
 int PtlNIStatus(ptl_handle_ni_t ni_handle,
                 ptl_sr_index_t  status_register,
                 ptl_sr_value_t *status);
+/*!
+ * @fn PtlNIReclaim(ptl_handle_ni_t ni_handle)
+ * @brief Give the unused memory of a network interface back to the system.
+ * @details Implementation specific. Frees the slabs of the internal object
+ *      pools of the interface that hold no object in use. Objects cached
+ *      by threads count as in use. The \c PTL_STAT_POOL_MEMORY counter
+ *      of PtlNIGetStat(), in portals4_stats.h, reports the memory left in
+ *      the pools.
+ * @param[in] ni_handle     An interface handle.
+ * @retval PTL_OK           Indicates success.
+ * @retval PTL_NO_INIT      Indicates that the portals API has not been
+ *                          successfully initialized.
+ * @retval PTL_ARG_INVALID  Indicates that \a ni_handle is not a valid network
+ *                          interface handle.
+ */
+int PtlNIReclaim(ptl_handle_ni_t ni_handle);
 /*!
  * @fn PtlNIHandle(ptl_handle_any_t handle,
  *                 ptl_handle_ni_t *ni_handle)
@@ -2939,6 +2955,84 @@ int PtlEQPoll(const ptl_handle_eq_t *eq_handles,
               ptl_time_t             timeout,
               ptl_event_t           *event,
               unsigned int          *which);
+/*!
+ * @fn PtlEQGetMany(ptl_handle_eq_t eq_handle,
+ *                  unsigned int    count,
+ *                  ptl_event_t    *events,
+ *                  unsigned int   *num_events)
+ * @brief Get up to \a count events from an event queue.
+ * @details Implementation specific extension of PtlEQGet(). Removes the
+ *      next events in the event queue, up to \a count of them, in one
+ *      call. The events returned are consecutive.
+ * @param[in] eq_handle     The event queue handle.
+ * @param[in] count         The maximum number of events to return.
+ * @param[out] events       On successful return, this array holds the
+ *                          events, oldest first.
+ * @param[out] num_events   On successful return, this location holds the
+ *                          number of events returned, at least 1.
+ * @retval PTL_OK               Indicates success.
+ * @retval PTL_EQ_DROPPED       Indicates success and that at least one event
+ *                              between the first returned event and the last
+ *                              event obtained from this event queue has been
+ *                              dropped due to limited space in the event
+ *                              queue.
+ * @retval PTL_EQ_EMPTY         Indicates that \a eq_handle is empty.
+ * @retval PTL_NO_INIT          Indicates that the portals API has not been
+ *                              successfully initialized.
+ * @retval PTL_ARG_INVALID      Indicates that \a eq_handle is not a valid
+ *                              event queue handle or \a count is 0.
+ * @see PtlEQGet(), PtlEQPollMany()
+ */
+int PtlEQGetMany(ptl_handle_eq_t eq_handle,
+                 unsigned int    count,
+                 ptl_event_t    *events,
+                 unsigned int   *num_events);
+/*!
+ * @fn PtlEQPollMany(const ptl_handle_eq_t *eq_handles,
+ *                   unsigned int           size,
+ *                   ptl_time_t             timeout,
+ *                   unsigned int           count,
+ *                   ptl_event_t           *events,
+ *                   unsigned int          *num_events,
+ *                   unsigned int          *which)
+ * @brief Poll for up to \a count events on multiple event queues.
+ * @details Implementation specific extension of PtlEQPoll(). Waits like
+ *      PtlEQPoll() for one of the event queues to have events, then
+ *      returns up to \a count consecutive events from that queue.
+ * @param[in] eq_handles    An array of event queue handles. All the handles
+ *                          must refer to the same interface.
+ * @param[in] size          Length of the array.
+ * @param[in] timeout       Time in milliseconds to wait, or \c
+ *                          PTL_TIME_FOREVER.
+ * @param[in] count         The maximum number of events to return.
+ * @param[out] events       On successful return, this array holds the
+ *                          events, oldest first.
+ * @param[out] num_events   On successful return, this location holds the
+ *                          number of events returned, at least 1.
+ * @param[out] which        On successful return, this location holds the
+ *                          index into \a eq_handles of the event queue the
+ *                          events were taken from.
+ * @retval PTL_OK               Indicates success.
+ * @retval PTL_EQ_DROPPED       Indicates success and that events were
+ *                              dropped before the first returned event.
+ * @retval PTL_EQ_EMPTY         Indicates that the timeout has been reached and
+ *                              all of the event queues are empty.
+ * @retval PTL_NO_INIT          Indicates that the portals API has not been
+ *                              successfully initialized.
+ * @retval PTL_ARG_INVALID      Indicates that an invalid argument was passed,
+ *                              including a \a count of 0.
+ * @retval PTL_INTERRUPTED      Indicates that PtlEQFree() or PtlNIFini() was
+ *                              called by another thread while this thread was
+ *                              waiting in PtlEQPollMany().
+ * @see PtlEQPoll(), PtlEQGetMany()
+ */
+int PtlEQPollMany(const ptl_handle_eq_t *eq_handles,
+                  unsigned int           size,
+                  ptl_time_t             timeout,
+                  unsigned int           count,
+                  ptl_event_t           *events,
+                  unsigned int          *num_events,
+                  unsigned int          *which);
 /*! @} */
 
 /************************
@@ -0,0 +1,54 @@
+/*!
+ * @file portals4_stats.h
+ * @brief Internal statistics of the Portals4 reference implementation
+ *
+ * These counters are not part of the Portals 4 interface and are not
+ * status registers. They are read by the tests and benchmarks of this
+ * tree. This header is not installed, and the counters may change from
+ * one version to the next.
+ */
+
+#ifndef PORTALS4_STATS_H
+#define PORTALS4_STATS_H
+
+#include <portals4.h>
+
+/*! The internal statistics of a network interface. */
+typedef enum {
+    PTL_STAT_CT_WAIT_SPINS,       /*!< PtlCTWait() and PtlCTPoll() calls that
+                                    * completed while spinning. */
+    PTL_STAT_CT_WAIT_BLOCKS,      /*!< PtlCTWait() and PtlCTPoll() calls that
+                                    * blocked before completing. */
+    PTL_STAT_EQ_WAIT_SPINS,       /*!< PtlEQWait() and PtlEQPoll() calls that
+                                    * returned an event while spinning. */
+    PTL_STAT_EQ_WAIT_BLOCKS,      /*!< PtlEQWait() and PtlEQPoll() calls that
+                                    * blocked before returning an event. */
+    PTL_STAT_OBJ_MAGAZINE_HITS,   /*!< Internal object allocations served by
+                                    * a per thread magazine. */
+    PTL_STAT_OBJ_MAGAZINE_MISSES, /*!< Internal object allocations that found
+                                    * their magazine empty. */
+    PTL_STAT_POOL_MEMORY          /*!< Memory held by the internal object
+                                    * pools of the interface, in kilobytes. */
+} ptl_stat_index_t;
+#define PTL_STAT_LAST (PTL_STAT_POOL_MEMORY + 1)
+
+/*!
+ * @fn PtlNIGetStat(ptl_handle_ni_t ni_handle,
+ *                  ptl_stat_index_t stat,
+ *                  ptl_sr_value_t *value)
+ * @brief Read an internal statistic of a network interface.
+ * @param[in] ni_handle     An interface handle.
+ * @param[in] stat          The statistic to read.
+ * @param[out] value        On successful return, this location holds the
+ *                          value of the statistic.
+ * @retval PTL_OK           Indicates success.
+ * @retval PTL_NO_INIT      Indicates that the portals API has not been
+ *                          successfully initialized.
+ * @retval PTL_ARG_INVALID  Indicates that \a ni_handle is not a valid network
+ *                          interface handle or \a stat is not a statistic.
+ */
+int PtlNIGetStat(ptl_handle_ni_t  ni_handle,
+                 ptl_stat_index_t stat,
+                 ptl_sr_value_t  *value);
+
+#endif /* PORTALS4_STATS_H */
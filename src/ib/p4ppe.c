@@ -563,7 +563,7 @@ static int ppe_init_prepare_transfer(md_t *md, data_dir_t dir,
         addr = md->start + offset;
         err = mr_lookup_app(ni, addr, length, &mr);
         if (!err) {
-            buf->mr_list[buf->num_mr++] = mr;
+            buf_mr_list(buf)[buf->num_mr++] = mr;
 
             append_init_data_ppe_direct(data, mr, addr, length, buf);
         }
@@ -713,6 +713,24 @@ static void do_OP_PtlNIStatus(ppebuf_t *buf)
                      &buf->msg.PtlNIStatus.status);
 }
 
+static void do_OP_PtlNIGetStat(ppebuf_t *buf)
+{
+    struct client *client = buf->cookie;
+
+    buf->msg.ret =
+        _PtlNIGetStat(&client->gbl, buf->msg.PtlNIGetStat.ni_handle,
+                      buf->msg.PtlNIGetStat.stat,
+                      &buf->msg.PtlNIGetStat.value);
+}
+
+static void do_OP_PtlNIReclaim(ppebuf_t *buf)
+{
+    struct client *client = buf->cookie;
+
+    buf->msg.ret =
+        _PtlNIReclaim(&client->gbl, buf->msg.PtlNIReclaim.ni_handle);
+}
+
 /* Remove an NI from a PPE set. */
 static void remove_ni(ni_t *ni)
 {
@@ -1427,8 +1445,10 @@ static struct {
         ADD_OP(PtlGetUid), ADD_OP(PtlInit), ADD_OP(PtlLEAppend),
         ADD_OP(PtlLESearch), ADD_OP(PtlLEUnlink), ADD_OP(PtlMDBind),
         ADD_OP(PtlMDRelease), ADD_OP(PtlMEAppend), ADD_OP(PtlMESearch),
-        ADD_OP(PtlMEUnlink), ADD_OP(PtlNIFini), ADD_OP(PtlNIHandle),
-        ADD_OP(PtlNIInit), ADD_OP(PtlNIStatus), ADD_OP(PtlPTAlloc),
+        ADD_OP(PtlMEUnlink), ADD_OP(PtlNIFini), ADD_OP(PtlNIGetStat),
+        ADD_OP(PtlNIHandle), ADD_OP(PtlNIInit), ADD_OP(PtlNIReclaim),
+        ADD_OP(PtlNIStatus),
+        ADD_OP(PtlPTAlloc),
         ADD_OP(PtlPTDisable), ADD_OP(PtlPTEnable), ADD_OP(PtlPTFree),
         ADD_OP(PtlPut), ADD_OP(PtlSetMap), ADD_OP(PtlSwap),
         ADD_OP(PtlTriggeredAtomic), ADD_OP(PtlTriggeredCTInc),
@@ -5,6 +5,7 @@
  */
 
 #include "ptl_loc.h"
+#include "ptl_atomic_kernels.h"
 
 /**
  * Misc useful information about atomic ops
@@ -54,1537 +55,6 @@ int atom_type_size[] = {
     [PTL_LONG_DOUBLE_COMPLEX] = sizeof(long double complex),
 };
 
-#define min(a, b)	(((a) < (b)) ? (a) : (b))
-#define max(a, b)	(((a) > (b)) ? (a) : (b))
-#define sum(a, b)	((a) + (b))
-#define prod(a, b)	((a) * (b))
-#define lor(a, b)	((a) || (b))
-#define land(a, b)	((a) && (b))
-#define bor(a, b)	((a) | (b))
-#define band(a, b)	((a) & (b))
-#define lxor(a, b)	(((a) && !(b)) || (!(a) && (b)))
-#define bxor(a, b)	((a) ^ (b))
-
-/**
- * Compute min of two signed char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int min_sc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int8_t *s = src;
-    int8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = min(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute min of two unsigned char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int min_uc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint8_t *s = src;
-    uint8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = min(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute min of two signed short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int min_ss(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int16_t *s = src;
-    int16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = min(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute min of two unsigned short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int min_us(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint16_t *s = src;
-    uint16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = min(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute min of two signed int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int min_si(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int32_t *s = src;
-    int32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = min(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute min of two unsigned int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int min_ui(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint32_t *s = src;
-    uint32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = min(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute min of two signed long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int min_sl(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int64_t *s = src;
-    int64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = min(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute min of two unsigned long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int min_ul(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint64_t *s = src;
-    uint64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = min(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute min of two float arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int min_f(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    float *s = src;
-    float *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = min(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute min of two double arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int min_d(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    double *s = src;
-    double *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = min(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute min of two long double arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int min_ld(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    long double *s = src;
-    long double *d = dst;
-
-    for (i = 0; i < length / sizeof(long double); i++, s++, d++)
-        *d = min(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute max of two signed char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int max_sc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int8_t *s = src;
-    int8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = max(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute max of two unsigned char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int max_uc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint8_t *s = src;
-    uint8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = max(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute max of two signed short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int max_ss(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int16_t *s = src;
-    int16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = max(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute max of two unsigned short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int max_us(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint16_t *s = src;
-    uint16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = max(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute max of two signed int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int max_si(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int32_t *s = src;
-    int32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = max(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute max of two unsigned int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int max_ui(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint32_t *s = src;
-    uint32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = max(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute max of two signed long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int max_sl(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int64_t *s = src;
-    int64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = max(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute max of two unsigned long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int max_ul(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint64_t *s = src;
-    uint64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = max(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute max of two float arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int max_f(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    float *s = src;
-    float *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = max(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute max of two double arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int max_d(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    double *s = src;
-    double *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = max(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute max of two long double arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int max_ld(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    long double *s = src;
-    long double *d = dst;
-
-    for (i = 0; i < length / sizeof(long double); i++, s++, d++)
-        *d = max(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two signed char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_sc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int8_t *s = src;
-    int8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = sum(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two unsigned char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_uc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint8_t *s = src;
-    uint8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = sum(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two signed short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_ss(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int16_t *s = src;
-    int16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = sum(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two unsigned short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_us(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint16_t *s = src;
-    uint16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = sum(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two signed int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_si(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int32_t *s = src;
-    int32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = sum(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two unsigned int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_ui(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint32_t *s = src;
-    uint32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = sum(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two signed long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_sl(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int64_t *s = src;
-    int64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = sum(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two unsigned long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_ul(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint64_t *s = src;
-    uint64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = sum(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two float arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_f(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    float *s = src;
-    float *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = sum(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two double arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_d(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    double *s = src;
-    double *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = sum(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two long double arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_ld(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    long double *s = src;
-    long double *d = dst;
-
-    for (i = 0; i < length / sizeof(long double); i++, s++, d++)
-        *d = sum(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute sum of two long double arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int sum_ldc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    long double complex *s = src;
-    long double complex *d = dst;
-
-    for (i = 0; i < length / sizeof(long double complex); i++, s++, d++) {
-        long double complex tmp;
-        memcpy(&tmp, s, sizeof(long double complex));
-        *d = sum(tmp, *d);
-    }
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two signed char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_sc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int8_t *s = src;
-    int8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = prod(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two unsigned char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_uc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint8_t *s = src;
-    uint8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = prod(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two signed short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_ss(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int16_t *s = src;
-    int16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = prod(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two unsigned short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_us(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint16_t *s = src;
-    uint16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = prod(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two signed int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_si(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int32_t *s = src;
-    int32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = prod(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two unsigned int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_ui(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint32_t *s = src;
-    uint32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = prod(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two signed long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_sl(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    int64_t *s = src;
-    int64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = prod(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two unsigned long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_ul(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint64_t *s = src;
-    uint64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = prod(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two float arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_f(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    float *s = src;
-    float *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = prod(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two complex float arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_fc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    float complex *s = src;
-    float complex *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++) {
-        *d = prod(*s, *d);
-    }
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two double arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_d(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    double *s = src;
-    double *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = prod(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two complex double arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_dc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    double complex *s = src;
-    double complex *d = dst;
-
-    for (i = 0; i < length / 16; i++, s++, d++) {
-        *d = prod(*s, *d);
-    }
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two long double arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_ld(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    long double *s = src;
-    long double *d = dst;
-
-    for (i = 0; i < length / sizeof(long double); i++, s++, d++)
-        *d = prod(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute prod of two long double complex arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int prod_ldc(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    long double complex *s = src;
-    long double complex *d = dst;
-
-    for (i = 0; i < length / sizeof(long double complex); i++, s++, d++) {
-        long double complex tmp;
-        memcpy(&tmp, s, sizeof(long double complex));
-        *d = prod(tmp, *d);
-    }
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical or of two signed or unsigned char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int lor_c(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint8_t *s = src;
-    uint8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = lor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical or of two signed or unsigned short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int lor_s(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint16_t *s = src;
-    uint16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = lor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical or of two signed or unsigned int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int lor_i(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint32_t *s = src;
-    uint32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = lor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical or of two signed or unsigned long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int lor_l(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint64_t *s = src;
-    uint64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = lor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical and of two signed or unsigned char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int land_c(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint8_t *s = src;
-    uint8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = land(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical and of two signed or unsigned short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int land_s(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint16_t *s = src;
-    uint16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = land(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical and of two signed or unsigned int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int land_i(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint32_t *s = src;
-    uint32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = land(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical and of two signed or unsigned long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int land_l(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint64_t *s = src;
-    uint64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = land(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise or of two signed or unsigned char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int bor_c(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint8_t *s = src;
-    uint8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = bor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise or of two signed or unsigned short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int bor_s(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint16_t *s = src;
-    uint16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = bor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise or of two signed or unsigned int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int bor_i(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint32_t *s = src;
-    uint32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = bor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise or of two signed or unsigned long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int bor_l(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint64_t *s = src;
-    uint64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = bor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise and of two signed or unsigned char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int band_c(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint8_t *s = src;
-    uint8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = band(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise and of two signed or unsigned short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int band_s(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint16_t *s = src;
-    uint16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = band(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise and of two signed or unsigned int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int band_i(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint32_t *s = src;
-    uint32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = band(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise and of two signed or unsigned long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int band_l(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint64_t *s = src;
-    uint64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = band(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical xor of two signed or unsigned char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int lxor_c(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint8_t *s = src;
-    uint8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = lxor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical xor of two signed or unsigned short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int lxor_s(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint16_t *s = src;
-    uint16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = lxor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical xor of two signed or unsigned int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int lxor_i(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint32_t *s = src;
-    uint32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = lxor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute logical xor of two signed or unsigned long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int lxor_l(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint64_t *s = src;
-    uint64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = lxor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise xor of two signed or unsigned char arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int bxor_c(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint8_t *s = src;
-    uint8_t *d = dst;
-
-    for (i = 0; i < length; i++, s++, d++)
-        *d = bxor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise xor of two signed or unsigned short arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int bxor_s(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint16_t *s = src;
-    uint16_t *d = dst;
-
-    for (i = 0; i < length / 2; i++, s++, d++)
-        *d = bxor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise xor of two signed or unsigned int arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int bxor_i(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint32_t *s = src;
-    uint32_t *d = dst;
-
-    for (i = 0; i < length / 4; i++, s++, d++)
-        *d = bxor(*s, *d);
-
-    return PTL_OK;
-}
-
-/**
- * Compute bitwise xor of two signed or unsigned long arrays.
- *
- * @param dst destination array
- * @param src source array
- * @param length array length in bytes
- *
- * @return status
- */
-static int bxor_l(void *dst, void *src, ptl_size_t length)
-{
-    ptl_size_t i;
-    uint64_t *s = src;
-    uint64_t *d = dst;
-
-    for (i = 0; i < length / 8; i++, s++, d++)
-        *d = bxor(*s, *d);
-
-    return PTL_OK;
-}
-
 /**
  * An array of function pointers to compute indicated atomic
  * op on two arrays of indicated data type.
@@ -1720,6 +190,58 @@ atom_op_t atom_op[PTL_OP_LAST][PTL_DATATYPE_LAST] = {
     ,
 };
 
+/**
+ * Replace a kernel in the atom_op table by an equivalent one.
+ *
+ * @param from kernel to replace
+ * @param to kernel to use instead
+ */
+static void atom_op_replace(atom_op_t from, atom_op_t to)
+{
+    int op;
+    int type;
+
+    for (op = 0; op < PTL_OP_LAST; op++) {
+        for (type = 0; type < PTL_DATATYPE_LAST; type++) {
+            if (atom_op[op][type] == from)
+                atom_op[op][type] = to;
+        }
+    }
+}
+
+#define ATOM_USE_VECTOR(isa, name, op, type)	\
+	atom_op_replace(name, name##_##isa);
+
+/**
+ * Switch the atom_op table to the widest vector kernels the CPU
+ * supports, unless PTL_ATOMIC_VECTOR is 0.
+ *
+ * Must be called once, before any atomic operation is processed.
+ */
+void atom_op_init(void)
+{
+    const char *name = "portable";
+
+#ifdef HAVE_X86_TARGET_ATTRIBUTE
+    if (get_param(PTL_ATOMIC_VECTOR)) {
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx512bw")) {
+            ATOM_VECTOR_KERNELS(ATOM_USE_VECTOR, avx512)
+            name = "avx512";
+        } else if (__builtin_cpu_supports("avx2")) {
+            ATOM_VECTOR_KERNELS(ATOM_USE_VECTOR, avx2)
+            name = "avx2";
+        } else if (__builtin_cpu_supports("sse2")) {
+            ATOM_VECTOR_KERNELS(ATOM_USE_VECTOR, sse2)
+            name = "sse2";
+        }
+    }
+#endif
+
+    ptl_info("atomic operations use %s kernels\n", name);
+}
+
 #define cswap(op, s, d, type)							\
 	do {	if (op->type == d->type) d->type = s->type; } while (0)
 
@@ -2040,3 +562,144 @@ int swap_data_in(ptl_op_t atom_op, ptl_datatype_t atom_type, void *dest,
 
     return PTL_OK;
 }
+
+/**
+ * Check whether an operation can be applied with processor atomics.
+ *
+ * @param op The operation
+ * @param type The data type
+ *
+ * @return true if atomic_coherent_apply() handles this operation
+ */
+int atomic_coherent_ok(ptl_op_t op, ptl_datatype_t type)
+{
+    switch (type) {
+        case PTL_INT32_T:
+        case PTL_UINT32_T:
+        case PTL_INT64_T:
+        case PTL_UINT64_T:
+            break;
+        default:
+            return 0;
+    }
+
+    if (op >= PTL_OP_LAST)
+        return 0;
+
+    return op_info[op].swap_ok || atom_op[op][type] != NULL;
+}
+
+/**
+ * Apply an operation on one element with processor atomics.
+ *
+ * Operations the processor supports directly use a single atomic
+ * instruction. The others compute the new value with the regular
+ * operation and install it with a compare and swap loop.
+ *
+ * @param name The datatype_t member
+ * @param op The operation
+ * @param type The data type
+ * @param d Pointer to the target element, naturally aligned
+ * @param s The incoming element
+ * @param operand Pointer to the operand of swap operations
+ * @param old Set to the previous value of the element
+ */
+#define coherent_apply(name, op, type, d, s, operand, old)		\
+	do {								\
+		switch (op) {						\
+		case PTL_SUM:						\
+			old = __atomic_fetch_add(d, s, __ATOMIC_SEQ_CST); \
+			break;						\
+		case PTL_BOR:						\
+			old = __atomic_fetch_or(d, s, __ATOMIC_SEQ_CST); \
+			break;						\
+		case PTL_BAND:						\
+			old = __atomic_fetch_and(d, s, __ATOMIC_SEQ_CST); \
+			break;						\
+		case PTL_BXOR:						\
+			old = __atomic_fetch_xor(d, s, __ATOMIC_SEQ_CST); \
+			break;						\
+		case PTL_SWAP:						\
+			old = __atomic_exchange_n(d, s, __ATOMIC_SEQ_CST); \
+			break;						\
+		case PTL_CSWAP:						\
+			old = (operand)->name;				\
+			__atomic_compare_exchange_n(d, &old, s, 0,	\
+				__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);	\
+			break;						\
+		default: {						\
+			datatype_t new, in;				\
+			in.name = s;					\
+			old = __atomic_load_n(d, __ATOMIC_SEQ_CST);	\
+			do {						\
+				new.name = old;				\
+				if (op_info[op].swap_ok)		\
+					swap_data_in(op, type, &new,	\
+						     &in, operand);	\
+				else					\
+					atom_op[op][type](&new, &in,	\
+						sizeof(new.name));	\
+			} while (!__atomic_compare_exchange_n(d, &old,	\
+				new.name, 0, __ATOMIC_SEQ_CST,		\
+				__ATOMIC_SEQ_CST));			\
+			break;						\
+		}							\
+		}							\
+	} while (0)
+
+/**
+ * Apply an atomic, fetch or swap operation with processor atomics.
+ *
+ * Each element is updated atomically with respect to other processor
+ * atomic operations on it, including those of other Portals operations
+ * done through this function. No lock is needed.
+ *
+ * @pre atomic_coherent_ok() is true for op and type, and dest is
+ * aligned on the size of type.
+ *
+ * @param op The operation to perform
+ * @param type The data type to use
+ * @param dest The target memory
+ * @param source The incoming data, possibly unaligned
+ * @param operand The operand of swap operations, possibly unaligned
+ * @param fetch If not NULL, receives the previous target data
+ * @param length The length in bytes, a multiple of the type size
+ *
+ * @return status
+ */
+int atomic_coherent_apply(ptl_op_t op, ptl_datatype_t type, void *dest,
+                          const void *source, const void *operand,
+                          void *fetch, ptl_size_t length)
+{
+    const int size = atom_type_size[type];
+    datatype_t opnd;
+    ptl_size_t i;
+
+    memset(&opnd, 0, sizeof(opnd));
+    if (op_info[op].use_operand)
+        memcpy(&opnd, operand, size);
+
+    for (i = 0; i < length; i += size) {
+        if (size == 4) {
+            uint32_t *d = dest + i;
+            uint32_t s;
+            uint32_t old;
+
+            memcpy(&s, source + i, size);
+            coherent_apply(u32, op, type, d, s, &opnd, old);
+            if (fetch)
+                memcpy(fetch + i, &old, size);
+        } else {
+            uint64_t *d = dest + i;
+            uint64_t s;
+            uint64_t old;
+
+            memcpy(&s, source + i, size);
+            coherent_apply(u64, op, type, d, s, &opnd, old);
+            if (fetch)
+                memcpy(fetch + i, &old, size);
+        }
+    }
+
+    return PTL_OK;
+}
@@ -33,6 +33,8 @@ typedef int (*atom_op_t) (void *src, void *dst, ptl_size_t length);
 
 extern atom_op_t atom_op[PTL_OP_LAST][PTL_DATATYPE_LAST];
 
+void atom_op_init(void);
+
 /*
  * Useful information about atomic operations.
  */
@@ -51,4 +53,10 @@ extern int atom_type_size[PTL_DATATYPE_LAST];
 int swap_data_in(ptl_op_t atom_op, ptl_datatype_t atom_type, void *dest,
                  void *source, datatype_t *operand);
 
+int atomic_coherent_ok(ptl_op_t op, ptl_datatype_t type);
+
+int atomic_coherent_apply(ptl_op_t op, ptl_datatype_t type, void *dest,
+                          const void *source, const void *operand,
+                          void *fetch, ptl_size_t length);
+
 #endif /* PTL_ATOMIC_H */
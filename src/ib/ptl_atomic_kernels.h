@@ -0,0 +1,226 @@
+/**
+ * @file ptl_atomic_kernels.h
+ *
+ * @brief Kernels applying an atomic operation to two arrays.
+ *
+ * Every kernel computes dst[i] = op(src[i], dst[i]) over length bytes
+ * and has the atom_op_t signature. The kernels are generated from the
+ * lists below: a portable version of each, and for the operations and
+ * types that map onto vector instructions, SSE2, AVX2 and AVX-512
+ * versions that process a full vector register per step. The vector
+ * versions give the same results as the portable ones.
+ *
+ * This file instantiates static functions; it is included by
+ * ptl_atomic.c, which selects the kernels for the CPU, and by the
+ * atomic kernel benchmark.
+ */
+#ifndef PTL_ATOMIC_KERNELS_H
+#define PTL_ATOMIC_KERNELS_H
+
+#define min(a, b)	(((a) < (b)) ? (a) : (b))
+#define max(a, b)	(((a) > (b)) ? (a) : (b))
+#define sum(a, b)	((a) + (b))
+#define prod(a, b)	((a) * (b))
+#define lor(a, b)	((a) || (b))
+#define land(a, b)	((a) && (b))
+#define bor(a, b)	((a) | (b))
+#define band(a, b)	((a) & (b))
+#define lxor(a, b)	(((a) && !(b)) || (!(a) && (b)))
+#define bxor(a, b)	((a) ^ (b))
+
+/*
+ * Vector forms of the operations, using the GCC vector extensions.
+ * A comparison yields an integer vector of all ones or all zeros per
+ * element, which selects between the operands bit by bit.
+ */
+#define vselect(m, a, b)						\
+	((__typeof__(a))(((m) & (__typeof__(m))(a)) |			\
+			 (~(m) & (__typeof__(m))(b))))
+#define vmin(a, b)	vselect((a) < (b), a, b)
+#define vmax(a, b)	vselect((a) > (b), a, b)
+#define vsum(a, b)	((a) + (b))
+#define vprod(a, b)	((a) * (b))
+#define vlor(a, b)	((__typeof__(a))((((a) != 0) | ((b) != 0)) & 1))
+#define vland(a, b)	((__typeof__(a))((((a) != 0) & ((b) != 0)) & 1))
+#define vbor(a, b)	((a) | (b))
+#define vband(a, b)	((a) & (b))
+#define vlxor(a, b)	((__typeof__(a))((((a) != 0) ^ ((b) != 0)) & 1))
+#define vbxor(a, b)	((a) ^ (b))
+
+/**
+ * Kernels with vector versions, as K(arg, name, op, type).
+ */
+#define ATOM_VECTOR_KERNELS(K, arg)					\
+	K(arg, min_sc, min, int8_t)					\
+	K(arg, min_uc, min, uint8_t)					\
+	K(arg, min_ss, min, int16_t)					\
+	K(arg, min_us, min, uint16_t)					\
+	K(arg, min_si, min, int32_t)					\
+	K(arg, min_ui, min, uint32_t)					\
+	K(arg, min_sl, min, int64_t)					\
+	K(arg, min_ul, min, uint64_t)					\
+	K(arg, min_f, min, float)					\
+	K(arg, min_d, min, double)					\
+	K(arg, max_sc, max, int8_t)					\
+	K(arg, max_uc, max, uint8_t)					\
+	K(arg, max_ss, max, int16_t)					\
+	K(arg, max_us, max, uint16_t)					\
+	K(arg, max_si, max, int32_t)					\
+	K(arg, max_ui, max, uint32_t)					\
+	K(arg, max_sl, max, int64_t)					\
+	K(arg, max_ul, max, uint64_t)					\
+	K(arg, max_f, max, float)					\
+	K(arg, max_d, max, double)					\
+	K(arg, sum_sc, sum, int8_t)					\
+	K(arg, sum_uc, sum, uint8_t)					\
+	K(arg, sum_ss, sum, int16_t)					\
+	K(arg, sum_us, sum, uint16_t)					\
+	K(arg, sum_si, sum, int32_t)					\
+	K(arg, sum_ui, sum, uint32_t)					\
+	K(arg, sum_sl, sum, int64_t)					\
+	K(arg, sum_ul, sum, uint64_t)					\
+	K(arg, sum_f, sum, float)					\
+	K(arg, sum_d, sum, double)					\
+	K(arg, prod_sc, prod, int8_t)					\
+	K(arg, prod_uc, prod, uint8_t)					\
+	K(arg, prod_ss, prod, int16_t)					\
+	K(arg, prod_us, prod, uint16_t)					\
+	K(arg, prod_si, prod, int32_t)					\
+	K(arg, prod_ui, prod, uint32_t)					\
+	K(arg, prod_sl, prod, int64_t)					\
+	K(arg, prod_ul, prod, uint64_t)					\
+	K(arg, prod_f, prod, float)					\
+	K(arg, prod_d, prod, double)					\
+	K(arg, lor_c, lor, uint8_t)					\
+	K(arg, lor_s, lor, uint16_t)					\
+	K(arg, lor_i, lor, uint32_t)					\
+	K(arg, lor_l, lor, uint64_t)					\
+	K(arg, land_c, land, uint8_t)					\
+	K(arg, land_s, land, uint16_t)					\
+	K(arg, land_i, land, uint32_t)					\
+	K(arg, land_l, land, uint64_t)					\
+	K(arg, bor_c, bor, uint8_t)					\
+	K(arg, bor_s, bor, uint16_t)					\
+	K(arg, bor_i, bor, uint32_t)					\
+	K(arg, bor_l, bor, uint64_t)					\
+	K(arg, band_c, band, uint8_t)					\
+	K(arg, band_s, band, uint16_t)					\
+	K(arg, band_i, band, uint32_t)					\
+	K(arg, band_l, band, uint64_t)					\
+	K(arg, lxor_c, lxor, uint8_t)					\
+	K(arg, lxor_s, lxor, uint16_t)					\
+	K(arg, lxor_i, lxor, uint32_t)					\
+	K(arg, lxor_l, lxor, uint64_t)					\
+	K(arg, bxor_c, bxor, uint8_t)					\
+	K(arg, bxor_s, bxor, uint16_t)					\
+	K(arg, bxor_i, bxor, uint32_t)					\
+	K(arg, bxor_l, bxor, uint64_t)
+
+/**
+ * Kernels that only have a portable version, as K(arg, name, op, type).
+ * Complex products are not element wise on the underlying reals.
+ */
+#define ATOM_SCALAR_KERNELS(K, arg)					\
+	K(arg, min_ld, min, long double)				\
+	K(arg, max_ld, max, long double)				\
+	K(arg, sum_ld, sum, long double)				\
+	K(arg, prod_ld, prod, long double)				\
+	K(arg, prod_fc, prod, float complex)				\
+	K(arg, prod_dc, prod, double complex)
+
+/**
+ * Long double complex kernels. The source is copied out first since it
+ * may not be aligned for this type.
+ */
+#define ATOM_UNALIGNED_KERNELS(K, arg)					\
+	K(arg, sum_ldc, sum, long double complex)			\
+	K(arg, prod_ldc, prod, long double complex)
+
+/**
+ * Portable kernel.
+ */
+#define ATOM_KERNEL(arg, name, op, type)				\
+static int name(void *dst, void *src, ptl_size_t length)		\
+{									\
+    ptl_size_t i;							\
+    type *s = src;							\
+    type *d = dst;							\
+									\
+    for (i = 0; i < length / sizeof(type); i++, s++, d++)		\
+        *d = op(*s, *d);						\
+									\
+    return PTL_OK;							\
+}
+
+/**
+ * Portable kernel for a source that may not be aligned.
+ */
+#define ATOM_UNALIGNED_KERNEL(arg, name, op, type)			\
+static int name(void *dst, void *src, ptl_size_t length)		\
+{									\
+    ptl_size_t i;							\
+    type *s = src;							\
+    type *d = dst;							\
+									\
+    for (i = 0; i < length / sizeof(type); i++, s++, d++) {		\
+        type tmp;							\
+        memcpy(&tmp, s, sizeof(type));					\
+        *d = op(tmp, *d);						\
+    }									\
+									\
+    return PTL_OK;							\
+}
+
+ATOM_VECTOR_KERNELS(ATOM_KERNEL, portable)
+ATOM_SCALAR_KERNELS(ATOM_KERNEL, portable)
+ATOM_UNALIGNED_KERNELS(ATOM_UNALIGNED_KERNEL, portable)
+
+#ifdef HAVE_X86_TARGET_ATTRIBUTE
+
+/* compiler target and vector width in bytes of each instruction set */
+#define ATOM_TARGET_sse2	"sse2"
+#define ATOM_WIDTH_sse2		16
+#define ATOM_TARGET_avx2	"avx2"
+#define ATOM_WIDTH_avx2		32
+#define ATOM_TARGET_avx512	"avx512f,avx512bw"
+#define ATOM_WIDTH_avx512	64
+
+/**
+ * Vector kernel for instruction set isa, named name_isa.
+ *
+ * Whole vectors are loaded and stored with memcpy since neither array
+ * needs to be aligned; the remaining elements use the portable code.
+ */
+#define ATOM_VECTOR_KERNEL(isa, name, op, type)				\
+__attribute__ ((target(ATOM_TARGET_##isa)))				\
+static int name##_##isa(void *dst, void *src, ptl_size_t length)	\
+{									\
+    typedef type vec_t __attribute__ ((vector_size(ATOM_WIDTH_##isa)));\
+    const ptl_size_t n = length / sizeof(type);				\
+    const ptl_size_t step = sizeof(vec_t) / sizeof(type);		\
+    type *s = src;							\
+    type *d = dst;							\
+    ptl_size_t i;							\
+									\
+    for (i = 0; i + step <= n; i += step) {				\
+        vec_t vs, vd;							\
+									\
+        memcpy(&vs, &s[i], sizeof(vec_t));				\
+        memcpy(&vd, &d[i], sizeof(vec_t));				\
+        vd = v##op(vs, vd);						\
+        memcpy(&d[i], &vd, sizeof(vec_t));				\
+    }									\
+									\
+    for (; i < n; i++)							\
+        d[i] = op(s[i], d[i]);						\
+									\
+    return PTL_OK;							\
+}
+
+ATOM_VECTOR_KERNELS(ATOM_VECTOR_KERNEL, sse2)
+ATOM_VECTOR_KERNELS(ATOM_VECTOR_KERNEL, avx2)
+ATOM_VECTOR_KERNELS(ATOM_VECTOR_KERNEL, avx512)
+
+#endif /* HAVE_X86_TARGET_ATTRIBUTE */
+
+#endif /* PTL_ATOMIC_KERNELS_H */
@@ -35,6 +35,7 @@ int buf_setup(void *arg)
 
 #if WITH_TRANSPORT_SHMEM &&!USE_KNEM
     buf->transfer.noknem.data = NULL;
+    buf->transfer.noknem.noknem = NULL;
 #endif
 
     return PTL_OK;
@@ -53,7 +54,7 @@ void buf_cleanup(void *arg)
     int i;
 
     for (i = 0; i < buf->num_mr; i++)
-        mr_put(buf->mr_list[i]);
+        mr_put(buf_mr_list(buf)[i]);
 
     buf->num_mr = 0;
 
@@ -98,9 +99,12 @@ int buf_init(void *arg, void *parm)
 
     buf->length = 0;
     buf->type = BUF_FREE;
+    buf->internal_size =
+        (buf->obj.obj_pool->size == small_buf_t_size()) ?
+        BUF_SMALL_DATA_SIZE : BUF_DATA_SIZE;
 
-    pthread_mutex_init(&buf->mutex, NULL);
-    pthread_cond_init(&buf->cond, NULL);
+    buf->lock = BUF_UNLOCKED;
+    buf->unexpected_busy = 0;
 
 #if WITH_TRANSPORT_IB
     if (parm) {
@@ -128,13 +132,54 @@ int buf_init(void *arg, void *parm)
 
 void buf_fini(void *arg)
 {
+#if WITH_TRANSPORT_IB
     buf_t *buf = arg;
 
-#if WITH_TRANSPORT_IB
     PTL_FASTLOCK_DESTROY(&buf->rdma.rdma_list_lock);
 #endif
-    pthread_mutex_destroy(&buf->mutex);
-    pthread_cond_destroy(&buf->cond);
+}
+
+/**
+ * @brief Wait for a buf lock held by another thread.
+ *
+ * Slow path of buf_lock. The lock word is set to BUF_CONTENDED before
+ * sleeping, so that the holder wakes us when it unlocks.
+ *
+ * @param[in] buf the buf to lock
+ * @param[in] c the value of the lock word found by buf_lock
+ */
+void buf_lock_wait(buf_t *buf, int c)
+{
+    if (c != BUF_CONTENDED)
+        c = __sync_lock_test_and_set(&buf->lock, BUF_CONTENDED);
+
+    while (c != BUF_UNLOCKED) {
+        futex_wait(&buf->lock, BUF_CONTENDED, NULL);
+        c = __sync_lock_test_and_set(&buf->lock, BUF_CONTENDED);
+    }
+}
+
+/**
+ * @brief Wait for the end of the processing of an unexpected message.
+ *
+ * The message may still be transferring when an append or search
+ * finds it on the unexpected list. Called with the buf locked, which
+ * is released while waiting.
+ *
+ * @param[in] buf the buf holding the message
+ */
+void buf_unexpected_wait(buf_t *buf)
+{
+    while (buf->unexpected_busy) {
+        buf_unlock(buf);
+
+        /* Tell buf_unexpected_done there is a waiter. */
+        if (__sync_bool_compare_and_swap(&buf->unexpected_busy, 1, 2) ||
+            buf->unexpected_busy == 2)
+            futex_wait(&buf->unexpected_busy, 2, NULL);
+
+        buf_lock(buf);
+    }
 }
 
 /**
@@ -147,7 +192,7 @@ void buf_dump(buf_t *buf)
     struct req_hdr *hdr = (struct req_hdr *)buf->data;
 
     printf("buf: %p\n", buf);
-    printf("buf->size	= %d\n", BUF_DATA_SIZE);
+    printf("buf->size	= %d\n", buf->internal_size);
     printf("buf->length	= %d\n", buf->length);
     printf("hdr->h1.version	= %d\n", hdr->h1.version);
     printf("hdr->h1.operation	= %d\n", hdr->h1.operation);
@@ -35,6 +35,7 @@ enum buf_type {
 #if WITH_TRANSPORT_SHMEM
     BUF_SHMEM_SEND,
     BUF_SHMEM_RETURN,
+    BUF_SHMEM_NOKNEM,           /* noknem transfer notification */
 #endif
 
 #if WITH_PPE
@@ -102,7 +103,11 @@ struct xremote {
     };
 };
 
+/* Size of the internal data of the two buf size classes. Large bufs
+ * carry messages, with their header and inline data. Small bufs only
+ * need room for an ACK header, or nothing for triggered operations. */
 #define BUF_DATA_SIZE 1024
+#define BUF_SMALL_DATA_SIZE 64
 
 /**
  * A buf struct holds information about a common
@@ -112,11 +117,15 @@ struct xremote {
  *
  * A buf struct includes room to hold either an OFA
  * verbs send or recv work request or info if it is
- * a shared memory message. It also includes a data buffer that
- * can hold a short message. Additionally there
- * is an array to hold a list of pointers to any memory
+ * a shared memory message. It is followed by a data buffer that
+ * can hold a short message. Additionally large bufs have
+ * an array to hold a list of pointers to any memory
  * regions used by the message so that they can be freed after
- * the operation is completed.
+ * the operation is completed, after their data buffer.
+ *
+ * The fields touched for every message come first, so that they
+ * share a few cache lines; the per transport and rarely used fields
+ * follow.
  *
  * Bufs used by OFA verbs are allocated in a slab that has been
  * registered.
@@ -125,12 +134,35 @@ struct buf {
         /** base object */
     obj_t obj;
 
-    pthread_mutex_t mutex;
+        /** type of buf */
+    buf_type_t type;
+
+    unsigned int event_mask;
+
+        /** message length */
+    unsigned int length;
+
+        /** recv state */
+    int recv_state;
 
         /** enables holding buf on lists */
     struct list_head list;
 
-    unsigned int event_mask;
+        /** message (usually internal_data) */
+    void *data;
+
+    conn_t *conn;
+
+#if WITH_TRANSPORT_SHMEM || IS_PPE
+    /* When receiving a shared memory buffer (sbuf), a regular buffer (buf) is
+     * allocated to process the data through the receive state machine
+     * without destroying the sbuf that belongs to
+     * another process. Keep a pointer to that sbuf. */
+    struct buf *mem_buf;
+#endif
+
+    struct data *data_in;
+    struct data *data_out;
 
     ptl_size_t rlength;
     ptl_size_t roffset;
@@ -139,10 +171,12 @@ struct buf {
     ptl_ni_fail_t ni_fail;      /* todo: may remove */
     ptl_list_t matching_list;   /* for ptl_list event field */
 
-    conn_t *conn;
+        /** remote destination for message */
+    struct xremote dest;
 
-    struct data *data_in;
-    struct data *data_out;
+        /** serializes the state machines on the buf: BUF_UNLOCKED,
+         * BUF_LOCKED or BUF_CONTENDED */
+    int lock;
 
     /* Fields only valid during the lifetime of a buffer. */
     union {
@@ -169,6 +203,8 @@ struct buf {
         struct {
             int tgt_state;
             int in_atomic;
+            unsigned int atomic_lock_first;
+            unsigned int atomic_lock_count;
 
             pt_t *pt;
             void *start;
@@ -221,28 +257,11 @@ struct buf {
         };
     };
 
-        /** recv state */
-    int recv_state;
-
-        /** remote destination for message */
-    struct xremote dest;
-
-        /** message length */
-    unsigned int length;
-
-        /** message (usually internal_data) */
-    void *data;
-
-        /** data to hold message */
-    uint8_t internal_data[BUF_DATA_SIZE];
-
-        /** type of buf */
-    buf_type_t type;
-
     /* Target only. Must survive through buffer reuse. */
     struct list_head unexpected_list;
-    int unexpected_busy;
-    pthread_cond_t cond;
+    struct list_head unexpected_index_list;
+    int unexpected_busy;        /* 0, 1 while the message is processed,
+                                 * 2 if a thread waits for it */
 
     /* Fields that survive between buffer reuse. */
     union {
@@ -277,6 +296,9 @@ struct buf {
             int in_progress;
 #endif
             int i_am_prog_thread;
+            /* received buf processed by the target, the progress
+             * thread can free it */
+            int tgt_done;
         } udp;
 #endif
 
@@ -330,6 +352,10 @@ struct buf {
              * 0=initiator, 2=target */
             int transfer_state_expected;
 
+            /* Whether this side fills the bounce buffer ring (the
+             * initiator of a put, the target of a get) or drains it. */
+            int producer;
+
             /* Local MD/ME/LE */
             ptl_iovec_t *iovecs;
             ptl_size_t num_iovecs;
@@ -353,6 +379,18 @@ struct buf {
              * same physical location from different address
              * spaces. */
             struct noknem *noknem;
+
+            /* The notifications of the transfer, in the request
+             * buffer. */
+            struct noknem_bells *bells;
+
+            /* Target only. Set once the done bell of the initiator
+             * has been received. */
+            int init_done;
+
+            /* Target only. The data descriptor of a DATA_FMT_CMA
+             * transfer, or NULL for a bounce buffer transfer. */
+            struct data *cma;
         } noknem;
 #endif
 
@@ -410,14 +448,6 @@ struct buf {
 #endif
     } transfer;
 
-#if WITH_TRANSPORT_SHMEM || IS_PPE
-    /* When receiving a shared memory buffer (sbuf), a regular buffer (buf) is
-     * allocated to process the data through the receive state machine
-     * without destroying the sbuf that belongs to
-     * another process. Keep a pointer to that sbuf. */
-    struct buf *mem_buf;
-#endif
-
 #if WITH_TRANSPORT_UDP
     struct buf *udp_buf;
 #endif
@@ -430,15 +460,26 @@ struct buf {
     ni_t *dest_ni;
 #endif
 
+        /** size of internal_data, BUF_DATA_SIZE or BUF_SMALL_DATA_SIZE */
+    unsigned int internal_size;
+
         /** number of mr's used in message */
     int num_mr;
 
-        /** mr's used in message */
-    mr_t *mr_list[0];
+        /** data to hold message, followed by the mr's used in message
+         * for large bufs */
+    uint8_t internal_data[0] __attribute__ ((aligned(8)));
 };
 
 typedef struct buf buf_t;
 
+/* States of the buf lock word. */
+enum {
+    BUF_UNLOCKED,
+    BUF_LOCKED,
+    BUF_CONTENDED,                      /* locked, and threads may wait */
+};
+
 int buf_setup(void *arg);
 
 int buf_init(void *arg, void *parm);
@@ -451,10 +492,60 @@ int ptl_post_recv(ni_t *ni, int count);
 
 void buf_dump(buf_t *buf);
 
+void buf_lock_wait(buf_t *buf, int c);
+
+void buf_unexpected_wait(buf_t *buf);
+
+/**
+ * @brief Lock a buf.
+ *
+ * An uncontended lock is a single atomic operation. Threads only
+ * block, on a futex, when the buf is already locked.
+ *
+ * @param[in] buf the buf to lock
+ */
+static inline void buf_lock(buf_t *buf)
+{
+    int c = __sync_val_compare_and_swap(&buf->lock, BUF_UNLOCKED,
+                                        BUF_LOCKED);
+
+    if (unlikely(c != BUF_UNLOCKED))
+        buf_lock_wait(buf, c);
+}
+
+/**
+ * @brief Unlock a buf.
+ *
+ * Only makes a system call if another thread may be waiting.
+ *
+ * @param[in] buf the buf to unlock
+ */
+static inline void buf_unlock(buf_t *buf)
+{
+    if (unlikely(__sync_fetch_and_sub(&buf->lock, 1) != BUF_LOCKED)) {
+        __sync_lock_release(&buf->lock);
+        futex_wake(&buf->lock);
+    }
+}
+
+/**
+ * @brief Mark the end of the processing of an unexpected message.
+ *
+ * Wakes a thread waiting in buf_unexpected_wait, if any.
+ *
+ * @param[in] buf the buf holding the message
+ */
+static inline void buf_unexpected_done(buf_t *buf)
+{
+    if (unlikely(__sync_lock_test_and_set(&buf->unexpected_busy, 0) == 2))
+        futex_wake(&buf->unexpected_busy);
+}
+
 /**
- * Compute the actual buf size.
+ * Compute the actual size of a large buf.
  *
- * Account for room needed to hold MR addresses in the buf_t struct.
+ * Account for the internal data and the room needed to hold MR
+ * addresses after it.
  *
  * @return size of buf
  */
@@ -462,7 +553,37 @@ static inline size_t real_buf_t_size(void)
 {
     int max_sge = get_param(PTL_MAX_QP_SEND_SGE);
 
-    return sizeof(buf_t) + max_sge * sizeof(mr_t *);
+    return sizeof(buf_t) + BUF_DATA_SIZE + max_sge * sizeof(mr_t *);
+}
+
+/* Size of a buf_t followed by a full internal data, as exchanged by
+ * the UDP transport. */
+#define BUF_WIRE_SIZE (sizeof(buf_t) + BUF_DATA_SIZE)
+
+/**
+ * Compute the actual size of a small buf.
+ *
+ * Small bufs have no MR list.
+ *
+ * @return size of buf
+ */
+static inline size_t small_buf_t_size(void)
+{
+    return sizeof(buf_t) + BUF_SMALL_DATA_SIZE;
+}
+
+/**
+ * Return the MR list of a large buf.
+ *
+ * @param buf the buf
+ *
+ * @return the array of MRs used by the message
+ */
+static inline mr_t **buf_mr_list(buf_t *buf)
+{
+    assert(buf->internal_size == BUF_DATA_SIZE);
+
+    return (mr_t **)(buf->internal_data + BUF_DATA_SIZE);
 }
 
 /**
@@ -489,6 +610,34 @@ static inline int buf_alloc(ni_t *ni, buf_t **buf_p)
     return PTL_OK;
 }
 
+/**
+ * Allocate a buf from the small buf pool.
+ *
+ * Small bufs can hold an ACK header but no message data. They are
+ * used for ACKs sent on their own and for triggered CT and ME
+ * operations.
+ *
+ * @param ni from which to allocate the buf
+ * @param buf_p pointer to return value
+ *
+ * @return status
+ */
+static inline int small_buf_alloc(ni_t *ni, buf_t **buf_p)
+{
+    int err;
+    obj_t *obj;
+
+    err = obj_alloc(&ni->small_buf_pool, &obj);
+    if (err) {
+        *buf_p = NULL;
+        return err;
+    }
+
+    *buf_p = container_of(obj, buf_t, obj);
+
+    return PTL_OK;
+}
+
 /**
  * Allocate a buf from the shared memory pool.
  *
@@ -7,10 +7,11 @@
 #include "ptl_loc.h"
 #include "ptl_timer.h"
 
-/* TODO make these unnecessary by queuing deferred operations */
-void ct_check(ct_t *ct);
 static void post_trig_ct(struct buf *buf, ct_t *trig_ct);
 static void do_trig_ct_op(struct buf *buf);
+#ifdef WITH_TRIG_ME_OPS
+void do_trig_me_op(struct buf *buf);
+#endif
 
 /**
  * @brief Initialize a ct object once when created.
@@ -25,6 +26,7 @@ int ct_init(void *arg, void *unused)
     PTL_FASTLOCK_INIT(&ct->lock);
     INIT_LIST_HEAD(&ct->trig_list);
     atomic_set(&ct->list_size, 0);
+    ct->trig_min = (ptl_size_t)-1;
 
     return PTL_OK;
 }
@@ -208,6 +210,8 @@ int _PtlCTFree(PPEGBL ptl_handle_ct_t ct_handle)
 
     /* clean up pending operations */
     ct->info.interrupt = 1;
+    __sync_synchronize();
+    ct_wake(ct);
     ct_check(ct);
 
     ct_put(ct);
@@ -259,6 +263,8 @@ int _PtlCTCancelTriggered(PPEGBL ptl_handle_ct_t ct_handle)
 #endif
 
     ct->info.interrupt = 1;
+    __sync_synchronize();
+    ct_wake(ct);
     ct_check(ct);
 
     err = PTL_OK;
@@ -365,7 +371,8 @@ int _PtlCTWait(PPEGBL ptl_handle_ct_t ct_handle, uint64_t threshold,
     ct = to_obj(MYGBL_ POOL_ANY, ct_handle);
 #endif
 
-    err = PtlCTWait_work(&ct->info, threshold, event_p);
+    err = PtlCTWait_work(&ct->info, threshold, event_p,
+                         obj_to_ni(ct)->stats);
 
     ct_put(ct);
 #ifndef NO_ARG_VALIDATION
@@ -451,7 +458,8 @@ int _PtlCTPoll(PPEGBL const ptl_handle_ct_t *ct_handles,
 #endif
 
     err =
-        PtlCTPoll_work(cts_info, thresholds, size, timeout, event_p, which_p);
+        PtlCTPoll_work(cts_info, thresholds, size, timeout, event_p, which_p,
+                       &obj_to_ni(cts[0])->ct_poll, obj_to_ni(cts[0])->stats);
 
 #ifndef NO_ARG_VALIDATION
   err2:
@@ -467,115 +475,234 @@ int _PtlCTPoll(PPEGBL const ptl_handle_ct_t *ct_handles,
 }
 
 /**
- * @brief Check to see if current value of ct event will
- * trigger a further action.
+ * @brief Get the threshold at which a pending triggered operation fires.
  *
- * @param[in] ct The counting event to check.
+ * @param[in] buf The buf of the triggered operation.
+ *
+ * @return the threshold.
  */
-void ct_check(ct_t *ct)
+static inline ptl_size_t trig_threshold(const buf_t *buf)
+{
+    return buf->type == BUF_TRIGGERED ? buf->threshold : buf->ct_threshold;
+}
+
+/**
+ * @brief Add a triggered operation to the pending list of a counting
+ * event.
+ *
+ * The list is kept sorted by threshold, and operations with the same
+ * threshold stay in posting order, so a counting event update only
+ * looks at the operations it fires. Thresholds usually grow as
+ * operations are posted, so the insertion point is searched from the
+ * end of the list.
+ *
+ * The cached smallest threshold is lowered before the caller checks
+ * the counters again, and the full barrier orders the two against a
+ * concurrent counter update that reads the cached threshold after
+ * changing the counters: one of them sees the other.
+ *
+ * Must be called with the ct lock held.
+ *
+ * @param[in] ct The counting event.
+ * @param[in] buf The buf of the triggered operation.
+ */
+void ct_add_trig(ct_t *ct, buf_t *buf)
 {
+    const ptl_size_t threshold = trig_threshold(buf);
     struct list_head *l;
-    struct list_head *t;
+
+    list_for_each_prev(l, &ct->trig_list) {
+        if (trig_threshold(list_entry(l, buf_t, list)) <= threshold)
+            break;
+    }
+
+    list_add(&buf->list, l);
+    atomic_inc(&ct->list_size);
+
+    if (threshold < ct->trig_min)
+        ct->trig_min = threshold;
+    __sync_synchronize();
+}
+
+/**
+ * @brief Discard a pending triggered operation of an interrupted
+ * counting event.
+ *
+ * @param[in] buf The buf of the triggered operation.
+ */
+static void discard_trig(buf_t *buf)
+{
     int err;
 
-    PTL_FASTLOCK_LOCK(&ct->lock);
+    if (buf->type == BUF_INIT) {
+        buf->init_state = STATE_INIT_CLEANUP;
+        err = process_init(buf);
+        if (unlikely(err))
+            ptl_warn("Error in cleanup on ct interrupt\n");
+    } else {
+        assert(buf->type == BUF_TRIGGERED || buf->type == BUF_TRIGGERED_ME);
+        ct_put(buf->ct);
+        buf_put(buf);
+    }
+}
+
+/**
+ * @brief Perform a triggered operation whose threshold was reached.
+ *
+ * @param[in] buf The buf of the triggered operation.
+ */
+static void run_trig(buf_t *buf)
+{
+    int err;
 
-    /* check to see if any pending triggered move operations
-     * can now be performed or discarded
-     * TODO this should enqueue the xi to a list and then unwind
-     * all the ct locks before calling process_init */
-    list_for_each_prev_safe(l, t, &ct->trig_list) {
-        buf_t *buf = list_entry(l, buf_t, list);
-
-        if (buf->type == BUF_INIT) {
-            ptl_info("check for init BUF triggering\n");
-            if (ct->info.interrupt) {
-                list_del(l);
-                atomic_dec(&ct->list_size);
-
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
-
-                buf->init_state = STATE_INIT_CLEANUP;
-                err = process_init(buf);
-                if (unlikely(err))
-                    ptl_warn("Error in cleanup on ct interrupt\n");
-
-                PTL_FASTLOCK_LOCK(&ct->lock);
-            } else if ((ct->info.event.success + ct->info.event.failure) >=
-                       buf->ct_threshold) {
-                list_del(l);
-                atomic_dec(&ct->list_size);
-
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
-                
-                ptl_info("CT Triggered, initiating operation\n");
+    if (buf->type == BUF_INIT) {
+        ptl_info("CT Triggered, initiating operation\n");
 #if WITH_TRANSPORT_UDP
-                buf->udp.i_am_prog_thread = 1;
+        buf->udp.i_am_prog_thread = 1;
 #endif
-                err = process_init(buf);
-                if (unlikely(err))
-                    ptl_warn("Error in processing initiator traffic\n");
-                PTL_FASTLOCK_LOCK(&ct->lock);
-            }
+        err = process_init(buf);
+        if (unlikely(err))
+            ptl_warn("Error in processing initiator traffic\n");
 #ifdef WITH_TRIG_ME_OPS
-        } else if (buf->type == BUF_TRIGGERED_ME) {
-             ptl_info("check for triggered ME ops\n");
-             if (ct->info.interrupt) {
-                list_del(l);
-                atomic_dec(&ct->list_size);
-
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
-
-                ct_put(buf->ct);
-                buf_put(buf);
-
-                PTL_FASTLOCK_LOCK(&ct->lock);
-            } else if ((ct->info.event.success + ct->info.event.failure) >=
-                       buf->ct_threshold) {
-                ptl_info("ME operation triggered: %i on ct of: %i and threshold %i\n", 
-                         buf->op,ct->info.event.success,buf->ct_threshold);
-                list_del(l);
-                atomic_dec(&ct->list_size);
-
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
-
-                do_trig_me_op(buf, ct);
-
-                PTL_FASTLOCK_LOCK(&ct->lock);
-            } else {
-                ptl_info("ME operation not triggered %i:%i threshold: %i\n",
-                         (int)ct->info.event.success,
-                         (int)ct->info.event.failure, (int)buf->ct_threshold);
-            }
+    } else if (buf->type == BUF_TRIGGERED_ME) {
+        do_trig_me_op(buf);
 #endif
-        } else {
-            ptl_info("check for BUF triggering\n");
-            assert(buf->type == BUF_TRIGGERED);
-            if (ct->info.interrupt) {
-                list_del(l);
-                atomic_dec(&ct->list_size);
+    } else {
+        assert(buf->type == BUF_TRIGGERED);
+        do_trig_ct_op(buf);
+    }
+}
+
+/**
+ * @brief Run the triggered operations on the ready queue of an NI.
+ *
+ * Only one thread runs the queue at a time. Operations fired while it
+ * runs, including by the operations it runs, are appended to the queue
+ * and picked up by the same loop, so cascades of triggered operations
+ * do not grow the stack and other threads return right away.
+ *
+ * @param[in] ni The NI.
+ */
+static void run_trig_ready(ni_t *ni)
+{
+    buf_t *buf;
 
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
+    if (__sync_lock_test_and_set(&ni->trig_ready_busy, 1))
+        return;
 
-                ct_put(buf->ct);
-                buf_put(buf);
+    for (;;) {
+        PTL_FASTLOCK_LOCK(&ni->trig_ready_lock);
 
-                PTL_FASTLOCK_LOCK(&ct->lock);
-            } else if ((ct->info.event.success + ct->info.event.failure) >=
-                       buf->threshold) {
-                list_del(l);
-                atomic_dec(&ct->list_size);
+        if (list_empty(&ni->trig_ready_list)) {
+            /* Cleared under the lock, so an operation queued after
+             * this check finds the queue idle and runs it. */
+            __sync_lock_release(&ni->trig_ready_busy);
+            PTL_FASTLOCK_UNLOCK(&ni->trig_ready_lock);
+            break;
+        }
 
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
+        buf = list_first_entry(&ni->trig_ready_list, buf_t, list);
+        list_del(&buf->list);
 
-                do_trig_ct_op(buf);
+        PTL_FASTLOCK_UNLOCK(&ni->trig_ready_lock);
 
-                PTL_FASTLOCK_LOCK(&ct->lock);
-            }
-        }
+        run_trig(buf);
+    }
+}
+
+/**
+ * @brief Check to see if current value of ct event will
+ * trigger a further action.
+ *
+ * Pending operations are sorted by threshold, so the ones that are
+ * reached form the head of the list. They are moved in one piece to
+ * the ready queue of the NI and run from there, after the ct lock is
+ * released. If the counting event is interrupted, all of them are
+ * discarded instead.
+ *
+ * @param[in] ct The counting event to check.
+ */
+void ct_check(ct_t *ct)
+{
+    ni_t *ni = obj_to_ni(ct);
+    struct list_head fired;
+    struct list_head *l;
+    int interrupt;
+    int count = 0;
+
+    INIT_LIST_HEAD(&fired);
+
+    PTL_FASTLOCK_LOCK(&ct->lock);
+
+    interrupt = ct->info.interrupt;
+
+    list_for_each(l, &ct->trig_list) {
+        if (!interrupt &&
+            (ct->info.event.success + ct->info.event.failure) <
+            trig_threshold(list_entry(l, buf_t, list)))
+            break;
+        count++;
+    }
+
+    if (count) {
+        list_cut_position(&fired, &ct->trig_list, l->prev);
+        atomic_sub(&ct->list_size, count);
+
+        if (list_empty(&ct->trig_list))
+            ct->trig_min = (ptl_size_t)-1;
+        else
+            ct->trig_min =
+                trig_threshold(list_first_entry(&ct->trig_list, buf_t,
+                                                list));
     }
 
     PTL_FASTLOCK_UNLOCK(&ct->lock);
+
+    if (!count)
+        return;
+
+    if (interrupt) {
+        while (!list_empty(&fired)) {
+            buf_t *buf = list_first_entry(&fired, buf_t, list);
+
+            list_del(&buf->list);
+            discard_trig(buf);
+        }
+        return;
+    }
+
+    PTL_FASTLOCK_LOCK(&ni->trig_ready_lock);
+    list_splice_tail(&fired, &ni->trig_ready_list);
+    PTL_FASTLOCK_UNLOCK(&ni->trig_ready_lock);
+
+    run_trig_ready(ni);
+}
+
+/**
+ * @brief Discard the fired triggered operations an NI has not run.
+ *
+ * Called when the NI is destroyed, once the progress thread is
+ * stopped. They are released like the pending operations of an
+ * interrupted counting event.
+ *
+ * @param[in] ni The NI.
+ */
+void ct_trig_ready_fini(ni_t *ni)
+{
+    struct list_head ready;
+
+    INIT_LIST_HEAD(&ready);
+
+    PTL_FASTLOCK_LOCK(&ni->trig_ready_lock);
+    list_splice_init(&ni->trig_ready_list, &ready);
+    PTL_FASTLOCK_UNLOCK(&ni->trig_ready_lock);
+
+    while (!list_empty(&ready)) {
+        buf_t *buf = list_first_entry(&ready, buf_t, list);
+
+        list_del(&buf->list);
+        discard_trig(buf);
+    }
 }
 
 /**
@@ -588,10 +715,13 @@ static void ct_set(ct_t *ct, ptl_ct_event_t new_ct)
 {
     /* set new value */
     ct->info.event = new_ct;
+    __sync_synchronize();
+
+    ct_wake(ct);
 
     /* check to see if this triggers any further
      * actions */
-    if (atomic_read(&ct->list_size))
+    if (ct_trig_reached(ct))
         ct_check(ct);
 }
 
@@ -658,9 +788,11 @@ static void ct_inc(ct_t *ct, ptl_ct_event_t increment)
         (void)__sync_add_and_fetch(&ct->info.event.failure,
                                    increment.failure);
 
+    ct_wake(ct);
+
     /* check to see if this triggers any further
      * actions */
-    if (atomic_read(&ct->list_size))
+    if (ct_trig_reached(ct))
         ct_check(ct);
 }
 
@@ -790,7 +922,7 @@ int _PtlTriggeredCTInc(PPEGBL ptl_handle_ct_t ct_handle,
 
         ct_put(ct);
     } else {
-        err = buf_alloc(ni, &buf);
+        err = small_buf_alloc(ni, &buf);
         if (err) {
             err = PTL_NO_SPACE;
             ct_put(ct);
@@ -884,7 +1016,7 @@ int _PtlTriggeredCTSet(PPEGBL ptl_handle_ct_t ct_handle,
 
     } else {
         /* get container for triggered ct op */
-        err = buf_alloc(ni, &buf);
+        err = small_buf_alloc(ni, &buf);
         if (err) {
             err = PTL_NO_SPACE;
             ct_put(ct);
@@ -964,9 +1096,7 @@ void post_ct(buf_t *buf, ct_t *ct)
         if (unlikely(err))
             ptl_warn("error in processing at initiator on post CT \n");
     } else {
-        atomic_inc(&ct->list_size);
-
-        list_add(&buf->list, &ct->trig_list);
+        ct_add_trig(ct, buf);
 
         /* We must check again to avoid a race with make_ct_event/ct_inc_ct_set. */
         if ((ct->info.event.success + ct->info.event.failure) >=
@@ -1000,9 +1130,7 @@ static void post_trig_ct(buf_t *buf, ct_t *trig_ct)
         do_trig_ct_op(buf);
 
     } else {
-        atomic_inc(&trig_ct->list_size);
-
-        list_add(&buf->list, &trig_ct->trig_list);
+        ct_add_trig(trig_ct, buf);
 
         /* We must check again to avoid a race with make_ct_event/ct_inc_ct_set. */
         if ((trig_ct->info.event.success + trig_ct->info.event.failure) >=
@@ -1036,6 +1164,8 @@ void make_ct_event(ct_t *ct, buf_t *buf, enum ct_bytes bytes)
         (void)__sync_add_and_fetch(&ct->info.event.success, buf->rlength);
     }
 
-    if (atomic_read(&ct->list_size))
+    ct_wake(ct);
+
+    if (ct_trig_reached(ct))
         ct_check(ct);
 }
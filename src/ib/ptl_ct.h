@@ -16,12 +16,16 @@ struct buf;
 struct ct {
     obj_t obj;                                  /**< object base class */
     struct list_head trig_list;                 /**< list head of pending
-						     triggered operations */
+						     triggered operations,
+						     by threshold */
     struct list_head list;                      /**< list member of allocated
 						     counting events */
     atomic_t list_size;                         /**< Number of elements in list */
 
     PTL_FASTLOCK_TYPE lock;                             /**< mutex for ct condition */
+    ptl_size_t trig_min;                        /**< smallest threshold on
+						     trig_list, or the largest
+						     value if it is empty */
 
 #if IS_PPE
     /* PPE transport specific */
@@ -30,7 +34,10 @@ struct ct {
     } ppe;
 #endif
 
-    struct ct_info info;
+    /* The counters are updated by every event, so they get their own
+     * cache line, away from the lock and list taken by posting
+     * threads. */
+    struct ct_info info __attribute__ ((aligned(64)));
 };
 
 typedef struct ct ct_t;
@@ -58,8 +65,46 @@ void post_ct(struct buf *buf, ct_t *ct);
 
 void post_ct_local(struct buf *buf, ct_t *ct);
 
+void ct_add_trig(ct_t *ct, struct buf *buf);
+
+void ct_check(ct_t *ct);
+
+void ct_trig_ready_fini(ni_t *ni);
+
 void make_ct_event(ct_t *ct, struct buf *buf, enum ct_bytes bytes);
 
+/**
+ * Check whether a counting event reached the smallest threshold of its
+ * pending triggered operations.
+ *
+ * This lets counter updates skip ct_check, and its lock, until one of
+ * the pending operations can fire.
+ *
+ * @param[in] ct the counting event, after its counters were updated
+ *
+ * @return non zero if ct_check must be called
+ */
+static inline int ct_trig_reached(ct_t *ct)
+{
+    return (ct->info.event.success + ct->info.event.failure) >=
+        *(volatile ptl_size_t *)&ct->trig_min;
+}
+
+/**
+ * Wake the threads blocked in PtlCTWait or PtlCTPoll on a counting
+ * event.
+ *
+ * Must follow a full barrier after the update of the counters or the
+ * interrupt flag, such as the atomic update itself.
+ *
+ * @param[in] ct the counting event
+ */
+static inline void ct_wake(ct_t *ct)
+{
+    if (unlikely(ct->info.wq.waiters))
+        waitq_wake(&ct->info.wq, &obj_to_ni(ct)->ct_poll);
+}
+
 /**
  * Allocate a new ct object.
  *
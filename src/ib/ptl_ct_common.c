@@ -14,33 +14,120 @@
 #endif
 
 atomic_t keep_polling;
+
+#ifndef IS_LIGHT_LIB
+/*
+ * Waiters spin for a while, then block on the wait queue of their
+ * counting event, or on the CT poll queue of the NI for PtlCTPoll; see
+ * struct waitq. ct_wake() wakes them after an update.
+ *
+ * The light library only spins: its counting events are updated by the
+ * PPE, in another process.
+ */
+#define CT_WAIT_BLOCKS 1
+
+/**
+ * @brief Count a completed wait in the NI statistics.
+ *
+ * @param[in] stats the statistics, or NULL
+ * @param[in] blocked whether the waiter blocked
+ */
+static inline void ct_wait_count(ptl_sr_value_t *stats, int blocked)
+{
+    if (stats)
+        __sync_fetch_and_add(&stats[blocked ? PTL_STAT_CT_WAIT_BLOCKS :
+                                    PTL_STAT_CT_WAIT_SPINS], 1);
+}
+#else
+#define CT_WAIT_BLOCKS 0
+
+static inline void ct_wait_count(ptl_sr_value_t *stats, int blocked)
+{
+}
+#endif
+
+/**
+ * @brief Check whether a wait on a counting event is over.
+ *
+ * @param[in] ct_info the counting event
+ * @param[in] threshold the success threshold
+ * @param[out] event_p address of returned event
+ *
+ * @return PTL_OK if the threshold was reached or a failure counted
+ * @return PTL_INTERRUPTED if someone is tearing down the ct
+ * @return PTL_CT_NONE_REACHED otherwise
+ */
+static inline int ct_wait_check(struct ct_info *ct_info, uint64_t threshold,
+                                ptl_ct_event_t *event_p)
+{
+    /* check if wait condition satisfied */
+    if (ct_info->event.success >= threshold || ct_info->event.failure) {
+        *event_p = ct_info->event;
+        return PTL_OK;
+    }
+
+    /* someone called PtlCTFree or PtlNIFini, leave */
+    if (unlikely(ct_info->interrupt))
+        return PTL_INTERRUPTED;
+
+    return PTL_CT_NONE_REACHED;
+}
+
+/**
+ * @brief Wait until a counting event reaches a threshold or has a
+ * failure.
+ *
+ * Spins for PTL_CT_WAIT_LOOP_COUNT rounds, yielding the processor
+ * between checks, then blocks until the counting event is updated.
+ *
+ * @param[in] ct_info the counting event
+ * @param[in] threshold the success threshold
+ * @param[out] event_p address of returned event
+ * @param[in] stats the NI statistics counting waits, or NULL
+ *
+ * @return PTL_OK if the threshold was reached or a failure counted
+ * @return PTL_INTERRUPTED if someone is tearing down the ct
+ */
 int PtlCTWait_work(struct ct_info *ct_info, uint64_t threshold,
-                   ptl_ct_event_t *event_p)
+                   ptl_ct_event_t *event_p, ptl_sr_value_t *stats)
 {
     int err;
+    int blocked = 0;
+#if CT_WAIT_BLOCKS
+    unsigned long spins = get_param(PTL_CT_WAIT_LOOP_COUNT);
+#endif
+
     atomic_inc(&keep_polling);
 
     /* wait loop */
     while (1) {
-        /* check if wait condition satisfied */
-        if (unlikely
-            (ct_info->event.success >= threshold || ct_info->event.failure)) {
-            *event_p = ct_info->event;
-            err = PTL_OK;
+        err = ct_wait_check(ct_info, threshold, event_p);
+        if (likely(err != PTL_CT_NONE_REACHED))
             break;
-        }
 
-        /* someone called PtlCTFree or PtlNIFini, leave */
-        if (unlikely(ct_info->interrupt)) {
-            err = PTL_INTERRUPTED;
-            break;
+#if CT_WAIT_BLOCKS
+        if (spins == 0) {
+            int wake = waitq_enter(&ct_info->wq);
+
+            err = ct_wait_check(ct_info, threshold, event_p);
+            if (err == PTL_CT_NONE_REACHED) {
+                waitq_block(&ct_info->wq, wake, NULL);
+                blocked = 1;
+            }
+
+            waitq_leave(&ct_info->wq);
+            continue;
         }
+        spins--;
+#endif
 
-        /* memory barrier */
         sched_yield();
     }
     atomic_dec(&keep_polling);
 
+    if (err == PTL_OK)
+        ct_wait_count(stats, blocked);
+
     return err;
 }
 
@@ -86,15 +173,71 @@ static int ct_poll_loop(int size, struct ct_info *cts_info[],
     return PTL_CT_NONE_REACHED;
 }
 
+#if CT_WAIT_BLOCKS
+/**
+ * @brief Block until one of an array of counting events is updated.
+ *
+ * @param size number of elements in the array
+ * @param cts_info array of ct objects
+ * @param thresholds array of thresholds
+ * @param poll the CT poll queue of their NI
+ * @param timeout the longest time to block, or NULL for no limit
+ * @param event_p address of returned event
+ * @param which_p address of returned which
+ *
+ * @return as ct_poll_loop, checked after registering as a waiter
+ */
+static int ct_poll_block(int size, struct ct_info *cts_info[],
+                         const ptl_size_t *thresholds, struct waitq *poll,
+                         const struct timespec *timeout,
+                         ptl_ct_event_t *event_p, unsigned int *which_p)
+{
+    int wake = waitq_enter(poll);
+    int err;
+    int i;
+
+    for (i = 0; i < size; i++)
+        waitq_enter(&cts_info[i]->wq);
+
+    err = ct_poll_loop(size, cts_info, thresholds, event_p, which_p);
+    if (err == PTL_CT_NONE_REACHED)
+        waitq_block(poll, wake, timeout);
+
+    for (i = 0; i < size; i++)
+        waitq_leave(&cts_info[i]->wq);
+    waitq_leave(poll);
+
+    return err;
+}
+#endif
+
+/**
+ * @brief Wait until one of an array of counting events reaches its
+ * threshold or has a failure, or the timeout expires.
+ *
+ * Spins for PTL_CT_POLL_LOOP_COUNT rounds, then blocks until one of
+ * the counting events is updated or the timeout expires.
+ *
+ * @see PtlCTPoll
+ *
+ * @param[in] poll the CT poll queue of the NI, NULL in the light library
+ * @param[in] stats the NI statistics counting waits, or NULL
+ */
 int PtlCTPoll_work(struct ct_info *cts_info[], const ptl_size_t *thresholds,
                    unsigned int size, ptl_time_t timeout,
-                   ptl_ct_event_t *event_p, unsigned int *which_p)
+                   ptl_ct_event_t *event_p, unsigned int *which_p,
+                   struct waitq *poll, ptl_sr_value_t *stats)
 {
     int err;
     int have_timeout = (timeout != PTL_TIME_FOREVER);
+    int blocked = 0;
     uint64_t timeout_ns;
     uint64_t nstart;
+    uint64_t elapsed = 0;
     TIMER_TYPE start;
+#if CT_WAIT_BLOCKS
+    unsigned long spins = get_param(PTL_CT_POLL_LOOP_COUNT);
+#endif
     atomic_inc(&keep_polling);
 
     /* compute expiration of poll time */
@@ -105,7 +248,6 @@ int PtlCTPoll_work(struct ct_info *cts_info[], const ptl_size_t *thresholds,
 
     /* poll loop */
     while (1) {
-        /* spin PTL_CT_POLL_LOOP_COUNT times */
         /* scan list to see if we can complete one */
         err = ct_poll_loop(size, cts_info, thresholds, event_p, which_p);
         if (err != PTL_CT_NONE_REACHED)
@@ -115,15 +257,41 @@ int PtlCTPoll_work(struct ct_info *cts_info[], const ptl_size_t *thresholds,
         if (have_timeout) {
             TIMER_TYPE tp;
             MARK_TIMER(tp);
-            if ((TIMER_INTS(tp) - nstart) >= timeout_ns) {
+            elapsed = TIMER_INTS(tp) - nstart;
+            if (elapsed >= timeout_ns) {
                 err = PTL_CT_NONE_REACHED;
                 break;
             }
         }
 
+#if CT_WAIT_BLOCKS
+        /* spin PTL_CT_POLL_LOOP_COUNT times, then block */
+        if (spins == 0) {
+            struct timespec ts;
+
+            if (have_timeout) {
+                ts.tv_sec = (timeout_ns - elapsed) / 1000000000;
+                ts.tv_nsec = (timeout_ns - elapsed) % 1000000000;
+            }
+
+            err = ct_poll_block(size, cts_info, thresholds, poll,
+                                have_timeout ? &ts : NULL, event_p, which_p);
+            if (err != PTL_CT_NONE_REACHED)
+                break;
+
+            blocked = 1;
+            continue;
+        }
+        spins--;
+#endif
+
         SPINLOCK_BODY();
     }
 
     atomic_dec(&keep_polling);
+
+    if (err == PTL_OK)
+        ct_wait_count(stats, blocked);
+
     return err;
 }
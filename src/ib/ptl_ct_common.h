@@ -1,3 +1,5 @@
+#include "ptl_futex.h"
+
 struct ct_info {
     /* When PPE has been selected, the following fields will be shared
      * with the light library. The other fields are only used by the
@@ -6,10 +8,14 @@ struct ct_info {
 
     int interrupt;                              /**< flag indicating ct is
 						     getting shut down */
+
+    struct waitq wq;                            /**< threads waiting in
+						     PtlCTWait or PtlCTPoll */
 };
 
 int PtlCTPoll_work(struct ct_info *cts_info[], const ptl_size_t *thresholds,
                    unsigned int size, ptl_time_t timeout,
-                   ptl_ct_event_t *event_p, unsigned int *which_p);
+                   ptl_ct_event_t *event_p, unsigned int *which_p,
+                   struct waitq *poll, ptl_sr_value_t *stats);
 int PtlCTWait_work(struct ct_info *ct_info, uint64_t threshold,
-                   ptl_ct_event_t *event_p);
+                   ptl_ct_event_t *event_p, ptl_sr_value_t *stats);
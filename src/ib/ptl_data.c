@@ -61,6 +61,12 @@ int data_size(data_t *data)
             break;
 #endif
 
+#if WITH_TRANSPORT_SHMEM && !USE_KNEM
+        case DATA_FMT_CMA:
+            size += data->cma.num_mem_iovecs * sizeof(struct mem_iovec);
+            break;
+#endif
+
 #if IS_PPE
         case DATA_FMT_MEM_DMA:
             size += data->mem.num_mem_iovecs * sizeof(struct mem_iovec);
@@ -34,6 +34,7 @@ enum data_fmt {
 
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
     DATA_FMT_NOKNEM,
+    DATA_FMT_CMA,
 #endif
 
 #if IS_PPE
@@ -53,6 +54,43 @@ struct mem_iovec {
     uint64_t length;
 };
 
+#if WITH_TRANSPORT_SHMEM && !USE_KNEM
+/**
+ * @brief Notification of a noknem transfer.
+ *
+ * It is posted on the shared memory queue of the side that owns it.
+ * It starts like a buf, with the BUF_SHMEM_NOKNEM type, so that the
+ * progress thread can tell it apart from the messages.
+ */
+struct noknem_bell {
+    obj_t obj;
+
+        /** BUF_SHMEM_NOKNEM, at the same place as the type of a buf */
+    int type;
+
+        /** set while the bell is queued and not yet handled */
+    int pending;
+
+        /** the buf of the owner, in the owner address space */
+    struct buf *buf;
+} __attribute__ ((aligned(CACHELINE_WIDTH)));
+
+/**
+ * @brief Notifications of a noknem transfer.
+ *
+ * They live at the end of the request buffer. Each side rings the
+ * other one after changing the state of the transfer, so that its
+ * progress thread only looks at the transfer when there is something
+ * to do. The done bell is rung once, by the initiator, when it has
+ * finished with the transfer.
+ */
+struct noknem_bells {
+    struct noknem_bell init_bell;
+    struct noknem_bell target_bell;
+    struct noknem_bell done_bell;
+};
+#endif
+
 /**
  * @brief Descriptor for input or output data for a message.
  */
@@ -84,27 +122,41 @@ struct data {
 #endif
 
 #if (WITH_TRANSPORT_SHMEM && !USE_KNEM)
-        /* State memory shared by both sides of the transfer. */
+        /* State memory shared by both sides of the transfer. The
+         * data goes through a ring of chunks in a bounce buffer. The
+         * producer is the initiator for a put and the target for a
+         * get; each counter is only written by its side. */
         struct noknem {
-            /* Transfer state.
-             * 0 = initiator to process (set by initiator)
-             * 1 = initiator processing (set by initiator)
-             * 2 = target to process (set by target)
-             * 3 = target processing (set by target)
-             * 4 = transfer done (set by target only.)
-             */
-            int state;
+            /* Chunks written to the ring by the producer, and read
+             * from it by the consumer. */
+            unsigned int produced;
+            unsigned int consumed;
 
-            /* Length being transfered. Only the current owner can modify it. */
-            int length;
+            /* Total length sent by the producer. Set before the first
+             * chunk is produced. */
+            uint64_t length;
 
-            /* Bounce buffer. */
+            /* Bounce buffer, and its ring geometry, set by the
+             * initiator. */
             off_t bounce_offset;
+            unsigned int chunk_size;
+            unsigned int num_chunks;
 
-            /* Transfer done. Set by the target only. */
-            int init_done;
+            /* Set by the target once it is done with the transfer. */
             int target_done;
+
+            /* Offset of the struct noknem_bells in the request
+             * buffer. */
+            uint32_t bells_offset;
         } noknem;
+
+        /* Initiator memory, copied directly by the target with
+         * process_vm_readv/process_vm_writev. */
+        struct {
+            int32_t pid;
+            uint32_t num_mem_iovecs;
+            struct mem_iovec mem_iovec[0];
+        } cma;
 #endif
 
 #if WITH_TRANSPORT_UDP
@@ -41,13 +41,14 @@ void eq_cleanup(void *arg)
     eq->eqe_list = NULL;
 }
 
-/* After an event is posted, check if there is any waiter. */
-static inline void check_waiter(struct eqe_list *eqe_list)
+/* After an event is posted, wake the waiters blocked on the queue.
+ * The barrier orders the publication before the check of the waiters
+ * count; see PtlEQWait_work(). */
+static inline void check_waiter(eq_t *eq)
 {
-    if (atomic_read(&eqe_list->waiter) > 0) {
-        SPINLOCK_BODY();
-        sched_yield();
-    }
+    __sync_synchronize();
+    if (unlikely(eq->eqe_list->wq.waiters))
+        waitq_wake(&eq->eqe_list->wq, &obj_to_ni(eq)->eq_poll);
 }
 
 /**
@@ -113,7 +114,8 @@ int _PtlEQAlloc(PPEGBL ptl_handle_ni_t ni_handle, ptl_size_t count,
     count += ni->limits.max_pt_index + 1;
 
     eq->eqe_list_size = sizeof(struct eqe_list) + count * sizeof(eqe_t);
-    eq->eqe_list = calloc(1, eq->eqe_list_size);
+    if (posix_memalign((void **)&eq->eqe_list, pagesize, eq->eqe_list_size))
+        eq->eqe_list = NULL;
     if (!eq->eqe_list) {
         err = PTL_NO_SPACE;
         (void)__sync_fetch_and_sub(&ni->current.max_eqs, 1);
@@ -121,34 +123,18 @@ int _PtlEQAlloc(PPEGBL ptl_handle_ni_t ni_handle, ptl_size_t count,
         goto err2;
     }
 
+    if (ni->numa_node >= 0)
+        numa_bind_area(eq->eqe_list, eq->eqe_list_size, ni->numa_node);
+
     eqe_list = eq->eqe_list;
+    memset(eqe_list, 0, eq->eqe_list_size);
 
-    eqe_list->producer = 0;
-    eqe_list->consumer = 0;
-    eqe_list->used = 0;
-    eqe_list->prod_gen = 0;
-    eqe_list->cons_gen = 0;
-    eqe_list->interrupt = 0;
     eqe_list->count = count;
 
 #if IS_PPE
-    pthread_mutexattr_t mattr;
-    pthread_condattr_t cattr;
-
     PTL_FASTLOCK_INIT_SHARED(&eqe_list->lock);
-
-    pthread_mutexattr_init(&mattr);
-    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
-    pthread_mutex_init(&eqe_list->mutex, &mattr);
-    pthread_mutexattr_destroy(&mattr);
-
-    pthread_condattr_init(&cattr);
-    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
-    pthread_cond_init(&eqe_list->cond, &cattr);
-    pthread_condattr_destroy(&cattr);
 #else
     PTL_FASTLOCK_INIT(&eqe_list->lock);
-
 #endif
 
     *eq_handle_p = eq_to_handle(eq);
@@ -210,7 +196,7 @@ int _PtlEQFree(PPEGBL ptl_handle_eq_t eq_handle)
     /* cleanup resources. */
     eq->eqe_list->interrupt = 1;
     __sync_synchronize();
-    check_waiter(eq->eqe_list);
+    check_waiter(eq);
 
     err = PTL_OK;
     eq_put(eq);                        /* from to_eq() */
@@ -281,6 +267,69 @@ int _PtlEQGet(PPEGBL ptl_handle_eq_t eq_handle, ptl_event_t *event_p)
     return err;
 }
 
+/**
+ * @brief Get the next events in an event queue.
+ *
+ * Extension of PtlEQGet() that returns up to count consecutive events
+ * in one call.
+ *
+ * @param[in] eq_handle The handle of the event queue from which to get
+ * events.
+ * @param[in] count The maximum number of events to get.
+ * @param[out] events The array of returned events.
+ * @param[out] num_events_p The address of the number of events returned.
+ *
+ * @return PTL_OK Indicates success.
+ * @return PTL_EQ_DROPPED Indicates success (i.e., events are returned) and
+ * that at least one event between the first returned event and the last
+ * event obtained from this event queue has been dropped due to limited
+ * space in the event queue.
+ * @return PTL_NO_INIT Indicates that the portals API has not been
+ * successfully initialized.
+ * @return PTL_EQ_EMPTY Indicates that eq_handle is empty.
+ * @return PTL_ARG_INVALID Indicates that eq_handle is not a valid event
+ * queue handle or count is 0. A count of 0 is rejected even without
+ * argument validation, since events is not used then.
+ */
+int _PtlEQGetMany(PPEGBL ptl_handle_eq_t eq_handle, unsigned int count,
+                  ptl_event_t *events, unsigned int *num_events_p)
+{
+    int err;
+    eq_t *eq;
+
+#ifndef NO_ARG_VALIDATION
+    err = gbl_get();
+    if (err)
+        goto err0;
+
+    err = to_eq(MYGBL_ eq_handle, &eq);
+    if (err)
+        goto err1;
+
+    if (!eq || count == 0) {
+        err = PTL_ARG_INVALID;
+        if (eq)
+            eq_put(eq);
+        goto err1;
+    }
+#else
+    if (count == 0)
+        return PTL_ARG_INVALID;
+
+    eq = to_obj(MYGBL_ POOL_ANY, eq_handle);
+#endif
+
+    err = PtlEQGetMany_work(eq->eqe_list, count, events, num_events_p);
+
+    eq_put(eq);
+#ifndef NO_ARG_VALIDATION
+  err1:
+    gbl_put();
+  err0:
+#endif
+    return err;
+}
+
 /**
  * @brief Wait for next event in event queue.
  *
@@ -322,7 +371,7 @@ int _PtlEQWait(PPEGBL ptl_handle_eq_t eq_handle, ptl_event_t *event_p)
     eq = to_obj(MYGBL_ POOL_ANY, eq_handle);
 #endif
 
-    err = PtlEQWait_work(eq->eqe_list, event_p);
+    err = PtlEQWait_work(eq->eqe_list, event_p, obj_to_ni(eq)->stats);
 
     eq_put(eq);
 #ifndef NO_ARG_VALIDATION
@@ -359,6 +408,34 @@ int _PtlEQWait(PPEGBL ptl_handle_eq_t eq_handle, ptl_event_t *event_p)
 int _PtlEQPoll(PPEGBL const ptl_handle_eq_t * eq_handles, unsigned int size,
                ptl_time_t timeout, ptl_event_t *event_p,
                unsigned int *which_p)
+{
+    unsigned int num;
+
+    return _PtlEQPollMany(MYGBL_ eq_handles, size, timeout, 1, event_p, &num,
+                          which_p);
+}
+
+/**
+ * @brief Poll for events in an array of event queues.
+ *
+ * Extension of PtlEQPoll() that returns up to count consecutive events
+ * from the event queue in one call.
+ *
+ * @param[in] eq_handles array of event queue handles
+ * @param[in] size the size of the array
+ * @param[in] timeout how long to poll in msec
+ * @param[in] count the maximum number of events to return
+ * @param[out] events array of returned events
+ * @param[out] num_events_p address of the number of events returned
+ * @param[out] which_p address of returned array index
+ *
+ * @return as PtlEQPoll(), PTL_EQ_DROPPED reporting a gap before the
+ * first event returned. PTL_ARG_INVALID also indicates that count is 0.
+ */
+int _PtlEQPollMany(PPEGBL const ptl_handle_eq_t * eq_handles,
+                   unsigned int size, ptl_time_t timeout, unsigned int count,
+                   ptl_event_t *events, unsigned int *num_events_p,
+                   unsigned int *which_p)
 {
     int err;
     eq_t *eqs[size];
@@ -374,7 +451,7 @@ int _PtlEQPoll(PPEGBL const ptl_handle_eq_t * eq_handles, unsigned int size,
         goto err0;
 #endif
 
-    if (size == 0) {
+    if (size == 0 || count == 0) {
         err = PTL_ARG_INVALID;
         goto err1;
     }
@@ -406,7 +483,9 @@ int _PtlEQPoll(PPEGBL const ptl_handle_eq_t * eq_handles, unsigned int size,
     i2 = size - 1;
 #endif
 
-    err = PtlEQPoll_work(eqes_list, size, timeout, event_p, which_p);
+    err = PtlEQPoll_work(eqes_list, size, timeout, count, events,
+                         num_events_p, which_p, &obj_to_ni(eqs[0])->eq_poll,
+                         obj_to_ni(eqs[0])->stats);
 
 #ifndef NO_ARG_VALIDATION
   err2:
@@ -421,35 +500,60 @@ int _PtlEQPoll(PPEGBL const ptl_handle_eq_t * eq_handles, unsigned int size,
     return err;
 }
 
+/**
+ * @brief Reserve the next slot of the event queue.
+ *
+ * The slot is marked as being written, so that a consumer copying the
+ * event it holds notices, but consumers do not see the new event until
+ * publish_ev() is called. The EQ lock must be taken.
+ *
+ * @param[in] eq the event queue
+ *
+ * @return the event to fill in
+ */
 static inline ptl_event_t *reserve_ev(eq_t *restrict eq)
 {
-    ptl_event_t *ev;
+    struct eqe_list *eqe_list = eq->eqe_list;
     eqe_t *eqe;
-    struct eqe_list *eqe_list;
 
-    eqe_list = eq->eqe_list;
-    eqe = &eqe_list->eqe[eqe_list->producer];
+    eqe = &eqe_list->eqe[eqe_list->reserved % eqe_list->count];
+    eqe_list->reserved++;
 
-    eqe->generation = eqe_list->prod_gen;
-    ev = &eqe->event;
-
-    eqe_list->producer++;
-    if (eqe_list->producer >= eqe_list->count) {
-        eqe_list->producer = 0;
-        eqe_list->prod_gen++;
-    }
-
-    eqe_list->used++;
+    __atomic_store_n(&eqe->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
 
     /* If all unreserved entries are used, then the queue is
      * overflowing. It matters only if an attached PT wants flow
      * control. TODO: we should not be counting already inserted
      * reserved entries. */
-    if (eqe_list->used == eq->count_simple && !list_empty(&eq->flowctrl_list)) {
+    if (!list_empty(&eq->flowctrl_list) &&
+        eqe_list->reserved -
+        __atomic_load_n(&eqe_list->consumer, __ATOMIC_RELAXED) >=
+        eq->count_simple) {
         eq->overflowing = 1;
     }
 
-    return ev;
+    return &eqe->event;
+}
+
+/**
+ * @brief Make the reserved events visible to the consumers.
+ *
+ * The EQ lock must be taken.
+ *
+ * @param[in] eq the event queue
+ */
+static inline void publish_ev(eq_t *restrict eq)
+{
+    struct eqe_list *eqe_list = eq->eqe_list;
+    uint64_t pos;
+
+    for (pos = eqe_list->producer; pos != eqe_list->reserved; pos++)
+        __atomic_store_n(&eqe_list->eqe[pos % eqe_list->count].sequence,
+                         pos + 1, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&eqe_list->producer, eqe_list->reserved,
+                     __ATOMIC_RELEASE);
 }
 
 /* Overflow situation. The EQ lock must be taken. */
@@ -527,9 +631,11 @@ void make_init_event(buf_t *restrict buf, eq_t *restrict eq,
     if (eq->overflowing)
         process_overflowing(eq);
 
+    publish_ev(eq);
+
     PTL_FASTLOCK_UNLOCK(&eq->eqe_list->lock);
 
-    check_waiter(eq->eqe_list);
+    check_waiter(eq);
 }
 
 /**
@@ -580,9 +686,11 @@ void send_target_event(eq_t *restrict eq, ptl_event_t *restrict ev)
     if (eq->overflowing)
         process_overflowing(eq);
 
+    publish_ev(eq);
+
     PTL_FASTLOCK_UNLOCK(&eq->eqe_list->lock);
 
-    check_waiter(eq->eqe_list);
+    check_waiter(eq);
 }
 
 /**
@@ -608,9 +716,11 @@ void make_target_event(buf_t *restrict buf, eq_t *restrict eq,
     if (eq->overflowing)
         process_overflowing(eq);
 
+    publish_ev(eq);
+
     PTL_FASTLOCK_UNLOCK(&eq->eqe_list->lock);
 
-    check_waiter(eq->eqe_list);
+    check_waiter(eq);
 }
 
 /**
@@ -637,7 +747,9 @@ void make_le_event(le_t *restrict le, eq_t *restrict eq,
     if (eq->overflowing)
         process_overflowing(eq);
 
+    publish_ev(eq);
+
     PTL_FASTLOCK_UNLOCK(&eq->eqe_list->lock);
 
-    check_waiter(eq->eqe_list);
+    check_waiter(eq);
 }
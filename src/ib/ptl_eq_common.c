@@ -26,65 +26,121 @@ extern atomic_t keep_polling;
  *
  * @param[in] eq the event queue
  *
- * @return non-zero if the queue is empty. The result is not
- * guaranteed unless the eq->lock is taken. However it is sufficient
- * to give an idea whether get_event() can be called. This avoids
- * taking a lock.
+ * @return non-zero if the queue is empty. The result may be stale by
+ * the time it is used, but it is sufficient to give an idea whether
+ * get_event() can be called.
  */
 static int inline is_queue_empty(struct eqe_list *eqe_list)
 {
-    return ((eqe_list->producer == eqe_list->consumer) &&
-            (eqe_list->prod_gen == eqe_list->cons_gen));
+    return __atomic_load_n(&eqe_list->consumer, __ATOMIC_RELAXED) ==
+        __atomic_load_n(&eqe_list->producer, __ATOMIC_RELAXED);
 }
 
 /**
- * @brief Find next event in event queue.
+ * @brief Take the next events in event queue.
+ *
+ * The events are consecutive: PTL_EQ_DROPPED only reports a gap
+ * before the first one.
  *
  * @param[in] eq the event queue
- * @param[out] event_p the address of the returned event
+ * @param[in] count the maximum number of events to take
+ * @param[out] events the array of returned events
+ * @param[out] num_p the address of the number of events returned
  *
  * @return PTL_EQ_EMPTY if there are no events in the queue
- * @return PTL_EQ_DROPPED if there was an event but there was a
+ * @return PTL_EQ_DROPPED if there were events but there was a
  * gap since the last event returned
- * @return PTL_EQ_OK if there was an event and no gap
+ * @return PTL_EQ_OK if there were events and no gap
  */
-static int get_event(struct eqe_list *restrict eqe_list,
-                     ptl_event_t *restrict event_p)
+static int get_events(struct eqe_list *restrict eqe_list, unsigned int count,
+                      ptl_event_t *restrict events, unsigned int *num_p)
 {
-    int dropped = 0;
+    uint64_t cons = __atomic_load_n(&eqe_list->consumer, __ATOMIC_ACQUIRE);
 
-    PTL_FASTLOCK_LOCK(&eqe_list->lock);
+    while (1) {
+        uint64_t prod = __atomic_load_n(&eqe_list->producer,
+                                        __ATOMIC_ACQUIRE);
+        unsigned int want = count;
+        unsigned int num;
+        unsigned int i;
+        uint64_t oldest;
 
-    /* check to see if the queue is empty */
-    if (is_queue_empty(eqe_list)) {
-        PTL_FASTLOCK_UNLOCK(&eqe_list->lock);
-        return PTL_EQ_EMPTY;
-    }
+        /* check to see if the queue is empty */
+        if (cons == prod)
+            return PTL_EQ_EMPTY;
+
+        if (prod - cons < want)
+            want = prod - cons;
+
+        /* copy the events whose slots hold them */
+        for (num = 0; num < want; num++) {
+            const eqe_t *eqe = &eqe_list->eqe[(cons + num) % eqe_list->count];
 
-    /* if we have been lapped by the producer advance the
-     * consumer pointer until we catch up */
-    while (eqe_list->cons_gen < eqe_list->eqe[eqe_list->consumer].generation) {
-        eqe_list->consumer++;
-        if (eqe_list->consumer == eqe_list->count) {
-            eqe_list->consumer = 0;
-            eqe_list->cons_gen++;
+            if (__atomic_load_n(&eqe->sequence, __ATOMIC_ACQUIRE) !=
+                cons + num + 1)
+                break;
+
+            events[num] = eqe->event;
         }
-        dropped = 1;
-        eqe_list->used--;
-    }
 
-    /* return the next valid event and update the consumer pointer */
-    *event_p = eqe_list->eqe[eqe_list->consumer++].event;
-    if (eqe_list->consumer >= eqe_list->count) {
-        eqe_list->consumer = 0;
-        eqe_list->cons_gen++;
-    }
+        /* the copies are good if the slots were not rewritten meanwhile */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        for (i = 0; i < num; i++) {
+            const eqe_t *eqe = &eqe_list->eqe[(cons + i) % eqe_list->count];
+
+            if (__atomic_load_n(&eqe->sequence, __ATOMIC_RELAXED) !=
+                cons + i + 1)
+                break;
+        }
+        num = i;
+
+        if (likely(num)) {
+            if (!__atomic_compare_exchange_n(&eqe_list->consumer, &cons,
+                                             cons + num, 0,
+                                             __ATOMIC_ACQ_REL,
+                                             __ATOMIC_ACQUIRE))
+                continue;       /* another consumer got them */
+
+            *num_p = num;
 
-    eqe_list->used--;
+            if (unlikely(eqe_list->dropped) &&
+                __atomic_exchange_n(&eqe_list->dropped, 0, __ATOMIC_ACQ_REL))
+                return PTL_EQ_DROPPED;
 
-    PTL_FASTLOCK_UNLOCK(&eqe_list->lock);
+            return PTL_OK;
+        }
+
+        /* We have been lapped by the producer, which is rewriting or
+         * has rewritten the slot. Skip to the oldest event that it
+         * cannot be rewriting. */
+        prod = __atomic_load_n(&eqe_list->producer, __ATOMIC_ACQUIRE);
+        oldest = (prod + 1 > eqe_list->count) ? prod + 1 - eqe_list->count : 0;
+        if (oldest <= cons)
+            oldest = cons + 1;
+
+        if (__atomic_compare_exchange_n(&eqe_list->consumer, &cons, oldest,
+                                        0, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&eqe_list->dropped, 1, __ATOMIC_RELEASE);
+            cons = oldest;
+        }
+    }
+}
+
+/**
+ * @brief Find next event in event queue.
+ *
+ * @param[in] eq the event queue
+ * @param[out] event_p the address of the returned event
+ *
+ * @return as get_events()
+ */
+static inline int get_event(struct eqe_list *restrict eqe_list,
+                            ptl_event_t *restrict event_p)
+{
+    unsigned int num;
 
-    return dropped ? PTL_EQ_DROPPED : PTL_OK;
+    return get_events(eqe_list, 1, event_p, &num);
 }
 
 /**
@@ -99,6 +155,15 @@ int PtlEQGet_work(struct eqe_list *eqe_list, ptl_event_t *event_p)
     return err;
 }
 
+/**
+ * Do the work for PtlEQGetMany
+ */
+int PtlEQGetMany_work(struct eqe_list *eqe_list, unsigned int count,
+                      ptl_event_t *events, unsigned int *num_p)
+{
+    return get_events(eqe_list, count, events, num_p);
+}
+
 static inline int check_eq(struct eqe_list *eqe_list, ptl_event_t *event_p)
 {
     int err;
@@ -116,14 +181,60 @@ static inline int check_eq(struct eqe_list *eqe_list, ptl_event_t *event_p)
     return PTL_EQ_EMPTY;
 }
 
+#ifndef IS_LIGHT_LIB
+/*
+ * Waiters spin for a while, then block on the wait queue of their
+ * event queue, or on the EQ poll queue of the NI for PtlEQPoll; see
+ * struct waitq. Producers wake them after publishing an event.
+ *
+ * The light library only spins: its event queues are filled by the
+ * PPE, in another process.
+ */
+#define EQ_WAIT_BLOCKS 1
+
+/**
+ * @brief Count a wait that returned an event in the NI statistics.
+ *
+ * @param[in] stats the statistics, or NULL
+ * @param[in] blocked whether the waiter blocked
+ */
+static inline void eq_wait_count(ptl_sr_value_t *stats, int blocked)
+{
+    if (stats)
+        __sync_fetch_and_add(&stats[blocked ? PTL_STAT_EQ_WAIT_BLOCKS :
+                                    PTL_STAT_EQ_WAIT_SPINS], 1);
+}
+#else
+#define EQ_WAIT_BLOCKS 0
+
+static inline void eq_wait_count(ptl_sr_value_t *stats, int blocked)
+{
+}
+#endif
+
 /**
- * Do the work for PtlEQWait
+ * @brief Wait for the next event in an event queue.
+ *
+ * Spins for PTL_EQ_WAIT_LOOP_COUNT rounds, yielding the processor
+ * between checks, then blocks until an event is published.
+ *
+ * @param[in] eqe_list the event queue
+ * @param[out] event_p address of returned event
+ * @param[in] stats the NI statistics counting waits, or NULL
+ *
+ * @return as get_event(), or PTL_INTERRUPTED if someone is tearing
+ * down the event queue
  */
-int PtlEQWait_work(struct eqe_list *eqe_list, ptl_event_t *event_p)
+int PtlEQWait_work(struct eqe_list *eqe_list, ptl_event_t *event_p,
+                   ptl_sr_value_t *stats)
 {
     int err;
+    int blocked = 0;
+#if EQ_WAIT_BLOCKS
+    unsigned long spins = get_param(PTL_EQ_WAIT_LOOP_COUNT);
+#endif
+
     atomic_inc(&keep_polling);
-    atomic_inc(&eqe_list->waiter);
 
     while (1) {
         err = check_eq(eqe_list, event_p);
@@ -131,29 +242,128 @@ int PtlEQWait_work(struct eqe_list *eqe_list, ptl_event_t *event_p)
             break;
         }
 
-        sched_yield();
+#if EQ_WAIT_BLOCKS
+        if (spins == 0) {
+            int wake = waitq_enter(&eqe_list->wq);
+
+            err = check_eq(eqe_list, event_p);
+            if (err == PTL_EQ_EMPTY) {
+                waitq_block(&eqe_list->wq, wake, NULL);
+                blocked = 1;
+            }
+
+            waitq_leave(&eqe_list->wq);
 
+            if (err != PTL_EQ_EMPTY)
+                break;
+            continue;
+        }
+        spins--;
+#endif
 
+        sched_yield();
     }
-    atomic_dec(&eqe_list->waiter);
     atomic_dec(&keep_polling);
 
+    if (err == PTL_OK || err == PTL_EQ_DROPPED)
+        eq_wait_count(stats, blocked);
+
+    return err;
+}
+
+/**
+ * @brief Perform one trip around the polling loop.
+ *
+ * @return as get_events(), PTL_INTERRUPTED if someone is tearing down
+ * an event queue
+ */
+static int eq_poll_loop(struct eqe_list *eqe_list_in[], unsigned int size,
+                        unsigned int count, ptl_event_t *events,
+                        unsigned int *num_p, unsigned int *which_p)
+{
+    int err;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        struct eqe_list *eqe_list = eqe_list_in[i];
+
+        if (!is_queue_empty(eqe_list)) {
+            err = get_events(eqe_list, count, events, num_p);
+
+            if (err != PTL_EQ_EMPTY) {
+                *which_p = i;
+                return err;
+            }
+        }
+
+        if (eqe_list->interrupt)
+            return PTL_INTERRUPTED;
+    }
+
+    return PTL_EQ_EMPTY;
+}
+
+#if EQ_WAIT_BLOCKS
+/**
+ * @brief Block until an event is published in one of an array of
+ * event queues.
+ *
+ * @param[in] poll the EQ poll queue of their NI
+ * @param[in] timeout the longest time to block, or NULL for no limit
+ *
+ * @return as eq_poll_loop, checked after registering as a waiter
+ */
+static int eq_poll_block(struct eqe_list *eqe_list_in[], unsigned int size,
+                         struct waitq *poll, const struct timespec *timeout,
+                         unsigned int count, ptl_event_t *events,
+                         unsigned int *num_p, unsigned int *which_p)
+{
+    int wake = waitq_enter(poll);
+    int err;
+    int i;
+
+    for (i = 0; i < size; i++)
+        waitq_enter(&eqe_list_in[i]->wq);
+
+    err = eq_poll_loop(eqe_list_in, size, count, events, num_p, which_p);
+    if (err == PTL_EQ_EMPTY)
+        waitq_block(poll, wake, timeout);
+
+    for (i = 0; i < size; i++)
+        waitq_leave(&eqe_list_in[i]->wq);
+    waitq_leave(poll);
+
     return err;
 }
+#endif
 
 /**
- * Do the work for PtlEQPoll.
+ * Do the work for PtlEQPoll and PtlEQPollMany.
+ *
+ * Up to count events are taken from the first event queue found not
+ * empty. Spins for PTL_EQ_POLL_LOOP_COUNT rounds, then blocks until an
+ * event is published in one of the event queues or the timeout
+ * expires.
+ *
+ * @param[in] poll the EQ poll queue of the NI, NULL in the light library
+ * @param[in] stats the NI statistics counting waits, or NULL
  */
 int PtlEQPoll_work(struct eqe_list *eqe_list_in[], unsigned int size,
-                   ptl_time_t timeout, ptl_event_t *event_p,
-                   unsigned int *which_p)
+                   ptl_time_t timeout, unsigned int count,
+                   ptl_event_t *events, unsigned int *num_p,
+                   unsigned int *which_p, struct waitq *poll,
+                   ptl_sr_value_t *stats)
 {
     int err;
     uint64_t nstart;
     uint64_t timeout_ns;
+    uint64_t elapsed = 0;
     TIMER_TYPE start;
-    int i;
+    int blocked = 0;
     const int forever = (timeout == PTL_TIME_FOREVER);
+#if EQ_WAIT_BLOCKS
+    unsigned long spins = get_param(PTL_EQ_POLL_LOOP_COUNT);
+#endif
 
     /* compute expiration of poll time */
     MARK_TIMER(start);
@@ -163,37 +373,47 @@ int PtlEQPoll_work(struct eqe_list *eqe_list_in[], unsigned int size,
     atomic_inc(&keep_polling);
 
     while (1) {
-        for (i = 0; i < size; i++) {
-            struct eqe_list *eqe_list = eqe_list_in[i];
-
-            if (!is_queue_empty(eqe_list)) {
-                err = get_event(eqe_list, event_p);
-
-                if (err != PTL_EQ_EMPTY) {
-                    *which_p = i;
-                    goto out;
-                }
-            }
-
-            if (eqe_list->interrupt) {
-                err = PTL_INTERRUPTED;
-                goto out;
-            }
-        }
+        err = eq_poll_loop(eqe_list_in, size, count, events, num_p,
+                           which_p);
+        if (err != PTL_EQ_EMPTY)
+            break;
 
         if (!forever) {
             TIMER_TYPE tp;
             MARK_TIMER(tp);
-            if ((TIMER_INTS(tp) - nstart) >= timeout_ns) {
-                err = PTL_EQ_EMPTY;
-                goto out;
+            elapsed = TIMER_INTS(tp) - nstart;
+            if (elapsed >= timeout_ns)
+                break;
+        }
+
+#if EQ_WAIT_BLOCKS
+        /* spin PTL_EQ_POLL_LOOP_COUNT times, then block */
+        if (spins == 0) {
+            struct timespec ts;
+
+            if (!forever) {
+                ts.tv_sec = (timeout_ns - elapsed) / 1000000000;
+                ts.tv_nsec = (timeout_ns - elapsed) % 1000000000;
             }
+
+            err = eq_poll_block(eqe_list_in, size, poll, forever ? NULL : &ts,
+                                count, events, num_p, which_p);
+            if (err != PTL_EQ_EMPTY)
+                break;
+
+            blocked = 1;
+            continue;
         }
+        spins--;
+#endif
 
         sched_yield();
     }
 
-  out:
     atomic_dec(&keep_polling);
+
+    if (err == PTL_OK || err == PTL_EQ_DROPPED)
+        eq_wait_count(stats, blocked);
+
     return err;
 }
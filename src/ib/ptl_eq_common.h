@@ -9,41 +9,71 @@
 #define PTL_EQ_COMMON_H
 
 #include "ptl_locks.h"
+#include "ptl_futex.h"
 
 /**
  * Event queue entry.
  */
 typedef struct {
-    unsigned int generation;                    /**< increments each time the producer
-									   pointer wraps */
+    uint64_t sequence;                          /**< position of the event
+						     in the queue plus one,
+						     0 while it is written */
     ptl_event_t event;                          /**< portals event */
 } eqe_t;
 
-// todo: reorder fields for better performance. use align.
+/**
+ * Event queue ring.
+ *
+ * Events have increasing positions; the event at position pos is in
+ * slot pos % count. Producers are serialized by the lock and never
+ * wait for consumers: once the ring is full the oldest events are
+ * overwritten. Consumers do not take the lock. They claim the event
+ * at the consumer position by advancing it with a compare and swap,
+ * and use the sequence number of its slot to detect that it was
+ * overwritten while they copied it. A consumer lapped by the producer
+ * skips to the oldest event still in the ring and the next event
+ * returned reports PTL_EQ_DROPPED.
+ *
+ * The producer and consumer state are on separate cache lines, so
+ * the progress thread producing events and the application threads
+ * consuming them only share the lines of the events themselves.
+ */
 struct eqe_list {
-    unsigned int producer;                      /**< producer index */
-    unsigned int consumer;                      /**< consumer index */
-    unsigned int prod_gen;                      /**< producer generation */
-    unsigned int cons_gen;                      /**< consumer generation */
-    int interrupt;                                              /**< if set eq is being
-									   freed or destroyed */
-    unsigned int used;                          /**< number of slots used */
     unsigned int count;                         /**< size of event queue */
+    int interrupt;                              /**< if set eq is being
+						     freed or destroyed */
 
-    PTL_FASTLOCK_TYPE lock;             /**< lock for adding */
+    struct waitq wq;                            /**< threads waiting in
+						     PtlEQWait or PtlEQPoll */
 
-    pthread_mutex_t mutex;     /**< mutex for eq condition */
-    pthread_cond_t cond;
+    /* Producer state. */
+    uint64_t producer __attribute__ ((aligned(64)));    /**< position of
+							     the next event
+							     published */
+    uint64_t reserved;                          /**< position of the next
+						     event reserved */
+    PTL_FASTLOCK_TYPE lock;             /**< lock for adding */
 
-    atomic_t waiter;
+    /* Consumer state. */
+    uint64_t consumer __attribute__ ((aligned(64)));    /**< position of
+							     the next event
+							     to return */
+    int dropped;                                /**< events were skipped
+						     since the last event
+						     returned */
 
-    eqe_t eqe[0];
+    eqe_t eqe[0] __attribute__ ((aligned(64)));
 };
 
 int PtlEQGet_work(struct eqe_list *eqe_list, ptl_event_t *event_p);
-int PtlEQWait_work(struct eqe_list *eqe_list, ptl_event_t *event_p);
+int PtlEQWait_work(struct eqe_list *eqe_list, ptl_event_t *event_p,
+                   ptl_sr_value_t *stats);
+int PtlEQGetMany_work(struct eqe_list *eqe_list, unsigned int count,
+                      ptl_event_t *events, unsigned int *num_p);
 int PtlEQPoll_work(struct eqe_list *eqe_list_in[], unsigned int size,
-                   ptl_time_t timeout, ptl_event_t *event_p,
-                   unsigned int *which_p);
+                   ptl_time_t timeout, unsigned int count,
+                   ptl_event_t *events, unsigned int *num_p,
+                   unsigned int *which_p, struct waitq *poll,
+                   ptl_sr_value_t *stats);
 
 #endif /* PTL_EQ_COMMON_H */
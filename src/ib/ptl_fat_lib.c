@@ -101,7 +101,7 @@ static void dump_everything(int unused)
             printf("  options: %x\n", ni->options);
             printf("  recv_list: %d\n", list_empty(&ni->rdma.recv_list));
 
-            printf("  buffers used: %d\n", atomic_read(&ni->buf_pool.count));
+            printf("  buffers used: %d\n", pool_count(&ni->buf_pool));
 
             printf("  limits.max_entries = %d\n", ni->limits.max_entries);
             printf("  limits.max_unexpected_headers = %d\n",
@@ -180,13 +180,15 @@ static void dump_everything(int unused)
                 eq_t *eq = container_of(obj, eq_t, obj);
 
                 printf("  EQ: %x\n", eq_to_handle(eq));
-                printf("    count = %d\n", eq->count);
-                printf("    producer = %d\n", eq->producer);
-                printf("    consumer = %d\n", eq->consumer);
-                printf("    prod_gen = %d\n", eq->prod_gen);
-                printf("    cons_gen = %d\n", eq->cons_gen);
-                printf("    interrupt = %d\n", eq->interrupt);
-                printf("    overflow = %d\n", eq->overflow);
+                printf("    count = %u\n", eq->eqe_list->count);
+                printf("    reserved = %" PRIu64 "\n",
+                       eq->eqe_list->reserved);
+                printf("    producer = %" PRIu64 "\n",
+                       eq->eqe_list->producer);
+                printf("    consumer = %" PRIu64 "\n",
+                       eq->eqe_list->consumer);
+                printf("    interrupt = %d\n", eq->eqe_list->interrupt);
+                printf("    overflowing = %d\n", eq->overflowing);
             }
 
 #endif
@@ -0,0 +1,68 @@
+/**
+ * @file ptl_futex.c
+ *
+ * @brief Blocking on a word of memory.
+ *
+ * Threads wait until another thread of the same process changes a word
+ * and wakes them. This is built on Linux futexes. Elsewhere a wait
+ * returns right away, so callers end up spinning as before.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/* for syscall() */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "ptl_futex.h"
+
+/**
+ * @brief Block while a word holds a given value.
+ *
+ * The check and the sleep are atomic with respect to futex_wake, so a
+ * thread that changes the word and then wakes cannot be missed. The
+ * call may also return spuriously; callers recheck their condition.
+ *
+ * @param[in] addr the word to wait on
+ * @param[in] val the value the word must still hold to block
+ * @param[in] timeout the longest time to block, or NULL for no limit
+ *
+ * @return 0 if woken, or an errno value (EAGAIN if the word changed,
+ * ETIMEDOUT, EINTR)
+ */
+int futex_wait(int *addr, int val, const struct timespec *timeout)
+{
+#ifdef __linux__
+    if (syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout,
+                NULL, 0) < 0)
+        return errno;
+    return 0;
+#else
+    return EAGAIN;
+#endif
+}
+
+/**
+ * @brief Wake all the threads blocked on a word.
+ *
+ * @param[in] addr the word, changed by the caller beforehand
+ */
+void futex_wake(int *addr)
+{
+#ifdef __linux__
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+}
@@ -0,0 +1,92 @@
+/**
+ * @file ptl_futex.h
+ *
+ * @brief Blocking on a word of memory.
+ */
+
+#ifndef PTL_FUTEX_H
+#define PTL_FUTEX_H
+
+struct timespec;
+
+int futex_wait(int *addr, int val, const struct timespec *timeout);
+
+void futex_wake(int *addr);
+
+/**
+ * @brief Threads waiting for an object to change.
+ *
+ * Waiters spin for a while, then block. A waiter registers with
+ * waitq_enter() before checking the object a last time, and a thread
+ * that finds a registered waiter after changing the object calls
+ * waitq_wake(). Both sides use full barriers in between, so either the
+ * waiter sees the change or the other thread sees the waiter.
+ *
+ * A thread waiting on several objects registers on each of them and
+ * blocks on a poll queue of their NI instead, which waitq_wake() also
+ * wakes when it has waiters.
+ */
+struct waitq {
+    int waiters;                /**< threads blocked, or about to block */
+    int wake;                   /**< futex word, bumped by waitq_wake() */
+};
+
+/**
+ * @brief Register as a waiter.
+ *
+ * @param[in] wq the wait queue
+ *
+ * @return the value to pass to waitq_block()
+ */
+static inline int waitq_enter(struct waitq *wq)
+{
+    int wake = wq->wake;
+
+    __sync_fetch_and_add(&wq->waiters, 1);
+
+    return wake;
+}
+
+/**
+ * @brief Unregister a waiter registered with waitq_enter().
+ *
+ * @param[in] wq the wait queue
+ */
+static inline void waitq_leave(struct waitq *wq)
+{
+    __sync_fetch_and_sub(&wq->waiters, 1);
+}
+
+/**
+ * @brief Block until waitq_wake() is called after waitq_enter().
+ *
+ * @param[in] wq the wait queue
+ * @param[in] wake the value returned by waitq_enter()
+ * @param[in] timeout the longest time to block, or NULL for no limit
+ */
+static inline void waitq_block(struct waitq *wq, int wake,
+                               const struct timespec *timeout)
+{
+    futex_wait(&wq->wake, wake, timeout);
+}
+
+/**
+ * @brief Wake the threads blocked on an object.
+ *
+ * Called after changing an object that has waiters.
+ *
+ * @param[in] wq the wait queue of the object
+ * @param[in] poll the poll queue of its NI, or NULL
+ */
+static inline void waitq_wake(struct waitq *wq, struct waitq *poll)
+{
+    __sync_fetch_and_add(&wq->wake, 1);
+    futex_wake(&wq->wake);
+
+    if (poll && poll->waiters) {
+        __sync_fetch_and_add(&poll->wake, 1);
+        futex_wake(&poll->wake);
+    }
+}
+
+#endif /* PTL_FUTEX_H */
@@ -7,6 +7,7 @@
 
 struct ni;
 struct iface;
+struct index_entry;
 
 extern void gbl_release(ref_t *ref);
 
@@ -31,7 +32,8 @@ typedef struct gbl {
     pool_t ni_pool;
 
     atomic_t next_index;
-    void **index_map;
+    struct index_entry **index_map;
+    uint64_t index_free;        /* free index stack, see index_get() */
 
     /* PPE specific. */
 
@@ -60,7 +62,7 @@ static inline void gbl_put(void)
 /* Never instanced, but removing it would needs lots of ifdefs
  * throughout the code. */
 typedef struct gbl {
-    void **index_map;
+    struct index_entry **index_map;
 } gbl_t;
 
 /* The light client doesn't have a GBL. */
@@ -85,7 +87,8 @@ typedef struct gbl {
     struct pool ni_pool;
 
     atomic_t next_index;
-    void **index_map;
+    struct index_entry **index_map;
+    uint64_t index_free;        /* free index stack, see index_get() */
 } gbl_t;
 
 extern gbl_t per_proc_gbl;
@@ -483,17 +483,19 @@ static int send_req(buf_t *buf)
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
     if ((buf->data_in && buf->data_in->data_fmt == DATA_FMT_NOKNEM) ||
         (buf->data_out && buf->data_out->data_fmt == DATA_FMT_NOKNEM)) {
-        ptl_info("add to noknem list \n");
-        ni_t *ni = obj_to_ni(buf);
-
-        PTL_FASTLOCK_LOCK(&ni->shmem.noknem_lock);
-        list_add_tail(&buf->list, &ni->shmem.noknem_list);
-        PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
-
-        if (buf->data_in && buf->data_in->data_fmt == DATA_FMT_NOKNEM)
+        /* The rest of the transfer is driven by the bells rung by
+         * the target. */
+        if (buf->data_in && buf->data_in->data_fmt == DATA_FMT_NOKNEM) {
             state = STATE_INIT_COPY_IN;
-        else
+        } else {
+            /* Fill the ring so the target finds data with the
+             * request. */
+            if (noknem_produce(buf)) {
+                WARN();
+                return STATE_INIT_SEND_ERROR;
+            }
             state = STATE_INIT_COPY_OUT;
+        }
     } else
 #endif
     if (buf->event_mask & XX_SIGNALED)
@@ -544,33 +546,26 @@ static int send_error(buf_t *buf)
 static int init_copy_in(buf_t *buf)
 {
     struct noknem *noknem = buf->transfer.noknem.noknem;
-    ptl_size_t to_copy;
-    int ret;
-
-    /* Copy the data from the bounce buffer. */
-    to_copy = noknem->length;
+    unsigned int consumed = noknem->consumed;
+    int target_done;
 
-    /* Target should never send more than requested. */
-    assert(to_copy <= buf->transfer.noknem.length_left);
+    /* The target has produced everything once it is done, so the
+     * transfer is complete when the ring is drained past that point. */
+    target_done = noknem->target_done;
+    __sync_synchronize();
 
-    ret =
-        iov_copy_in(buf->transfer.noknem.data, buf->transfer.noknem.iovecs,
-                    NULL, buf->transfer.noknem.num_iovecs,
-                    buf->transfer.noknem.offset, to_copy);
-    if (ret == PTL_FAIL) {
+    /* Drain the chunks from the bounce buffer ring. */
+    if (noknem_consume(buf) == PTL_FAIL) {
         WARN();
         return STATE_INIT_ERROR;
     }
 
-    if (noknem->target_done)
+    if (target_done && noknem->consumed == noknem->produced)
         return STATE_INIT_COPY_DONE;
 
-    buf->transfer.noknem.length_left -= to_copy;
-    buf->transfer.noknem.offset += to_copy;
-
-    /* Tell the target the data is ready. */
-    __sync_synchronize();
-    noknem->state = 2;
+    /* Let the target reuse the chunks. */
+    if (noknem->consumed != consumed)
+        noknem_notify(buf);
 
     return STATE_INIT_COPY_IN;
 }
@@ -578,36 +573,20 @@ static int init_copy_in(buf_t *buf)
 static int init_copy_out(buf_t *buf)
 {
     struct noknem *noknem = buf->transfer.noknem.noknem;
-    ptl_size_t to_copy;
-    int ret;
+    unsigned int produced = noknem->produced;
 
+    /* The target stops consuming once it has all the data it needs. */
     if (noknem->target_done)
         return STATE_INIT_COPY_DONE;
 
-    noknem->state = 1;
-
-    /* Copy the data to the bounce buffer. */
-    to_copy = buf->transfer.noknem.data_length;
-    if (to_copy > buf->transfer.noknem.length_left)
-        to_copy = buf->transfer.noknem.length_left;
-
-    ret =
-        iov_copy_out(buf->transfer.noknem.data, buf->transfer.noknem.iovecs,
-                     NULL, buf->transfer.noknem.num_iovecs,
-                     buf->transfer.noknem.offset, to_copy);
-    if (ret == PTL_FAIL) {
+    /* Fill the free chunks of the bounce buffer ring. */
+    if (noknem_produce(buf) == PTL_FAIL) {
         WARN();
         return STATE_INIT_ERROR;
     }
 
-    buf->transfer.noknem.length_left -= to_copy;
-    buf->transfer.noknem.offset += to_copy;
-
-    noknem->length = to_copy;
-
-    /* Tell the target the data is ready. */
-    __sync_synchronize();
-    noknem->state = 2;
+    if (noknem->produced != produced)
+        noknem_notify(buf);
 
     return STATE_INIT_COPY_OUT;
 }
@@ -615,23 +594,17 @@ static int init_copy_out(buf_t *buf)
 static int init_copy_done(buf_t *buf)
 {
     ni_t *ni = obj_to_ni(buf);
-    struct noknem *noknem = buf->transfer.noknem.noknem;
-
-    /* Ack. */
-    noknem->init_done = 1;
-    __sync_synchronize();
-    noknem->state = 2;
 
     /* Free the bounce buffer allocated in init_append_data. */
     if (buf->transfer.noknem.data)
-        ll_enqueue_obj_alien(&ni->shmem.bounce_buf.head->free_list,
-                             buf->transfer.noknem.data,
-                             ni->shmem.bounce_buf.head,
-                             ni->shmem.bounce_buf.head->head_index0);
+        shmem_bounce_buf_free(ni, buf->transfer.noknem.data);
 
-    /* Only called from the progress thread, so ni->shmem.noknem_lock is
-     * already locked. */
-    list_del(&buf->list);
+    /* Bells rung by the target before it saw we were done may still
+     * be in our queue; they are ignored from now on. */
+    buf->transfer.noknem.noknem = NULL;
+
+    /* Ack. */
+    noknem_notify_done(buf);
 
     if (buf->event_mask & XI_EARLY_SEND)
         return STATE_INIT_EARLY_SEND_EVENT;
@@ -1171,7 +1144,7 @@ static void cleanup(buf_t *buf)
  * in the start state. It may exit the state machine for
  * one of the wait states (wait_conn, wait_comp, wait_recv)
  * and be reentered when the event occurs. The state
- * machine is protected by buf->mutex so only one thread at
+ * machine is protected by buf->lock so only one thread at
  * a time can work on a given message. It can be executed
  * on an application thread, the IB connection thread or
  * a progress thread. The state machine drops the reference
@@ -1189,7 +1162,7 @@ int process_init(buf_t *buf)
     int err = PTL_OK;
     enum init_state state;
 
-    pthread_mutex_lock(&buf->mutex);
+    buf_lock(buf);
 
     state = buf->init_state;
 
@@ -1266,19 +1239,19 @@ int process_init(buf_t *buf)
             case STATE_INIT_CLEANUP:
 #if WITH_TRANSPORT_UDP
                 if (buf->conn->transport.type == CONN_TYPE_UDP) {
-                    pthread_mutex_unlock(&buf->mutex);
+                    buf_unlock(buf);
                     ni_t *ni;
                     ni = obj_to_ni(buf);
                     while (atomic_read(&ni->udp.self_recv) > 0) {
                         sched_yield();
                         SPINLOCK_BODY();
                     }
-                    pthread_mutex_lock(&buf->mutex);
+                    buf_lock(buf);
                 }
 #endif
                 cleanup(buf);
                 buf->init_state = STATE_INIT_DONE;
-                pthread_mutex_unlock(&buf->mutex);
+                buf_unlock(buf);
                 buf_put(buf);
                 return err;
             case STATE_INIT_DONE:
@@ -1302,6 +1275,6 @@ int process_init(buf_t *buf)
      * to wait for an external event such as an IB send completion. */
     ptl_info("exiting process init with pending task\n");
     buf->init_state = state;
-    pthread_mutex_unlock(&buf->mutex);
+    buf_unlock(buf);
     return err;
 }
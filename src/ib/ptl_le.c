@@ -100,6 +100,13 @@ void le_unlink(le_t *le, int auto_event)
             else if (le->ptl_list == PTL_OVERFLOW_LIST)
                 pt->overflow_size--;
             list_del_init(&le->list);
+            if (le->type == TYPE_ME) {
+                match_index_del((me_t *)le);
+                if (le->ptl_list == PTL_PRIORITY_LIST)
+                    match_shadow_del(&pt->priority_shadow, (me_t *)le);
+                else if (le->ptl_list == PTL_OVERFLOW_LIST)
+                    match_shadow_del(&pt->overflow_shadow, (me_t *)le);
+            }
 
             if (auto_event)
                 le_post_unlink_event(le);
@@ -251,7 +258,15 @@ int le_append_pt(ni_t *ni, le_t *le)
             WARN();
             return PTL_NO_SPACE;
         }
+        if (le->type == TYPE_ME &&
+            match_shadow_enabled(&pt->priority_shadow) &&
+            match_shadow_add(&pt->priority_shadow, (me_t *)le)) {
+            pt->priority_size--;
+            return PTL_NO_SPACE;
+        }
         list_add_tail(&le->list, &pt->priority_list);
+        if (le->type == TYPE_ME && match_index_enabled(&pt->priority_index))
+            match_index_add(&pt->priority_index, (me_t *)le);
     } else if (le->ptl_list == PTL_OVERFLOW_LIST) {
         pt->overflow_size++;
         if (unlikely(pt->overflow_size > ni->limits.max_list_size)) {
@@ -259,7 +274,15 @@ int le_append_pt(ni_t *ni, le_t *le)
             WARN();
             return PTL_NO_SPACE;
         }
+        if (le->type == TYPE_ME &&
+            match_shadow_enabled(&pt->overflow_shadow) &&
+            match_shadow_add(&pt->overflow_shadow, (me_t *)le)) {
+            pt->overflow_size--;
+            return PTL_NO_SPACE;
+        }
         list_add_tail(&le->list, &pt->overflow_list);
+        if (le->type == TYPE_ME && match_index_enabled(&pt->overflow_index))
+            match_index_add(&pt->overflow_index, (me_t *)le);
     }
 
     if (le->eq && !(le->options & PTL_LE_EVENT_LINK_DISABLE))
@@ -268,6 +291,25 @@ int le_append_pt(ni_t *ni, le_t *le)
     return PTL_OK;
 }
 
+/**
+ * @brief Get the bucket of the unexpected index holding all the
+ * messages an LE/ME can match.
+ * @pre PT lock must be held by caller.
+ *
+ * @param[in] pt The PT entry.
+ * @param[in] le The LE/ME to match against the unexpected list.
+ *
+ * @return the bucket, or NULL if the whole unexpected list must be
+ * scanned.
+ */
+static inline struct list_head *unexpected_bucket(pt_t *pt, const le_t *le)
+{
+    if (le->type != TYPE_ME)
+        return NULL;
+
+    return unexpected_index_bucket(&pt->unexpected_index, (me_t *)le);
+}
+
 /**
  * @brief Compares an ME/LE with the unexpected list
  * and returns a list of messages that match.
@@ -282,14 +324,33 @@ static void __match_le_unexpected(const le_t *le,
 {
     ni_t *ni = obj_to_ni(le);
     pt_t *pt = &ni->pt[le->pt_index];
+    struct list_head *bucket;
     buf_t *buf;
     buf_t *n;
 
     INIT_LIST_HEAD(buf_list);
 
+    bucket = unexpected_bucket(pt, le);
+    if (bucket) {
+        /* Fully specified ME. Only the messages in this bucket can
+         * match, and they are in arrival order. */
+        list_for_each_entry_safe(buf, n, bucket, unexpected_index_list) {
+            if (check_match(buf, (me_t *)le)) {
+                unexpected_index_del(buf);
+                list_del(&buf->unexpected_list);
+                list_add_tail(&buf->unexpected_list, buf_list);
+
+                if (le->options & PTL_LE_USE_ONCE)
+                    break;
+            }
+        }
+        return;
+    }
+
     list_for_each_entry_safe(buf, n, &pt->unexpected_list, unexpected_list) {
 
         if ((le->type == TYPE_LE || check_match(buf, (me_t *)le))){
+            unexpected_index_del(buf);
             list_del(&buf->unexpected_list);
             list_add_tail(&buf->unexpected_list, buf_list);
 
@@ -312,12 +373,11 @@ static void flush_from_unexpected_list(le_t *le,
         int err;
         int state;
 
-        pthread_mutex_lock(&buf->mutex);
+        buf_lock(buf);
 
         /* It is possible that there is a still a transfer occurring
          * on this buffer. So wait for it to finish. */
-        if (buf->unexpected_busy)
-            pthread_cond_wait(&buf->cond, &buf->mutex);
+        buf_unexpected_wait(buf);
         assert(buf->unexpected_busy == 0);
 
         assert(buf->matching.le == NULL);
@@ -333,7 +393,7 @@ static void flush_from_unexpected_list(le_t *le,
 
         state = buf->tgt_state;
 
-        pthread_mutex_unlock(&buf->mutex);
+        buf_unlock(buf);
 
         if (state == STATE_TGT_WAIT_APPEND) {
             err = process_tgt(buf);
@@ -394,25 +454,44 @@ int check_overflow_search_only(le_t *le)
 {
     ni_t *ni = obj_to_ni(le);
     pt_t *pt = &ni->pt[le->pt_index];
+    struct list_head *bucket;
     buf_t *buf;
     buf_t *n;
     int found = 0;
     PTL_FASTLOCK_LOCK(&pt->lock);
     ptl_event_t event[atomic_read(&pt->unexpected_size)];
 
-    list_for_each_entry_safe(buf, n, &pt->unexpected_list, unexpected_list) {
+    bucket = unexpected_bucket(pt, le);
+    if (bucket) {
+        list_for_each_entry(buf, bucket, unexpected_index_list) {
+            if (check_match(buf, (me_t *)le)) {
+                if (le->eq && !(le->options & PTL_LE_EVENT_COMM_DISABLE)) {
+                    buf->matching_list = PTL_OVERFLOW_LIST;
+                    fill_target_event(buf, PTL_EVENT_SEARCH, le->user_ptr,
+                                      NULL, &event[found]);
+                }
 
-        if ((le->type == TYPE_LE || check_match(buf, (me_t *)le))) {
-            if (le->eq && !(le->options & PTL_LE_EVENT_COMM_DISABLE)) {
-                buf->matching_list = PTL_OVERFLOW_LIST;
-                fill_target_event(buf, PTL_EVENT_SEARCH, le->user_ptr, NULL,
-                                  &event[found]);
+                found++;
+                if (le->options & PTL_LE_USE_ONCE)
+                    break;
             }
+        }
+    } else {
+        list_for_each_entry_safe(buf, n, &pt->unexpected_list,
+                                 unexpected_list) {
+
+            if ((le->type == TYPE_LE || check_match(buf, (me_t *)le))) {
+                if (le->eq && !(le->options & PTL_LE_EVENT_COMM_DISABLE)) {
+                    buf->matching_list = PTL_OVERFLOW_LIST;
+                    fill_target_event(buf, PTL_EVENT_SEARCH, le->user_ptr,
+                                      NULL, &event[found]);
+                }
 
-            found++;
-            if (le->options & PTL_LE_USE_ONCE)
-                break;
+                found++;
+                if (le->options & PTL_LE_USE_ONCE)
+                    break;
 
+            }
         }
     }
 
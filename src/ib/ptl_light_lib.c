@@ -532,6 +532,56 @@ int PtlNIStatus(ptl_handle_ni_t ni_handle, ptl_sr_index_t status_register,
     return err;
 }
 
+int PtlNIGetStat(ptl_handle_ni_t ni_handle, ptl_stat_index_t stat,
+                 ptl_sr_value_t *value)
+{
+    ppebuf_t *buf;
+    int err;
+
+    if ((err = ppebuf_alloc(&buf))) {
+        WARN();
+        return err;
+    }
+
+    buf->op = OP_PtlNIGetStat;
+
+    buf->msg.PtlNIGetStat.ni_handle = ni_handle;
+    buf->msg.PtlNIGetStat.stat = stat;
+
+    transfer_msg(buf);
+
+    err = buf->msg.ret;
+
+    *value = buf->msg.PtlNIGetStat.value;
+
+    ppebuf_release(buf);
+
+    return err;
+}
+
+int PtlNIReclaim(ptl_handle_ni_t ni_handle)
+{
+    ppebuf_t *buf;
+    int err;
+
+    if ((err = ppebuf_alloc(&buf))) {
+        WARN();
+        return err;
+    }
+
+    buf->op = OP_PtlNIReclaim;
+
+    buf->msg.PtlNIReclaim.ni_handle = ni_handle;
+
+    transfer_msg(buf);
+
+    err = buf->msg.ret;
+
+    ppebuf_release(buf);
+
+    return err;
+}
+
 int PtlNIHandle(ptl_handle_any_t handle, ptl_handle_ni_t *ni_handle)
 {
     ppebuf_t *buf;
@@ -1160,7 +1210,7 @@ int PtlCTWait(ptl_handle_ct_t ct_handle, ptl_size_t test,
 
     ct = get_light_ct(ct_handle);
     if (ct)
-        err = PtlCTWait_work(ct->info, test, event);
+        err = PtlCTWait_work(ct->info, test, event, NULL);
     else
         err = PTL_ARG_INVALID;
 
@@ -1200,7 +1250,8 @@ int PtlCTPoll(const ptl_handle_ct_t *ct_handles, const ptl_size_t *tests,
         cts_info[i] = ct->info;
     }
 
-    err = PtlCTPoll_work(cts_info, tests, size, timeout, event, which);
+    err = PtlCTPoll_work(cts_info, tests, size, timeout, event, which,
+                         NULL, NULL);
 
   done:
     if (cts_info)
@@ -1602,6 +1653,27 @@ int PtlEQGet(ptl_handle_eq_t eq_handle, ptl_event_t *event)
     return err;
 }
 
+int PtlEQGetMany(ptl_handle_eq_t eq_handle, unsigned int count,
+                 ptl_event_t *events, unsigned int *num_events)
+{
+    const struct light_eq *eq;
+    int err;
+
+#ifndef NO_ARG_VALIDATION
+    if (!ppe.ppe_comm_pad)
+        return PTL_NO_INIT;
+#endif
+
+    eq = get_light_eq(eq_handle);
+    if (eq && count) {
+        err = PtlEQGetMany_work(eq->eqe_list, count, events, num_events);
+    } else {
+        err = PTL_ARG_INVALID;
+    }
+
+    return err;
+}
+
 int PtlEQWait(ptl_handle_eq_t eq_handle, ptl_event_t *event)
 {
     const struct light_eq *eq;
@@ -1614,7 +1686,7 @@ int PtlEQWait(ptl_handle_eq_t eq_handle, ptl_event_t *event)
 
     eq = get_light_eq(eq_handle);
     if (eq)
-        err = PtlEQWait_work(eq->eqe_list, event);
+        err = PtlEQWait_work(eq->eqe_list, event, NULL);
     else
         err = PTL_ARG_INVALID;
 
@@ -1623,6 +1695,15 @@ int PtlEQWait(ptl_handle_eq_t eq_handle, ptl_event_t *event)
 
 int PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
               ptl_time_t timeout, ptl_event_t *event, unsigned int *which)
+{
+    unsigned int num;
+
+    return PtlEQPollMany(eq_handles, size, timeout, 1, event, &num, which);
+}
+
+int PtlEQPollMany(const ptl_handle_eq_t * eq_handles, unsigned int size,
+                  ptl_time_t timeout, unsigned int count, ptl_event_t *events,
+                  unsigned int *num_events, unsigned int *which)
 {
     int err;
     int i;
@@ -1633,7 +1714,7 @@ int PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
         return PTL_NO_INIT;
 #endif
 
-    if (size == 0) {
+    if (size == 0 || count == 0) {
         err = PTL_ARG_INVALID;
         goto done;
     }
@@ -1653,7 +1734,8 @@ int PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
         eqes_list[i] = eq->eqe_list;
     }
 
-    err = PtlEQPoll_work(eqes_list, size, timeout, event, which);
+    err = PtlEQPoll_work(eqes_list, size, timeout, count, events,
+                         num_events, which, NULL, NULL);
 
   done:
     if (eqes_list)
@@ -49,12 +49,14 @@
 #endif
 
 #include "portals4.h"
+#include "portals4_stats.h"
 
 #include "ptl_byteorder.h"
 #include "ptl_log.h"
 #include "ptl_list.h"
 #include "ptl_lockfree.h"
 #include "ptl_sync.h"
+#include "ptl_futex.h"
 #include "ptl_ref.h"
 #include "ptl_atomic.h"
 #include "ptl_param.h"
@@ -67,6 +69,7 @@
 #include "ptl_ppe.h"
 #include "p4ppe.h"
 #include "ptl_iface.h"
+#include "ptl_match.h"
 #include "ptl_pt.h"
 #include "ptl_ni.h"
 #include "ptl_data.h"
@@ -254,7 +257,16 @@ int PtlSetMap_mem(ni_t *ni, ptl_size_t map_size,
                   const ptl_process_t *mapping);
 void shmem_enqueue(ni_t *ni, buf_t *buf, ptl_pid_t dest);
 buf_t *shmem_dequeue(ni_t *ni);
+void shmem_flush_deferred(ni_t *ni);
+void shmem_eager_flush(ni_t *ni);
+int shmem_eager_poll(ni_t *ni);
+void shmem_bounce_buf_free(ni_t *ni, void *bb);
+int noknem_produce(buf_t *buf);
+int noknem_consume(buf_t *buf);
+void noknem_notify(buf_t *buf);
+void noknem_notify_done(buf_t *buf);
 void process_recv_mem(ni_t *ni, buf_t *buf);
+void process_recv_shmem(ni_t *ni, buf_t *shmem_buf);
 int mem_do_transfer(buf_t *buf);
 
 #if WITH_TRANSPORT_SHMEM || IS_PPE
@@ -272,7 +284,8 @@ void cleanup_udp(ni_t *ni);
 void PtlSetMap_udp(ni_t *ni, ptl_size_t map_size,
                    const ptl_process_t *mapping);
 void disconnect_conn_locked(conn_t *conn);
-void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest);
+void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest,
+              int from_init);
 buf_t *udp_receive(ni_t *ni);
 void process_recv_udp(ni_t *ni, buf_t *buf);
 void progress_thread_udp(ni_t *ni);
@@ -122,6 +122,70 @@ static inline void ll_enqueue_obj_alien(union counted_ptr *free_list,
     } while (tmpv.c16 != oldv.c16);
 }
 
+/**
+ * Add a chain of objects to a freelist.
+ *
+ * @param free_list the freelist
+ * @param first the first object of the chain
+ * @param last the last object, reached from first through next pointers
+ */
+static inline void ll_enqueue_chain(union counted_ptr *free_list,
+                                    void *first, void *last)
+{
+    union counted_ptr oldv, newv, tmpv;
+
+    tmpv.c16 = free_list->c16;
+
+    do {
+        oldv = tmpv;
+        *(void **)last = tmpv.head;
+        newv.head = first;
+        newv.counter = oldv.counter + 1;
+        tmpv.c16 = PtlInternalAtomicCas128(&free_list->c16, oldv, newv);
+    } while (tmpv.c16 != oldv.c16);
+}
+
+/**
+ * Remove up to max objects from a freelist at once.
+ *
+ * Every change of the list bumps its counter, so the chain walked
+ * before the compare and swap is still the head of the list when it
+ * succeeds.
+ *
+ * @param free_list the freelist
+ * @param max maximum number of objects to remove
+ * @param num_p address of the number of objects removed
+ *
+ * @return the first object, the others follow through next pointers
+ */
+static inline void *ll_dequeue_chain(union counted_ptr *free_list, int max,
+                                     int *num_p)
+{
+    union counted_ptr oldv, newv, retv;
+    void *p;
+    int num;
+
+    retv.c16 = free_list->c16;
+
+    do {
+        oldv = retv;
+        p = retv.head;
+        for (num = 0; num < max && p; num++)
+            p = *(void **)p;
+        newv.head = p;
+        newv.counter = oldv.counter + 1;
+
+        if (num == 0)
+            break;
+
+        retv.c16 = PtlInternalAtomicCas128(&free_list->c16, oldv, newv);
+    } while (retv.c16 != oldv.c16);
+
+    *num_p = num;
+
+    return num ? retv.head : NULL;
+}
+
 static inline void ll_init(union counted_ptr *free_list)
 {
     free_list->head = NULL;
@@ -172,6 +236,38 @@ static inline void ll_enqueue_obj_alien(union counted_ptr *free_list,
     PTL_FASTLOCK_UNLOCK(&free_list->lock);
 }
 
+static inline void ll_enqueue_chain(union counted_ptr *free_list,
+                                    void *first, void *last)
+{
+    PTL_FASTLOCK_LOCK(&free_list->lock);
+
+    *(void **)last = free_list->head;
+    free_list->head = first;
+
+    PTL_FASTLOCK_UNLOCK(&free_list->lock);
+}
+
+static inline void *ll_dequeue_chain(union counted_ptr *free_list, int max,
+                                     int *num_p)
+{
+    void *ret;
+    void *p;
+    int num;
+
+    PTL_FASTLOCK_LOCK(&free_list->lock);
+
+    ret = p = free_list->head;
+    for (num = 0; num < max && p; num++)
+        p = *(void **)p;
+    free_list->head = p;
+
+    PTL_FASTLOCK_UNLOCK(&free_list->lock);
+
+    *num_p = num;
+
+    return num ? ret : NULL;
+}
+
 static inline void ll_init(union counted_ptr *free_list)
 {
     free_list->head = NULL;
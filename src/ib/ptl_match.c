@@ -0,0 +1,719 @@
+/**
+ * @file ptl_match.c
+ *
+ * @brief Hash indexes and compact shadows of the priority, overflow
+ * and unexpected lists of a PT.
+ *
+ * The indexes and shadows are lookup accelerators only. The MEs and messages remain
+ * on the regular PT lists, which are still used for unlinking, for
+ * wildcard searches and for checking whether a PT is in use.
+ */
+
+#include "ptl_loc.h"
+
+#ifdef HAVE_X86_TARGET_ATTRIBUTE
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Compute a source key from a process id.
+ *
+ * @param[in] ni The network interface.
+ * @param[in] id The process id.
+ *
+ * @return the source key.
+ */
+static inline uint64_t id_to_key(const ni_t *ni, const ptl_process_t *id)
+{
+    if (ni->options & PTL_NI_LOGICAL)
+        return id->rank;
+    else
+        return ((uint64_t)id->phys.nid << 32) | id->phys.pid;
+}
+
+/**
+ * @brief Hash the match bits and the source key of an ME or a message.
+ *
+ * @param[in] index The match index.
+ * @param[in] match_bits The match bits.
+ * @param[in] src The source key.
+ *
+ * @return the bucket list.
+ */
+static inline struct list_head *match_bucket(struct list_head *buckets,
+                                             unsigned int num_buckets,
+                                             uint64_t match_bits,
+                                             uint64_t src)
+{
+    uint64_t h = match_bits ^ (src * 0x9e3779b97f4a7c15ULL);
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return &buckets[h & (num_buckets - 1)];
+}
+
+/**
+ * @brief Compute the source key of a message.
+ *
+ * @param[in] ni The network interface.
+ * @param[in] buf The message buf received by the target.
+ *
+ * @return the source key.
+ */
+static inline uint64_t buf_to_key(const ni_t *ni, const buf_t *buf)
+{
+    const req_hdr_t *hdr = (req_hdr_t *) buf->data;
+    ptl_process_t initiator;
+
+    if (ni->options & PTL_NI_LOGICAL) {
+        initiator.rank = le32_to_cpu(hdr->h1.src_rank);
+    } else {
+        initiator.phys.nid = le32_to_cpu(hdr->h1.src_nid);
+        initiator.phys.pid = le32_to_cpu(hdr->h1.src_pid);
+    }
+
+    return id_to_key(ni, &initiator);
+}
+
+/**
+ * @brief Allocate an array of empty buckets.
+ *
+ * @param[out] buckets_p The allocated buckets.
+ * @param[in,out] num_buckets_p The number of buckets, rounded up to a
+ * power of 2 on return.
+ *
+ * @return status
+ */
+static int buckets_alloc(struct list_head **buckets_p,
+                         unsigned int *num_buckets_p)
+{
+    unsigned int num_buckets = *num_buckets_p;
+    struct list_head *buckets;
+    unsigned int i;
+
+    while (num_buckets & (num_buckets - 1))
+        num_buckets += num_buckets & -num_buckets;
+
+    buckets = malloc(num_buckets * sizeof(struct list_head));
+    if (!buckets)
+        return PTL_NO_SPACE;
+
+    for (i = 0; i < num_buckets; i++)
+        INIT_LIST_HEAD(&buckets[i]);
+
+    *buckets_p = buckets;
+    *num_buckets_p = num_buckets;
+
+    return PTL_OK;
+}
+
+/**
+ * @brief Check whether an ME can go in a hash bucket.
+ *
+ * @param[in] ni The network interface.
+ * @param[in] me The ME.
+ *
+ * @return non zero if the ME has no wildcard.
+ */
+static int me_fully_specified(const ni_t *ni, const me_t *me)
+{
+    if (me->ignore_bits)
+        return 0;
+
+    if (ni->options & PTL_NI_LOGICAL)
+        return me->id.rank != PTL_RANK_ANY;
+    else
+        return me->id.phys.nid != PTL_NID_ANY &&
+            me->id.phys.pid != PTL_PID_ANY;
+}
+
+/**
+ * @brief Initialize a match index.
+ *
+ * @param[in] index The match index.
+ * @param[in] num_buckets The number of buckets, rounded up to a power
+ * of 2. The index is disabled if 0.
+ *
+ * @return status
+ */
+int match_index_init(struct match_index *index, unsigned int num_buckets)
+{
+    int err;
+
+    index->num_buckets = 0;
+    index->buckets = NULL;
+    index->next_seq = 0;
+    INIT_LIST_HEAD(&index->wildcard_list);
+
+    if (!num_buckets)
+        return PTL_OK;
+
+    err = buckets_alloc(&index->buckets, &num_buckets);
+    if (err)
+        return err;
+
+    index->num_buckets = num_buckets;
+
+    return PTL_OK;
+}
+
+/**
+ * @brief Release the resources of a match index.
+ *
+ * @param[in] index The match index.
+ */
+void match_index_fini(struct match_index *index)
+{
+    free(index->buckets);
+    index->buckets = NULL;
+    index->num_buckets = 0;
+}
+
+/**
+ * @brief Add an ME to a match index.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] index The match index of the list the ME is appended to.
+ * @param[in] me The ME.
+ */
+void match_index_add(struct match_index *index, me_t *me)
+{
+    ni_t *ni = obj_to_ni(me);
+
+    me->seq = index->next_seq++;
+
+    if (me_fully_specified(ni, me))
+        list_add_tail(&me->index_list,
+                      match_bucket(index->buckets, index->num_buckets,
+                                   me->match_bits, id_to_key(ni, &me->id)));
+    else
+        list_add_tail(&me->index_list, &index->wildcard_list);
+}
+
+/**
+ * @brief Remove an ME from its match index, if any.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] me The ME.
+ */
+void match_index_del(me_t *me)
+{
+    list_del_init(&me->index_list);
+}
+
+/**
+ * @brief Find the first ME of a list matching a message.
+ *
+ * The candidate from the hash bucket is compared with the wildcard
+ * MEs appended before it, so the result is the same as a linear scan
+ * of the list.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] index The match index of the list to search.
+ * @param[in] buf The message buf received by the target.
+ *
+ * @return the matching ME or NULL.
+ */
+me_t *match_index_find(struct match_index *index, buf_t *buf)
+{
+    const ni_t *ni = obj_to_ni(buf);
+    const req_hdr_t *hdr = (req_hdr_t *) buf->data;
+    struct list_head *bucket;
+    me_t *found = NULL;
+    me_t *me;
+
+    bucket = match_bucket(index->buckets, index->num_buckets,
+                          le64_to_cpu(hdr->match_bits), buf_to_key(ni, buf));
+
+    list_for_each_entry(me, bucket, index_list) {
+        if (check_match(buf, me)) {
+            found = me;
+            break;
+        }
+    }
+
+    list_for_each_entry(me, &index->wildcard_list, index_list) {
+        if (found && me->seq > found->seq)
+            break;
+
+        if (check_match(buf, me)) {
+            found = me;
+            break;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * @brief Initialize an unexpected message index.
+ *
+ * @param[in] index The unexpected index.
+ * @param[in] num_buckets The number of buckets, rounded up to a power
+ * of 2. The index is disabled if 0.
+ *
+ * @return status
+ */
+int unexpected_index_init(struct unexpected_index *index,
+                          unsigned int num_buckets)
+{
+    int err;
+
+    index->num_buckets = 0;
+    index->buckets = NULL;
+
+    if (!num_buckets)
+        return PTL_OK;
+
+    err = buckets_alloc(&index->buckets, &num_buckets);
+    if (err)
+        return err;
+
+    index->num_buckets = num_buckets;
+
+    return PTL_OK;
+}
+
+/**
+ * @brief Release the resources of an unexpected message index.
+ *
+ * @param[in] index The unexpected index.
+ */
+void unexpected_index_fini(struct unexpected_index *index)
+{
+    free(index->buckets);
+    index->buckets = NULL;
+    index->num_buckets = 0;
+}
+
+/**
+ * @brief Add a message to an unexpected index.
+ *
+ * Messages must be added in the order they are appended to the
+ * unexpected list, so each bucket stays in arrival order.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] index The unexpected index.
+ * @param[in] buf The message buf received by the target.
+ */
+void unexpected_index_add(struct unexpected_index *index, buf_t *buf)
+{
+    const ni_t *ni = obj_to_ni(buf);
+    const req_hdr_t *hdr = (req_hdr_t *) buf->data;
+
+    list_add_tail(&buf->unexpected_index_list,
+                  match_bucket(index->buckets, index->num_buckets,
+                               le64_to_cpu(hdr->match_bits),
+                               buf_to_key(ni, buf)));
+}
+
+/**
+ * @brief Remove a message from its unexpected index, if any.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] buf The message buf.
+ */
+void unexpected_index_del(buf_t *buf)
+{
+    list_del_init(&buf->unexpected_index_list);
+}
+
+/**
+ * @brief Find the bucket holding every unexpected message an ME can
+ * match.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] index The unexpected index.
+ * @param[in] me The ME being appended or searched.
+ *
+ * @return the bucket, or NULL if the index is disabled or the ME has
+ * wildcards and the whole unexpected list must be scanned.
+ */
+struct list_head *unexpected_index_bucket(struct unexpected_index *index,
+                                          const me_t *me)
+{
+    const ni_t *ni = obj_to_ni(me);
+
+    if (!index->num_buckets || !me_fully_specified(ni, me))
+        return NULL;
+
+    return match_bucket(index->buckets, index->num_buckets,
+                        me->match_bits, id_to_key(ni, &me->id));
+}
+
+/** source key of a hole, which no message can carry */
+#define SHADOW_HOLE_SRC		(~0ULL)
+
+/** a shadow is compacted once it has that many holes, and more holes
+ * than MEs */
+#define SHADOW_MIN_HOLES	(64)
+
+/**
+ * @brief Scan a match shadow.
+ *
+ * @param[in] shadow The match shadow.
+ * @param[in] start The first entry to test.
+ * @param[in] match_bits The match bits of the message.
+ * @param[in] src The source key of the message.
+ *
+ * @return the first entry from start that matches, or shadow->count.
+ */
+typedef unsigned int (*shadow_scan_t)(const struct match_shadow *shadow,
+                                      unsigned int start,
+                                      uint64_t match_bits, uint64_t src);
+
+/**
+ * @brief Test one shadow entry.
+ */
+static inline int shadow_entry_match(const struct match_shadow *shadow,
+                                     unsigned int i, uint64_t match_bits,
+                                     uint64_t src)
+{
+    return (((shadow->match_bits[i] ^ match_bits) & shadow->care_bits[i]) |
+            ((shadow->src[i] ^ src) & shadow->src_mask[i])) == 0;
+}
+
+/**
+ * @brief Portable scan of a match shadow.
+ */
+static unsigned int shadow_scan_scalar(const struct match_shadow *shadow,
+                                       unsigned int start,
+                                       uint64_t match_bits, uint64_t src)
+{
+    unsigned int i;
+
+    for (i = start; i < shadow->count; i++) {
+        if (shadow_entry_match(shadow, i, match_bits, src))
+            break;
+    }
+
+    return i;
+}
+
+#ifdef HAVE_X86_TARGET_ATTRIBUTE
+/**
+ * @brief AVX2 scan of a match shadow, 4 entries per step.
+ */
+__attribute__ ((target("avx2")))
+static unsigned int shadow_scan_avx2(const struct match_shadow *shadow,
+                                     unsigned int start,
+                                     uint64_t match_bits, uint64_t src)
+{
+    const __m256i mb = _mm256_set1_epi64x(match_bits);
+    const __m256i sk = _mm256_set1_epi64x(src);
+    const __m256i zero = _mm256_setzero_si256();
+    unsigned int i = start;
+
+    for (; i + 4 <= shadow->count; i += 4) {
+        __m256i m = _mm256_loadu_si256((const __m256i *)
+                                       &shadow->match_bits[i]);
+        __m256i c = _mm256_loadu_si256((const __m256i *)
+                                       &shadow->care_bits[i]);
+        __m256i s = _mm256_loadu_si256((const __m256i *)&shadow->src[i]);
+        __m256i k = _mm256_loadu_si256((const __m256i *)
+                                       &shadow->src_mask[i]);
+        __m256i d = _mm256_or_si256(_mm256_and_si256(_mm256_xor_si256(m, mb),
+                                                     c),
+                                    _mm256_and_si256(_mm256_xor_si256(s, sk),
+                                                     k));
+        int hits = _mm256_movemask_pd(_mm256_castsi256_pd
+                                      (_mm256_cmpeq_epi64(d, zero)));
+
+        if (hits)
+            return i + __builtin_ctz(hits);
+    }
+
+    return shadow_scan_scalar(shadow, i, match_bits, src);
+}
+
+/**
+ * @brief AVX-512 scan of a match shadow, 8 entries per step.
+ */
+__attribute__ ((target("avx512f")))
+static unsigned int shadow_scan_avx512(const struct match_shadow *shadow,
+                                       unsigned int start,
+                                       uint64_t match_bits, uint64_t src)
+{
+    const __m512i mb = _mm512_set1_epi64(match_bits);
+    const __m512i sk = _mm512_set1_epi64(src);
+    unsigned int i = start;
+
+    for (; i + 8 <= shadow->count; i += 8) {
+        __m512i m = _mm512_loadu_si512(&shadow->match_bits[i]);
+        __m512i c = _mm512_loadu_si512(&shadow->care_bits[i]);
+        __m512i s = _mm512_loadu_si512(&shadow->src[i]);
+        __m512i k = _mm512_loadu_si512(&shadow->src_mask[i]);
+        __m512i d = _mm512_or_si512(_mm512_and_si512(_mm512_xor_si512(m, mb),
+                                                     c),
+                                    _mm512_and_si512(_mm512_xor_si512(s, sk),
+                                                     k));
+        __mmask8 hits = _mm512_testn_epi64_mask(d, d);
+
+        if (hits)
+            return i + __builtin_ctz(hits);
+    }
+
+    return shadow_scan_scalar(shadow, i, match_bits, src);
+}
+#endif
+
+/** scan implementation chosen for this CPU */
+static shadow_scan_t shadow_scan = shadow_scan_scalar;
+
+static pthread_once_t shadow_scan_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Pick the fastest scan the CPU supports.
+ */
+static void shadow_scan_select(void)
+{
+    const char *name = "scalar";
+
+#ifdef HAVE_X86_TARGET_ATTRIBUTE
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        shadow_scan = shadow_scan_avx512;
+        name = "avx512f";
+    } else if (__builtin_cpu_supports("avx2")) {
+        shadow_scan = shadow_scan_avx2;
+        name = "avx2";
+    }
+#endif
+
+    ptl_info("match shadow scan uses %s\n", name);
+}
+
+/**
+ * @brief Initialize a match shadow.
+ *
+ * @param[in] shadow The match shadow.
+ * @param[in] enabled Whether the shadow is used.
+ *
+ * @return status
+ */
+int match_shadow_init(struct match_shadow *shadow, int enabled)
+{
+    memset(shadow, 0, sizeof(*shadow));
+
+    if (enabled) {
+        pthread_once(&shadow_scan_once, shadow_scan_select);
+        shadow->enabled = 1;
+    }
+
+    return PTL_OK;
+}
+
+/**
+ * @brief Release the resources of a match shadow.
+ *
+ * @param[in] shadow The match shadow.
+ */
+void match_shadow_fini(struct match_shadow *shadow)
+{
+    /* All the arrays are in one allocation. */
+    free(shadow->match_bits);
+    memset(shadow, 0, sizeof(*shadow));
+}
+
+/**
+ * @brief Move the entries of a shadow to arrays of a new size.
+ *
+ * Holes are dropped and the MEs are told their new slot.
+ *
+ * @param[in] shadow The match shadow.
+ * @param[in] size The new number of entries, at least the number of MEs.
+ *
+ * @return status
+ */
+static int shadow_resize(struct match_shadow *shadow, unsigned int size)
+{
+    void *block;
+    uint64_t *match_bits;
+    uint64_t *care_bits;
+    uint64_t *src;
+    uint64_t *src_mask;
+    me_t **me;
+    unsigned int i;
+    unsigned int n = 0;
+
+    /* Keep each array on its own cache lines. */
+    size = (size + 7) & ~7U;
+
+    if (posix_memalign(&block, 64,
+                       size * (4 * sizeof(uint64_t) + sizeof(me_t *))))
+        return PTL_NO_SPACE;
+
+    match_bits = block;
+    care_bits = match_bits + size;
+    src = care_bits + size;
+    src_mask = src + size;
+    me = (me_t **)(src_mask + size);
+
+    for (i = 0; i < shadow->count; i++) {
+        if (!shadow->me[i])
+            continue;
+
+        match_bits[n] = shadow->match_bits[i];
+        care_bits[n] = shadow->care_bits[i];
+        src[n] = shadow->src[i];
+        src_mask[n] = shadow->src_mask[i];
+        me[n] = shadow->me[i];
+        me[n]->shadow_slot = n;
+        n++;
+    }
+
+    free(shadow->match_bits);
+
+    shadow->match_bits = match_bits;
+    shadow->care_bits = care_bits;
+    shadow->src = src;
+    shadow->src_mask = src_mask;
+    shadow->me = me;
+    shadow->size = size;
+    shadow->count = n;
+    shadow->holes = 0;
+
+    return PTL_OK;
+}
+
+/**
+ * @brief Append an ME to a match shadow.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] shadow The match shadow of the list the ME is appended to.
+ * @param[in] me The ME.
+ *
+ * @return status
+ */
+int match_shadow_add(struct match_shadow *shadow, me_t *me)
+{
+    ni_t *ni = obj_to_ni(me);
+    unsigned int i;
+
+    if (shadow->count == shadow->size) {
+        unsigned int live = shadow->count - shadow->holes;
+        unsigned int size = live * 2;
+        int err;
+
+        if (size < 64)
+            size = 64;
+
+        err = shadow_resize(shadow, size);
+        if (err)
+            return err;
+    }
+
+    i = shadow->count++;
+
+    shadow->match_bits[i] = me->match_bits;
+    shadow->care_bits[i] = ~me->ignore_bits;
+    shadow->src[i] = id_to_key(ni, &me->id);
+
+    if (ni->options & PTL_NI_LOGICAL) {
+        shadow->src_mask[i] = (me->id.rank == PTL_RANK_ANY) ? 0 : ~0ULL;
+    } else {
+        shadow->src_mask[i] =
+            ((me->id.phys.nid == PTL_NID_ANY) ? 0 : 0xffffffff00000000ULL) |
+            ((me->id.phys.pid == PTL_PID_ANY) ? 0 : 0x00000000ffffffffULL);
+    }
+
+    shadow->me[i] = me;
+    me->shadow_slot = i;
+
+    return PTL_OK;
+}
+
+/**
+ * @brief Remove an ME from a match shadow.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] shadow The match shadow of the list the ME was on.
+ * @param[in] me The ME.
+ */
+void match_shadow_del(struct match_shadow *shadow, me_t *me)
+{
+    unsigned int i = me->shadow_slot;
+
+    if (i >= shadow->count || shadow->me[i] != me)
+        return;
+
+    /* Leave a hole that never matches. */
+    shadow->match_bits[i] = 0;
+    shadow->care_bits[i] = 0;
+    shadow->src[i] = SHADOW_HOLE_SRC;
+    shadow->src_mask[i] = ~0ULL;
+    shadow->me[i] = NULL;
+    shadow->holes++;
+
+    /* Drop the holes at the end for free. */
+    while (shadow->count && !shadow->me[shadow->count - 1]) {
+        shadow->count--;
+        shadow->holes--;
+    }
+
+    /* Compact in place. Moving the entries down can not fail. */
+    if (shadow->holes >= SHADOW_MIN_HOLES &&
+        shadow->holes > shadow->count - shadow->holes) {
+        unsigned int n = 0;
+
+        for (i = 0; i < shadow->count; i++) {
+            if (!shadow->me[i])
+                continue;
+
+            shadow->match_bits[n] = shadow->match_bits[i];
+            shadow->care_bits[n] = shadow->care_bits[i];
+            shadow->src[n] = shadow->src[i];
+            shadow->src_mask[n] = shadow->src_mask[i];
+            shadow->me[n] = shadow->me[i];
+            shadow->me[n]->shadow_slot = n;
+            n++;
+        }
+
+        shadow->count = n;
+        shadow->holes = 0;
+    }
+}
+
+/**
+ * @brief Find the first ME of a list matching a message.
+ *
+ * The vector scan only compares the match bits and the source. The
+ * remaining checks of check_match() are done on each candidate.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] shadow The match shadow of the list to search.
+ * @param[in] buf The message buf received by the target.
+ *
+ * @return the matching ME or NULL.
+ */
+me_t *match_shadow_find(struct match_shadow *shadow, buf_t *buf)
+{
+    const ni_t *ni = obj_to_ni(buf);
+    const req_hdr_t *hdr = (req_hdr_t *) buf->data;
+    uint64_t match_bits = le64_to_cpu(hdr->match_bits);
+    uint64_t src = buf_to_key(ni, buf);
+    unsigned int i = 0;
+
+    for (;;) {
+        i = shadow_scan(shadow, i, match_bits, src);
+        if (i >= shadow->count)
+            return NULL;
+
+        if (shadow->me[i] && check_match(buf, shadow->me[i]))
+            return shadow->me[i];
+
+        i++;
+    }
+}
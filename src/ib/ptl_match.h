@@ -0,0 +1,161 @@
+/**
+ * @file ptl_match.h
+ *
+ * @brief Header for ptl_match.c.
+ */
+#ifndef PTL_MATCH_H
+#define PTL_MATCH_H
+
+/* forward declarations */
+struct ni;
+struct me;
+struct buf;
+
+/**
+ * @brief Optional index over an ME list of a portals table entry.
+ *
+ * Fully specified MEs (no ignore bits and a fixed source) are hashed
+ * on their match bits and source. All other MEs are kept in append
+ * order on the wildcard list. Each ME receives a sequence number when
+ * it is appended, so the first match in list order can still be
+ * found by comparing the candidates from a bucket and from the
+ * wildcard list.
+ */
+struct match_index {
+        /** number of hash buckets, a power of 2, or 0 if disabled */
+    unsigned int num_buckets;
+
+        /** fully specified MEs, in append order within a bucket */
+    struct list_head *buckets;
+
+        /** MEs with wildcards, in append order */
+    struct list_head wildcard_list;
+
+        /** sequence number of the next appended ME */
+    uint64_t next_seq;
+};
+
+int match_index_init(struct match_index *index, unsigned int num_buckets);
+
+void match_index_fini(struct match_index *index);
+
+void match_index_add(struct match_index *index, struct me *me);
+
+void match_index_del(struct me *me);
+
+struct me *match_index_find(struct match_index *index, struct buf *buf);
+
+/**
+ * @brief Optional index over the unexpected list of a portals table
+ * entry.
+ *
+ * Every unexpected message has exact match bits and source, so all of
+ * them are hashed. A bucket keeps its messages in arrival order. An ME
+ * without wildcards can only match messages from one bucket; any other
+ * ME or LE still scans the unexpected list.
+ */
+struct unexpected_index {
+        /** number of hash buckets, a power of 2, or 0 if disabled */
+    unsigned int num_buckets;
+
+        /** unexpected messages, in arrival order within a bucket */
+    struct list_head *buckets;
+};
+
+int unexpected_index_init(struct unexpected_index *index,
+                          unsigned int num_buckets);
+
+void unexpected_index_fini(struct unexpected_index *index);
+
+void unexpected_index_add(struct unexpected_index *index, struct buf *buf);
+
+void unexpected_index_del(struct buf *buf);
+
+struct list_head *unexpected_index_bucket(struct unexpected_index *index,
+                                          const struct me *me);
+
+/**
+ * @brief Optional compact copy of an ME list of a portals table entry.
+ *
+ * The fields used for matching are kept in parallel arrays, in list
+ * order, so a scan reads a few contiguous cache lines and can test
+ * several MEs per vector instruction. Unlinked MEs leave a hole that
+ * never matches until the arrays are compacted.
+ */
+struct match_shadow {
+        /** non zero if the shadow is in use */
+    int enabled;
+
+        /** number of used entries, including holes */
+    unsigned int count;
+
+        /** number of allocated entries */
+    unsigned int size;
+
+        /** number of holes */
+    unsigned int holes;
+
+        /** match bits of each ME */
+    uint64_t *match_bits;
+
+        /** complement of the ignore bits of each ME */
+    uint64_t *care_bits;
+
+        /** source key of each ME */
+    uint64_t *src;
+
+        /** bits of the source key that must match */
+    uint64_t *src_mask;
+
+        /** the MEs, or NULL for a hole */
+    struct me **me;
+};
+
+int match_shadow_init(struct match_shadow *shadow, int enabled);
+
+void match_shadow_fini(struct match_shadow *shadow);
+
+int match_shadow_add(struct match_shadow *shadow, struct me *me);
+
+void match_shadow_del(struct match_shadow *shadow, struct me *me);
+
+struct me *match_shadow_find(struct match_shadow *shadow, struct buf *buf);
+
+/**
+ * @brief Check whether a match shadow is in use.
+ *
+ * @param[in] shadow The match shadow.
+ *
+ * @return non zero if the shadow is enabled.
+ */
+static inline int match_shadow_enabled(const struct match_shadow *shadow)
+{
+    return shadow->enabled;
+}
+
+/**
+ * @brief Check whether a match index is in use.
+ *
+ * @param[in] index The match index.
+ *
+ * @return non zero if the index is enabled.
+ */
+static inline int match_index_enabled(const struct match_index *index)
+{
+    return index->num_buckets != 0;
+}
+
+/**
+ * @brief Check whether an unexpected index is in use.
+ *
+ * @param[in] index The unexpected index.
+ *
+ * @return non zero if the index is enabled.
+ */
+static inline int unexpected_index_enabled(const struct unexpected_index
+                                           *index)
+{
+    return index->num_buckets != 0;
+}
+
+#endif /* PTL_MATCH_H */
@@ -9,7 +9,7 @@
 
 #ifdef WITH_TRIG_ME_OPS
 static void post_trig_me(buf_t *buf, ct_t *me_ct);
-void do_trig_me_op(buf_t *buf, ct_t *ct);
+void do_trig_me_op(buf_t *buf);
 #endif
 
 /**
@@ -109,6 +109,7 @@ static int me_append_or_search(PPEGBL ptl_handle_ni_t ni_handle,
     pt = &ni->pt[pt_index];
 
     INIT_LIST_HEAD(&me->list);
+    INIT_LIST_HEAD(&me->index_list);
     me->pt_index = pt_index;
     me->eq = pt->eq;
     me->uid = me_init->uid;
@@ -307,7 +308,12 @@ int _PtlTriggeredMEAppend(PPEGBL ptl_handle_ni_t ni_handle,
     }
 #endif
 
-    buf = malloc(sizeof(buf_t));
+    err = small_buf_alloc(ni, &buf);
+    if (err) {
+        err = PTL_NO_SPACE;
+        ct_put(ct);
+        goto err1;
+    }
 
     buf->user_ptr = user_ptr;
     buf->ct_threshold = threshold;
@@ -481,7 +487,14 @@ int _PtlTriggeredMEUnlink(PPEGBL ptl_handle_me_t me_handle,
     }
 #endif
 
-    buf = malloc(sizeof(buf_t));
+    ni = obj_to_ni(ct);
+
+    err = small_buf_alloc(ni, &buf);
+    if (err) {
+        err = PTL_NO_SPACE;
+        ct_put(ct);
+        goto err1;
+    }
 
     buf->me_handle = me_handle;
     buf->ct = ct;
@@ -508,16 +521,8 @@ int _PtlTriggeredMEUnlink(PPEGBL ptl_handle_me_t me_handle,
  *
  * @param[in] buf
  */
-void do_trig_me_op(buf_t *buf, ct_t *ct)
+void do_trig_me_op(buf_t *buf)
 {
-
-    /* if we're a zombie */
-    if (ct->info.interrupt) {
-        ptl_info("this CT is being shut down, don't trigger anything on it\n");
-        goto done;
-    }
-
-
     ptl_info("type of triggered me op is: %i \n", buf->me_op);
     switch (buf->me_op) {
         case TRIG_ME_APPEND:
@@ -531,8 +536,7 @@ void do_trig_me_op(buf_t *buf, ct_t *ct)
             assert(0);
     }
 
-  done:
-    free(buf);
+    buf_put(buf);
 }
 
 /**
@@ -552,12 +556,13 @@ static void post_trig_me(buf_t *buf, ct_t *me_ct)
         buf->ct_threshold) {
         PTL_FASTLOCK_UNLOCK(&me_ct->lock);
 
-        do_trig_me_op(buf,me_ct);
+        if (!me_ct->info.interrupt)
+            do_trig_me_op(buf);
+        else
+            buf_put(buf);
 
     } else {
-        atomic_inc(&me_ct->list_size);
-
-        list_add(&buf->list, &me_ct->trig_list);
+        ct_add_trig(me_ct, buf);
 
         /* We must check again to avoid a race with make_ct_event/ct_inc_ct_set. */
         if ((me_ct->info.event.success + me_ct->info.event.failure) >=
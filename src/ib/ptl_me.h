@@ -22,6 +22,9 @@ struct me {
     uint64_t match_bits;
     uint64_t ignore_bits;
     ptl_process_t id;
+    struct list_head index_list;        /* link in the PT match index */
+    uint64_t seq;               /* append order in the PT list */
+    unsigned int shadow_slot;   /* entry in the PT match shadow */
 };
 
 /**
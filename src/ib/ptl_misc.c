@@ -6,6 +6,13 @@
 
 #include "ptl_loc.h"
 
+#if defined HAVE_HWLOC
+#include <hwloc.h>
+#if HWLOC_API_VERSION >= 0x00020000
+#define USE_HWLOC_NUMA 1
+#endif
+#endif
+
 /* Internal debug tuning variables. */
 int debug;
 int ptl_log_level;
@@ -56,6 +63,8 @@ int ppe_misc_init_once(void)
     transports.remote = transport_remote_udp;
 #endif
 
+    atom_op_init();
+
     return PTL_OK;
 }
 
@@ -95,6 +104,8 @@ int misc_init_once(void)
     transports.remote = transport_remote_udp;
 #endif
 
+    atom_op_init();
+
 #endif /* !IS_LIGHT_LIB */
 
     return PTL_OK;
@@ -192,6 +203,263 @@ void _PtlFini(gbl_t *gbl)
 }
 #endif
 
+const char *huge_backing_name[] = {
+    [HUGE_BACKING_NONE] = "regular pages",
+    [HUGE_BACKING_THP] = "transparent huge pages",
+    [HUGE_BACKING_HUGETLB] = "hugetlb pages",
+};
+
+/**
+ * @brief Allocate memory on huge pages.
+ *
+ * Reserved huge pages are used if the system has some free, else the
+ * memory is aligned on a huge page and the kernel is advised to back
+ * it with transparent huge pages.
+ *
+ * @param[in] size the size to allocate, rounded up to HUGE_PAGE_SIZE
+ * @param[out] backing_p how the memory was obtained
+ *
+ * @return the memory, or NULL if none could be allocated
+ */
+void *huge_alloc(size_t size, enum huge_backing *backing_p)
+{
+    void *p;
+
+    size = ROUND_UP(size, HUGE_PAGE_SIZE);
+
+#ifdef MAP_HUGETLB
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        *backing_p = HUGE_BACKING_HUGETLB;
+        return p;
+    }
+#endif
+
+    if (posix_memalign(&p, HUGE_PAGE_SIZE, size))
+        return NULL;
+
+    *backing_p = HUGE_BACKING_NONE;
+#ifdef MADV_HUGEPAGE
+    if (huge_thp_enabled(0) && madvise(p, size, MADV_HUGEPAGE) == 0)
+        *backing_p = HUGE_BACKING_THP;
+#endif
+
+    return p;
+}
+
+/**
+ * @brief Free memory obtained with huge_alloc().
+ *
+ * @param[in] p the memory
+ * @param[in] size the size given to huge_alloc()
+ * @param[in] backing the backing returned by huge_alloc()
+ */
+void huge_free(void *p, size_t size, enum huge_backing backing)
+{
+    if (backing == HUGE_BACKING_HUGETLB) {
+        size = ROUND_UP(size, HUGE_PAGE_SIZE);
+        munmap(p, size);
+    } else {
+        free(p);
+    }
+}
+
+/**
+ * @brief Check whether the kernel honors MADV_HUGEPAGE.
+ *
+ * madvise() accepts the advice even when transparent huge pages are
+ * disabled, so the setting is read from sysfs.
+ *
+ * @param[in] shmem check for shared memory files instead of anonymous
+ * memory
+ *
+ * @return 1 if advised memory may get transparent huge pages
+ */
+int huge_thp_enabled(int shmem)
+{
+    const char *knob = shmem ?
+        "/sys/kernel/mm/transparent_hugepage/shmem_enabled" :
+        "/sys/kernel/mm/transparent_hugepage/enabled";
+    char line[256];
+    FILE *f;
+    int enabled = 0;
+
+    f = fopen(knob, "r");
+    if (!f)
+        return 0;
+
+    if (fgets(line, sizeof(line), f))
+        enabled = !strstr(line, "[never]") && !strstr(line, "[deny]");
+
+    fclose(f);
+
+    return enabled;
+}
+
+/**
+ * @brief Find a hugetlbfs mount to create shared files on huge pages.
+ *
+ * Only mounts with HUGE_PAGE_SIZE pages are considered.
+ *
+ * @return the mount point, or NULL if there is none
+ */
+const char *huge_page_dir(void)
+{
+    static char dir[PATH_MAX];
+    static int checked;
+    char line[PATH_MAX + 128];
+    FILE *f;
+
+    if (checked)
+        return dir[0] ? dir : NULL;
+
+    checked = 1;
+
+    f = fopen("/proc/mounts", "r");
+    if (!f)
+        return NULL;
+
+    while (fgets(line, sizeof(line), f)) {
+        char mnt[PATH_MAX];
+        char type[64];
+        char opts[512];
+
+        if (sscanf(line, "%*s %4095s %63s %511s", mnt, type, opts) != 3 ||
+            strcmp(type, "hugetlbfs"))
+            continue;
+
+        /* The default page size is not listed in the options. */
+        if (strstr(opts, "pagesize=") && !strstr(opts, "pagesize=2M") &&
+            !strstr(opts, "pagesize=2048k"))
+            continue;
+
+        if (access(mnt, W_OK) == 0) {
+            strcpy(dir, mnt);
+            break;
+        }
+    }
+
+    fclose(f);
+
+    return dir[0] ? dir : NULL;
+}
+
+#if USE_HWLOC_NUMA
+static hwloc_topology_t numa_topology;
+static pthread_once_t numa_once = PTHREAD_ONCE_INIT;
+
+static void numa_init_once(void)
+{
+    if (hwloc_topology_init(&numa_topology))
+        return;
+
+    if (hwloc_topology_load(numa_topology)) {
+        hwloc_topology_destroy(numa_topology);
+        numa_topology = NULL;
+    }
+}
+
+static hwloc_topology_t numa_get_topology(void)
+{
+    pthread_once(&numa_once, numa_init_once);
+
+    return numa_topology;
+}
+#endif
+
+/**
+ * @brief Find the NUMA node of the calling thread.
+ *
+ * @return the OS index of the node of the processor the thread last
+ * ran on, or -1 if it is not known
+ */
+int numa_current_node(void)
+{
+    int node = -1;
+
+#if USE_HWLOC_NUMA
+    hwloc_topology_t topo = numa_get_topology();
+    hwloc_bitmap_t cpuset;
+    hwloc_bitmap_t nodeset;
+
+    if (!topo)
+        return -1;
+
+    cpuset = hwloc_bitmap_alloc();
+    nodeset = hwloc_bitmap_alloc();
+
+    if (hwloc_get_last_cpu_location(topo, cpuset, HWLOC_CPUBIND_THREAD) == 0) {
+        hwloc_cpuset_to_nodeset(topo, cpuset, nodeset);
+        node = hwloc_bitmap_first(nodeset);
+    }
+
+    hwloc_bitmap_free(nodeset);
+    hwloc_bitmap_free(cpuset);
+#endif
+
+    return node;
+}
+
+/**
+ * @brief Bind memory to a NUMA node.
+ *
+ * Only the pages entirely within the range are bound. Pages already
+ * touched are migrated. Failures are ignored; the memory then keeps the
+ * default policy.
+ *
+ * @param[in] addr the start of the memory
+ * @param[in] len the length of the memory
+ * @param[in] node the OS index of the node
+ */
+void numa_bind_area(void *addr, size_t len, int node)
+{
+#if USE_HWLOC_NUMA
+    hwloc_topology_t topo = numa_get_topology();
+    hwloc_bitmap_t nodeset;
+    uintptr_t start = ((uintptr_t)addr + pagesize - 1) & ~(pagesize - 1);
+    uintptr_t end = ((uintptr_t)addr + len) & ~(pagesize - 1);
+
+    if (!topo || node < 0 || end <= start)
+        return;
+
+    nodeset = hwloc_bitmap_alloc();
+    hwloc_bitmap_only(nodeset, node);
+
+    if (hwloc_set_area_membind(topo, (void *)start, end - start, nodeset,
+                               HWLOC_MEMBIND_BIND,
+                               HWLOC_MEMBIND_BYNODESET |
+                               HWLOC_MEMBIND_MIGRATE))
+        ptl_info("cannot bind %zu bytes at %p to node %d (errno=%d)\n",
+                 (size_t)(end - start), (void *)start, node, errno);
+
+    hwloc_bitmap_free(nodeset);
+#endif
+}
+
+/**
+ * @brief Bind the calling thread to the processors of a NUMA node.
+ *
+ * @param[in] node the OS index of the node
+ */
+void numa_bind_thread(int node)
+{
+#if USE_HWLOC_NUMA
+    hwloc_topology_t topo = numa_get_topology();
+    hwloc_obj_t obj;
+
+    if (!topo || node < 0)
+        return;
+
+    obj = hwloc_get_numanode_obj_by_os_index(topo, node);
+    if (!obj)
+        return;
+
+    if (hwloc_set_cpubind(topo, obj->cpuset, HWLOC_CPUBIND_THREAD))
+        ptl_info("cannot bind thread to node %d (errno=%d)\n", node, errno);
+#endif
+}
+
 #ifndef IS_PPE
 /* can return */
 int PtlHandleIsEqual(ptl_handle_any_t handle1, ptl_handle_any_t handle2)
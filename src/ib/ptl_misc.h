@@ -3,6 +3,27 @@ extern int ptl_log_level;
 extern unsigned long pagesize;
 extern unsigned int linesize;
 
+/* Size of the huge pages requested by PTL_HUGE_PAGES. */
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+/* How memory asked to be on huge pages was obtained. */
+enum huge_backing {
+    HUGE_BACKING_NONE,          /* regular pages */
+    HUGE_BACKING_THP,           /* transparent huge pages, advised */
+    HUGE_BACKING_HUGETLB,       /* reserved huge pages */
+};
+
+extern const char *huge_backing_name[];
+
+void *huge_alloc(size_t size, enum huge_backing *backing_p);
+void huge_free(void *p, size_t size, enum huge_backing backing);
+const char *huge_page_dir(void);
+int huge_thp_enabled(int shmem);
+
+int numa_current_node(void);
+void numa_bind_area(void *addr, size_t len, int node);
+void numa_bind_thread(int node);
+
 #ifdef IS_PPE
 int ppe_misc_init_once(void);
 #else
@@ -41,6 +41,12 @@ static void set_limits(ni_t *ni, const ptl_ni_limits_t *desired)
         ni->limits.features = chk_param(PTL_LIM_FEATURES, desired->features);
         if (desired->features & PTL_TARGET_BIND_INACCESSIBLE)
             ni->limits.features |= PTL_TARGET_BIND_INACCESSIBLE;
+#if IS_PPE
+        /* The target side of the PPE only applies atomics under its
+         * locks. Elsewhere, 32 and 64 bit integer atomics are applied
+         * with processor atomics if PTL_COHERENT_ATOMICS is set. */
+        ni->limits.features &= ~PTL_COHERENT_ATOMICS;
+#endif
     } else {
         ni->limits.max_entries = get_param(PTL_LIM_MAX_ENTRIES);
         ni->limits.max_unexpected_headers =
@@ -65,6 +71,30 @@ static void set_limits(ni_t *ni, const ptl_ni_limits_t *desired)
     }
 }
 
+/*
+ * init_atomic_locks - allocate the locks serializing atomic operations
+ */
+static int init_atomic_locks(ni_t *ni)
+{
+    unsigned int num = get_param(PTL_ATOMIC_LOCKS);
+    unsigned int i;
+
+    /* Round up to a power of 2 so a cache line number can be masked. */
+    while (num & (num - 1))
+        num += num & -num;
+
+    ni->atomic_locks = malloc(num * sizeof(pthread_rwlock_t));
+    if (!ni->atomic_locks)
+        return PTL_NO_SPACE;
+
+    for (i = 0; i < num; i++)
+        pthread_rwlock_init(&ni->atomic_locks[i], NULL);
+
+    ni->num_atomic_locks = num;
+
+    return PTL_OK;
+}
+
 /*
  * init_pools - initialize resource pools for NI
  */
@@ -146,7 +176,9 @@ static int init_pools(ni_t *ni)
     ni->buf_pool.init = buf_init;
     ni->buf_pool.fini = buf_fini;
     ni->buf_pool.cleanup = buf_cleanup;
-    ni->buf_pool.slab_size = 128 * 1024;
+    ni->buf_pool.huge_pages = get_param(PTL_HUGE_PAGES);
+    ni->buf_pool.slab_size =
+        ni->buf_pool.huge_pages ? HUGE_PAGE_SIZE : 128 * 1024;
 
     err =
         pool_init(gbl, &ni->buf_pool, "buf", real_buf_t_size(), POOL_BUF,
@@ -156,6 +188,22 @@ static int init_pools(ni_t *ni)
         return err;
     }
 
+    /* Small bufs, for ACKs and triggered operations. They are IB
+     * registered like the large ones, so have the same type. */
+    ni->small_buf_pool.setup = buf_setup;
+    ni->small_buf_pool.init = buf_init;
+    ni->small_buf_pool.fini = buf_fini;
+    ni->small_buf_pool.cleanup = buf_cleanup;
+    ni->small_buf_pool.slab_size = 64 * 1024;
+
+    err =
+        pool_init(gbl, &ni->small_buf_pool, "small_buf", small_buf_t_size(),
+                  POOL_BUF, (obj_t *)ni);
+    if (err) {
+        WARN();
+        return err;
+    }
+
     ni->conn_pool.init = conn_init;
     ni->conn_pool.fini = conn_fini;
     err =
@@ -317,6 +365,7 @@ int _PtlNIInit(gbl_t *gbl, ptl_interface_t iface_id, unsigned int options,
     ni->cleanup_state = NI_INIT_CLEANUP;
     INIT_LIST_HEAD(&ni->md_list);
     INIT_LIST_HEAD(&ni->ct_list);
+    INIT_LIST_HEAD(&ni->trig_ready_list);
 #if WITH_TRANSPORT_UDP
     PTL_FASTLOCK_INIT(&ni->udp_lock);
     INIT_LIST_HEAD(&ni->udp_list);
@@ -330,11 +379,13 @@ int _PtlNIInit(gbl_t *gbl, ptl_interface_t iface_id, unsigned int options,
 #endif
     PTL_FASTLOCK_INIT(&ni->md_list_lock);
     PTL_FASTLOCK_INIT(&ni->ct_list_lock);
-    pthread_mutex_init(&ni->atomic_mutex, NULL);
+    PTL_FASTLOCK_INIT(&ni->trig_ready_lock);
+    ni->trig_ready_busy = 0;
+    ni->atomic_locks = NULL;
+    ni->num_atomic_locks = 0;
     pthread_mutex_init(&ni->pt_mutex, NULL);
 
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
-    PTL_FASTLOCK_INIT(&ni->shmem.noknem_lock);
     INIT_LIST_HEAD(&ni->shmem.noknem_list);
 #endif
 
@@ -346,6 +397,15 @@ int _PtlNIInit(gbl_t *gbl, ptl_interface_t iface_id, unsigned int options,
     mr_init(ni);
 #endif
 
+    err = init_atomic_locks(ni);
+    if (unlikely(err))
+        goto err3;
+
+    /* Bind the NI to the NUMA node of the thread creating it. */
+    ni->numa_node = get_param(PTL_NUMA_BIND) ? numa_current_node() : -1;
+    if (ni->numa_node >= 0)
+        ptl_info("NI memory is bound to NUMA node %d\n", ni->numa_node);
+
     err = init_pools(ni);
     if (unlikely(err))
         goto err3;
@@ -584,6 +644,8 @@ static void interrupt_cts(ni_t *ni)
     list_for_each(l, &ni->ct_list) {
         ct = list_entry(l, ct_t, list);
         ct->info.interrupt = 1;
+        __sync_synchronize();
+        ct_wake(ct);
     }
     PTL_FASTLOCK_UNLOCK(&ni->ct_list_lock);
 }
@@ -622,6 +684,7 @@ static void ni_cleanup(ni_t *ni)
     destroy_conns(ni);
 
     interrupt_cts(ni);
+    ct_trig_ready_fini(ni);
     cleanup_mr_trees(ni);
 
     if (transports.local.NIFini)
@@ -645,6 +708,7 @@ static void ni_cleanup(ni_t *ni)
     }
 
     pool_fini(&ni->conn_pool);
+    pool_fini(&ni->small_buf_pool);
     pool_fini(&ni->buf_pool);
     pool_fini(&ni->xt_pool);
     pool_fini(&ni->ct_pool);
@@ -655,14 +719,33 @@ static void ni_cleanup(ni_t *ni)
     pool_fini(&ni->mr_pool);
 
     if (ni->pt) {
+        int i;
+
+        for (i = 0; i <= ni->limits.max_pt_index; i++) {
+            match_index_fini(&ni->pt[i].priority_index);
+            match_index_fini(&ni->pt[i].overflow_index);
+            unexpected_index_fini(&ni->pt[i].unexpected_index);
+            match_shadow_fini(&ni->pt[i].priority_shadow);
+            match_shadow_fini(&ni->pt[i].overflow_shadow);
+        }
+
         free(ni->pt);
         ni->pt = NULL;
     }
 
-    pthread_mutex_destroy(&ni->atomic_mutex);
+    if (ni->atomic_locks) {
+        unsigned int i;
+
+        for (i = 0; i < ni->num_atomic_locks; i++)
+            pthread_rwlock_destroy(&ni->atomic_locks[i]);
+
+        free(ni->atomic_locks);
+        ni->atomic_locks = NULL;
+    }
     pthread_mutex_destroy(&ni->pt_mutex);
     PTL_FASTLOCK_DESTROY(&ni->md_list_lock);
     PTL_FASTLOCK_DESTROY(&ni->ct_list_lock);
+    PTL_FASTLOCK_DESTROY(&ni->trig_ready_lock);
     PTL_FASTLOCK_DESTROY(&ni->mr_self.tree_lock);
     PTL_FASTLOCK_DESTROY(&ni->mr_app.tree_lock);
 #if WITH_TRANSPORT_UDP
@@ -725,6 +808,53 @@ int _PtlNIFini(gbl_t *gbl, ptl_handle_ni_t ni_handle)
     return err;
 }
 
+/**
+ * @brief Add up the magazine hits or misses of the pools of an NI.
+ *
+ * @param[in] ni the network interface
+ * @param[in] stat PTL_STAT_OBJ_MAGAZINE_HITS or PTL_STAT_OBJ_MAGAZINE_MISSES
+ *
+ * @return the count
+ */
+static ptl_sr_value_t ni_mag_stats(ni_t *ni, ptl_stat_index_t stat)
+{
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+
+    pool_mag_stats(&ni->mr_pool, &hits, &misses);
+    pool_mag_stats(&ni->md_pool, &hits, &misses);
+    pool_mag_stats(&ni->me_pool, &hits, &misses);
+    pool_mag_stats(&ni->le_pool, &hits, &misses);
+    pool_mag_stats(&ni->eq_pool, &hits, &misses);
+    pool_mag_stats(&ni->ct_pool, &hits, &misses);
+    pool_mag_stats(&ni->xt_pool, &hits, &misses);
+    pool_mag_stats(&ni->buf_pool, &hits, &misses);
+    pool_mag_stats(&ni->small_buf_pool, &hits, &misses);
+    pool_mag_stats(&ni->conn_pool, &hits, &misses);
+
+    return (stat == PTL_STAT_OBJ_MAGAZINE_HITS) ? hits : misses;
+}
+
+/**
+ * @brief Add up the memory held by the pools of an NI.
+ *
+ * @param[in] ni the network interface
+ *
+ * @return the memory in kilobytes
+ */
+static ptl_sr_value_t ni_pool_memory(ni_t *ni)
+{
+    unsigned long size;
+
+    size = ni->mr_pool.mem_size + ni->md_pool.mem_size +
+        ni->me_pool.mem_size + ni->le_pool.mem_size +
+        ni->eq_pool.mem_size + ni->ct_pool.mem_size +
+        ni->xt_pool.mem_size + ni->buf_pool.mem_size +
+        ni->small_buf_pool.mem_size + ni->conn_pool.mem_size;
+
+    return size / 1024;
+}
+
 int _PtlNIStatus(PPEGBL ptl_handle_ni_t ni_handle, ptl_sr_index_t index,
                  ptl_sr_value_t *status)
 {
@@ -760,6 +890,85 @@ int _PtlNIStatus(PPEGBL ptl_handle_ni_t ni_handle, ptl_sr_index_t index,
     return err;
 }
 
+int _PtlNIGetStat(PPEGBL ptl_handle_ni_t ni_handle, ptl_stat_index_t stat,
+                  ptl_sr_value_t *value)
+{
+    int err;
+    ni_t *ni;
+
+    err = gbl_get();
+    if (unlikely(err))
+        return err;
+
+    if (unlikely(stat >= PTL_STAT_LAST)) {
+        err = PTL_ARG_INVALID;
+        goto err1;
+    }
+
+    err = to_ni(MYGBL_ ni_handle, &ni);
+    if (unlikely(err))
+        goto err1;
+
+    if (!ni) {
+        err = PTL_ARG_INVALID;
+        goto err1;
+    }
+
+    if (stat == PTL_STAT_OBJ_MAGAZINE_HITS ||
+        stat == PTL_STAT_OBJ_MAGAZINE_MISSES)
+        *value = ni_mag_stats(ni, stat);
+    else if (stat == PTL_STAT_POOL_MEMORY)
+        *value = ni_pool_memory(ni);
+    else
+        *value = ni->stats[stat];
+
+    ni_put(ni);
+    gbl_put();
+    return PTL_OK;
+
+  err1:
+    gbl_put();
+    return err;
+}
+
+int _PtlNIReclaim(PPEGBL ptl_handle_ni_t ni_handle)
+{
+    int err;
+    ni_t *ni;
+
+    err = gbl_get();
+    if (unlikely(err))
+        return err;
+
+    err = to_ni(MYGBL_ ni_handle, &ni);
+    if (unlikely(err))
+        goto err1;
+
+    if (!ni) {
+        err = PTL_ARG_INVALID;
+        goto err1;
+    }
+
+    pool_reclaim(&ni->mr_pool);
+    pool_reclaim(&ni->md_pool);
+    pool_reclaim(&ni->me_pool);
+    pool_reclaim(&ni->le_pool);
+    pool_reclaim(&ni->eq_pool);
+    pool_reclaim(&ni->ct_pool);
+    pool_reclaim(&ni->xt_pool);
+    pool_reclaim(&ni->buf_pool);
+    pool_reclaim(&ni->small_buf_pool);
+    pool_reclaim(&ni->conn_pool);
+
+    ni_put(ni);
+    gbl_put();
+    return PTL_OK;
+
+  err1:
+    gbl_put();
+    return err;
+}
+
 int _PtlNIHandle(PPEGBL ptl_handle_any_t handle, ptl_handle_ni_t *ni_handle)
 {
     obj_t *obj;
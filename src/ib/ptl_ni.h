@@ -30,12 +30,63 @@ struct shmem_pid_table {
 
     /* Set to 1 when id is valid. */
     int valid;
+
+    /* Process ID, and address of the rank's own copy of id, used to
+     * check that the other ranks can access its memory. */
+    pid_t os_pid;
+    void *cma_addr;
+
+    /* Set to 1 once the rank has found it can read and write the
+     * memory of all the local ranks with process_vm_readv/writev. */
+    int cma;
 };
 
 struct shmem_bounce_head {
-    union counted_ptr free_list;    /* head of free list of bounce buffers */
     void *head_index0;          /* logical address of the head of local index
                                  * 0. Invariant. */
+    union counted_ptr free_list[0]; /* heads of free lists of bounce
+                                     * buffers, one per local rank with
+                                     * PTL_NUMA_BIND, else one */
+};
+
+/* Number of bufs taken from the shmem ring at once. */
+#define SHMEM_RING_BATCH 16
+
+/* Singly linked list of bufs, through obj.next. */
+struct shmem_deferred {
+    struct obj *head;
+    struct obj *tail;
+};
+
+/* Receive slot of the eager protocol, in the comm pad of the target.
+ * The message follows the slot header, unless it is too large, in
+ * which case the slot holds the offset of its buf. */
+struct shmem_eager_slot {
+    volatile unsigned long seq; /* message number + 1, once filled */
+    unsigned int length;        /* inline message length, or 0 */
+    unsigned int reserved;
+    unsigned long off;          /* offset of the buf when length is 0 */
+    unsigned char data[0];
+};
+
+/* Eager channel from one local rank to another, in the comm pad of
+ * the target. The slots follow. */
+struct shmem_eager {
+    /* Credits. Number of slots consumed by the target, published once
+     * per batch. */
+    volatile unsigned long consumed;
+    uint8_t pad[CACHELINE_WIDTH - sizeof(unsigned long)];
+};
+
+/* Sender side of an eager channel, local to the sender. */
+struct shmem_eager_tx {
+    PTL_FASTLOCK_TYPE lock;
+    unsigned long produced;     /* messages sent */
+    unsigned long consumed;     /* last credits read from the target */
+
+    /* Bufs waiting for a free slot, in the order they were sent. */
+    struct obj *deferred_head;
+    struct obj *deferred_tail;
 };
 
 struct udp_bounce_head {
@@ -70,6 +121,15 @@ typedef struct ni {
 
     ptl_sr_value_t status[PTL_SR_LAST];
 
+    /* Internal statistics, see portals4_stats.h. Some are computed
+     * when read instead. */
+    ptl_sr_value_t stats[PTL_STAT_LAST];
+
+    /* Threads blocked in PtlCTPoll and PtlEQPoll on the counting events
+     * and event queues of the NI. */
+    struct waitq ct_poll;
+    struct waitq eq_poll;
+
     ptl_size_t num_recv_pkts;
     ptl_size_t num_recv_bytes;
     ptl_size_t num_recv_errs;
@@ -77,8 +137,16 @@ typedef struct ni {
 
     int shutting_down;
 
-    /* Serialize atomic operations on this NI. */
-    pthread_mutex_t atomic_mutex;
+    /* NUMA node the memory of the NI and its progress thread are bound
+     * to, or -1. */
+    int numa_node;
+
+    /* Serialize atomic operations on overlapping bytes. Each lock
+     * covers the cache lines of ME memory whose address hashes to it.
+     * Single element operations done with processor atomics share
+     * them; the others hold them exclusively. */
+    pthread_rwlock_t *atomic_locks;
+    unsigned int num_atomic_locks;
 
     pt_t *pt;
     pthread_mutex_t pt_mutex;
@@ -90,6 +158,12 @@ typedef struct ni {
     struct list_head ct_list;
     PTL_FASTLOCK_TYPE ct_list_lock;
 
+    /* Triggered operations whose threshold was reached, in firing
+     * order, and whether a thread is running them. */
+    struct list_head trig_ready_list;
+    PTL_FASTLOCK_TYPE trig_ready_lock;
+    int trig_ready_busy;
+
     /* The PPE must have a tree indexed on the application addresses,
      * and one tree for its own addresses. The other implementations
      * don't need that distinction. */
@@ -153,7 +227,39 @@ typedef struct ni {
         int knem_fd;
         struct queue *queue;    /* own queue, in the comm pad */
         void *first_queue;      /* addr of rank 0 queue, in the comm pad */
+
+        /* With PTL_SHMEM_RING, each rank receives on a bounded ring
+         * that follows its queue, instead of the queue. */
+        struct ring *ring;      /* own ring, in the comm pad, or NULL */
+        unsigned int ring_slots;
+
+        /* Bufs dequeued from the ring in one batch and not yet
+         * returned by shmem_dequeue(). */
+        struct buf *batch[SHMEM_RING_BATCH];
+        int batch_next;
+        int batch_count;
+
+        /* Bufs waiting for room in the full ring of a rank, one list
+         * per local rank, in the order they were sent. */
+        struct shmem_deferred *deferred;
+        int num_deferred;
+        PTL_FASTLOCK_TYPE deferred_lock;
+
+        /* With PTL_SHMEM_EAGER, messages to a local rank go through a
+         * channel of receive slots in its comm pad, one channel per
+         * sender. Small messages are copied into the slots. */
+        unsigned int eager_slots;       /* slots per channel, or 0 */
+        unsigned int eager_slot_size;
+        unsigned int eager_max_length;  /* largest inline message */
+        unsigned int eager_batch;       /* credits returned at once */
+        size_t eager_chan_size;
+        size_t eager_offset;    /* from the start of the queue of a rank */
+        struct shmem_eager_tx *eager_tx;        /* one per target */
+        unsigned long *eager_rx;        /* consumed slots, one per sender */
+        atomic_t eager_num_deferred;
+
         char *comm_pad_shm_name;
+        char *comm_pad_huge_path;       /* file in hugetlbfs, or NULL */
 
 #if !USE_KNEM
         /* Bounce buffers used when KNEM is not available. They are
@@ -162,11 +268,15 @@ typedef struct ni {
             struct shmem_bounce_head *head;
             void *bbs;          /* local address of the bounce buffers */
 
-            size_t buf_size;
+            size_t buf_size;    /* num_chunks chunks of chunk_size */
             unsigned int num_bufs;
+            unsigned int num_lists;
+            unsigned int chunk_size;
+            unsigned int num_chunks;
         } bounce_buf;
 
-        PTL_FASTLOCK_TYPE noknem_lock;
+        /* Target bufs of the noknem transfers in progress. Only
+         * used by the progress thread. */
         struct list_head noknem_list;
 #endif
     } shmem;
@@ -240,6 +350,7 @@ typedef struct ni {
     pool_t ct_pool;
     pool_t xt_pool;
     pool_t buf_pool;
+    pool_t small_buf_pool;
     pool_t sbuf_pool;
     pool_t conn_pool;
 
@@ -4,8 +4,18 @@
 
 #include "ptl_loc.h"
 
-/* Maximum number of stored objects ever. */
-#define MAX_INDEX	(256*1024)
+/* Maximum number of objects at any time. */
+#define MAX_INDEX	(1 << HANDLE_INDEX_BITS)
+
+/*
+ * Free indexes are kept on a lock free stack, linked through their
+ * index map entries. gbl->index_free holds the top index + 1 in its low
+ * 32 bits, and a count of the pops in its high 32 bits so that a pop
+ * racing with a pop and push of the same index fails its CAS. Indexes
+ * never used before come from gbl->next_index.
+ */
+#define INDEX_FREE_TOP(head)	((unsigned int)(head))
+#define INDEX_FREE_TAG		(1ULL << 32)
 
 /**
  * initialize indexing service
@@ -14,11 +24,12 @@
  */
 int index_init(gbl_t *gbl)
 {
-    gbl->index_map = calloc(MAX_INDEX, sizeof(void *));
+    gbl->index_map = calloc(INDEX_NUM_SEGMENTS, sizeof(*gbl->index_map));
     if (!gbl->index_map)
         return PTL_NO_SPACE;
 
     atomic_set(&gbl->next_index, 0);
+    gbl->index_free = 0;
 
     return PTL_OK;
 }
@@ -28,35 +39,121 @@ int index_init(gbl_t *gbl)
  */
 void index_fini(gbl_t *gbl)
 {
+    int i;
+
+    for (i = 0; i < INDEX_NUM_SEGMENTS; i++)
+        free(gbl->index_map[i]);
     free(gbl->index_map);
 }
 
+/**
+ * Make sure the segment of the index map holding an index exists.
+ *
+ * @param index the index
+ *
+ * @return status
+ */
+static int index_segment_get(gbl_t *gbl, unsigned int index)
+{
+    struct index_entry **segment_p =
+        &gbl->index_map[index >> INDEX_SEGMENT_BITS];
+    struct index_entry *segment;
+
+    if (likely(*segment_p != NULL))
+        return PTL_OK;
+
+    segment = calloc(INDEX_SEGMENT_SIZE, sizeof(*segment));
+    if (!segment)
+        return PTL_NO_SPACE;
+
+    /* another thread may have installed it meanwhile */
+    if (!__sync_bool_compare_and_swap(segment_p, NULL, segment))
+        free(segment);
+
+    return PTL_OK;
+}
+
 /**
  * Get index for object and save address.
  *
+ * A freed index is reused first.
+ *
  * @param obj
  * @param index_p
+ * @param gen_p address of the generation of the index
  *
  * @output status
  */
-static inline int index_get(gbl_t *gbl, obj_t *obj, unsigned int *index_p)
+static inline int index_get(gbl_t *gbl, obj_t *obj, unsigned int *index_p,
+                            unsigned int *gen_p)
 {
+    struct index_entry *entry;
+    uint64_t head = gbl->index_free;
     unsigned int index;
 
+    while (INDEX_FREE_TOP(head)) {
+        uint64_t newhead;
+
+        index = INDEX_FREE_TOP(head) - 1;
+        entry = index_entry(gbl->index_map, index);
+
+        newhead = ((head & ~0xffffffffULL) + INDEX_FREE_TAG) | entry->next;
+        if (__sync_bool_compare_and_swap(&gbl->index_free, head, newhead))
+            goto found;
+
+        head = gbl->index_free;
+    }
+
     index = atomic_inc(&gbl->next_index);
 
     if (index >= MAX_INDEX) {
+        atomic_dec(&gbl->next_index);
         ptl_warn("Index > MAX Index, index was: %i \n", index);
         return PTL_FAIL;
     }
 
-    gbl->index_map[index] = obj;
+    if (index_segment_get(gbl, index)) {
+        /* The index is lost, but so is the memory. */
+        WARN();
+        return PTL_NO_SPACE;
+    }
+
+    entry = index_entry(gbl->index_map, index);
+
+  found:
+    entry->obj = obj;
 
     *index_p = index;
+    *gen_p = entry->gen;
 
     return PTL_OK;
 }
 
+/**
+ * Give back the index of an object being destroyed.
+ *
+ * Handles carrying the index are stale from now on: the generation is
+ * changed so that they do not match the next object to use it.
+ *
+ * @param index the index
+ */
+void index_put(gbl_t *gbl, unsigned int index)
+{
+    struct index_entry *entry = index_entry(gbl->index_map, index);
+    uint64_t head;
+
+    entry->obj = NULL;
+    entry->gen = (entry->gen + 1) & HANDLE_GEN_MASK;
+
+    do {
+        head = gbl->index_free;
+        entry->next = INDEX_FREE_TOP(head);
+        __sync_synchronize();
+    } while (!__sync_bool_compare_and_swap(&gbl->index_free, head,
+                                           (head & ~0xffffffffULL) |
+                                           (index + 1)));
+}
+
 /**
  * Convert index to object.
  *
@@ -66,59 +163,101 @@ static inline int index_get(gbl_t *gbl, obj_t *obj, unsigned int *index_p)
  */
 static inline int index_lookup(gbl_t *gbl, unsigned int index, obj_t **obj_p)
 {
+    const struct index_entry *segment;
+    obj_t *obj;
+
     if (index >= MAX_INDEX) {
         WARN();
         return PTL_FAIL;
     }
 
-    if (gbl->index_map[index]) {
-        *obj_p = gbl->index_map[index];
+    segment = gbl->index_map[index >> INDEX_SEGMENT_BITS];
+    if (!segment)
+        return PTL_FAIL;
+
+    obj = segment[index & (INDEX_SEGMENT_SIZE - 1)].obj;
+    if (obj) {
+        *obj_p = obj;
         return PTL_OK;
     } else {
         return PTL_FAIL;
     }
 }
 
-#define HANDLE_SHIFT ((sizeof(ptl_handle_any_t)*8)-8)
-
 /**
  * Return a new zero filled slab.
  *
  * The slab will be used by caller to hold a new
  * batch of objects. Normal behavior is to allocate
- * page aligned memory. In the special case that
+ * page aligned memory, or memory on huge pages if the
+ * pool asks for it. In the special case that
  * we are creating objects in shared memory the pool
  * has a pre allocated chunk of shared memory that is
  * used instead.
  *
  * @param pool the pool for which slab is created.
+ * @param info the slab_info of the slab
  *
  * @return address of slab or null if unable to allocate memory
  */
-static void *pool_get_slab(pool_t *pool)
+static void *pool_get_slab(pool_t *pool, slab_info_t *info)
 {
     int err;
     void *slab;
+    enum huge_backing backing;
 
     if (pool->use_pre_alloc_buffer) {
         slab = pool->pre_alloc_buffer;
         pool->pre_alloc_buffer = NULL;
+    } else if (pool->huge_pages) {
+        slab = huge_alloc(pool->slab_size, &backing);
+        if (slab) {
+            /* Report the backing of the first slab, and of any slab
+             * that gets a different one. */
+            if (!pool->mem_size || backing != info->backing)
+                ptl_info("%s pool slabs of %d bytes use %s\n", pool->name,
+                         pool->slab_size, huge_backing_name[backing]);
+            info->backing = backing;
+        }
     } else {
         err = posix_memalign(&slab, pagesize, pool->slab_size);
         if (unlikely(err))
             slab = NULL;
     }
 
+    /* Place the slab before touching it. */
+    if (slab && !pool->use_pre_alloc_buffer && pool->parent &&
+        pool->parent->obj_ni->numa_node >= 0)
+        numa_bind_area(slab, pool->slab_size,
+                       pool->parent->obj_ni->numa_node);
+
     if (slab)
         memset(slab, 0, pool->slab_size);
 
     return slab;
 }
 
+/**
+ * Free the memory of a slab.
+ *
+ * @param pool the pool of the slab
+ * @param info the slab_info of the slab
+ */
+static void pool_put_slab(pool_t *pool, slab_info_t *info)
+{
+    if (pool->use_pre_alloc_buffer)
+        return;
+
+    if (pool->huge_pages)
+        huge_free(info->addr, pool->slab_size, info->backing);
+    else
+        free(info->addr);
+}
+
 /**
  * get chunk hold new slab.
- * note that we currently never free objects so there are
- * never any holes in chunk->slab_list
+ * the holes left by reclaimed slabs are used first, see
+ * pool_find_hole()
  *
  * @pre caller should hold pool->mutex
  *
@@ -158,6 +297,31 @@ static int pool_get_chunk(pool_t *pool, chunk_t **chunk_p)
     return PTL_OK;
 }
 
+/**
+ * Find the slab_list entry of a reclaimed slab.
+ *
+ * @pre caller should hold pool->mutex and pool->num_holes is not 0
+ *
+ * @param pool the pool
+ *
+ * @return the entry
+ */
+static slab_info_t *pool_find_hole(pool_t *pool)
+{
+    chunk_t *chunk;
+    unsigned int i;
+
+    list_for_each_entry(chunk, &pool->chunk_list, list) {
+        for (i = 0; i < chunk->num_slabs; i++) {
+            if (!chunk->slab_list[i].addr)
+                return &chunk->slab_list[i];
+        }
+    }
+
+    abort();
+    return NULL;
+}
+
 /**
  * Allocate a new slab of objects for a given pool
  *
@@ -176,15 +340,27 @@ static int pool_alloc_slab(pool_t *pool)
     struct list_head temp_list;
     slab_info_t *slab;
 
-    err = pool_get_chunk(pool, &chunk);
-    if (unlikely(err))
-        return err;
+    if (pool->max_size &&
+        pool->mem_size + pool->slab_size > pool->max_size) {
+        ptl_info("%s pool reached its size limit of %lu bytes\n",
+                 pool->name, pool->max_size);
+        return PTL_NO_SPACE;
+    }
+
+    if (pool->num_holes) {
+        slab = pool_find_hole(pool);
+    } else {
+        err = pool_get_chunk(pool, &chunk);
+        if (unlikely(err))
+            return err;
 
-    p = pool_get_slab(pool);
+        slab = &chunk->slab_list[chunk->num_slabs];
+    }
+
+    p = pool_get_slab(pool, slab);
     if (unlikely(!p))
         return PTL_NO_SPACE;
 
-    slab = &chunk->slab_list[chunk->num_slabs];
     slab->addr = p;
 
 #if WITH_TRANSPORT_IB
@@ -197,7 +373,8 @@ static int pool_alloc_slab(pool_t *pool)
                         IBV_ACCESS_LOCAL_WRITE);
         if (!mr) {
             WARN();
-            free(p);
+            pool_put_slab(pool, slab);
+            slab->addr = NULL;
             return PTL_FAIL;
         }
         slab->mr = mr;
@@ -208,6 +385,7 @@ static int pool_alloc_slab(pool_t *pool)
 
     for (i = 0; i < pool->obj_per_slab; i++) {
         unsigned int index;
+        unsigned int gen;
 
         obj = (obj_t *)p;
         obj->obj_free = 1;
@@ -216,13 +394,14 @@ static int pool_alloc_slab(pool_t *pool)
         obj->obj_parent = pool->parent;
         obj->obj_ni = (pool->parent) ? pool->parent->obj_ni : (ni_t *)obj;
 
-        err = index_get(pool->gbl, obj, &index);
+        err = index_get(pool->gbl, obj, &index, &gen);
         if (err) {
             WARN();
             //todo: leak
             return err;
         }
-        obj->obj_handle = ((uint64_t) (pool->type) << HANDLE_SHIFT) | index;
+        obj->obj_handle = ((uint64_t) (pool->type) << HANDLE_SHIFT) |
+            (gen << HANDLE_INDEX_BITS) | index;
 
         if (pool->init) {
             err = pool->init(obj, mr);
@@ -236,11 +415,514 @@ static int pool_alloc_slab(pool_t *pool)
         p += pool->round_size;
     }
 
-    chunk->num_slabs++;
+    if (chunk)
+        chunk->num_slabs++;
+    else
+        pool->num_holes--;
+
+    pool->mem_size += pool->slab_size;
 
     return PTL_OK;
 }
 
+/**
+ * Take an object from the free list of a pool.
+ *
+ * pool_reclaim() waits for the dequeuers count to drop to zero before
+ * freeing slabs, since a thread in ll_dequeue_obj() may still read the
+ * next pointer of an object it saw at the head of the list. Pools in a
+ * pre-allocated buffer are never reclaimed and skip the count.
+ *
+ * @param pool the pool
+ *
+ * @return the object, or NULL if the list is empty
+ */
+static inline obj_t *pool_dequeue(pool_t *pool)
+{
+    obj_t *obj;
+
+    if (pool->use_pre_alloc_buffer)
+        return ll_dequeue_obj(&pool->free_list);
+
+    atomic_inc(&pool->dequeuers);
+    obj = ll_dequeue_obj(&pool->free_list);
+    atomic_dec(&pool->dequeuers);
+
+    return obj;
+}
+
+/* Maximum number of threads with magazines. Other threads use the
+ * pool free lists directly. */
+#define MAG_MAX_THREADS	(64)
+
+/*
+ * Each thread with magazines owns a slot, which indexes pool->mags. The
+ * slot is given back when the thread exits, and the next thread to take
+ * it inherits the objects left in its magazines.
+ */
+static pthread_mutex_t mag_slot_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t mag_slot_once = PTHREAD_ONCE_INIT;
+static pthread_key_t mag_slot_key;
+static unsigned char mag_slot_used[MAG_MAX_THREADS];
+
+/* slot + 1 of this thread, 0 if not assigned yet, -1 if none was left */
+static __thread int mag_slot;
+
+static void mag_slot_release(void *arg)
+{
+    int slot = (int)(uintptr_t) arg - 1;
+
+    pthread_mutex_lock(&mag_slot_mutex);
+    mag_slot_used[slot] = 0;
+    pthread_mutex_unlock(&mag_slot_mutex);
+}
+
+static void mag_slot_key_create(void)
+{
+    pthread_key_create(&mag_slot_key, mag_slot_release);
+}
+
+/**
+ * Return the magazine slot of the calling thread.
+ *
+ * @return the slot, or -1 if the thread has none
+ */
+static int mag_slot_get(void)
+{
+    int slot;
+
+    if (likely(mag_slot > 0))
+        return mag_slot - 1;
+
+    if (mag_slot < 0)
+        return -1;
+
+    pthread_once(&mag_slot_once, mag_slot_key_create);
+
+    pthread_mutex_lock(&mag_slot_mutex);
+    for (slot = 0; slot < MAG_MAX_THREADS; slot++) {
+        if (!mag_slot_used[slot]) {
+            mag_slot_used[slot] = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mag_slot_mutex);
+
+    if (slot == MAG_MAX_THREADS) {
+        mag_slot = -1;
+        return -1;
+    }
+
+    pthread_setspecific(mag_slot_key, (void *)(uintptr_t) (slot + 1));
+    mag_slot = slot + 1;
+
+    return slot;
+}
+
+/**
+ * Return the calling thread's magazine for a pool.
+ *
+ * The magazine is allocated on first use.
+ *
+ * @param pool the pool, which has magazines
+ *
+ * @return the magazine, or NULL if the thread cannot have one
+ */
+static struct magazine *mag_get(pool_t *pool)
+{
+    struct magazine *mag;
+    int slot;
+
+    slot = mag_slot_get();
+    if (unlikely(slot < 0))
+        return NULL;
+
+    mag = pool->mags[slot];
+    if (unlikely(!mag)) {
+        if (posix_memalign((void **)&mag, linesize, sizeof(*mag) +
+                           pool->mag_size * sizeof(mag->objs[0])))
+            return NULL;
+
+        memset(mag, 0, sizeof(*mag));
+        pool->mags[slot] = mag;
+    }
+
+    return mag;
+}
+
+/**
+ * Move the oldest objects of a magazine to the pool free list.
+ *
+ * @param pool the pool
+ * @param mag the magazine
+ * @param num the number of objects to move
+ */
+static void mag_flush(pool_t *pool, struct magazine *mag, unsigned int num)
+{
+    unsigned int i;
+
+    for (i = 0; i < num - 1; i++)
+        mag->objs[i]->next = mag->objs[i + 1];
+
+    ll_enqueue_chain(&pool->free_list, mag->objs[0], mag->objs[num - 1]);
+
+    mag->num -= num;
+    memmove(&mag->objs[0], &mag->objs[num],
+            mag->num * sizeof(mag->objs[0]));
+}
+
+/**
+ * Take an object from a magazine.
+ *
+ * An empty magazine is refilled with half a magazine of objects from
+ * the pool free list.
+ *
+ * @param pool the pool
+ * @param mag the magazine
+ *
+ * @return the object, or NULL if the pool free list is empty too
+ */
+static obj_t *mag_alloc(pool_t *pool, struct magazine *mag)
+{
+    obj_t *obj;
+    obj_t *p;
+    int num;
+
+    if (likely(mag->num)) {
+        mag->hits++;
+        return mag->objs[--mag->num];
+    }
+
+    mag->misses++;
+
+    atomic_inc(&pool->dequeuers);
+    obj = ll_dequeue_chain(&pool->free_list, pool->mag_size / 2 + 1, &num);
+    atomic_dec(&pool->dequeuers);
+
+    for (p = obj; num > 1; num--) {
+        p = p->next;
+        mag->objs[mag->num++] = p;
+    }
+
+    return obj;
+}
+
+/**
+ * Return the number of objects allocated from a pool.
+ *
+ * The count is exact only while no thread is using the pool.
+ *
+ * @param pool the pool
+ *
+ * @return the number of objects
+ */
+int pool_count(pool_t *pool)
+{
+    int count = atomic_read(&pool->count);
+    int i;
+
+    if (pool->mags) {
+        for (i = 0; i < MAG_MAX_THREADS; i++) {
+            if (pool->mags[i])
+                count += pool->mags[i]->count;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Add up the magazine hits and misses of a pool.
+ *
+ * @param pool the pool
+ * @param hits_p address of the hits to add to
+ * @param misses_p address of the misses to add to
+ */
+void pool_mag_stats(pool_t *pool, unsigned long *hits_p,
+                    unsigned long *misses_p)
+{
+    int i;
+
+    if (!pool->mags)
+        return;
+
+    for (i = 0; i < MAG_MAX_THREADS; i++) {
+        const struct magazine *mag = pool->mags[i];
+
+        if (mag) {
+            *hits_p += mag->hits;
+            *misses_p += mag->misses;
+        }
+    }
+}
+
+/**
+ * Move the objects in the magazines of a pool to its free list.
+ *
+ * @pre no thread is using the pool
+ *
+ * @param pool the pool
+ */
+static void pool_mags_drain(pool_t *pool)
+{
+    int i;
+
+    for (i = 0; i < MAG_MAX_THREADS; i++) {
+        struct magazine *mag = pool->mags[i];
+
+        if (mag && mag->num)
+            mag_flush(pool, mag, mag->num);
+    }
+}
+
+/**
+ * Free the magazines of a pool.
+ *
+ * @param pool the pool
+ */
+static void pool_mags_free(pool_t *pool)
+{
+    int i;
+
+    for (i = 0; i < MAG_MAX_THREADS; i++)
+        free(pool->mags[i]);
+
+    free(pool->mags);
+    pool->mags = NULL;
+}
+
+static int slab_compare(const void *a, const void *b)
+{
+    const slab_info_t *slab_a = *(slab_info_t * const *)a;
+    const slab_info_t *slab_b = *(slab_info_t * const *)b;
+
+    return (slab_a->addr > slab_b->addr) - (slab_a->addr < slab_b->addr);
+}
+
+/**
+ * Find the slab holding an object.
+ *
+ * @param pool the pool
+ * @param slabs the slabs of the pool, sorted by address
+ * @param num_slabs the number of slabs
+ * @param obj the object
+ *
+ * @return the slab
+ */
+static slab_info_t *slab_lookup(pool_t *pool, slab_info_t **slabs,
+                                unsigned int num_slabs, obj_t *obj)
+{
+    unsigned int lo = 0;
+    unsigned int hi = num_slabs;
+
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        uint8_t *addr = slabs[mid]->addr;
+
+        if ((uint8_t *)obj < addr)
+            hi = mid;
+        else if ((uint8_t *)obj >= addr + pool->slab_size)
+            lo = mid + 1;
+        else
+            return slabs[mid];
+    }
+
+    /* a free object that does not belong to the pool */
+    abort();
+    return NULL;
+}
+
+/**
+ * Give the slabs of a pool that have no object in use back to the system.
+ *
+ * All the free objects are taken off the free list and counted per
+ * slab. The objects of the entirely free slabs are finalized and their
+ * indexes recycled, and the slabs are freed; the other objects go back
+ * to the free list. Objects in magazines count as in use.
+ *
+ * @pre caller should hold pool->mutex, which may be dropped and taken
+ * again
+ *
+ * @param pool the pool
+ *
+ * @return the number of bytes released
+ */
+static unsigned long pool_reclaim_locked(pool_t *pool)
+{
+    slab_info_t **slabs;
+    slab_info_t *slab;
+    chunk_t *chunk;
+    unsigned int num_slabs = 0;
+    unsigned int i;
+    obj_t *obj;
+    obj_t *next;
+    obj_t *keep = NULL;
+    obj_t *keep_last = NULL;
+    unsigned long released = 0;
+    int num;
+    int j;
+
+    if (pool->use_pre_alloc_buffer)
+        return 0;
+
+    /* Take all the free objects, then wait for the threads that may
+     * have seen one of them at the head of the list. The mutex is
+     * dropped meanwhile so that slab allocations aren't held up; the
+     * slabs are only looked at once it is taken again. */
+    obj = ll_dequeue_chain(&pool->free_list, INT_MAX, &num);
+    if (!num)
+        return 0;
+
+    if (atomic_read(&pool->dequeuers)) {
+        pthread_mutex_unlock(&pool->mutex);
+        while (atomic_read(&pool->dequeuers))
+            sched_yield();
+        pthread_mutex_lock(&pool->mutex);
+    }
+
+    list_for_each_entry(chunk, &pool->chunk_list, list)
+        num_slabs += chunk->num_slabs;
+
+    slabs = malloc(num_slabs * sizeof(*slabs));
+    if (!slabs) {
+        for (next = obj, j = 1; j < num; j++)
+            next = next->next;
+        ll_enqueue_chain(&pool->free_list, obj, next);
+        return 0;
+    }
+
+    num_slabs = 0;
+    list_for_each_entry(chunk, &pool->chunk_list, list) {
+        for (i = 0; i < chunk->num_slabs; i++) {
+            slab = &chunk->slab_list[i];
+            if (slab->addr) {
+                slab->num_free = 0;
+                slabs[num_slabs++] = slab;
+            }
+        }
+    }
+
+    qsort(slabs, num_slabs, sizeof(*slabs), slab_compare);
+
+    for (next = obj, j = 0; j < num; j++, next = next->next)
+        slab_lookup(pool, slabs, num_slabs, next)->num_free++;
+
+    for (j = 0; j < num; j++, obj = next) {
+        next = obj->next;
+
+        slab = slab_lookup(pool, slabs, num_slabs, obj);
+        if (slab->num_free == pool->obj_per_slab)
+            continue;
+
+        obj->next = keep;
+        if (!keep)
+            keep_last = obj;
+        keep = obj;
+    }
+
+    if (keep)
+        ll_enqueue_chain(&pool->free_list, keep, keep_last);
+
+    for (i = 0; i < num_slabs; i++) {
+        uint8_t *p;
+
+        slab = slabs[i];
+        if (slab->num_free != pool->obj_per_slab)
+            continue;
+
+        for (p = slab->addr, j = 0; j < pool->obj_per_slab;
+             j++, p += pool->round_size) {
+            obj = (obj_t *)p;
+
+            index_put(pool->gbl, obj_handle_to_index(obj->obj_handle));
+
+            if (pool->fini)
+                pool->fini(obj);
+        }
+
+#if WITH_TRANSPORT_IB
+        if (slab->mr) {
+            ibv_dereg_mr(slab->mr);
+            slab->mr = NULL;
+        }
+#endif
+
+        pool_put_slab(pool, slab);
+        slab->addr = NULL;
+
+        pool->num_holes++;
+        pool->mem_size -= pool->slab_size;
+        released += pool->slab_size;
+    }
+
+    free(slabs);
+
+    return released;
+}
+
+/**
+ * Give the slabs of a pool that have no object in use back to the system.
+ *
+ * @param pool the pool
+ *
+ * @return the number of bytes released
+ */
+unsigned long pool_reclaim(pool_t *pool)
+{
+    unsigned long released;
+
+    if (!pool->name)
+        return 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    released = pool_reclaim_locked(pool);
+    pool->reclaim_size = pool->mem_size;
+    pool->reclaim_used = pool_count(pool);
+    pthread_mutex_unlock(&pool->mutex);
+
+    return released;
+}
+
+/**
+ * Reclaim the free slabs of a pool above its high water mark.
+ *
+ * This is done when half of the objects are free, and again only when
+ * the pool has grown or half of the objects in use at the last pass
+ * have been released, so that a pool that is large because it is busy
+ * is not scanned over and over.
+ *
+ * @param pool the pool
+ */
+static void pool_reclaim_high_water(pool_t *pool)
+{
+    unsigned long total = pool->mem_size / pool->slab_size *
+        pool->obj_per_slab;
+    unsigned long used = pool_count(pool);
+
+    if (used > total / 2)
+        return;
+
+    if (pool->mem_size == pool->reclaim_size &&
+        used >= pool->reclaim_used / 2)
+        return;
+
+    /* Don't wait behind another pass or a slab allocation. */
+    if (pthread_mutex_trylock(&pool->mutex))
+        return;
+
+    pool_reclaim_locked(pool);
+    pool->reclaim_size = pool->mem_size;
+    pool->reclaim_used = used;
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static inline void pool_check_high_water(pool_t *pool)
+{
+    if (unlikely(pool->high_water && pool->mem_size > pool->high_water))
+        pool_reclaim_high_water(pool);
+}
+
 /**
  * Cleanup an object pool.
  *
@@ -253,6 +935,7 @@ int pool_fini(pool_t *pool)
     struct list_head *l, *t;
     obj_t *obj;
     chunk_t *chunk;
+    int count;
     int i;
     int err = PTL_OK;
 
@@ -260,6 +943,9 @@ int pool_fini(pool_t *pool)
     if (!pool->name)
         return err;
 
+    if (pool->mags)
+        pool_mags_drain(pool);
+
     /*
      * if pool has a fini routine call it on
      * each free object
@@ -270,14 +956,17 @@ int pool_fini(pool_t *pool)
         }
     }
 
-    if (atomic_read(&pool->count)) {
+    count = pool_count(pool);
+    if (count) {
         /* There's still an object allocated. Do not free the pool
          * else we open the library to memory scribble bugs. */
-        ptl_warn("leaked %d %s objects\n", atomic_read(&pool->count),
-                 pool->name);
+        ptl_warn("leaked %d %s objects\n", count, pool->name);
         return PTL_FAIL;
     }
 
+    if (pool->mags)
+        pool_mags_free(pool);
+
     pthread_mutex_destroy(&pool->mutex);
 
     /*
@@ -288,19 +977,34 @@ int pool_fini(pool_t *pool)
         chunk = list_entry(l, chunk_t, list);
 
         for (i = 0; i < chunk->num_slabs; i++) {
+            uint8_t *p = chunk->slab_list[i].addr;
+            int j;
+
+            if (!p)
+                continue;
+
+            /* recycle the indexes of the objects */
+            for (j = 0; j < pool->obj_per_slab; j++) {
+                obj = (obj_t *)p;
+                index_put(pool->gbl, obj_handle_to_index(obj->obj_handle));
+                p += pool->round_size;
+            }
+
 #if WITH_TRANSPORT_IB
             struct ibv_mr *mr = chunk->slab_list[i].mr;
             if (mr)
                 ibv_dereg_mr(mr);
 #endif
 
-            if (!pool->use_pre_alloc_buffer)
-                free(chunk->slab_list[i].addr);
+            pool_put_slab(pool, &chunk->slab_list[i]);
         }
 
         free(chunk);
     }
 
+    pool->mem_size = 0;
+    pool->name = NULL;
+
     return err;
 }
 
@@ -343,7 +1047,31 @@ int pool_init(gbl_t *gbl, pool_t *pool, char *name, int size,
         return PTL_FAIL;
     }
 
+    /* Pools in preallocated memory may be shared with other processes
+     * and cannot expand or shrink, so their objects must not sit in
+     * magazines. */
+    pool->mags = NULL;
+    pool->mag_size = get_param(PTL_OBJ_MAGAZINE_SIZE);
+    if (pool->mag_size && !pool->use_pre_alloc_buffer) {
+        pool->mags = calloc(MAG_MAX_THREADS, sizeof(*pool->mags));
+        if (!pool->mags)
+            return PTL_NO_SPACE;
+    }
+
+    pool->mem_size = 0;
+    pool->num_holes = 0;
+    pool->reclaim_size = 0;
+    pool->reclaim_used = 0;
+    if (pool->use_pre_alloc_buffer) {
+        pool->max_size = 0;
+        pool->high_water = 0;
+    } else {
+        pool->max_size = get_param(PTL_POOL_MAX_SIZE);
+        pool->high_water = get_param(PTL_POOL_HIGH_WATER_MARK);
+    }
+
     atomic_set(&pool->count, 0);
+    atomic_set(&pool->dequeuers, 0);
     ll_init(&pool->free_list);
     INIT_LIST_HEAD(&pool->chunk_list);
     pthread_mutex_init(&pool->mutex, NULL);
@@ -359,7 +1087,7 @@ int pool_init(gbl_t *gbl, pool_t *pool, char *name, int size,
 }
 
 /**
- * Release an object back to the free list.
+ * Release an object back to the thread's magazine or the free list.
  *
  * Called by obj_put when last reference to an object is dropped.
  *
@@ -369,6 +1097,7 @@ void obj_release(ref_t *ref)
 {
     obj_t *obj = container_of(ref, obj_t, obj_ref);
     pool_t *pool = obj->obj_pool;
+    struct magazine *mag;
 
     if (pool->cleanup)
         pool->cleanup(obj);
@@ -379,16 +1108,30 @@ void obj_release(ref_t *ref)
     assert(obj->obj_free == 0);
     obj->obj_free = 1;
 
+    if (pool->mags && (mag = mag_get(pool))) {
+        if (unlikely(mag->num == pool->mag_size)) {
+            mag_flush(pool, mag, (pool->mag_size + 1) / 2);
+            pool_check_high_water(pool);
+        }
+
+        mag->objs[mag->num++] = obj;
+        mag->count--;
+        return;
+    }
+
     __sync_synchronize();
 
     ll_enqueue_obj(&pool->free_list, obj);
     atomic_dec(&pool->count);
+
+    pool_check_high_water(pool);
 }
 
 /**
  * Allocate a new object.
  *
- * If the free list is empty allocate a new
+ * The object comes from the thread's magazine when the pool has
+ * magazines. If the free list is empty allocate a new
  * slab of objects first.
  *
  * @param pool pool to get object from
@@ -400,11 +1143,17 @@ int obj_alloc(pool_t *pool, obj_t **obj_p)
 {
     int err;
     obj_t *obj;
+    struct magazine *mag = NULL;
 
     /* reserve an object */
-    atomic_inc(&pool->count);
+    if (pool->mags && (mag = mag_get(pool))) {
+        mag->count++;
+        obj = mag_alloc(pool, mag);
+    } else {
+        atomic_inc(&pool->count);
+        obj = pool_dequeue(pool);
+    }
 
-    obj = ll_dequeue_obj(&pool->free_list);
     if (unlikely(!obj)) {
         if (pool->use_pre_alloc_buffer) {
             /* The pool cannot expand, for instance in the case of the
@@ -420,11 +1169,14 @@ int obj_alloc(pool_t *pool, obj_t **obj_p)
                 pthread_mutex_unlock(&pool->mutex);
 
                 if (unlikely(err)) {
-                    atomic_dec(&pool->count);
+                    if (mag)
+                        mag->count--;
+                    else
+                        atomic_dec(&pool->count);
                     WARN();
                     return err;
                 }
-            } while ((obj = ll_dequeue_obj(&pool->free_list)) == NULL);
+            } while ((obj = pool_dequeue(pool)) == NULL);
         }
     }
 
@@ -493,7 +1245,8 @@ void *to_obj(PPEGBL enum obj_type type, ptl_handle_any_t handle)
         goto err1;
     }
 
-    if (obj_handle_to_index(obj->obj_handle) != index) {
+    /* a stale handle has another generation */
+    if ((obj->obj_handle ^ handle) & ((1U << HANDLE_SHIFT) - 1)) {
         WARN();
         goto err1;
     }
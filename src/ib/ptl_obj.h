@@ -8,8 +8,10 @@
  * in pools which on demand create new objects in 'slabs'.
  *
  * Each base object has a handle assigned which can be used to lookup
- * the object. The handle includes an object type and an index into
- * an array of object pointers.
+ * the object. The handle includes an object type, an index into
+ * a map of object pointers and the generation of that index. Indexes
+ * are recycled when their object is destroyed, and the generation
+ * changes each time, so that stale handles do not find the new object.
  *
  * Each base object also has a reference count that is used to handle
  * object cleanup. When an object is allocated its ref count is set to 1.
@@ -59,11 +61,20 @@ int index_init(struct gbl *gbl);
 
 void index_fini(struct gbl *gbl);
 
+void index_put(struct gbl *gbl, unsigned int index);
+
 int pool_init(struct gbl *gbl, pool_t *pool, char *name, int size,
               enum obj_type type, obj_t *parent);
 
 int pool_fini(pool_t *pool);
 
+int pool_count(pool_t *pool);
+
+unsigned long pool_reclaim(pool_t *pool);
+
+void pool_mag_stats(pool_t *pool, unsigned long *hits_p,
+                    unsigned long *misses_p);
+
 void obj_release(ref_t *ref);
 
 int obj_alloc(pool_t *pool, obj_t **p_obj);
@@ -109,7 +120,33 @@ static inline int obj_put(obj_t *obj)
     return ref_put(&obj->obj_ref, obj_release);
 }
 
-#define HANDLE_INDEX_MASK	(0x00ffffff)
+/*
+ * A handle holds the pool type in the top 8 bits, then the generation
+ * and the index of the object.
+ */
+#define HANDLE_SHIFT		((sizeof(ptl_handle_any_t)*8)-8)
+#define HANDLE_INDEX_BITS	(18)
+#define HANDLE_INDEX_MASK	((1 << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GEN_MASK		((1 << (HANDLE_SHIFT - HANDLE_INDEX_BITS)) - 1)
+
+/* The index map is an array of segments allocated when first used. */
+#define INDEX_SEGMENT_BITS	(12)
+#define INDEX_SEGMENT_SIZE	(1 << INDEX_SEGMENT_BITS)
+#define INDEX_NUM_SEGMENTS	(1 << (HANDLE_INDEX_BITS - INDEX_SEGMENT_BITS))
+
+/**
+ * An entry of the index map.
+ */
+struct index_entry {
+        /** object using the index, or NULL if free */
+    void *obj;
+
+        /** next free index + 1, or 0, while on the free list */
+    unsigned int next;
+
+        /** generation of the index, changed when it is freed */
+    unsigned int gen;
+};
 
 /**
  * Convert a handle to an object index.
@@ -123,6 +160,18 @@ static inline unsigned int obj_handle_to_index(ptl_handle_any_t handle)
     return handle & HANDLE_INDEX_MASK;
 }
 
+/**
+ * Return the index map entry of an index.
+ *
+ * The segment holding the index must exist.
+ */
+static inline struct index_entry *index_entry(struct index_entry **index_map,
+                                              unsigned int index)
+{
+    return &index_map[index >> INDEX_SEGMENT_BITS]
+        [index & (INDEX_SEGMENT_SIZE - 1)];
+}
+
 #ifdef NO_ARG_VALIDATION
 /**
  * Faster version of to_obj without checking.
@@ -136,7 +185,8 @@ static inline unsigned int obj_handle_to_index(ptl_handle_any_t handle)
  */
 static inline void *to_obj(PPEGBL enum obj_type type, ptl_handle_any_t handle)
 {
-    obj_t *obj = (obj_t *)MYGBL->index_map[handle & HANDLE_INDEX_MASK];
+    obj_t *obj = index_entry(MYGBL->index_map,
+                             obj_handle_to_index(handle))->obj;
     atomic_inc(&obj->obj_ref.ref_cnt);
     return obj;
 }
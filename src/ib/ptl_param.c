@@ -273,12 +273,97 @@ param_t param[] = {
                              .max = 10000000,
                              .val = 8 * 4096,
                              },
+    [PTL_BOUNCE_DEPTH] = {
+                          .name = "PTL_BOUNCE_DEPTH",
+                          .min = 1,
+                          .max = 1024,
+                          .val = 4,
+                          },
     [PTL_DISABLE_MEM_REG_CACHE] = {
                                    .name = "PTL_DISABLE_MEM_REG_CACHE",
                                    .min = 0,
                                    .max = 1,
                                    .val = 0,
                                   },
+    [PTL_MATCH_INDEX_BUCKETS] = {
+                                 .name = "PTL_MATCH_INDEX_BUCKETS",
+                                 .min = 0,
+                                 .max = 1 << 20,
+                                 .val = 0,
+                                 },
+    [PTL_MATCH_SHADOW] = {
+                          .name = "PTL_MATCH_SHADOW",
+                          .min = 0,
+                          .max = 1,
+                          .val = 0,
+                          },
+    [PTL_ATOMIC_LOCKS] = {
+                          .name = "PTL_ATOMIC_LOCKS",
+                          .min = 1,
+                          .max = 1 << 16,
+                          .val = 64,
+                          },
+    [PTL_ATOMIC_VECTOR] = {
+                           .name = "PTL_ATOMIC_VECTOR",
+                           .min = 0,
+                           .max = 1,
+                           .val = 1,
+                           },
+    [PTL_OBJ_MAGAZINE_SIZE] = {
+                               .name = "PTL_OBJ_MAGAZINE_SIZE",
+                               .min = 0,
+                               .max = 1024,
+                               .val = 32,
+                               },
+    [PTL_POOL_MAX_SIZE] = {
+                           .name = "PTL_POOL_MAX_SIZE",
+                           .min = 0,
+                           .max = LONG_MAX,
+                           .val = 0,
+                           },
+    [PTL_POOL_HIGH_WATER_MARK] = {
+                                  .name = "PTL_POOL_HIGH_WATER_MARK",
+                                  .min = 0,
+                                  .max = LONG_MAX,
+                                  .val = 0,
+                                  },
+    [PTL_HUGE_PAGES] = {
+                        .name = "PTL_HUGE_PAGES",
+                        .min = 0,
+                        .max = 1,
+                        .val = 0,
+                        },
+    [PTL_NUMA_BIND] = {
+                       .name = "PTL_NUMA_BIND",
+                       .min = 0,
+                       .max = 1,
+                       .val = 0,
+                       },
+    [PTL_SHMEM_CMA] = {
+                       .name = "PTL_SHMEM_CMA",
+                       .min = 0,
+                       .max = 1,
+                       .val = 1,
+                       },
+    [PTL_SHMEM_RING] = {
+                        .name = "PTL_SHMEM_RING",
+                        .min = 0,
+                        .max = 65536,
+                        .val = 0,
+                        },
+    [PTL_SHMEM_EAGER] = {
+                         .name = "PTL_SHMEM_EAGER",
+                         .min = 0,
+                         .max = 4096,
+                         .val = 128,
+                         },
+    [PTL_SHMEM_EAGER_SIZE] = {
+                              .name = "PTL_SHMEM_EAGER_SIZE",
+                              .min = 64,
+                              .max = sizeof(struct shmem_eager_slot) +
+                              BUF_DATA_SIZE,
+                              .val = 256,
+                              },
 };
 
 /**
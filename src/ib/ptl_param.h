@@ -53,7 +53,21 @@ enum {
     PTL_ENABLE_MEM,
     PTL_BOUNCE_NUM_BUFS,
     PTL_BOUNCE_BUF_SIZE,
+    PTL_BOUNCE_DEPTH,
     PTL_DISABLE_MEM_REG_CACHE,
+    PTL_MATCH_INDEX_BUCKETS,
+    PTL_MATCH_SHADOW,
+    PTL_ATOMIC_LOCKS,
+    PTL_ATOMIC_VECTOR,
+    PTL_OBJ_MAGAZINE_SIZE,
+    PTL_POOL_MAX_SIZE,
+    PTL_POOL_HIGH_WATER_MARK,
+    PTL_HUGE_PAGES,
+    PTL_NUMA_BIND,
+    PTL_SHMEM_CMA,
+    PTL_SHMEM_RING,
+    PTL_SHMEM_EAGER,
+    PTL_SHMEM_EAGER_SIZE,
     PTL_PARAM_LAST,             /* keep me last */
 };
 
@@ -11,15 +11,21 @@
  * Slabs are maintained in 'chunks' which are page sized arrays of
  * slab_info structs.
  *
- * And chunks are maintained in circular lists within pools. The
- * current design is very simple and only allows the object resources
- * in a pool to grow. Additional work would allow this design to
- * dynamically grow and shrink the amount of memory used in a given
- * pool.
+ * And chunks are maintained in circular lists within pools. A pool
+ * grows a slab at a time, up to an optional size limit. A reclaim pass
+ * counts the free objects of each slab and gives the slabs that are
+ * entirely free back to the system, leaving holes in the chunks that
+ * later slabs fill. It runs when asked to, and when a pool above its
+ * high water mark has at least half of its objects free.
  *
  * Pools are designed to allow an object to 'own' pools of other objects
  * in a heirarchy. All objects eventually belong to an NI which is the
  * root of Portals4 resources.
+ *
+ * Each thread has a magazine of free objects in front of the pool free
+ * list, so that most allocations and releases do not touch the shared
+ * list head. A magazine refills from and flushes to the free list half
+ * a magazine at a time.
  */
 
 #ifndef PTL_POOL_H
@@ -54,9 +60,15 @@ enum obj_type {
  * buffer separately.
  */
 struct slab_info {
-        /** address of slab */
+        /** address of slab, or NULL if the slab was reclaimed */
     void *addr;
 
+        /** number of free objects, counted by the reclaim pass */
+    unsigned int num_free;
+
+        /** an enum huge_backing if the pool uses huge pages */
+    unsigned int backing;
+
         /** slab private data */
 #if WITH_TRANSPORT_IB
     struct ibv_mr *mr;
@@ -77,7 +89,7 @@ struct chunk {
         /** number of entries in chunk->slab_list */
     unsigned int max_slabs;
 
-        /** next slab_list entry to allocate */
+        /** next slab_list entry to allocate, the ones before may be holes */
     unsigned int num_slabs;
 
         /** space for slab_list with max_slabs entries */
@@ -86,6 +98,26 @@ struct chunk {
 
 typedef struct chunk chunk_t;
 
+/**
+ * A magazine caches free objects of a pool for a single thread.
+ */
+struct magazine {
+        /** number of objects in objs */
+    unsigned int num;
+
+        /** objects allocated minus objects released through the magazine */
+    int count;
+
+        /** allocations served by the magazine */
+    unsigned long hits;
+
+        /** allocations that had to go to the pool free list */
+    unsigned long misses;
+
+        /** free objects, the most recently released one last */
+    struct obj *objs[0];
+};
+
 /**
  * A pool struct holds information about a type of object
  * that it manages.
@@ -120,6 +152,15 @@ struct pool {
         /** pointer to free list */
     union counted_ptr free_list;
 
+        /** threads taking objects from the free list */
+    atomic_t dequeuers;
+
+        /** per thread magazines, indexed by thread slot, or NULL */
+    struct magazine **mags;
+
+        /** number of objects a magazine holds */
+    unsigned int mag_size;
+
         /** pool type */
     enum obj_type type;
 
@@ -141,8 +182,29 @@ struct pool {
         /** slab is in preallocated memory */
     int use_pre_alloc_buffer;
 
+        /** slabs are allocated on huge pages */
+    int huge_pages;
+
         /** address of preallocated slab */
     void *pre_alloc_buffer;
+
+        /** bytes of memory in slabs */
+    unsigned long mem_size;
+
+        /** maximum bytes of memory in slabs, or 0 */
+    unsigned long max_size;
+
+        /** reclaim above this many bytes of memory in slabs, or 0 */
+    unsigned long high_water;
+
+        /** mem_size after the last reclaim pass */
+    unsigned long reclaim_size;
+
+        /** number of objects in use at the last reclaim pass */
+    unsigned long reclaim_used;
+
+        /** number of reclaimed slab_list entries in the chunks */
+    unsigned int num_holes;
 };
 
 typedef struct pool pool_t;
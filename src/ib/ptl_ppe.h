@@ -38,7 +38,9 @@ enum ppe_op {
     OP_PtlMEUnlink,
     OP_PtlNIFini,
     OP_PtlNIHandle,
+    OP_PtlNIGetStat,
     OP_PtlNIInit,
+    OP_PtlNIReclaim,
     OP_PtlNIStatus,
     OP_PtlPTAlloc,
     OP_PtlPTDisable,
@@ -83,6 +85,16 @@ struct ppe_msg {
             ptl_sr_value_t status;
         } PtlNIStatus;
 
+        struct {
+            ptl_handle_ni_t ni_handle;
+            ptl_stat_index_t stat;
+            ptl_sr_value_t value;
+        } PtlNIGetStat;
+
+        struct {
+            ptl_handle_ni_t ni_handle;
+        } PtlNIReclaim;
+
         struct {
             ptl_handle_any_t handle;
             ptl_handle_ni_t ni_handle;
@@ -494,9 +506,15 @@ int _PtlEQAlloc(PPEGBL ptl_handle_ni_t ni_handle, ptl_size_t count,
 int _PtlEQFree(PPEGBL ptl_handle_eq_t eq_handle);
 int _PtlEQGet(PPEGBL ptl_handle_eq_t eq_handle, ptl_event_t *event_p);
 int _PtlEQWait(PPEGBL ptl_handle_eq_t eq_handle, ptl_event_t *event_p);
+int _PtlEQGetMany(PPEGBL ptl_handle_eq_t eq_handle, unsigned int count,
+                  ptl_event_t *events, unsigned int *num_events_p);
 int _PtlEQPoll(PPEGBL const ptl_handle_eq_t * eq_handles, unsigned int size,
                ptl_time_t timeout, ptl_event_t *event_p,
                unsigned int *which_p);
+int _PtlEQPollMany(PPEGBL const ptl_handle_eq_t * eq_handles,
+                   unsigned int size, ptl_time_t timeout, unsigned int count,
+                   ptl_event_t *events, unsigned int *num_events_p,
+                   unsigned int *which_p);
 int _PtlGetUid(PPEGBL ptl_handle_ni_t ni_handle, ptl_uid_t *uid_p);
 int _PtlGetId(PPEGBL ptl_handle_ni_t ni_handle, ptl_process_t *id_p);
 int _PtlGetPhysId(PPEGBL ptl_handle_ni_t ni_handle, ptl_process_t *id_p);
@@ -598,7 +616,10 @@ int _PtlGetMap(PPEGBL ptl_handle_ni_t ni_handle, ptl_size_t map_size,
                ptl_process_t *mapping, ptl_size_t *actual_map_size);
 int _PtlNIStatus(PPEGBL ptl_handle_ni_t ni_handle, ptl_sr_index_t index,
                  ptl_sr_value_t *status);
+int _PtlNIGetStat(PPEGBL ptl_handle_ni_t ni_handle, ptl_stat_index_t stat,
+                  ptl_sr_value_t *value);
 int _PtlNIHandle(PPEGBL ptl_handle_any_t handle, ptl_handle_ni_t *ni_handle);
+int _PtlNIReclaim(PPEGBL ptl_handle_ni_t ni_handle);
 int _PtlPTAlloc(PPEGBL ptl_handle_ni_t ni_handle, unsigned int options,
                 ptl_handle_eq_t eq_handle, ptl_pt_index_t pt_index_req,
                 ptl_pt_index_t *pt_index);
@@ -636,7 +657,9 @@ int _PtlPTEnable(PPEGBL ptl_handle_ni_t ni_handle, ptl_pt_index_t pt_index);
 #define _PtlEQAlloc PtlEQAlloc
 #define _PtlEQFree PtlEQFree
 #define _PtlEQGet PtlEQGet
+#define _PtlEQGetMany PtlEQGetMany
 #define _PtlEQPoll PtlEQPoll
+#define _PtlEQPollMany PtlEQPollMany
 #define _PtlEQWait PtlEQWait
 #define _PtlEndBundle PtlEndBundle
 #define _PtlFetchAtomic PtlFetchAtomic
@@ -653,7 +676,9 @@ int _PtlPTEnable(PPEGBL ptl_handle_ni_t ni_handle, ptl_pt_index_t pt_index);
 #define _PtlMEAppend PtlMEAppend
 #define _PtlMESearch PtlMESearch
 #define _PtlMEUnlink PtlMEUnlink
+#define _PtlNIGetStat PtlNIGetStat
 #define _PtlNIHandle PtlNIHandle
+#define _PtlNIReclaim PtlNIReclaim
 #define _PtlNIStatus PtlNIStatus
 #define _PtlPTAlloc PtlPTAlloc
 #define _PtlPTDisable PtlPTDisable
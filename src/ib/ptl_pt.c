@@ -85,6 +85,8 @@ int _PtlPTAlloc(PPEGBL ptl_handle_ni_t ni_handle, unsigned int options,
     ni_t *ni;
     ptl_pt_index_t index = 0;
     eq_t *eq;
+    unsigned int num_buckets;
+    int shadow;
 
     err = gbl_get();
     if (unlikely(err))
@@ -131,6 +133,29 @@ int _PtlPTAlloc(PPEGBL ptl_handle_ni_t ni_handle, unsigned int options,
     pt->eq = eq;
     atomic_set(&pt->unexpected_size, 0);
 
+    /* Only matching NIs can benefit from a match index or shadow. */
+    num_buckets = (ni->options & PTL_NI_MATCHING) ?
+        get_param(PTL_MATCH_INDEX_BUCKETS) : 0;
+    shadow = (ni->options & PTL_NI_MATCHING) ?
+        get_param(PTL_MATCH_SHADOW) : 0;
+
+    match_shadow_init(&pt->priority_shadow, shadow);
+    match_shadow_init(&pt->overflow_shadow, shadow);
+
+    err = match_index_init(&pt->priority_index, num_buckets);
+    if (likely(!err))
+        err = match_index_init(&pt->overflow_index, num_buckets);
+    if (likely(!err))
+        err = unexpected_index_init(&pt->unexpected_index, num_buckets);
+    if (unlikely(err)) {
+        match_index_fini(&pt->priority_index);
+        match_index_fini(&pt->overflow_index);
+        pthread_mutex_lock(&ni->pt_mutex);
+        pt->in_use = 0;
+        pthread_mutex_unlock(&ni->pt_mutex);
+        goto err3;
+    }
+
     PTL_FASTLOCK_INIT(&pt->lock);
     INIT_LIST_HEAD(&pt->priority_list);
     INIT_LIST_HEAD(&pt->overflow_list);
@@ -212,6 +237,12 @@ int _PtlPTFree(PPEGBL ptl_handle_ni_t ni_handle, ptl_pt_index_t pt_index)
 
     PTL_FASTLOCK_DESTROY(&pt->lock);
 
+    match_index_fini(&pt->priority_index);
+    match_index_fini(&pt->overflow_index);
+    unexpected_index_fini(&pt->unexpected_index);
+    match_shadow_fini(&pt->priority_shadow);
+    match_shadow_fini(&pt->overflow_shadow);
+
     pt->in_use = 0;
     pt->state = PT_DISABLED;
 
@@ -57,12 +57,27 @@ struct pt {
         /** list of overflow me/le's */
     struct list_head overflow_list;
 
+        /** optional hash index over the priority list */
+    struct match_index priority_index;
+
+        /** optional hash index over the overflow list */
+    struct match_index overflow_index;
+
+        /** optional compact copy of the priority list */
+    struct match_shadow priority_shadow;
+
+        /** optional compact copy of the overflow list */
+    struct match_shadow overflow_shadow;
+
         /** size of unexpected list */
     atomic_t unexpected_size;
 
         /** list of unexpected xt's */
     struct list_head unexpected_list;
 
+        /** optional hash index over the unexpected list */
+    struct unexpected_index unexpected_index;
+
         /** to attach on the EQ flow control list if this PT does it. **/
     struct list_head flowctrl_list;
 
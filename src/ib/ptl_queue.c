@@ -90,3 +90,123 @@ void queue_init(queue_t *queue)
     queue->tail = 0;
     queue->shadow_head = 0;
 }
+
+/**
+ * @brief Return the size of a ring.
+ *
+ * @param[in] num_slots the number of slots, a power of 2
+ *
+ * @return the size in bytes
+ */
+size_t ring_size(unsigned int num_slots)
+{
+    return sizeof(ring_t) + num_slots * sizeof(struct ring_slot);
+}
+
+/**
+ * @brief Initialize a ring.
+ *
+ * @param[in] ring the ring to initialize
+ * @param[in] num_slots the number of slots, a power of 2
+ */
+void ring_init(ring_t *ring, unsigned int num_slots)
+{
+    unsigned int i;
+
+    assert((num_slots & (num_slots - 1)) == 0);
+
+    ring->tail = 0;
+    ring->head = 0;
+    ring->mask = num_slots - 1;
+
+    for (i = 0; i < num_slots; i++)
+        ring->slot[i].seq = i;
+}
+
+/**
+ * @brief enqueue a buf on a ring.
+ *
+ * @param[in] ring the ring.
+ * @param[in] obj the object to enqueue.
+ *
+ * @return PTL_OK, or PTL_NO_SPACE if the ring is full.
+ */
+int ring_enqueue(const void *comm_pad, ring_t *ring, obj_t *obj)
+{
+    unsigned long pos = ring->tail;
+    struct ring_slot *slot;
+    long diff;
+
+    while (1) {
+        slot = &ring->slot[pos & ring->mask];
+        diff = (long)(slot->seq - pos);
+
+        if (diff == 0) {
+            /* Free slot; claim it. */
+            unsigned long old =
+                __sync_val_compare_and_swap(&ring->tail, pos, pos + 1);
+
+            if (old == pos)
+                break;
+            pos = old;
+        } else if (diff < 0) {
+            /* The consumer has not released the slot from the previous
+             * lap yet. */
+            return PTL_NO_SPACE;
+        } else {
+            /* Another producer claimed it. */
+            pos = ring->tail;
+        }
+    }
+
+    slot->off = PTR2OFF(comm_pad, obj);
+
+    /* Publish the offset. */
+    __sync_synchronize();
+    slot->seq = pos + 1;
+
+    return PTL_OK;
+}
+
+/**
+ * @brief dequeue bufs from a ring.
+ *
+ * The filled slots are taken in order, up to the first one a producer
+ * has claimed but not filled yet, and then released together.
+ *
+ * @param[in] ring the ring.
+ * @param[out] objs the objects dequeued.
+ * @param[in] max the size of objs.
+ *
+ * @return the number of objects dequeued.
+ */
+int ring_dequeue(const void *comm_pad, ring_t *ring, obj_t **objs, int max)
+{
+    unsigned long pos = ring->head;
+    unsigned long mask = ring->mask;
+    int n;
+
+    for (n = 0; n < max; n++) {
+        struct ring_slot *slot = &ring->slot[(pos + n) & mask];
+
+        if (slot->seq != pos + n + 1)
+            break;
+
+        /* Read the offset after seeing it published. */
+        __sync_synchronize();
+        objs[n] = OFF2PTR(comm_pad, slot->off);
+    }
+
+    if (n) {
+        int i;
+
+        /* Give the slots back to the producers, for the next lap. */
+        __sync_synchronize();
+        for (i = 0; i < n; i++)
+            ring->slot[(pos + i) & mask].seq = pos + i + mask + 1;
+
+        ring->head = pos + n;
+    }
+
+    return n;
+}
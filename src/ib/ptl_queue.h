@@ -21,11 +21,50 @@ struct queue {
 };
 
 typedef struct queue queue_t;
+
+/**
+ * @brief slot of a shared memory ring
+ *
+ * Each slot has its own cache line, so that producers filling
+ * neighbour slots do not share lines.
+ */
+struct ring_slot {
+    /* Position the slot is ready for: pos when free, pos + 1 once
+     * filled for the consumer. */
+    volatile unsigned long seq;
+    unsigned long off;
+    uint8_t pad[CACHELINE_WIDTH - (2 * sizeof(unsigned long))];
+};
+
+/**
+ * @brief bounded shared memory buffer ring, with many producers and
+ * a single consumer
+ */
+struct ring {
+    /* The First Cacheline, written by the producers */
+    volatile unsigned long tail;
+    uint8_t pad1[CACHELINE_WIDTH - sizeof(unsigned long)];
+    /* The Second Cacheline, only used by the consumer */
+    unsigned long head;
+    uint8_t pad2[CACHELINE_WIDTH - sizeof(unsigned long)];
+    /* The Third Cacheline, read only */
+    unsigned long mask;
+    uint8_t pad3[CACHELINE_WIDTH - sizeof(unsigned long)];
+    struct ring_slot slot[0];
+};
+
+typedef struct ring ring_t;
 struct obj;
 
 void queue_init(queue_t *queue);
 void enqueue(const void *comm_pad, queue_t *restrict queue, struct obj *obj);
 struct obj *dequeue(const void *comm_pad, queue_t *queue);
 
+size_t ring_size(unsigned int num_slots);
+void ring_init(ring_t *ring, unsigned int num_slots);
+int ring_enqueue(const void *comm_pad, ring_t *ring, struct obj *obj);
+int ring_dequeue(const void *comm_pad, ring_t *ring, struct obj **objs,
+                 int max);
+
 
 #endif /* PTL_QUEUE_H */
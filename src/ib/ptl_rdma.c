@@ -349,7 +349,7 @@ static int rdma_init_prepare_transfer(md_t *md, data_dir_t dir,
         addr = md->start + offset;
         err = mr_lookup_app(ni, addr, length, &mr);
         if (!err) {
-            buf->mr_list[buf->num_mr++] = mr;
+            buf_mr_list(buf)[buf->num_mr++] = mr;
 
             append_init_data_rdma_direct(data, mr, addr, length, buf);
         }
@@ -592,7 +592,7 @@ static int rdma_do_transfer(buf_t *buf)
         if (!rdma_buf)
             return PTL_FAIL;
 
-        mr_list = rdma_buf->mr_list + rdma_buf->num_mr;
+        mr_list = buf_mr_list(rdma_buf) + rdma_buf->num_mr;
 
         /* build a local scatter/gather array on our stack
          * to transfer as many bytes as possible from the
@@ -736,7 +736,7 @@ int process_rdma_desc(buf_t *buf)
     }
 
     buf->indir_sge = indir_sge;
-    buf->mr_list[buf->num_mr++] = mr;
+    buf_mr_list(buf)[buf->num_mr++] = mr;
 
     sge.addr = (uintptr_t) indir_sge;
     sge.lkey = mr->ibmr->lkey;
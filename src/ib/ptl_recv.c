@@ -361,16 +361,6 @@ static int recv_req(buf_t *buf)
     if (err)
         WARN();
 
-#if WITH_TRANSPORT_UDP
-    //REG: indicate that this buffer is OK to free later
-    if (buf->tgt_state != STATE_TGT_WAIT_APPEND) {
-        buf->completed = 1;
-    } else {
-        buf->completed = 0;
-    }
-
-#endif
-
     return STATE_RECV_REPOST;
 }
 
@@ -413,9 +403,12 @@ static int recv_init(PPEGBL buf_t *buf)
 
 #if WITH_TRANSPORT_UDP
     conn_t *conn;
+    int is_udp;
+
     conn = get_conn(buf->obj.obj_ni, buf->obj.obj_ni->id);
+    is_udp = conn->transport.type == CONN_TYPE_UDP;
 
-    if (conn->transport.type == CONN_TYPE_UDP) {
+    if (is_udp) {
         ptl_info("udp connection processing \n");
         ni_t *ni = obj_to_ni(buf);
 
@@ -444,7 +437,7 @@ static int recv_init(PPEGBL buf_t *buf)
         WARN();
 
 #if WITH_TRANSPORT_UDP
-    if (atomic_read(&init_buf->obj.obj_ref.ref_cnt) > 1)
+    if (!is_udp || atomic_read(&init_buf->obj.obj_ref.ref_cnt) > 1)
 #endif
         buf_put(init_buf);             /* from to_buf() */
 
@@ -623,7 +616,7 @@ void progress_thread_udp(ni_t *ni)
                          * owner. Send the buffer back in both cases. */
                         //shmem_enqueue(ni, udp_buf, udp_buf->udp.index_owner);
                         //udp_send(ni, udp_buf, udp_buf->udp.index_owner);
-                        udp_send(ni, udp_buf, &udp_buf->dest.udp.dest_addr);
+                        udp_send(ni, udp_buf, &udp_buf->dest.udp.dest_addr, 0);
                     } else {
                         /* It was returned to us with a message from a remote
                          * rank. From send_message_udp(). */
@@ -638,7 +631,7 @@ void progress_thread_udp(ni_t *ni)
                     if (udp_buf->put_ct != NULL) {
                         ptl_info("putct is : %p \n", udp_buf->put_ct);
                     }
-                    pthread_mutex_init(&udp_buf->mutex, NULL);
+                    udp_buf->lock = BUF_UNLOCKED;
                     udp_buf->obj.obj_ni = ni;
                     udp_buf->conn = get_conn(ni, ni->id);
                     udp_buf->conn->state = CONN_STATE_CONNECTED;
@@ -668,13 +661,13 @@ void progress_thread_udp(ni_t *ni)
                     msg.req.src_id = ni->id;
 
                     udp_buf->transfer.udp.conn_msg = msg;
-                    udp_buf->length = (sizeof(buf_t));
+                    udp_buf->length = BUF_WIRE_SIZE;
 
                     //send back to the requesting address
                     udp_buf->udp.dest_addr = &udp_buf->udp.src_addr;
                     udp_buf->dest.udp.dest_addr = udp_buf->udp.src_addr;
 
-                    udp_send(ni, udp_buf, udp_buf->udp.dest_addr);
+                    udp_send(ni, udp_buf, udp_buf->udp.dest_addr, 0);
                     //REG: Note: this assumes that we have a reliable transport, otherwise things can go wrong here
                     ptl_info
                         ("Connection request reply sent, connection valid. \n");
@@ -712,10 +705,8 @@ void progress_thread_udp(ni_t *ni)
             }
             //if a buffer was allocated for the recv, free it
             if (atomic_read(&ni->udp.self_recv) == 0) {
-                if (udp_buf->completed) {
+                if (udp_buf->udp.tgt_done) {
                     ptl_info("free recv buf %p\n", &udp_buf);
-                    if (udp_buf->recv_buf)
-                        buf_put(udp_buf->recv_buf);
                     if (udp_buf->conn)
                         conn_put(udp_buf->conn);
                     free(udp_buf);
@@ -763,7 +754,7 @@ void progress_thread_udp(ni_t *ni)
 						// owner. Send the buffer back in both cases. 
 						//shmem_enqueue(ni, udp_buf, udp_buf->udp.index_owner);
 						//udp_send(ni, udp_buf, udp_buf->udp.index_owner);
-						udp_send(ni, udp_buf, &udp_buf->dest.udp.dest_addr);
+						udp_send(ni, udp_buf, &udp_buf->dest.udp.dest_addr, 0);
 					} else {
 						// It was returned to us with a message from a remote
 						// rank. From send_message_udp(). 
@@ -859,6 +850,9 @@ void process_recv_udp(ni_t *ni, buf_t *buf)
                 state = recv_req(buf);
                 ptl_info("recv_req returned state: %s\n",
                          recv_state_name[state]);
+
+                //REG: indicate that this buffer is OK to free later
+                buf->udp.tgt_done = buf->tgt_state != STATE_TGT_WAIT_APPEND;
                 break;
             case STATE_RECV_INIT:
                 state = recv_init(MYNIGBL_ buf);
@@ -889,6 +883,130 @@ void process_recv_udp(ni_t *ni, buf_t *buf)
 #endif
 
 #if !IS_PPE
+#if WITH_TRANSPORT_SHMEM && !USE_KNEM
+/* The progress thread reads the type of a bell as the type of a buf. */
+_Static_assert(offsetof(struct noknem_bell, type) == offsetof(buf_t, type),
+               "noknem bell type not at the offset of the buf type");
+
+/**
+ * Process a bell of a noknem transfer.
+ *
+ * The other side of the transfer changed its state; run the state
+ * machine of the local side.
+ *
+ * @param ni the ni that received the bell.
+ * @param bell the bell.
+ */
+static void process_noknem_bell(ni_t *ni, struct noknem_bell *bell)
+{
+    buf_t *buf = bell->buf;
+    int err;
+
+    if (buf->transfer.noknem.transfer_state_expected == 0) {
+        /* Initiator. Rings that raced with the end of the transfer
+         * find it already finished. */
+        bell->pending = 0;
+        __sync_synchronize();
+
+        if (buf->transfer.noknem.noknem) {
+            err = process_init(buf);
+            if (unlikely(err))
+                ptl_warn("Error in non-knem shared memory initiator processing\n");
+        }
+    } else if (bell == &buf->transfer.noknem.bells->done_bell) {
+        buf_t *shmem_buf = buf->mem_buf;
+
+        /* The transfer is now done, and no other bell of it is
+         * queued. Remove from noknem_list. */
+        buf->transfer.noknem.init_done = 1;
+        list_del(&buf->list);
+
+        err = process_tgt(buf);
+        if (unlikely(err))
+            ptl_warn("Error in non-knem shared memory target processing");
+
+        if (shmem_buf->type == BUF_SHMEM_SEND ||
+            shmem_buf->shmem.index_owner != ni->mem.index) {
+            /* Requested to send the buffer back, or not the
+             * owner. Send the buffer back in both cases. */
+            shmem_enqueue(ni, shmem_buf, shmem_buf->shmem.index_owner);
+        } else {
+            /* It was returned to us with a message from a remote
+             * rank. From send_message_shmem(). */
+            buf_put(shmem_buf);
+        }
+    } else {
+        /* Target. Once done, it only waits for the done bell. */
+        bell->pending = 0;
+        __sync_synchronize();
+
+        if (!buf->transfer.noknem.noknem->target_done) {
+            err = process_tgt(buf);
+            if (unlikely(err))
+                ptl_warn("Error in non-knem shared memory target processing");
+        }
+    }
+}
+#endif
+
+#if WITH_TRANSPORT_SHMEM
+/**
+ * @brief Process a message received in a shared memory buffer.
+ *
+ * The buffer is then sent back to its owner, unless it is still
+ * needed.
+ *
+ * @param ni the network interface.
+ * @param shmem_buf the buffer of the remote rank.
+ */
+void process_recv_shmem(ni_t *ni, buf_t *shmem_buf)
+{
+    buf_t *buf;
+    int err;
+
+    /* Mark it for return now. The target state machine might
+     * change its type to BUF_SHMEM_SEND. */
+    shmem_buf->type = BUF_SHMEM_RETURN;
+
+    err = buf_alloc(ni, &buf);
+    if (err) {
+        WARN();
+    } else {
+        buf->data = shmem_buf->internal_data;
+        buf->length = shmem_buf->length;
+        buf->mem_buf = shmem_buf;
+        buf->dest.shmem.local_rank = shmem_buf->shmem.index_owner;
+        INIT_LIST_HEAD(&buf->list);
+        process_recv_mem(ni, buf);
+    }
+
+#if !USE_KNEM
+    /* Don't send back if it's on the noknem list. */
+    if (!list_empty(&buf->list))
+        return;
+#endif
+#if WITH_TRANSPORT_IB
+    if (buf_ref_cnt(buf) == 1 && 
+        !(buf->event_mask & XI_RECEIVE_EXPECTED) && 
+        (buf->type == BUF_TGT)) {
+        ptl_warn("freeing a shared mem buf of type: %i with mask %X \n",buf->type, buf->event_mask);
+        buf->type = BUF_FREE;
+        buf_put(buf);
+    }
+#endif
+    if (shmem_buf->type == BUF_SHMEM_SEND ||
+        shmem_buf->shmem.index_owner != ni->mem.index) {
+        /* Requested to send the buffer back, or not the
+         * owner. Send the buffer back in both cases. */
+        shmem_enqueue(ni, shmem_buf, shmem_buf->shmem.index_owner);
+    } else {
+        /* It was returned to us with a message from a remote
+         * rank. From send_message_shmem(). */
+        buf_put(shmem_buf);
+    }
+}
+#endif
+
 /**
  * Progress thread. Waits for ib, udp, and/or shared memory messages.
  *
@@ -898,9 +1016,10 @@ void process_recv_udp(ni_t *ni, buf_t *buf)
 static void *progress_thread(void *arg)
 {
     ni_t *ni = arg;
-#if WITH_TRANSPORT_SHMEM
-    int err = 0;
-#endif
+
+    /* Stay close to the memory of the NI. */
+    if (ni->numa_node >= 0)
+        numa_bind_thread(ni->numa_node);
 
     while (!ni->catcher_stop
 #if WITH_TRANSPORT_SHMEM
@@ -918,58 +1037,31 @@ static void *progress_thread(void *arg)
             
             buf_t *shmem_buf;
 
+            int received = 0;
+
+            if (ni->shmem.num_deferred)
+                shmem_flush_deferred(ni);
+
+            if (ni->shmem.eager_slots) {
+                if (atomic_read(&ni->shmem.eager_num_deferred))
+                    shmem_eager_flush(ni);
+
+                received = shmem_eager_poll(ni);
+            }
+
             shmem_buf = shmem_dequeue(ni);
 
+            /* Let the ranks with a full ring or channel run, if they
+             * share our CPU. */
+            if (!shmem_buf && !received &&
+                (ni->shmem.num_deferred ||
+                 atomic_read(&ni->shmem.eager_num_deferred)))
+                sched_yield();
+
             if (shmem_buf) {
                 switch (shmem_buf->type) {
-                    case BUF_SHMEM_SEND:{
-                        buf_t *buf;
-
-                        /* Mark it for return now. The target state machine might
-                         * change its type to BUF_SHMEM_SEND. */
-                        shmem_buf->type = BUF_SHMEM_RETURN;
-
-                        err = buf_alloc(ni, &buf);
-                        if (err) {
-                            WARN();
-                        } else {
-                            buf->data = shmem_buf->internal_data;
-                            buf->length = shmem_buf->length;
-                            buf->mem_buf = shmem_buf;
-                            INIT_LIST_HEAD(&buf->list);
-                            process_recv_mem(ni, buf);
-                        }
-
-#if WITH_TRANSPORT_SHMEM && !USE_KNEM
-                        /* Don't send back if it's on the noknem list. */
-                        PTL_FASTLOCK_LOCK(&ni->shmem.noknem_lock);
-                        if (!list_empty(&buf->list)) {
-                            PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
-                            break;
-                        }
-                        PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
-#endif
-#if WITH_TRANSPORT_IB
-                        if (buf_ref_cnt(buf) == 1 && 
-                            !(buf->event_mask & XI_RECEIVE_EXPECTED) && 
-                            (buf->type == BUF_TGT)) {
-                            ptl_warn("freeing a shared mem buf of type: %i with mask %X \n",buf->type, buf->event_mask);
-			    buf->type = BUF_FREE;
-			    buf_put(buf);
-			}
-#endif
-                        if (shmem_buf->type == BUF_SHMEM_SEND ||
-                            shmem_buf->shmem.index_owner != ni->mem.index) {
-                            /* Requested to send the buffer back, or not the
-                             * owner. Send the buffer back in both cases. */
-                            shmem_enqueue(ni, shmem_buf,
-                                          shmem_buf->shmem.index_owner);
-                        } else {
-                            /* It was returned to us with a message from a remote
-                             * rank. From send_message_shmem(). */
-                            buf_put(shmem_buf);
-                        }
-                    }
+                    case BUF_SHMEM_SEND:
+                        process_recv_shmem(ni, shmem_buf);
                         break;
 
                     case BUF_SHMEM_RETURN:
@@ -980,6 +1072,13 @@ static void *progress_thread(void *arg)
                         buf_put(shmem_buf);
                         break;
 
+#if !USE_KNEM
+                    case BUF_SHMEM_NOKNEM:
+                        process_noknem_bell(ni,
+                                            (struct noknem_bell *)shmem_buf);
+                        break;
+#endif
+
                     default:
                         /* Should not happen. */
                         abort();
@@ -988,60 +1087,6 @@ static void *progress_thread(void *arg)
         }
 #endif
 
-#if WITH_TRANSPORT_SHMEM && !USE_KNEM
-        struct list_head *l, *t;
-
-        /* TODO: instead of having a lock, the initiator should send
-         * the buf to itself, and on receiving it, the progress thread
-         * will put it on the list. That way, only the progress thread
-         * has access to the list. */
-        PTL_FASTLOCK_LOCK(&ni->shmem.noknem_lock);
-
-        list_for_each_safe(l, t, &ni->shmem.noknem_list) {
-            buf_t *buf = list_entry(l, buf_t, list);
-            struct noknem *noknem = buf->transfer.noknem.noknem;
-
-            if (buf->transfer.noknem.transfer_state_expected == noknem->state) {
-                if (noknem->state == 0){
-                    err = process_init(buf);
-                    if (unlikely(err))
-                        ptl_warn("Error in non-knem shared memory initiator processing\n");
-                }
-                else if (noknem->state == 2) {
-                    if (noknem->init_done) {
-                        buf_t *shmem_buf = buf->mem_buf;
-
-                        /* The transfer is now done. Remove from
-                         * noknem_list. */
-                        list_del(&buf->list);
-
-                        err = process_tgt(buf);
-                        if (unlikely(err))
-                            ptl_warn("Error in non-knem shared memory target processing");
-
-                        if (shmem_buf->type == BUF_SHMEM_SEND ||
-                            shmem_buf->shmem.index_owner != ni->mem.index) {
-                            /* Requested to send the buffer back, or not the
-                             * owner. Send the buffer back in both cases. */
-                            shmem_enqueue(ni, shmem_buf,
-                                          shmem_buf->shmem.index_owner);
-                        } else {
-                            /* It was returned to us with a message from a remote
-                             * rank. From send_message_shmem(). */
-                            buf_put(shmem_buf);
-                        }
-
-                    } else {
-                        err = process_tgt(buf);
-                        if (unlikely(err))
-                            ptl_warn("Error in non-knem shared memory target processing");
-                    }
-                }
-            }
-        }
-
-        PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
-#endif
     }
 
     return NULL;
@@ -1078,6 +1123,8 @@ void stop_progress_thread(ni_t *ni)
     if (ni->has_catcher) {
         ni->catcher_stop = 1;
         pthread_cancel(ni->catcher);
+        /* The NI is freed next, so wait for the thread to be gone. */
+        pthread_join(ni->catcher, NULL);
         ni->has_catcher = 0;
     }
 }
@@ -140,7 +140,7 @@ int process_rudp_recv_hdr(buf_t *buf, int len, ni_t *ni)
                 ptl_info("@@@@ RUDP NACK sendto retransmission @@@@@\n");
                 ret =
                     sendto(ni->iface->udp.connect_s, temp_buf,
-                           sizeof(*temp_buf), 0,
+                           BUF_WIRE_SIZE, 0,
                            (struct sockaddr *)temp_buf->udp.dest_addr,
                            sizeof(*temp_buf->udp.dest_addr));
                 if (ret == -1)
@@ -186,7 +186,7 @@ int process_rudp_recv_hdr(buf_t *buf, int len, ni_t *ni)
 
             //TODO: strip out the data so we have less network load
             //      on the ACK/NACK
-            sendto(ni->iface->udp.connect_s, buf, sizeof(*buf), 0,
+            sendto(ni->iface->udp.connect_s, buf, BUF_WIRE_SIZE, 0,
                    (struct sockaddr *)&temp_conn->sin,
                    sizeof(*&temp_conn->sin));
             break;
@@ -4,6 +4,273 @@
 
 #include "ptl_loc.h"
 
+#if HAVE_PROCESS_VM_READV
+#include <sys/uio.h>
+#endif
+
+/**
+ * @brief Find the eager channel from a rank to another.
+ *
+ * @param[in] ni the network interface
+ * @param[in] target the local rank receiving on the channel
+ * @param[in] source the local rank sending on the channel
+ *
+ * @return the channel, in the comm pad of the target
+ */
+static inline struct shmem_eager *eager_chan(ni_t *ni, int target,
+                                             int source)
+{
+    return ni->shmem.first_queue +
+        ni->shmem.per_proc_comm_buf_size * target +
+        ni->shmem.eager_offset + ni->shmem.eager_chan_size * source;
+}
+
+/**
+ * @brief Find the slot of an eager channel for a message number.
+ *
+ * @param[in] ni the network interface
+ * @param[in] chan the channel
+ * @param[in] n the message number
+ *
+ * @return the slot
+ */
+static inline struct shmem_eager_slot *eager_slot(ni_t *ni,
+                                                  struct shmem_eager *chan,
+                                                  unsigned long n)
+{
+    return (void *)(chan + 1) +
+        (n & (ni->shmem.eager_slots - 1)) * ni->shmem.eager_slot_size;
+}
+
+/**
+ * @brief Whether a message is copied into its eager slot.
+ *
+ * Other messages keep their buf, and the slot only points to it.
+ * Noknem transfers need it since the target rings the bells in it.
+ *
+ * @param[in] ni the network interface
+ * @param[in] buf the buf to send
+ *
+ * @return 1 if the message is copied, 0 otherwise
+ */
+static inline int eager_inline(ni_t *ni, buf_t *buf)
+{
+#if !USE_KNEM
+    if (buf->transfer.noknem.noknem)
+        return 0;
+#endif
+
+    return buf->length <= ni->shmem.eager_max_length;
+}
+
+/**
+ * @brief Fill the next slot of the eager channel to a rank.
+ *
+ * The lock of the channel must be held.
+ *
+ * @param[in] ni the network interface
+ * @param[in] tx the sender side of the channel
+ * @param[in] dest the local rank of the target
+ * @param[in] buf the buf to send
+ *
+ * @return 1 if sent, 0 if the target has not given the credits back
+ */
+static int eager_push(ni_t *ni, struct shmem_eager_tx *tx, int dest,
+                      buf_t *buf)
+{
+    struct shmem_eager *chan = eager_chan(ni, dest, ni->mem.index);
+    struct shmem_eager_slot *slot;
+
+    if (tx->produced - tx->consumed == ni->shmem.eager_slots) {
+        /* Out of credits. Only now read the ones given back. */
+        tx->consumed = chan->consumed;
+        if (tx->produced - tx->consumed == ni->shmem.eager_slots)
+            return 0;
+
+        /* Don't fill the slot before the target is done with it. */
+        __sync_synchronize();
+    }
+
+    slot = eager_slot(ni, chan, tx->produced);
+
+    if (eager_inline(ni, buf)) {
+        memcpy(slot->data, buf->data, buf->length);
+        slot->length = buf->length;
+    } else {
+        slot->length = 0;
+        slot->off = (void *)buf - ni->shmem.comm_pad;
+    }
+
+    /* Publish the slot. */
+    __sync_synchronize();
+    slot->seq = ++tx->produced;
+
+    return 1;
+}
+
+/**
+ * @brief Send a message on the eager channel to a rank.
+ *
+ * When the channel is full, or earlier messages are already waiting
+ * for it, the message waits for the progress thread to send it.
+ *
+ * @param[in] ni the network interface
+ * @param[in] buf the buf to send
+ * @param[in] dest the local rank of the target
+ */
+static void shmem_eager_send(ni_t *ni, buf_t *buf, int dest)
+{
+    struct shmem_eager_tx *tx = &ni->shmem.eager_tx[dest];
+    int copied = eager_inline(ni, buf);
+
+    /* A buf that is not copied is returned by the remote side with
+     * type=BUF_SHMEM_RETURN. */
+    if (!copied)
+        buf_get(buf);
+
+    PTL_FASTLOCK_LOCK(&tx->lock);
+
+    if (!tx->deferred_head && eager_push(ni, tx, dest, buf)) {
+        PTL_FASTLOCK_UNLOCK(&tx->lock);
+        return;
+    }
+
+    /* Keep the buf until it is copied too. */
+    if (copied)
+        buf_get(buf);
+
+    buf->obj.next = NULL;
+    if (tx->deferred_head)
+        tx->deferred_tail->next = &buf->obj;
+    else
+        tx->deferred_head = &buf->obj;
+    tx->deferred_tail = &buf->obj;
+    atomic_inc(&ni->shmem.eager_num_deferred);
+
+    PTL_FASTLOCK_UNLOCK(&tx->lock);
+}
+
+/**
+ * @brief Send the messages waiting for room in the eager channels.
+ *
+ * Called by the progress thread.
+ *
+ * @param[in] ni the network interface
+ */
+void shmem_eager_flush(ni_t *ni)
+{
+    int i;
+
+    for (i = 0; i < ni->mem.node_size; i++) {
+        struct shmem_eager_tx *tx = &ni->shmem.eager_tx[i];
+
+        while (tx->deferred_head) {
+            buf_t *buf = NULL;
+            obj_t *obj;
+
+            PTL_FASTLOCK_LOCK(&tx->lock);
+
+            /* The head stays on the list until it is sent, so that
+             * newer messages to the same rank don't pass it. */
+            obj = tx->deferred_head;
+            if (obj && eager_push(ni, tx, i,
+                                  container_of(obj, buf_t, obj))) {
+                tx->deferred_head = obj->next;
+                buf = container_of(obj, buf_t, obj);
+            }
+
+            PTL_FASTLOCK_UNLOCK(&tx->lock);
+
+            if (!buf)
+                break;
+
+            atomic_dec(&ni->shmem.eager_num_deferred);
+            if (eager_inline(ni, buf))
+                buf_put(buf);
+        }
+    }
+}
+
+/**
+ * @brief Give an eager slot back to its sender.
+ *
+ * The credits are published once per batch of slots.
+ *
+ * @param[in] ni the network interface
+ * @param[in] chan the channel
+ * @param[in] source the local rank of the sender
+ */
+static inline void eager_release(ni_t *ni, struct shmem_eager *chan,
+                                 int source)
+{
+    unsigned long consumed = ++ni->shmem.eager_rx[source];
+
+    if ((consumed & (ni->shmem.eager_batch - 1)) == 0) {
+        __sync_synchronize();
+        chan->consumed = consumed;
+    }
+}
+
+/**
+ * @brief Process the messages received on the eager channels.
+ *
+ * Called by the progress thread. Each channel gets at most a batch
+ * of messages per call.
+ *
+ * @param[in] ni the network interface
+ *
+ * @return the number of messages processed
+ */
+int shmem_eager_poll(ni_t *ni)
+{
+    int count = 0;
+    int i;
+
+    for (i = 0; i < ni->mem.node_size; i++) {
+        struct shmem_eager *chan = eager_chan(ni, ni->mem.index, i);
+        unsigned int n;
+
+        for (n = 0; n < ni->shmem.eager_batch; n++) {
+            struct shmem_eager_slot *slot =
+                eager_slot(ni, chan, ni->shmem.eager_rx[i]);
+            buf_t *buf;
+            int err;
+
+            if (slot->seq != ni->shmem.eager_rx[i] + 1)
+                break;
+
+            /* Read the slot after seeing it published. */
+            __sync_synchronize();
+
+            if (slot->length) {
+                /* The message is processed in place, and the slot
+                 * given back after. */
+                err = buf_alloc(ni, &buf);
+                if (err) {
+                    WARN();
+                } else {
+                    buf->data = slot->data;
+                    buf->length = slot->length;
+                    buf->mem_buf = NULL;
+                    buf->dest.shmem.local_rank = i;
+                    INIT_LIST_HEAD(&buf->list);
+                    process_recv_mem(ni, buf);
+                }
+
+                eager_release(ni, chan, i);
+            } else {
+                buf = ni->shmem.comm_pad + slot->off;
+                eager_release(ni, chan, i);
+                process_recv_shmem(ni, buf);
+            }
+
+            count++;
+        }
+    }
+
+    return count;
+}
+
 /**
  * @brief Send a message using shared memory.
  *
@@ -14,10 +281,9 @@
  */
 static int shmem_send_message(buf_t *buf, int from_init)
 {
-    /* Keep a reference on the buffer so it doesn't get freed. will be
-     * returned by the remote side with type=BUF_SHMEM_RETURN. */
+    ni_t *ni = buf->obj.obj_ni;
+
     assert(buf->obj.obj_pool->type == POOL_SBUF);
-    buf_get(buf);
 
     buf->type = BUF_SHMEM_SEND;
 
@@ -25,9 +291,18 @@ static int shmem_send_message(buf_t *buf, int from_init)
         buf->dest.shmem.local_rank = buf->mem_buf->shmem.index_owner;
     }
 
-    buf->shmem.index_owner = buf->obj.obj_ni->mem.index;
+    buf->shmem.index_owner = ni->mem.index;
 
-    shmem_enqueue(buf->obj.obj_ni, buf, buf->dest.shmem.local_rank);
+    if (ni->shmem.eager_slots) {
+        shmem_eager_send(ni, buf, buf->dest.shmem.local_rank);
+        return PTL_OK;
+    }
+
+    /* Keep a reference on the buffer so it doesn't get freed. will be
+     * returned by the remote side with type=BUF_SHMEM_RETURN. */
+    buf_get(buf);
+
+    shmem_enqueue(ni, buf, buf->dest.shmem.local_rank);
 
     return PTL_OK;
 }
@@ -161,7 +436,7 @@ static int shmem_init_prepare_transfer(md_t *md, data_dir_t dir,
         addr = md->start + offset;
         err = mr_lookup_app(ni, addr, length, &mr);
         if (!err) {
-            buf->mr_list[buf->num_mr++] = mr;
+            buf_mr_list(buf)[buf->num_mr++] = mr;
 
             append_init_data_shmem_direct(data, mr, addr, length, buf);
         }
@@ -200,61 +475,181 @@ static int knem_tgt_data_out(buf_t *buf, data_t *data)
 }
 
 #else
+/**
+ * @brief Return the index of the first bounce buffer of a free list.
+ *
+ * The bounce buffers are split evenly between the lists, in order.
+ *
+ * @param[in] ni
+ * @param[in] list the list
+ *
+ * @return the index
+ */
+static inline unsigned int bounce_buf_first(ni_t *ni, unsigned int list)
+{
+    return (unsigned long)list * ni->shmem.bounce_buf.num_bufs /
+        ni->shmem.bounce_buf.num_lists;
+}
+
+/**
+ * @brief Get a free bounce buffer.
+ *
+ * The list of this rank, whose buffers are on its NUMA node, is tried
+ * first, then the lists of the other ranks.
+ *
+ * @param[in] ni
+ *
+ * @return the bounce buffer
+ */
+static void *bounce_buf_alloc(ni_t *ni)
+{
+    struct shmem_bounce_head *head = ni->shmem.bounce_buf.head;
+    unsigned int num_lists = ni->shmem.bounce_buf.num_lists;
+    unsigned int first = (num_lists > 1) ? ni->mem.index : 0;
+    unsigned int i;
+    void *bb;
+
+    while (1) {
+        for (i = 0; i < num_lists; i++) {
+            bb = ll_dequeue_obj_alien(&head->free_list[(first + i) %
+                                                       num_lists], head,
+                                      head->head_index0);
+            if (bb)
+                return bb;
+        }
+
+        SPINLOCK_BODY();
+    }
+}
+
+/**
+ * @brief Return a bounce buffer to the free list it belongs to.
+ *
+ * @param[in] ni
+ * @param[in] bb the bounce buffer
+ */
+void shmem_bounce_buf_free(ni_t *ni, void *bb)
+{
+    struct shmem_bounce_head *head = ni->shmem.bounce_buf.head;
+    unsigned long num_lists = ni->shmem.bounce_buf.num_lists;
+    unsigned long index;
+    unsigned int list;
+
+    index = (bb - ni->shmem.bounce_buf.bbs) / ni->shmem.bounce_buf.buf_size;
+    list = ((index + 1) * num_lists - 1) / ni->shmem.bounce_buf.num_bufs;
+
+    ll_enqueue_obj_alien(&head->free_list[list], bb, head,
+                         head->head_index0);
+}
+
+/**
+ * @brief Put the bounce buffers of this rank on its free list.
+ *
+ * Each rank touches its own buffers first, after binding them to its
+ * NUMA node. Needs head_index0 to be set by rank 0.
+ *
+ * @param[in] ni
+ */
+static void bounce_buf_link_own(ni_t *ni)
+{
+    struct shmem_bounce_head *head = ni->shmem.bounce_buf.head;
+    unsigned int list = ni->mem.index;
+    unsigned int first = bounce_buf_first(ni, list);
+    unsigned int last = bounce_buf_first(ni, list + 1);
+    size_t buf_size = ni->shmem.bounce_buf.buf_size;
+    unsigned int i;
+
+    if (ni->numa_node >= 0)
+        numa_bind_area(ni->shmem.bounce_buf.bbs + first * buf_size,
+                       (last - first) * buf_size, ni->numa_node);
+
+    ll_init(&head->free_list[list]);
+
+    for (i = first; i < last; i++)
+        ll_enqueue_obj_alien(&head->free_list[list],
+                             ni->shmem.bounce_buf.bbs + i * buf_size, head,
+                             head->head_index0);
+}
+
 static void attach_bounce_buffer(buf_t *buf, data_t *data)
 {
     void *bb;
     ni_t *ni = obj_to_ni(buf);
 
-    while ((bb =
-            ll_dequeue_obj_alien(&ni->shmem.bounce_buf.head->free_list,
-                                 ni->shmem.bounce_buf.head,
-                                 ni->shmem.bounce_buf.head->head_index0)) ==
-           NULL)
-        SPINLOCK_BODY();
+    bb = bounce_buf_alloc(ni);
 
     buf->transfer.noknem.data = bb;
-    buf->transfer.noknem.data_length = ni->shmem.bounce_buf.buf_size;
+    buf->transfer.noknem.data_length =
+        (ptl_size_t)ni->shmem.bounce_buf.chunk_size *
+        ni->shmem.bounce_buf.num_chunks;
     buf->transfer.noknem.bounce_offset =
         bb - (void *)ni->shmem.bounce_buf.head;
 
     data->noknem.bounce_offset = buf->transfer.noknem.bounce_offset;
+    data->noknem.chunk_size = ni->shmem.bounce_buf.chunk_size;
+    data->noknem.num_chunks = ni->shmem.bounce_buf.num_chunks;
 }
 
-static void append_init_data_noknem_iovec(data_t *data, md_t *md,
-                                          int iov_start, int num_iov,
-                                          ptl_size_t length, buf_t *buf)
+static void append_init_data_noknem(data_t *data, data_dir_t dir,
+                                    ptl_size_t length, buf_t *buf)
 {
+    struct noknem_bells *bells;
+
     data->data_fmt = DATA_FMT_NOKNEM;
 
+    data->noknem.produced = 0;
+    data->noknem.consumed = 0;
     data->noknem.target_done = 0;
-    data->noknem.init_done = 0;
+
+    /* For a get, the target sets the length it sends. */
+    if (dir == DATA_DIR_OUT)
+        data->noknem.length = length;
 
     buf->transfer.noknem.transfer_state_expected = 0;   /* always the initiator here */
+    buf->transfer.noknem.producer = (dir == DATA_DIR_OUT);
     buf->transfer.noknem.noknem = &data->noknem;
 
     attach_bounce_buffer(buf, data);
 
-    buf->transfer.noknem.num_iovecs = num_iov;
-    buf->transfer.noknem.iovecs = &((ptl_iovec_t *)md->start)[iov_start];
-    buf->transfer.noknem.offset = 0;
+    /* The bells go at the end of the request buffer, which stays
+     * with the target until it is done with the transfer. */
+    bells = (void *)(((uintptr_t)buf->internal_data + BUF_DATA_SIZE -
+                      sizeof(*bells)) & ~(uintptr_t)(CACHELINE_WIDTH - 1));
+    assert((void *)bells >= (void *)data + sizeof(*data));
+    data->noknem.bells_offset = (void *)bells - (void *)buf->internal_data;
+    buf->transfer.noknem.bells = bells;
+
+    /* The target sets the owner of its bells when it gets the
+     * request; it only rings the initiator after that. */
+    bells->init_bell.type = BUF_SHMEM_NOKNEM;
+    bells->init_bell.pending = 0;
+    bells->init_bell.buf = buf;
+    bells->target_bell.type = BUF_SHMEM_NOKNEM;
+    bells->target_bell.pending = 0;
+    bells->done_bell.type = BUF_SHMEM_NOKNEM;
 
     buf->transfer.noknem.length_left = length;
 
     buf->length += sizeof(*data);
 }
 
-static void append_init_data_noknem_direct(data_t *data, mr_t *mr, void *addr,
-                                           ptl_size_t length, buf_t *buf)
+static void append_init_data_noknem_iovec(data_t *data, md_t *md,
+                                          data_dir_t dir, int iov_start,
+                                          ptl_size_t iov_offset, int num_iov,
+                                          ptl_size_t length, buf_t *buf)
 {
-    data->data_fmt = DATA_FMT_NOKNEM;
-
-    data->noknem.target_done = 0;
-    data->noknem.init_done = 0;
+    append_init_data_noknem(data, dir, length, buf);
 
-    buf->transfer.noknem.transfer_state_expected = 0;   /* always the initiator here */
-    buf->transfer.noknem.noknem = &data->noknem;
+    buf->transfer.noknem.num_iovecs = num_iov;
+    buf->transfer.noknem.iovecs = &((ptl_iovec_t *)md->start)[iov_start];
+    buf->transfer.noknem.offset = iov_offset;
+}
 
-    attach_bounce_buffer(buf, data);
+static void append_init_data_noknem_direct(data_t *data, mr_t *mr,
+                                           data_dir_t dir, void *addr,
+                                           ptl_size_t length, buf_t *buf)
+{
+    append_init_data_noknem(data, dir, length, buf);
 
     /* Describes local memory */
     buf->transfer.noknem.my_iovec.iov_base = addr;
@@ -263,11 +658,95 @@ static void append_init_data_noknem_direct(data_t *data, mr_t *mr, void *addr,
     buf->transfer.noknem.num_iovecs = 1;
     buf->transfer.noknem.iovecs = &buf->transfer.noknem.my_iovec;
     buf->transfer.noknem.offset = 0;
+}
 
-    buf->transfer.noknem.length_left = length;
+#if HAVE_PROCESS_VM_READV
+/**
+ * @brief Append a cross memory attach data segment to a request message.
+ *
+ * The segment describes the initiator memory, which the target
+ * reads or writes directly. It is only used if the target found it
+ * can access the memory of the local ranks, and if the iovecs fit in
+ * the request.
+ *
+ * @param[in] data the data segment
+ * @param[in] md the md that contains the data
+ * @param[in] dir the data direction, in or out
+ * @param[in] offset the offset into the md
+ * @param[in] length the length of the data
+ * @param[in] buf the buf the add the data segment to
+ *
+ * @return PTL_OK if the segment was appended, PTL_FAIL if the bounce
+ * buffers must be used instead.
+ */
+static int append_init_data_cma(data_t *data, md_t *md, data_dir_t dir,
+                                ptl_size_t offset, ptl_size_t length,
+                                buf_t *buf)
+{
+    ni_t *ni = obj_to_ni(md);
+    struct shmem_pid_table *pid_table =
+        (struct shmem_pid_table *)ni->shmem.comm_pad;
+    req_hdr_t *hdr = (req_hdr_t *) buf->data;
+    ptl_rank_t dest = buf->conn->shmem.local_rank;
+    int num_sge = 1;
+    int i;
 
-    buf->length += sizeof(*data);
+    if (!(ni->options & PTL_NI_LOGICAL) || dest < 0 ||
+        dest >= ni->mem.node_size || !pid_table[dest].cma)
+        return PTL_FAIL;
+
+    if (md->options & PTL_IOVEC) {
+        ptl_iovec_t *iovecs = md->start;
+        ptl_size_t iov_start = 0;
+        ptl_size_t iov_offset = 0;
+
+        num_sge =
+            iov_count_elem(iovecs, md->num_iov, offset, length, &iov_start,
+                           &iov_offset);
+        if (num_sge < 0 || num_sge > get_param(PTL_MAX_INLINE_SGE) ||
+            buf->length + sizeof(*data) + num_sge * sizeof(struct mem_iovec) >
+            BUF_DATA_SIZE)
+            return PTL_FAIL;
+
+        for (i = 0; i < num_sge; i++) {
+            data->cma.mem_iovec[i].addr = iovecs[iov_start + i].iov_base;
+            data->cma.mem_iovec[i].length = iovecs[iov_start + i].iov_len;
+        }
+
+        /* Trim the first and last segments to the data. */
+        data->cma.mem_iovec[0].addr += iov_offset;
+        data->cma.mem_iovec[0].length -= iov_offset;
+        for (i = 0; i < num_sge - 1; i++)
+            length -= data->cma.mem_iovec[i].length;
+        data->cma.mem_iovec[num_sge - 1].length = length;
+    } else {
+        data->cma.mem_iovec[0].addr = md->start + offset;
+        data->cma.mem_iovec[0].length = length;
+    }
+
+    data->data_fmt = DATA_FMT_CMA;
+    data->cma.pid = getpid();
+    data->cma.num_mem_iovecs = num_sge;
+
+    buf->length += sizeof(*data) + num_sge * sizeof(struct mem_iovec);
+
+    /* The target reads the MD after the request is sent. Keep it
+     * until the target acknowledges the transfer. */
+    if (dir == DATA_DIR_OUT) {
+        hdr->ack_req = PTL_ACK_REQ;
+        buf->event_mask |= XI_RECEIVE_EXPECTED;
+    }
+
+    return PTL_OK;
 }
+#else
+static int append_init_data_cma(data_t *data, md_t *md, data_dir_t dir,
+                                ptl_size_t offset, ptl_size_t length,
+                                buf_t *buf)
+{
+    return PTL_FAIL;
+}
+#endif
 
 /**
  * @brief Build and append a data segment to a request message.
@@ -286,7 +765,6 @@ static int noknem_init_prepare_transfer(md_t *md, data_dir_t dir,
                                         buf_t *buf)
 {
     int err = PTL_OK;
-    req_hdr_t *hdr = (req_hdr_t *) buf->data;
     data_t *data = (data_t *)(buf->data + buf->length);
     int num_sge;
     ptl_size_t iov_start = 0;
@@ -296,44 +774,35 @@ static int noknem_init_prepare_transfer(md_t *md, data_dir_t dir,
         err =
             append_immediate_data(md->start, NULL, md->num_iov, dir, offset,
                                   length, buf);
-    } else {
-        if (dir == DATA_DIR_IN)
-            buf->data_in->noknem.state = 2;
-        else
-            buf->data_out->noknem.state = 0;
-
-        if (md->options & PTL_IOVEC) {
-            ptl_iovec_t *iovecs = md->start;
-
-            /* Find the index and offset of the first IOV as well as the
-             * total number of IOVs to transfer. */
-            num_sge =
-                iov_count_elem(iovecs, md->num_iov, offset, length,
-                               &iov_start, &iov_offset);
-            if (num_sge < 0) {
-                WARN();
-                return PTL_FAIL;
-            }
+    } else if (append_init_data_cma(data, md, dir, offset, length, buf) ==
+               PTL_OK) {
+        /* Single copy by the target. */
+    } else if (md->options & PTL_IOVEC) {
+        ptl_iovec_t *iovecs = md->start;
 
-            append_init_data_noknem_iovec(data, md, iov_start, num_sge,
-                                          length, buf);
+        /* Find the index and offset of the first IOV as well as the
+         * total number of IOVs to transfer. */
+        num_sge =
+            iov_count_elem(iovecs, md->num_iov, offset, length, &iov_start,
+                           &iov_offset);
+        if (num_sge < 0) {
+            WARN();
+            return PTL_FAIL;
+        }
 
-            /* @todo this is completely bogus */
-            /* Adjust the header offset for iov start. */
-            hdr->roffset =
-                cpu_to_le64(le64_to_cpu(hdr->roffset) - iov_offset);
-        } else {
-            void *addr;
-            mr_t *mr;
-            ni_t *ni = obj_to_ni(md);
+        append_init_data_noknem_iovec(data, md, dir, iov_start, iov_offset,
+                                      num_sge, length, buf);
+    } else {
+        void *addr;
+        mr_t *mr;
+        ni_t *ni = obj_to_ni(md);
 
-            addr = md->start + offset;
-            err = mr_lookup_app(ni, addr, length, &mr);
-            if (!err) {
-                buf->mr_list[buf->num_mr++] = mr;
+        addr = md->start + offset;
+        err = mr_lookup_app(ni, addr, length, &mr);
+        if (!err) {
+            buf_mr_list(buf)[buf->num_mr++] = mr;
 
-                append_init_data_noknem_direct(data, mr, addr, length, buf);
-            }
+            append_init_data_noknem_direct(data, mr, dir, addr, length, buf);
         }
     }
 
@@ -343,85 +812,342 @@ static int noknem_init_prepare_transfer(md_t *md, data_dir_t dir,
     return err;
 }
 
-static int noknem_do_transfer(buf_t *buf)
+/**
+ * @brief Fill the free chunks of the bounce buffer ring of a transfer.
+ *
+ * Copy the next chunks of the local memory to the ring until it is
+ * full or all the data has been produced.
+ *
+ * @param[in] buf the initiator or target buf
+ *
+ * @return status
+ */
+int noknem_produce(buf_t *buf)
 {
     struct noknem *noknem = buf->transfer.noknem.noknem;
-    ptl_size_t *resid =
-        buf->rdma_dir == DATA_DIR_IN ? &buf->put_resid : &buf->get_resid;
+    unsigned int chunk_size = noknem->chunk_size;
+    unsigned int num_chunks = noknem->num_chunks;
+    unsigned int produced = noknem->produced;
     ptl_size_t to_copy;
     int err;
 
-    if (noknem->state != 2)
-        return PTL_OK;
+    while (buf->transfer.noknem.length_left &&
+           produced - noknem->consumed < num_chunks) {
+        /* Do not overwrite the chunk before it is consumed. */
+        __sync_synchronize();
 
-    if (noknem->init_done) {
-        assert(noknem->target_done);
-        return PTL_OK;
+        to_copy = chunk_size;
+        if (to_copy > buf->transfer.noknem.length_left)
+            to_copy = buf->transfer.noknem.length_left;
+
+        err =
+            iov_copy_out(buf->transfer.noknem.data +
+                         (produced % num_chunks) * chunk_size,
+                         buf->transfer.noknem.iovecs, NULL,
+                         buf->transfer.noknem.num_iovecs,
+                         buf->transfer.noknem.offset, to_copy);
+        if (err)
+            return err;
+
+        buf->transfer.noknem.offset += to_copy;
+        buf->transfer.noknem.length_left -= to_copy;
+
+        /* Publish the chunk. */
+        __sync_synchronize();
+        noknem->produced = ++produced;
     }
 
-    noknem->state = 3;
+    return PTL_OK;
+}
 
-    if (*resid) {
-        if (buf->rdma_dir == DATA_DIR_IN) {
-            to_copy = noknem->length;
-            if (to_copy > *resid)
-                to_copy = *resid;
+/**
+ * @brief Drain the filled chunks of the bounce buffer ring of a transfer.
+ *
+ * Copy the available chunks to the local memory. The part of the
+ * chunks beyond the local length is discarded.
+ *
+ * @param[in] buf the initiator or target buf
+ *
+ * @return status
+ */
+int noknem_consume(buf_t *buf)
+{
+    struct noknem *noknem = buf->transfer.noknem.noknem;
+    unsigned int chunk_size = noknem->chunk_size;
+    unsigned int num_chunks = noknem->num_chunks;
+    unsigned int consumed = noknem->consumed;
+    ptl_size_t chunk_start;
+    ptl_size_t to_copy;
+    int err;
+
+    while (consumed != noknem->produced) {
+        /* Read the chunk after seeing it published. */
+        __sync_synchronize();
 
+        chunk_start = (ptl_size_t)consumed * chunk_size;
+        to_copy = noknem->length - chunk_start;
+        if (to_copy > chunk_size)
+            to_copy = chunk_size;
+        if (to_copy > buf->transfer.noknem.length_left)
+            to_copy = buf->transfer.noknem.length_left;
+
+        if (to_copy) {
             err =
-                iov_copy_in(buf->transfer.noknem.data,
+                iov_copy_in(buf->transfer.noknem.data +
+                            (consumed % num_chunks) * chunk_size,
                             buf->transfer.noknem.iovecs, NULL,
                             buf->transfer.noknem.num_iovecs,
                             buf->transfer.noknem.offset, to_copy);
-        } else {
-            to_copy = buf->transfer.noknem.data_length;
-            if (to_copy > *resid)
-                to_copy = *resid;
-
-            err =
-                iov_copy_out(buf->transfer.noknem.data,
-                             buf->transfer.noknem.iovecs, NULL,
-                             buf->transfer.noknem.num_iovecs,
-                             buf->transfer.noknem.offset, to_copy);
+            if (err)
+                return err;
 
-            noknem->length = to_copy;
+            buf->transfer.noknem.offset += to_copy;
+            buf->transfer.noknem.length_left -= to_copy;
         }
 
-        /* That should never happen since all lengths were properly
-         * computed before entering. */
-        assert(err == PTL_OK);
+        /* Give the chunk back to the producer. */
+        __sync_synchronize();
+        noknem->consumed = ++consumed;
+    }
+
+    return PTL_OK;
+}
+
+/**
+ * @brief Ring a bell of a noknem transfer.
+ *
+ * The bell is only queued if it is not already, since its owner looks
+ * at the whole state of the transfer when handling it.
+ *
+ * @param[in] ni the network interface
+ * @param[in] bell the bell
+ * @param[in] dest the local rank that owns the bell
+ */
+static void noknem_ring(ni_t *ni, struct noknem_bell *bell, ptl_rank_t dest)
+{
+    if (__sync_lock_test_and_set(&bell->pending, 1) == 0)
+        shmem_enqueue(ni, (buf_t *)bell, dest);
+}
+
+/**
+ * @brief Tell the other side of a noknem transfer its state changed.
+ *
+ * @param[in] buf the initiator or target buf
+ */
+void noknem_notify(buf_t *buf)
+{
+    ni_t *ni = obj_to_ni(buf);
+    struct noknem_bells *bells = buf->transfer.noknem.bells;
+
+    if (buf->transfer.noknem.transfer_state_expected == 0)
+        noknem_ring(ni, &bells->target_bell, buf->dest.shmem.local_rank);
+    else
+        noknem_ring(ni, &bells->init_bell,
+                    buf->mem_buf->shmem.index_owner);
+}
+
+/**
+ * @brief Tell the target the initiator is done with a noknem transfer.
+ *
+ * The done bell is queued after all the other bells rung by the
+ * initiator, so the target knows none of them is left in its queue
+ * when it returns the request buffer.
+ *
+ * @param[in] buf the initiator buf
+ */
+void noknem_notify_done(buf_t *buf)
+{
+    ni_t *ni = obj_to_ni(buf);
+
+    shmem_enqueue(ni, (buf_t *)&buf->transfer.noknem.bells->done_bell,
+                  buf->dest.shmem.local_rank);
+}
+
+static int noknem_do_transfer(buf_t *buf)
+{
+    struct noknem *noknem = buf->transfer.noknem.noknem;
+    ptl_size_t *resid =
+        buf->rdma_dir == DATA_DIR_IN ? &buf->put_resid : &buf->get_resid;
+    ptl_size_t length_left = buf->transfer.noknem.length_left;
+    unsigned int *counter;
+    unsigned int old_counter;
+    int err;
 
+    if (noknem->target_done) {
+        /* Waiting for the initiator, or done. */
+        return PTL_OK;
+    }
+
+    if (buf->transfer.noknem.producer) {
+        counter = &noknem->produced;
+        old_counter = *counter;
+        err = noknem_produce(buf);
     } else {
-        /* Dropped case. Nothing to transfer, but the buffer must
-         * still be returned. */
-        to_copy = 0;
-        err = PTL_OK;
+        counter = &noknem->consumed;
+        old_counter = *counter;
+        err = noknem_consume(buf);
     }
 
-    buf->transfer.noknem.offset += to_copy;
-    *resid -= to_copy;
+    /* That should never happen since all lengths were properly
+     * computed before entering. */
+    assert(err == PTL_OK);
+
+    *resid -= length_left - buf->transfer.noknem.length_left;
 
-    if (*resid == 0)
+    /* The target is done once it has produced all its data, or it
+     * has all the data it needs; for a dropped message, that is
+     * right away. */
+    if (buf->transfer.noknem.length_left == 0) {
+        __sync_synchronize();
         noknem->target_done = 1;
+    }
 
-    /* Tell the initiator the buffer is his again. */
-    __sync_synchronize();
-    noknem->state = 0;
+    if (*counter != old_counter || noknem->target_done)
+        noknem_notify(buf);
 
     return err;
 }
 
+#if HAVE_PROCESS_VM_READV
+/* Number of local iovecs passed to each process_vm_readv/writev. */
+#define CMA_IOV_BATCH 64
+
+/**
+ * @brief Copy the data of a DATA_FMT_CMA transfer.
+ *
+ * Copy between the ME, from the current offset, and the initiator
+ * memory described by the data segment, in one pass.
+ *
+ * @param[in] buf the target buf
+ *
+ * @return status
+ */
+static int cma_do_transfer(buf_t *buf)
+{
+    data_t *data = buf->transfer.noknem.cma;
+    ptl_size_t *resid =
+        buf->rdma_dir == DATA_DIR_IN ? &buf->put_resid : &buf->get_resid;
+    ptl_iovec_t *iov = buf->transfer.noknem.iovecs;
+    ptl_size_t num_iov = buf->transfer.noknem.num_iovecs;
+    ptl_size_t offset = buf->transfer.noknem.offset;
+    struct mem_iovec *rem = data->cma.mem_iovec;
+    ptl_size_t rem_offset = 0;
+    unsigned int r = 0;
+    unsigned int i = 0;
+
+    /* Find the first local iovec. */
+    while (*resid && i < num_iov && offset >= iov[i].iov_len) {
+        offset -= iov[i].iov_len;
+        i++;
+    }
+
+    while (*resid) {
+        struct iovec local[CMA_IOV_BATCH];
+        struct iovec remote;
+        ptl_size_t local_len = 0;
+        ptl_size_t done;
+        ssize_t ret;
+        int num_local = 0;
+        unsigned int j;
+
+        if (r >= data->cma.num_mem_iovecs || i >= num_iov) {
+            WARN();
+            return PTL_FAIL;
+        }
+
+        remote.iov_base = rem[r].addr + rem_offset;
+        remote.iov_len = rem[r].length - rem_offset;
+        if (remote.iov_len > *resid)
+            remote.iov_len = *resid;
+
+        /* Gather the local segments facing the remote one. */
+        for (j = i; j < num_iov && num_local < CMA_IOV_BATCH &&
+             local_len < remote.iov_len; j++) {
+            ptl_size_t off = (j == i) ? offset : 0;
+
+            local[num_local].iov_base = iov[j].iov_base + off;
+            local[num_local].iov_len = iov[j].iov_len - off;
+            local_len += local[num_local].iov_len;
+            num_local++;
+        }
+
+        if (buf->rdma_dir == DATA_DIR_IN)
+            ret =
+                process_vm_readv(data->cma.pid, local, num_local, &remote, 1,
+                                 0);
+        else
+            ret =
+                process_vm_writev(data->cma.pid, local, num_local, &remote, 1,
+                                  0);
+
+        if (ret <= 0) {
+            ptl_warn("cross memory attach with process %d failed (errno=%d)\n",
+                     data->cma.pid, errno);
+            return PTL_FAIL;
+        }
+
+        *resid -= ret;
+        buf->transfer.noknem.offset += ret;
+
+        rem_offset += ret;
+        if (rem_offset == rem[r].length) {
+            r++;
+            rem_offset = 0;
+        }
+
+        for (done = ret; done;) {
+            ptl_size_t bytes = iov[i].iov_len - offset;
+
+            if (bytes > done)
+                bytes = done;
+
+            offset += bytes;
+            done -= bytes;
+
+            if (offset == iov[i].iov_len) {
+                i++;
+                offset = 0;
+            }
+        }
+    }
+
+    return PTL_OK;
+}
+#else
+static int cma_do_transfer(buf_t *buf)
+{
+    abort();
+}
+#endif
+
+/**
+ * @brief Post the data transfer of a target buf.
+ *
+ * @param[in] buf the target buf
+ *
+ * @return status
+ */
+static int shmem_do_transfer(buf_t *buf)
+{
+    if (buf->transfer.noknem.cma)
+        return cma_do_transfer(buf);
+    else
+        return noknem_do_transfer(buf);
+}
+
 static int noknem_tgt_data_out(buf_t *buf, data_t *data)
 {
     ni_t *ni = obj_to_ni(buf);
 
-    if (data->data_fmt != DATA_FMT_NOKNEM) {
+    if (data->data_fmt != DATA_FMT_NOKNEM && data->data_fmt != DATA_FMT_CMA) {
         assert(0);
         WARN();
         return STATE_TGT_ERROR;
     }
 
     buf->transfer.noknem.transfer_state_expected = 2;   /* always the target here */
-    buf->transfer.noknem.noknem = &data->noknem;
+    buf->transfer.noknem.noknem = NULL;
+    buf->transfer.noknem.cma = NULL;
 
     if ((buf->rdma_dir == DATA_DIR_IN && buf->put_resid) ||
         (buf->rdma_dir == DATA_DIR_OUT && buf->get_resid)) {
@@ -438,10 +1164,30 @@ static int noknem_tgt_data_out(buf_t *buf, data_t *data)
     }
 
     buf->transfer.noknem.offset = buf->moffset;
-    buf->transfer.noknem.length_left = buf->get_resid;
+    buf->transfer.noknem.length_left =
+        buf->rdma_dir == DATA_DIR_IN ? buf->put_resid : buf->get_resid;
+
+    /* The initiator memory is copied directly, without going through
+     * the noknem_list. */
+    if (data->data_fmt == DATA_FMT_CMA) {
+        buf->transfer.noknem.cma = data;
+        return STATE_TGT_RDMA;
+    }
+
+    buf->transfer.noknem.noknem = &data->noknem;
+    buf->transfer.noknem.producer = (buf->rdma_dir == DATA_DIR_OUT);
     buf->transfer.noknem.data =
         (void *)ni->shmem.bounce_buf.head + data->noknem.bounce_offset;
-    buf->transfer.noknem.data_length = ni->shmem.bounce_buf.buf_size;
+    buf->transfer.noknem.data_length =
+        (ptl_size_t)data->noknem.chunk_size * data->noknem.num_chunks;
+    buf->transfer.noknem.bells =
+        (void *)buf->mem_buf->internal_data + data->noknem.bells_offset;
+    buf->transfer.noknem.bells->target_bell.buf = buf;
+    buf->transfer.noknem.bells->done_bell.buf = buf;
+    buf->transfer.noknem.init_done = 0;
+
+    if (buf->transfer.noknem.producer)
+        data->noknem.length = buf->transfer.noknem.length_left;
 
     return STATE_TGT_START_COPY;
 }
@@ -459,11 +1205,24 @@ struct transport transport_shmem = {
     .tgt_data_out = knem_tgt_data_out,
 #else
     .init_prepare_transfer = noknem_init_prepare_transfer,
-    .post_tgt_dma = noknem_do_transfer,
+    .post_tgt_dma = shmem_do_transfer,
     .tgt_data_out = noknem_tgt_data_out,
 #endif
 };
 
+/**
+ * @brief Remove the comm pad file.
+ *
+ * @param[in] ni
+ */
+static void comm_pad_unlink(ni_t *ni)
+{
+    if (ni->shmem.comm_pad_huge_path)
+        unlink(ni->shmem.comm_pad_huge_path);
+    else
+        shm_unlink(ni->shmem.comm_pad_shm_name);
+}
+
 /**
  * @brief Cleanup shared memory resources.
  *
@@ -481,18 +1240,127 @@ static void release_shmem_resources(ni_t *ni)
     if (ni->shmem.comm_pad_shm_name) {
         /* Destroy the mmaped file so it doesn't pollute.
          * All ranks try it in case rank 0 died. */
-        shm_unlink(ni->shmem.comm_pad_shm_name);
+        comm_pad_unlink(ni);
 
         free(ni->shmem.comm_pad_shm_name);
         ni->shmem.comm_pad_shm_name = NULL;
     }
 
+    free(ni->shmem.comm_pad_huge_path);
+    ni->shmem.comm_pad_huge_path = NULL;
+
+    if (ni->shmem.deferred) {
+        PTL_FASTLOCK_DESTROY(&ni->shmem.deferred_lock);
+        free(ni->shmem.deferred);
+        ni->shmem.deferred = NULL;
+    }
+    ni->shmem.ring = NULL;
+
+    if (ni->shmem.eager_tx) {
+        int i;
+
+        for (i = 0; i < ni->mem.node_size; i++)
+            PTL_FASTLOCK_DESTROY(&ni->shmem.eager_tx[i].lock);
+        free(ni->shmem.eager_tx);
+        ni->shmem.eager_tx = NULL;
+    }
+    free(ni->shmem.eager_rx);
+    ni->shmem.eager_rx = NULL;
+
     knem_fini(ni);
+}
+
+/**
+ * @brief Create and map the comm pad in a hugetlbfs file.
+ *
+ * The file is created under a temporary name and renamed once it is
+ * mapped, which reserves its huge pages, so the other ranks never open
+ * a file rank 0 may still give up on.
+ *
+ * @param[in] ni
+ * @param[in] path the name of the file
+ *
+ * @return status
+ */
+static int comm_pad_create_huge(ni_t *ni, const char *path)
+{
+    char tmp_path[PATH_MAX];
+    size_t size;
+    void *p;
+    int fd;
+
+    size = ROUND_UP(ni->shmem.comm_pad_size, HUGE_PAGE_SIZE);
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    unlink(tmp_path);
+
+    fd = open(tmp_path, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return PTL_FAIL;
+
+    if (ftruncate(fd, size) == 0) {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            if (rename(tmp_path, path) == 0) {
+                close(fd);
+                ni->shmem.comm_pad = p;
+                ni->shmem.comm_pad_size = size;
+                ni->shmem.comm_pad_huge_path = strdup(path);
+                return PTL_OK;
+            }
+            munmap(p, size);
+        }
+    }
+
+    close(fd);
+    unlink(tmp_path);
+
+    return PTL_FAIL;
+}
 
 #if !USE_KNEM
-    PTL_FASTLOCK_DESTROY(&ni->shmem.noknem_lock);
+/**
+ * @brief Check whether this rank can access the memory of all the local
+ * ranks with cross memory attach.
+ *
+ * That depends on the ptrace restrictions of the system, so each
+ * local rank is asked for its copy of its ID.
+ *
+ * @param[in] ni
+ * @param[in] pid_table the filled PID table of the comm pad
+ *
+ * @return 1 if it can, 0 otherwise
+ */
+static int cma_probe(ni_t *ni, struct shmem_pid_table *pid_table)
+{
+#if HAVE_PROCESS_VM_READV
+    int i;
+
+    if (!get_param(PTL_SHMEM_CMA))
+        return 0;
+
+    for (i = 0; i < ni->mem.node_size; i++) {
+        ptl_process_t id;
+        struct iovec local = {
+            .iov_base = &id,
+            .iov_len = sizeof(id),
+        };
+        struct iovec remote = {
+            .iov_base = pid_table[i].cma_addr,
+            .iov_len = sizeof(id),
+        };
+
+        if (process_vm_readv(pid_table[i].os_pid, &local, 1, &remote, 1, 0)
+            != sizeof(id) || memcmp(&id, &pid_table[i].id, sizeof(id)))
+            return 0;
+    }
+
+    return 1;
+#else
+    return 0;
 #endif
 }
+#endif
 
 /**
  * @brief Initialize shared memory resources.
@@ -511,6 +1379,8 @@ static int setup_commpad(ni_t *ni)
     int err;
     int i;
     int pid_table_size;
+    char huge_path[PATH_MAX] = "";
+    enum huge_backing backing = HUGE_BACKING_NONE;
 
     /*
      * Buffers in shared memory. The buffers will be allocated later,
@@ -546,9 +1416,83 @@ static int setup_commpad(ni_t *ni)
     }
     ni->shmem.comm_pad_shm_name = strdup(comm_pad_shm_name);
 
+    /* With huge pages, the comm pad is a file in a hugetlbfs mount if
+     * there is one, else transparent huge pages are asked for the
+     * shared memory file. */
+    if (get_param(PTL_HUGE_PAGES) && huge_page_dir())
+        snprintf(huge_path, sizeof(huge_path), "%s%s", huge_page_dir(),
+                 comm_pad_shm_name);
+
+    /* With PTL_SHMEM_RING, the ring goes between the queue and the
+     * buffers. All the local ranks must set it alike. */
+    ni->shmem.ring_slots = get_param(PTL_SHMEM_RING);
+    if (ni->shmem.ring_slots) {
+        unsigned int slots = 1;
+
+        while (slots < ni->shmem.ring_slots)
+            slots <<= 1;
+        ni->shmem.ring_slots = slots;
+
+        ni->shmem.deferred =
+            calloc(ni->mem.node_size, sizeof(struct shmem_deferred));
+        if (!ni->shmem.deferred) {
+            WARN();
+            goto exit_fail;
+        }
+        ni->shmem.num_deferred = 0;
+        PTL_FASTLOCK_INIT(&ni->shmem.deferred_lock);
+    }
+
+    /* With PTL_SHMEM_EAGER, each rank then has a channel of receive
+     * slots for every local rank, itself included. */
+    ni->shmem.eager_slots = get_param(PTL_SHMEM_EAGER);
+    if (ni->shmem.eager_slots) {
+        unsigned int slots = 1;
+
+        while (slots < ni->shmem.eager_slots)
+            slots <<= 1;
+        ni->shmem.eager_slots = slots;
+
+        ni->shmem.eager_slot_size =
+            ROUND_UP(get_param(PTL_SHMEM_EAGER_SIZE), CACHELINE_WIDTH);
+        ni->shmem.eager_max_length =
+            ni->shmem.eager_slot_size - sizeof(struct shmem_eager_slot);
+        ni->shmem.eager_chan_size = sizeof(struct shmem_eager) +
+            (size_t)slots * ni->shmem.eager_slot_size;
+
+        /* The target gives the credits back a quarter of the slots at
+         * a time. */
+        ni->shmem.eager_batch = slots >= 4 ? slots / 4 : 1;
+
+        ni->shmem.eager_tx =
+            calloc(ni->mem.node_size, sizeof(struct shmem_eager_tx));
+        ni->shmem.eager_rx =
+            calloc(ni->mem.node_size, sizeof(unsigned long));
+        if (!ni->shmem.eager_tx || !ni->shmem.eager_rx) {
+            WARN();
+            goto exit_fail;
+        }
+        for (i = 0; i < ni->mem.node_size; i++)
+            PTL_FASTLOCK_INIT(&ni->shmem.eager_tx[i].lock);
+        atomic_set(&ni->shmem.eager_num_deferred, 0);
+    }
+
     /* Allocate a pool of buffers in the mmapped region. */
     ni->shmem.per_proc_comm_buf_size =
         sizeof(queue_t) + ni->sbuf_pool.slab_size;
+    if (ni->shmem.ring_slots)
+        ni->shmem.per_proc_comm_buf_size +=
+            ring_size(ni->shmem.ring_slots);
+    ni->shmem.eager_offset =
+        ni->shmem.per_proc_comm_buf_size - ni->sbuf_pool.slab_size;
+    if (ni->shmem.eager_slots)
+        ni->shmem.per_proc_comm_buf_size +=
+            ni->shmem.eager_chan_size * ni->mem.node_size;
+
+    /* Give each rank whole pages, to place them on its NUMA node. */
+    if (get_param(PTL_NUMA_BIND))
+        ni->shmem.per_proc_comm_buf_size =
+            ROUND_UP(ni->shmem.per_proc_comm_buf_size, pagesize);
 
     pid_table_size = ni->mem.node_size * sizeof(struct shmem_pid_table);
     pid_table_size = ROUND_UP(pid_table_size, pagesize);
@@ -562,11 +1506,22 @@ static int setup_commpad(ni_t *ni)
     off_t bounce_buf_offset;
     off_t bounce_head_offset;
 
+    /* With PTL_NUMA_BIND, each rank has its own bounce buffers on its
+     * node, and their own free list. */
+    ni->shmem.bounce_buf.num_lists =
+        get_param(PTL_NUMA_BIND) ? ni->mem.node_size : 1;
+
     bounce_head_offset = ni->shmem.comm_pad_size;
     ni->shmem.comm_pad_size +=
-        ROUND_UP(sizeof(struct shmem_bounce_head), pagesize);
-
-    ni->shmem.bounce_buf.buf_size = get_param(PTL_BOUNCE_BUF_SIZE);
+        ROUND_UP(sizeof(struct shmem_bounce_head) +
+                 ni->shmem.bounce_buf.num_lists * sizeof(union counted_ptr),
+                 pagesize);
+
+    ni->shmem.bounce_buf.chunk_size = get_param(PTL_BOUNCE_BUF_SIZE);
+    ni->shmem.bounce_buf.num_chunks = get_param(PTL_BOUNCE_DEPTH);
+    ni->shmem.bounce_buf.buf_size =
+        (size_t)ni->shmem.bounce_buf.chunk_size *
+        ni->shmem.bounce_buf.num_chunks;
     ni->shmem.bounce_buf.num_bufs = get_param(PTL_BOUNCE_NUM_BUFS);
 
     bounce_buf_offset = ni->shmem.comm_pad_size;
@@ -580,7 +1535,17 @@ static int setup_commpad(ni_t *ni)
     if (ni->mem.index == 0) {
         /* Just in case, remove that file if it already exist. */
         shm_unlink(comm_pad_shm_name);
+        if (huge_path[0]) {
+            unlink(huge_path);
+
+            if (comm_pad_create_huge(ni, huge_path) == PTL_OK)
+                backing = HUGE_BACKING_HUGETLB;
+        }
+    }
 
+    if (ni->shmem.comm_pad != MAP_FAILED) {
+        /* Already mapped on huge pages. */
+    } else if (ni->mem.index == 0) {
         shm_fd =
             shm_open(comm_pad_shm_name, O_RDWR | O_CREAT | O_EXCL,
                      S_IRUSR | S_IWUSR);
@@ -602,9 +1567,20 @@ static int setup_commpad(ni_t *ni)
         int try_count;
 
         /* Try for 10 seconds. That should leave enough time for rank
-         * 0 to create the file. */
+         * 0 to create the file, in hugetlbfs or in shared memory. */
         try_count = 100;
         do {
+            if (huge_path[0]) {
+                shm_fd = open(huge_path, O_RDWR);
+                if (shm_fd != -1) {
+                    ni->shmem.comm_pad_huge_path = strdup(huge_path);
+                    ni->shmem.comm_pad_size =
+                        ROUND_UP(ni->shmem.comm_pad_size, HUGE_PAGE_SIZE);
+                    backing = HUGE_BACKING_HUGETLB;
+                    break;
+                }
+            }
+
             shm_fd = shm_open(comm_pad_shm_name, O_RDWR, S_IRUSR | S_IWUSR);
 
             if (shm_fd != -1)
@@ -644,29 +1620,61 @@ static int setup_commpad(ni_t *ni)
         }
     }
 
-    /* Fill our portion of the comm pad. */
-    ni->shmem.comm_pad =
-        (uint8_t *) mmap(NULL, ni->shmem.comm_pad_size,
-                         PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
     if (ni->shmem.comm_pad == MAP_FAILED) {
-        ptl_warn("mmap failed (%d)", errno);
-        perror("");
-        goto exit_fail;
+        /* Fill our portion of the comm pad. */
+        ni->shmem.comm_pad =
+            (uint8_t *) mmap(NULL, ni->shmem.comm_pad_size,
+                             PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+        if (ni->shmem.comm_pad == MAP_FAILED) {
+            ptl_warn("mmap failed (%d)", errno);
+            perror("");
+            goto exit_fail;
+        }
+
+        /* The share memory is mmaped, so we can close the file. */
+        close(shm_fd);
+        shm_fd = -1;
+
+#ifdef MADV_HUGEPAGE
+        if (get_param(PTL_HUGE_PAGES) && backing == HUGE_BACKING_NONE &&
+            huge_thp_enabled(1) &&
+            madvise(ni->shmem.comm_pad, ni->shmem.comm_pad_size,
+                    MADV_HUGEPAGE) == 0)
+            backing = HUGE_BACKING_THP;
+#endif
     }
 
-    /* The share memory is mmaped, so we can close the file. */
-    close(shm_fd);
-    shm_fd = -1;
+    ptl_info("comm pad %s of %zu bytes uses %s\n", comm_pad_shm_name,
+             ni->shmem.comm_pad_size, huge_backing_name[backing]);
 
     /* Now we can create the buffer pool */
     ni->shmem.first_queue = ni->shmem.comm_pad + pid_table_size;
     ni->shmem.queue =
         (queue_t *)(ni->shmem.first_queue +
                     (ni->shmem.per_proc_comm_buf_size * ni->mem.index));
+    if (ni->numa_node >= 0)
+        numa_bind_area(ni->shmem.queue, ni->shmem.per_proc_comm_buf_size,
+                       ni->numa_node);
     queue_init(ni->shmem.queue);
 
-    /* The buffer is right after the nemesis queue. */
+    /* The buffer is right after the nemesis queue, or after the ring
+     * that follows it. */
     ni->sbuf_pool.pre_alloc_buffer = (void *)(ni->shmem.queue + 1);
+    if (ni->shmem.ring_slots) {
+        ni->shmem.ring = ni->sbuf_pool.pre_alloc_buffer;
+        ring_init(ni->shmem.ring, ni->shmem.ring_slots);
+        ni->shmem.batch_next = 0;
+        ni->shmem.batch_count = 0;
+        ni->sbuf_pool.pre_alloc_buffer += ring_size(ni->shmem.ring_slots);
+    }
+    if (ni->shmem.eager_slots) {
+        /* The other ranks only write to the channels once we are
+         * announced below. */
+        memset(ni->sbuf_pool.pre_alloc_buffer, 0,
+               ni->shmem.eager_chan_size * ni->mem.node_size);
+        ni->sbuf_pool.pre_alloc_buffer +=
+            ni->shmem.eager_chan_size * ni->mem.node_size;
+    }
 
     err =
         pool_init(ni->iface->gbl, &ni->sbuf_pool, "sbuf", real_buf_t_size(),
@@ -683,14 +1691,9 @@ static int setup_commpad(ni_t *ni)
 
     if (ni->mem.index == 0) {
         ni->shmem.bounce_buf.head->head_index0 = ni->shmem.bounce_buf.head;
-        ll_init(&ni->shmem.bounce_buf.head->free_list);
-
-        for (i = 0; i < ni->shmem.bounce_buf.num_bufs; i++) {
-            void *bb =
-                ni->shmem.bounce_buf.bbs + i * ni->shmem.bounce_buf.buf_size;
 
-            ll_enqueue_obj(&ni->shmem.bounce_buf.head->free_list, bb);
-        }
+        if (ni->shmem.bounce_buf.num_lists == 1)
+            bounce_buf_link_own(ni);
     }
 #endif
 
@@ -702,6 +1705,8 @@ static int setup_commpad(ni_t *ni)
             (struct shmem_pid_table *)ni->shmem.comm_pad;
 
         pid_table[ni->mem.index].id = ni->id;
+        pid_table[ni->mem.index].os_pid = getpid();
+        pid_table[ni->mem.index].cma_addr = &ni->id;
         __sync_synchronize();          /* ensure "valid" is not written before pid. */
         pid_table[ni->mem.index].valid = 1;
 
@@ -713,10 +1718,26 @@ static int setup_commpad(ni_t *ni)
                 SPINLOCK_BODY();
         }
 
+#if !USE_KNEM
+        /* Let the initiators know whether they can leave the copies
+         * to this rank. */
+        pid_table[ni->mem.index].cma = cma_probe(ni, pid_table);
+        ptl_info("cross memory attach %s\n",
+                 pid_table[ni->mem.index].cma ? "enabled" : "disabled");
+#endif
+
         /* All ranks have mmaped the memory. Get rid of the file. */
-        shm_unlink(ni->shmem.comm_pad_shm_name);
+        comm_pad_unlink(ni);
         free(ni->shmem.comm_pad_shm_name);
         ni->shmem.comm_pad_shm_name = NULL;
+
+#if !USE_KNEM
+        /* Rank 0 has set head_index0. Until the other ranks link
+         * their buffers, bounce_buf_alloc() finds them elsewhere or
+         * waits. */
+        if (ni->shmem.bounce_buf.num_lists > 1)
+            bounce_buf_link_own(ni);
+#endif
     }
 
     return PTL_OK;
@@ -742,20 +1763,106 @@ void shmem_enqueue(ni_t *ni, buf_t *buf, ptl_pid_t dest)
     queue_t *queue =
         (queue_t *)(ni->shmem.first_queue +
                     (ni->shmem.per_proc_comm_buf_size * dest));
+    struct shmem_deferred *deferred;
 
     buf->obj.next = NULL;
 
-    enqueue(ni->shmem.comm_pad, queue, &buf->obj);
+    if (!ni->shmem.ring_slots) {
+        enqueue(ni->shmem.comm_pad, queue, &buf->obj);
+        return;
+    }
+
+    /* Go through the ring, unless earlier bufs for that rank are
+     * still waiting for room in it. */
+    deferred = &ni->shmem.deferred[dest];
+    if (!deferred->head &&
+        ring_enqueue(ni->shmem.comm_pad, (ring_t *)(queue + 1),
+                     &buf->obj) == PTL_OK)
+        return;
+
+    /* The ring is full. Don't wait for the target to make room; the
+     * progress thread will send it later, in order. */
+    PTL_FASTLOCK_LOCK(&ni->shmem.deferred_lock);
+
+    if (!deferred->head &&
+        ring_enqueue(ni->shmem.comm_pad, (ring_t *)(queue + 1),
+                     &buf->obj) == PTL_OK) {
+        PTL_FASTLOCK_UNLOCK(&ni->shmem.deferred_lock);
+        return;
+    }
+
+    if (deferred->head)
+        deferred->tail->next = &buf->obj;
+    else
+        deferred->head = &buf->obj;
+    deferred->tail = &buf->obj;
+    ni->shmem.num_deferred++;
+
+    PTL_FASTLOCK_UNLOCK(&ni->shmem.deferred_lock);
+}
+
+/**
+ * @brief Send the bufs waiting for room in the rings of other ranks.
+ *
+ * Called by the progress thread.
+ *
+ * @param[in] ni the network interface
+ */
+void shmem_flush_deferred(ni_t *ni)
+{
+    int i;
+
+    PTL_FASTLOCK_LOCK(&ni->shmem.deferred_lock);
+
+    for (i = 0; i < ni->mem.node_size && ni->shmem.num_deferred; i++) {
+        struct shmem_deferred *deferred = &ni->shmem.deferred[i];
+        ring_t *ring =
+            (ring_t *)((queue_t *)(ni->shmem.first_queue +
+                                   (ni->shmem.per_proc_comm_buf_size *
+                                    i)) + 1);
+
+        /* The head stays on the list until it is in the ring, so
+         * that newer bufs for the same rank don't pass it. */
+        while (deferred->head) {
+            obj_t *obj = deferred->head;
+            obj_t *next = obj->next;
+
+            obj->next = NULL;
+            if (ring_enqueue(ni->shmem.comm_pad, ring, obj) != PTL_OK) {
+                obj->next = next;
+                break;
+            }
+
+            deferred->head = next;
+            ni->shmem.num_deferred--;
+        }
+    }
+
+    PTL_FASTLOCK_UNLOCK(&ni->shmem.deferred_lock);
 }
 
 /**
  * @brief dequeue a buf using shared memory.
  *
+ * With a ring, bufs are taken from it in batches.
+ *
  * @param[in] ni the network interface.
  */
 buf_t *shmem_dequeue(ni_t *ni)
 {
-    return (buf_t *)dequeue(ni->shmem.comm_pad, ni->shmem.queue);
+    if (!ni->shmem.ring)
+        return (buf_t *)dequeue(ni->shmem.comm_pad, ni->shmem.queue);
+
+    if (ni->shmem.batch_next == ni->shmem.batch_count) {
+        ni->shmem.batch_next = 0;
+        ni->shmem.batch_count =
+            ring_dequeue(ni->shmem.comm_pad, ni->shmem.ring,
+                         (obj_t **)ni->shmem.batch, SHMEM_RING_BATCH);
+        if (!ni->shmem.batch_count)
+            return NULL;
+    }
+
+    return ni->shmem.batch[ni->shmem.batch_next++];
 }
 
 /**
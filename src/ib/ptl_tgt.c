@@ -259,15 +259,26 @@ static int prepare_send_buf(buf_t *buf)
     /* Determine whether to reuse the current buffer to reply, or get
      * a new one. */
 #if WITH_TRANSPORT_IB
-    if (buf->conn->transport.type == CONN_TYPE_RDMA)
-        err = buf_alloc(ni, &send_buf);
-    else
+    if (buf->conn->transport.type == CONN_TYPE_RDMA) {
+        /* An ACK only needs a header. */
+        if (buf->event_mask & XT_REPLY_EVENT)
+            err = buf_alloc(ni, &send_buf);
+        else
+            err = small_buf_alloc(ni, &send_buf);
+    } else
 #endif
     {
         if (!(buf->event_mask & XT_ACK_EVENT)) {
             /* No ack but a reply. The current buffer cannot be
              * reused. */
             err = buf->conn->transport.buf_alloc(ni, &send_buf);
+#if WITH_TRANSPORT_SHMEM
+        } else if (buf->conn->transport.type == CONN_TYPE_SHMEM &&
+                   !buf->mem_buf) {
+            /* The request was copied into an eager slot, which is
+             * given back before the ack is sent. */
+            err = buf->conn->transport.buf_alloc(ni, &send_buf);
+#endif
         } else {
             /* Itself. */
             send_buf = NULL;
@@ -418,6 +429,7 @@ static int tgt_start(buf_t *buf)
 
     /* initialize fields */
     INIT_LIST_HEAD(&buf->unexpected_list);
+    INIT_LIST_HEAD(&buf->unexpected_index_list);
 #if WITH_TRANSPORT_IB
     INIT_LIST_HEAD(&buf->transfer.rdma.rdma_list);
 #endif
@@ -441,7 +453,10 @@ static int tgt_start(buf_t *buf)
         buf->conn = get_conn(ni, initiator);
     }
     buf->conn->state = CONN_STATE_CONNECTED;
-    buf->conn->udp.dest_addr = buf->conn->sin;
+    /* The udp and shmem parts of the conn share storage, so only touch
+     * the address of an actual UDP connection. */
+    if (buf->conn->transport.type == CONN_TYPE_UDP)
+        buf->conn->udp.dest_addr = buf->conn->sin;
 #endif
 #if !WITH_TRANSPORT_UDP
     buf->conn = get_conn(ni, initiator);
@@ -635,6 +650,36 @@ static int tgt_get_match(buf_t *buf)
     /* Synchronize with LE/ME append/search APIs */
     PTL_FASTLOCK_LOCK(&pt->lock);
 
+    /* Use the hash index if the PT has one. It finds the same ME
+     * as the list walks below. */
+    if (match_index_enabled(&pt->priority_index)) {
+        buf->me = match_index_find(&pt->priority_index, buf);
+        if (!buf->me)
+            buf->me = match_index_find(&pt->overflow_index, buf);
+
+        if (buf->me) {
+            me_get(buf->me);
+            goto found_one;
+        }
+
+        goto no_match;
+    }
+
+    /* Otherwise scan the compact copies of the lists if the PT has
+     * them. */
+    if (match_shadow_enabled(&pt->priority_shadow)) {
+        buf->me = match_shadow_find(&pt->priority_shadow, buf);
+        if (!buf->me)
+            buf->me = match_shadow_find(&pt->overflow_shadow, buf);
+
+        if (buf->me) {
+            me_get(buf->me);
+            goto found_one;
+        }
+
+        goto no_match;
+    }
+
     /* Check the priority list.
      * If we find a match take a reference to protect
      * the list element pointer.
@@ -664,6 +709,7 @@ static int tgt_get_match(buf_t *buf)
         }
     }
 
+  no_match:
     /* Failed to match any elements */
     if (pt->options & PTL_PT_FLOWCTRL) {
         pt->state |= PT_AUTO_DISABLED;
@@ -729,6 +775,8 @@ static int tgt_get_match(buf_t *buf)
             buf->unexpected_busy = 1;
 
             list_add_tail(&buf->unexpected_list, &pt->unexpected_list);
+            if (unexpected_index_enabled(&pt->unexpected_index))
+                unexpected_index_add(&pt->unexpected_index, buf);
 
 #if WITH_TRANSPORT_SHMEM || IS_PPE
             /* If it is a shared memory buffer, then the data is actually
@@ -955,6 +1003,225 @@ static int tgt_wait_conn(buf_t *buf)
     return STATE_TGT_DATA;
 }
 
+/** each atomic lock covers 64 byte lines of ME memory */
+#define ATOMIC_LOCK_SHIFT	(6)
+
+/** what atomic_locks_range() does with the locks */
+enum atomic_lock_mode {
+    ATOMIC_UNLOCK,
+    ATOMIC_LOCK_SHARED,
+    ATOMIC_LOCK_EXCL,
+};
+
+/**
+ * @brief Apply a lock mode to one atomic lock.
+ *
+ * @param[in] lock The atomic lock.
+ * @param[in] mode The lock mode.
+ */
+static inline void atomic_lock_one(pthread_rwlock_t *lock,
+                                   enum atomic_lock_mode mode)
+{
+    switch (mode) {
+        case ATOMIC_UNLOCK:
+            pthread_rwlock_unlock(lock);
+            break;
+        case ATOMIC_LOCK_SHARED:
+            pthread_rwlock_rdlock(lock);
+            break;
+        case ATOMIC_LOCK_EXCL:
+            pthread_rwlock_wrlock(lock);
+            break;
+    }
+}
+
+/**
+ * @brief Lock or unlock a range of atomic locks.
+ *
+ * Locks are always taken in increasing index order, so two operations
+ * covering overlapping ranges cannot deadlock.
+ *
+ * @param[in] ni The network interface.
+ * @param[in] first The first lock index.
+ * @param[in] count The number of locks, wrapping around.
+ * @param[in] mode Whether to lock, shared or exclusive, or unlock.
+ */
+static void atomic_locks_range(ni_t *ni, unsigned int first,
+                               unsigned int count,
+                               enum atomic_lock_mode mode)
+{
+    unsigned int num = ni->num_atomic_locks;
+    unsigned int end = first + count;
+    unsigned int i;
+
+    /* The part that wrapped around comes first in index order. */
+    for (i = 0; end > num && i < end - num; i++)
+        atomic_lock_one(&ni->atomic_locks[i], mode);
+
+    for (i = first; i < end && i < num; i++)
+        atomic_lock_one(&ni->atomic_locks[i], mode);
+}
+
+/**
+ * @brief Take the atomic locks covering the target bytes of an
+ * atomic, fetch or swap operation.
+ *
+ * Operations touching different cache lines usually hold different
+ * locks and can proceed in parallel, even on the same ME. MEs with an
+ * iovec take every lock.
+ *
+ * @param[in] buf The message buf received by the target.
+ * @param[in] mode ATOMIC_LOCK_SHARED for single element operations done
+ * with processor atomics, ATOMIC_LOCK_EXCL otherwise.
+ */
+static void tgt_atomic_lock(buf_t *buf, enum atomic_lock_mode mode)
+{
+    ni_t *ni = obj_to_ni(buf);
+    const me_t *me = buf->me;
+    unsigned int num = ni->num_atomic_locks;
+
+    if (me->num_iov) {
+        buf->atomic_lock_first = 0;
+        buf->atomic_lock_count = num;
+    } else if (buf->mlength == 0) {
+        buf->atomic_lock_first = 0;
+        buf->atomic_lock_count = 0;
+    } else {
+        uintptr_t start = (uintptr_t)me->start + buf->moffset;
+        uintptr_t first = start >> ATOMIC_LOCK_SHIFT;
+        uintptr_t last = (start + buf->mlength - 1) >> ATOMIC_LOCK_SHIFT;
+
+        if (last - first + 1 >= num) {
+            buf->atomic_lock_first = 0;
+            buf->atomic_lock_count = num;
+        } else {
+            buf->atomic_lock_first = first & (num - 1);
+            buf->atomic_lock_count = last - first + 1;
+        }
+    }
+
+    atomic_locks_range(ni, buf->atomic_lock_first, buf->atomic_lock_count,
+                       mode);
+    buf->in_atomic = 1;
+}
+
+/**
+ * @brief Release the atomic locks taken by tgt_atomic_lock().
+ *
+ * @param[in] buf The message buf received by the target.
+ */
+static void tgt_atomic_unlock(buf_t *buf)
+{
+    atomic_locks_range(obj_to_ni(buf), buf->atomic_lock_first,
+                       buf->atomic_lock_count, ATOMIC_UNLOCK);
+    buf->in_atomic = 0;
+}
+
+#if !IS_PPE
+/**
+ * @brief Check whether an atomic, fetch or swap operation can be done
+ * with processor atomics.
+ *
+ * This is the case when the NI provides atomics coherent with the
+ * processor and the operation works on naturally aligned 32 or 64 bit
+ * integers in contiguous ME memory, with all the data inline.
+ *
+ * @param[in] buf The message buf received by the target.
+ *
+ * @return non zero if tgt_coherent_atomic() can handle the operation.
+ */
+static int tgt_coherent_atomic_ok(buf_t *buf)
+{
+    const ni_t *ni = obj_to_ni(buf);
+    const req_hdr_t *hdr = (req_hdr_t *) buf->data;
+    const me_t *me = buf->me;
+    int size;
+
+    if (!(ni->limits.features & PTL_COHERENT_ATOMICS))
+        return 0;
+
+    if (me->num_iov || !buf->mlength || !buf->put_resid)
+        return 0;
+
+    if (!atomic_coherent_ok(hdr->atom_op, hdr->atom_type))
+        return 0;
+
+    /* Atomic and fetch operations are not swaps, and the reverse. */
+    if ((buf->operation == OP_SWAP) != !!op_info[hdr->atom_op].swap_ok)
+        return 0;
+
+    size = atom_type_size[hdr->atom_type];
+    if (buf->mlength % size ||
+        ((uintptr_t)me->start + buf->moffset) & (size - 1))
+        return 0;
+
+    if (!buf->data_in || buf->data_in->data_fmt != DATA_FMT_IMMEDIATE)
+        return 0;
+
+    if (buf->get_resid &&
+        (!buf->data_out || buf->data_out->data_fmt != DATA_FMT_IMMEDIATE))
+        return 0;
+
+    return 1;
+}
+
+/**
+ * @brief Apply an atomic, fetch or swap operation with processor
+ * atomics.
+ *
+ * A single element operation without data out holds its atomic locks
+ * shared, so it only excludes the locked path of tgt_data() and runs in
+ * parallel with other such operations. Multi element operations and
+ * those returning the previous target data hold them exclusively, so
+ * the reply is consistent with the whole range. The previous target
+ * data, if requested, is captured by the same atomic instructions and
+ * appended to the reply.
+ *
+ * @param[in] buf The message buf received by the target.
+ *
+ * @return The next state.
+ */
+static int tgt_coherent_atomic(buf_t *buf)
+{
+    const req_hdr_t *hdr = (req_hdr_t *) buf->data;
+    me_t *me = buf->me;
+    uint8_t fetch[buf->mlength];
+    int err;
+
+    assert(buf->mlength <= get_param(PTL_MAX_INLINE_DATA));
+
+    if (buf->mlength == atom_type_size[hdr->atom_type] && !buf->get_resid)
+        tgt_atomic_lock(buf, ATOMIC_LOCK_SHARED);
+    else
+        tgt_atomic_lock(buf, ATOMIC_LOCK_EXCL);
+
+    err = atomic_coherent_apply(hdr->atom_op, hdr->atom_type,
+                                me->start + buf->moffset,
+                                buf->data_in->immediate.data,
+                                buf->data + sizeof(req_hdr_t),
+                                buf->get_resid ? fetch : NULL,
+                                buf->mlength);
+
+    tgt_atomic_unlock(buf);
+
+    if (err)
+        return STATE_TGT_ERROR;
+
+    if (buf->get_resid) {
+        ack_hdr_t *send_hdr = (ack_hdr_t *) buf->send_buf->data;
+
+        send_hdr->h1.data_out = 1;
+
+        err = append_immediate_data(fetch, NULL, 0, DATA_DIR_OUT, 0,
+                                    buf->mlength, buf->send_buf);
+        if (err)
+            return STATE_TGT_ERROR;
+    }
+
+    return STATE_TGT_COMM_EVENT;
+}
+#endif
+
 /**
  * @brief target data state.
  *
@@ -967,8 +1234,6 @@ static int tgt_wait_conn(buf_t *buf)
  */
 static int tgt_data(buf_t *buf)
 {
-    ni_t *ni = obj_to_ni(buf);
-
     /* save the addressing information to the initiator
      * in buf */
     if (buf->conn->state >= CONN_STATE_CONNECTED)
@@ -976,16 +1241,18 @@ static int tgt_data(buf_t *buf)
 
     /* This implementation guarantees atomicity between
      * the three atomic type operations by only alowing a
-     * single operation at a time to be processed. */
+     * single operation at a time to be processed on any
+     * given byte of ME memory. */
 
-    // TODO we could improve performance by having more locks
-    // here covering operations that do no overlap. Also
-    // we could think some more about how to protect between
+    // TODO we could think some more about how to protect between
     // atomic and regular get/put operations.
     if (buf->operation == OP_ATOMIC || buf->operation == OP_SWAP ||
         buf->operation == OP_FETCH) {
-        pthread_mutex_lock(&ni->atomic_mutex);
-        buf->in_atomic = 1;
+#if !IS_PPE
+        if (tgt_coherent_atomic_ok(buf))
+            return tgt_coherent_atomic(buf);
+#endif
+        tgt_atomic_lock(buf, ATOMIC_LOCK_EXCL);
     }
 
     /* process data out, then data in */
@@ -1128,12 +1395,11 @@ static int tgt_data_out(buf_t *buf)
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
 static int tgt_start_copy(buf_t *buf)
 {
-    /* Add to the data queue. */
+    /* Keep the request buffer until the initiator is done. The
+     * rest of the transfer is driven by the bells it rings. */
     ni_t *ni = obj_to_ni(buf);
 
-    PTL_FASTLOCK_LOCK(&ni->shmem.noknem_lock);
     list_add_tail(&buf->list, &ni->shmem.noknem_list);
-    PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
 
     return STATE_TGT_RDMA;
 }
@@ -1166,16 +1432,13 @@ static int tgt_rdma(buf_t *buf)
     int was_done;
     was_done = 0;
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
-    /* It is possible that post_tgt_dma() sets the target_done flag,
-     * and that the initiator replies with init_done before we reach
-     * the exit test. However we must leave the state machine so the
-     * receive state machine can remove the buffer from the
-     * noknem_list; this function will be called again, and this time
-     * was_done will be 1. May be this part needs a nicer design. */
+    /* A bounce buffer transfer is over once the done bell of the
+     * initiator has been received, even if post_tgt_dma() finishes
+     * the target side earlier. Until then, the buf stays on the
+     * noknem_list and this function is called again for each bell. */
     if (buf->conn->transport.type == CONN_TYPE_SHMEM)
         was_done =
-            buf->transfer.noknem.noknem ? buf->transfer.noknem.
-            noknem->init_done : 0;
+            buf->transfer.noknem.noknem ? buf->transfer.noknem.init_done : 0;
 #endif
 
     /* post one or more RDMA operations */
@@ -1195,7 +1458,8 @@ static int tgt_rdma(buf_t *buf)
         return STATE_TGT_RDMA;
 #endif
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
-    if ((was_done == 0) && (buf->conn->transport.type == CONN_TYPE_SHMEM))
+    if ((was_done == 0) && (buf->conn->transport.type == CONN_TYPE_SHMEM) &&
+        buf->transfer.noknem.noknem)
         return STATE_TGT_RDMA;
 #endif
 
@@ -1387,7 +1651,7 @@ static int tgt_shmem_desc(buf_t *buf)
                     len);
 
     buf->indir_sge = indir_sge;
-    buf->mr_list[buf->num_mr++] = mr;
+    buf_mr_list(buf)[buf->num_mr++] = mr;
     buf->transfer.mem.cur_rem_iovec = indir_sge;
     buf->transfer.mem.cur_rem_off = 0;
     buf->transfer.mem.num_rem_iovecs = len / sizeof(struct mem_iovec);
@@ -1433,12 +1697,8 @@ static int tgt_data_in(buf_t *buf)
     }
 
     /* this can happen for a simple swap operation */
-    if (buf->in_atomic) {
-        ni_t *ni = obj_to_ni(buf);
-
-        pthread_mutex_unlock(&ni->atomic_mutex);
-        buf->in_atomic = 0;
-    }
+    if (buf->in_atomic)
+        tgt_atomic_unlock(buf);
 
     return next;
 }
@@ -1457,7 +1717,6 @@ static int tgt_atomic_data_in(buf_t *buf)
     int err;
     data_t *data = buf->data_in;
     me_t *me = buf->me;
-    ni_t *ni;
     const req_hdr_t *hdr = (req_hdr_t *) buf->data;
 
     /* assumes that max_atomic_size is <= PTL_MAX_INLINE_DATA */
@@ -1478,9 +1737,7 @@ static int tgt_atomic_data_in(buf_t *buf)
     //PTL_FASTLOCK_UNLOCK(&pt->lock);
     assert(buf->in_atomic);
 
-    ni = obj_to_ni(buf);
-    pthread_mutex_unlock(&ni->atomic_mutex);
-    buf->in_atomic = 0;
+    tgt_atomic_unlock(buf);
 
     return STATE_TGT_COMM_EVENT;
 }
@@ -1511,7 +1768,6 @@ static int tgt_swap_data_in(buf_t *buf)
     data_t *data = buf->data_in;
     uint8_t copy[sizeof(datatype_t)];
     void *dst;
-    ni_t *ni;
     const req_hdr_t *hdr = (req_hdr_t *) buf->data;
     void *operand = buf->data + sizeof(req_hdr_t);
     void *source = data->immediate.data;
@@ -1571,9 +1827,7 @@ static int tgt_swap_data_in(buf_t *buf)
 
     assert(buf->in_atomic);
 
-    ni = obj_to_ni(buf);
-    pthread_mutex_unlock(&ni->atomic_mutex);
-    buf->in_atomic = 0;
+    tgt_atomic_unlock(buf);
 
     return STATE_TGT_COMM_EVENT;
 }
@@ -1596,8 +1850,7 @@ static int tgt_comm_event(buf_t *buf)
          * append/search operation removed it since the buffer was in
          * the check_match state. Tell the potential waiter the buffer
          * is now ready. */
-        buf->unexpected_busy = 0;
-        pthread_cond_signal(&buf->cond);
+        buf_unexpected_done(buf);
     }
 
     if (buf->me)
@@ -1745,7 +1998,7 @@ static int tgt_send_ack(buf_t *buf)
             case CONN_TYPE_UDP:
                 ack_buf->dest.udp.dest_addr = buf->udp.src_addr;
                 ack_buf->conn = buf->conn;
-                ack_buf->rlength = sizeof(buf_t);
+                ack_buf->rlength = BUF_WIRE_SIZE;
                 ptl_info("buffer handle for initiator: %i \n",
                          le32_to_cpu(ack_hdr->h1.handle));
 
@@ -1811,7 +2064,9 @@ static int tgt_send_reply(buf_t *buf)
 
 #if WITH_TRANSPORT_SHMEM
     if (buf->conn->transport.type == CONN_TYPE_SHMEM) {
-        rep_buf->dest.shmem.local_rank = buf->mem_buf->shmem.index_owner;
+        if (buf->mem_buf)
+            rep_buf->dest.shmem.local_rank =
+                buf->mem_buf->shmem.index_owner;
         ptl_info("shared mem reply from %i to %i \n",
                  buf->conn->shmem.local_rank, rep_buf->dest.shmem.local_rank);
     }
@@ -1940,10 +2195,10 @@ static void tgt_cleanup_2(buf_t *buf)
 #if WITH_TRANSPORT_IB && !IS_PPE
     if(buf->conn->transport.type == CONN_TYPE_RDMA){
         ni_t *ni = obj_to_ni(buf);
-        if(buf->mr_list[0] != NULL && ni->umn_fd == -1){
+        if(buf_mr_list(buf)[0] != NULL && ni->umn_fd == -1){
             int i = 0;
-            while (buf->mr_list[i] != NULL){
-                mr_cleanup(buf->mr_list[i]);
+            while (buf_mr_list(buf)[i] != NULL){
+                mr_cleanup(buf_mr_list(buf)[i]);
                 i++;
                 if (i == 2) 
                  abort();
@@ -2058,7 +2313,7 @@ int process_tgt(buf_t *buf)
     ptl_info("locking buffer for target processing \n");
 #endif
 
-    pthread_mutex_lock(&buf->mutex);
+    buf_lock(buf);
 
 #if WITH_TRANSPORT_UDP
     ptl_info("got lock for target buffer processing \n");
@@ -2101,7 +2356,6 @@ int process_tgt(buf_t *buf)
                 break;
             case STATE_TGT_START_COPY:
                 state = tgt_start_copy(buf);
-                goto exit;
                 break;
             case STATE_TGT_RDMA:
                 state = tgt_rdma(buf);
@@ -2144,11 +2398,8 @@ int process_tgt(buf_t *buf)
                 state = tgt_overflow_event(buf);
                 break;
             case STATE_TGT_ERROR:
-                if (buf->in_atomic) {
-                    ni_t *ni = obj_to_ni(buf);
-                    pthread_mutex_unlock(&ni->atomic_mutex);
-                    buf->in_atomic = 0;
-                }
+                if (buf->in_atomic)
+                    tgt_atomic_unlock(buf);
                 err = PTL_FAIL;
                 state = STATE_TGT_CLEANUP;
                 break;
@@ -2158,7 +2409,7 @@ int process_tgt(buf_t *buf)
             case STATE_TGT_CLEANUP_2:
                 tgt_cleanup_2(buf);
                 buf->tgt_state = STATE_TGT_DONE;
-                pthread_mutex_unlock(&buf->mutex);
+                buf_unlock(buf);
 #if WITH_TRANSPORT_UDP
                 ni_t *ni = obj_to_ni(buf);
                 if (atomic_read(&ni->udp.self_recv) == 0)
@@ -2176,6 +2427,6 @@ int process_tgt(buf_t *buf)
   exit:
     buf->tgt_state = state;
   done:
-    pthread_mutex_unlock(&buf->mutex);
+    buf_unlock(buf);
     return err;
 }
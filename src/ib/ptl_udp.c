@@ -30,7 +30,7 @@ static int send_message_udp(buf_t *buf, int from_init)
     ptl_info("&&&&&&&&&& Reliable UDP send &&&&&&&&&\n");
 #endif
 
-    udp_send(buf->obj.obj_ni, buf, &buf->dest.udp.dest_addr);
+    udp_send(buf->obj.obj_ni, buf, &buf->dest.udp.dest_addr, from_init);
 
     buf_put(buf);
 
@@ -172,7 +172,7 @@ static int init_prepare_transfer_udp(md_t *md, data_dir_t dir,
             addr = md->start + offset;
             err = mr_lookup_app(ni, addr, length, &mr);
             if (!err) {
-                buf->mr_list[buf->num_mr + 1] = mr;
+                buf_mr_list(buf)[buf->num_mr + 1] = mr;
                 buf->num_mr++;
                 append_init_data_udp_direct(data, mr, addr, length, buf);
                 ptl_info("addr to send is: %p, buf addr is: %p \n", addr,
@@ -342,8 +342,10 @@ static int udp_tgt_data_out(buf_t *buf, data_t *data)
  * @param[in] ni the network interface
  * @param[in] buf the buf
  * @param[in] dest the destination socket info
+ * @param[in] from_init whether the buf is an initiator buf. Only those
+ * have a put_md and a get_md.
  */
-void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
+void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest, int from_init)
 {
     int err;
 
@@ -365,7 +367,7 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
     if (((dest->sin_port == ni->id.phys.pid) &&
          (dest->sin_addr.s_addr == nid_to_addr(ni->id.phys.nid)))) {
         ptl_info("sending to self! \n");
-        if (buf->rlength <= sizeof(buf_t)) {
+        if (buf->rlength <= BUF_WIRE_SIZE) {
             if (buf->transfer.udp.conn_msg.msg_type !=
                 le16_to_cpu(UDP_CONN_MSG_REP)) {
                 //the only multiple outstanding self sends that are valid are
@@ -384,7 +386,7 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
             }
             buf->udp.src_addr = *dest;
             ni->udp.self_recv_addr = buf;
-            ni->udp.self_recv_len = sizeof(buf_t);
+            ni->udp.self_recv_len = BUF_WIRE_SIZE;
             ptl_info("self ref addr is: %p \n", ni->udp.self_recv_addr);
             atomic_inc(&ni->udp.self_recv);
             return;
@@ -397,7 +399,9 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
 
     struct md *send_md = NULL;
 
-    if ((buf->put_md != NULL) || buf->get_md != NULL) {
+    /* The initiator fields share their storage with the target ones,
+     * so don't look at them on a target buf, such as an ack. */
+    if (from_init && (buf->put_md != NULL || buf->get_md != NULL)) {
         if (buf->put_md != NULL) {
             if (buf->put_md->options) {
                 if (!!(buf->put_md->options & PTL_IOVEC)) {
@@ -417,7 +421,7 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
     }
     //the buf has data and is not a small message or an ack
     //TODO: Adjust this to the actual data size available in the buf_t immediate data
-    if (buf->rlength > sizeof(buf_t)) {
+    if (buf->rlength > BUF_WIRE_SIZE) {
         //this means that we have a message that is too large for an immediate send
         //we must send it as a iovec upto the maximum UDP message size (64KB)
 
@@ -462,7 +466,7 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
         msg_dest = *dest;
         req_hdr_t *hdr = (req_hdr_t *) buf->internal_data;
 
-        segments = (buf->rlength / (MAX_UDP_MSG_SIZE - sizeof(buf_t))) + 1;
+        segments = (buf->rlength / (MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE)) + 1;
 
         hdr->fragment_seq = 0;
 
@@ -499,18 +503,18 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
 
 
         iov[0].iov_base = buf;
-        iov[0].iov_len = sizeof(buf_t);
+        iov[0].iov_len = BUF_WIRE_SIZE;
 
         if (buf->transfer.udp.is_iovec == 0) {
             buf->transfer.udp.is_iovec = 0;
             iov[1].iov_base = (void *)buf->transfer.udp.my_iovec.iov_base;
             ptl_info("sending iov: %p \n",
                      buf->transfer.udp.my_iovec.iov_base);
-            if (buf->rlength > MAX_UDP_MSG_SIZE - sizeof(buf_t)) {
-                iov[1].iov_len = MAX_UDP_MSG_SIZE - sizeof(buf_t);
+            if (buf->rlength > MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE) {
+                iov[1].iov_len = MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE;
                 bytes_remain =
-                    buf->rlength - (MAX_UDP_MSG_SIZE - sizeof(buf_t));
-                cur_ptr = (MAX_UDP_MSG_SIZE - sizeof(buf_t));
+                    buf->rlength - (MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE);
+                cur_ptr = (MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE);
             } else {
                 iov[1].iov_len = buf->rlength;
                 bytes_remain = 0;
@@ -531,7 +535,7 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
             ptl_info("total size of iovec is: %i \n", total_size);
             i = 1;
 
-            if (total_size < (MAX_UDP_MSG_SIZE - sizeof(buf_t))) {
+            if (total_size < (MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE)) {
                 //just send all of the iovecs in the message data iovec
                 for (i = 1; i <= iovec_elements; i++) {
                     iov[i].iov_base =
@@ -545,7 +549,7 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
 
                     if ((current_size +
                          buf->transfer.udp.iovecs[current_iovec].iov_len) <
-                        (MAX_UDP_MSG_SIZE - sizeof(buf_t))) {
+                        (MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE)) {
                         iov[i].iov_base =
                             buf->transfer.udp.iovecs[current_iovec].iov_base;
                         ptl_info
@@ -560,9 +564,9 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
                         i++;
                     } else {
                         //if there's any space left, send part of the next iovec.
-                        if (current_size < (MAX_UDP_MSG_SIZE - sizeof(buf_t))) {
+                        if (current_size < (MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE)) {
                             int space_left =
-                                (MAX_UDP_MSG_SIZE - sizeof(buf_t)) -
+                                (MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE) -
                                 current_size;
                             iov[i].iov_base =
                                 buf->transfer.udp.
@@ -657,10 +661,10 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
 
             hdr->fragment_seq++;
             //keep sending multiple UDP segments until all the data is sent
-            if (bytes_remain >= (MAX_UDP_MSG_SIZE - sizeof(buf_t))) {
+            if (bytes_remain >= (MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE)) {
                 //more UDP segments to this message will follow
-                cur_ptr = MAX_UDP_MSG_SIZE - sizeof(buf_t);
-                bytes_remain -= (MAX_UDP_MSG_SIZE - sizeof(buf_t));
+                cur_ptr = MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE;
+                bytes_remain -= (MAX_UDP_MSG_SIZE - BUF_WIRE_SIZE);
             } else {
                 //last UDP segment in sequence
                 cur_ptr = bytes_remain;
@@ -687,9 +691,9 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
         }
 
 
-    } else if (buf->rlength <= sizeof(buf_t)) { // for immediate data, just send the actual buffer
+    } else if (buf->rlength <= BUF_WIRE_SIZE) { // for immediate data, just send the actual buffer
         err =
-            ptl_sendto(ni->iface->udp.connect_s, buf, sizeof(*buf), 0,
+            ptl_sendto(ni->iface->udp.connect_s, buf, BUF_WIRE_SIZE, 0,
                        (struct sockaddr *)dest, sizeof(*dest), ni);
     }
 
@@ -705,7 +709,7 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
     ptl_info
         ("UDP send completed successfully to: %s:%d from: %d size:%lu %i %i\n",
          inet_ntoa(target.sin_addr), ntohs(target.sin_port),
-         ntohs(ni->iface->udp.sin.sin_port), sizeof(*buf), (int)buf->rlength,
+         ntohs(ni->iface->udp.sin.sin_port), BUF_WIRE_SIZE, (int)buf->rlength,
          err);
 
 }
@@ -722,7 +726,7 @@ buf_t *udp_receive(ni_t *ni)
     struct sockaddr_in temp_sin;
     socklen_t lensin = sizeof(temp_sin);
 
-    buf_t *thebuf = (buf_t *)calloc(1, sizeof(buf_t));
+    buf_t *thebuf = (buf_t *)calloc(1, BUF_WIRE_SIZE);
 
     if (atomic_read(&ni->udp.self_recv) >= 1) {
         ptl_info("got a message from self %p \n", ni->udp.self_recv_addr);
@@ -738,7 +742,7 @@ buf_t *udp_receive(ni_t *ni)
     // this can be tweaked performance wise to only peek on the beginning of the buf for the length
     // this peak is also used to determine if it is a multi-segment message
     err =
-        ptl_recvfrom(ni->iface->udp.connect_s, thebuf, sizeof(*thebuf), flags,
+        ptl_recvfrom(ni->iface->udp.connect_s, thebuf, BUF_WIRE_SIZE, flags,
                      (struct sockaddr *)&temp_sin, &lensin, ni);
 
     if (err == -1) {
@@ -780,7 +784,7 @@ buf_t *udp_receive(ni_t *ni)
         
     }
     //we are going to be handling multiple messages, implemented through a recvmsg call
-    if (thebuf->rlength > sizeof(buf_t)) {
+    if (thebuf->rlength > BUF_WIRE_SIZE) {
         ptl_info("peek indicates large message of size: %i\n",
                  (int)thebuf->rlength);
 
@@ -807,7 +811,7 @@ buf_t *udp_receive(ni_t *ni)
         buf_data = calloc(1, (size_t) MAX_UDP_MSG_SIZE);
 
         iov[0].iov_base = thebuf;
-        iov[0].iov_len = sizeof(buf_t);
+        iov[0].iov_len = BUF_WIRE_SIZE;
         iov[1].iov_base = buf_data;
         //just combine all data into one big iov
         iov[1].iov_len = thebuf->rlength;
@@ -831,7 +835,7 @@ buf_t *udp_receive(ni_t *ni)
 
         }
 
-        current_message_size = err - sizeof(buf_t);
+        current_message_size = err - BUF_WIRE_SIZE;
         ptl_info("received message of size: %i %i %i\n", err,
                  (int)iov[0].iov_len, (int)iov[1].iov_len);
 
@@ -882,7 +886,7 @@ buf_t *udp_receive(ni_t *ni)
         if (MAX_UDP_RECV_SIZE > 65507)
             MAX_UDP_RECV_SIZE = 65507;
 
-        if ((thebuf->rlength + sizeof(buf_t)) > MAX_UDP_RECV_SIZE) {
+        if ((thebuf->rlength + BUF_WIRE_SIZE) > MAX_UDP_RECV_SIZE) {
             //this message is large enough to span multiple UDP messages, so we need to fetch them all
             //first message will be the portals buf, and data upto 64K
             //subsequent messages need to be added to the received data buffer as extra data
@@ -935,9 +939,9 @@ buf_t *udp_receive(ni_t *ni)
                 ptl_info
                     ("not an oustanding transfer, allocate a new buffer \n");
                 //copy the buf over to the first iovec
-                big_buf = calloc(1, sizeof(buf_t));
+                big_buf = calloc(1, BUF_WIRE_SIZE);
                 memcpy(big_buf, buf_msg_hdr.msg_iov[0].iov_base,
-                       sizeof(buf_t));
+                       BUF_WIRE_SIZE);
                 //set the 16MB buffer
                 big_buf->transfer.udp.data = calloc(1, 65536 << 8);
                 ptl_info
@@ -963,7 +967,7 @@ buf_t *udp_receive(ni_t *ni)
             ptl_info("copying to location: %p \n",
                      big_buf->transfer.udp.data +
                      ((MAX_UDP_RECV_SIZE -
-                       sizeof(buf_t)) * hdr->fragment_seq));
+                       BUF_WIRE_SIZE) * hdr->fragment_seq));
 
             if (big_buf->transfer.udp.is_iovec) {
                 if ((big_buf->put_md != NULL) || big_buf->get_md != NULL) {
@@ -992,11 +996,11 @@ buf_t *udp_receive(ni_t *ni)
 
             memcpy((big_buf->transfer.udp.data +
                     (((MAX_UDP_RECV_SIZE -
-                       sizeof(buf_t)) * hdr->fragment_seq))),
+                       BUF_WIRE_SIZE) * hdr->fragment_seq))),
                    buf_msg_hdr.msg_iov[1].iov_base, current_message_size);
 
             ptl_info("segment size was data:%i max data size:%lu \n",
-                     current_message_size, MAX_UDP_RECV_SIZE - sizeof(buf_t));
+                     current_message_size, MAX_UDP_RECV_SIZE - BUF_WIRE_SIZE);
             big_buf->transfer.udp.my_iovec.iov_len += current_message_size;
 
             //increment the fragment counter and check to see if it equals the total
@@ -1004,11 +1008,11 @@ buf_t *udp_receive(ni_t *ni)
             ptl_info("have #%i segments of #%i size: %i\n",
                      (int)big_buf->transfer.udp.fragment_count,
                      (int)((thebuf->rlength /
-                            (MAX_UDP_RECV_SIZE - sizeof(buf_t))) + 1),
+                            (MAX_UDP_RECV_SIZE - BUF_WIRE_SIZE)) + 1),
                      (int)thebuf->rlength);
             //check to see if the transfer is complete
             if (big_buf->transfer.udp.fragment_count ==
-                ((thebuf->rlength / (MAX_UDP_RECV_SIZE - sizeof(buf_t))) +
+                ((thebuf->rlength / (MAX_UDP_RECV_SIZE - BUF_WIRE_SIZE)) +
                  1)) {
                 //we're done the transfer
                 ptl_info
@@ -1028,7 +1032,6 @@ buf_t *udp_receive(ni_t *ni)
                     big_buf->transfer.udp.data;
                 big_buf->transfer.udp.my_iovec.iov_len = thebuf->rlength;
                 thebuf = big_buf;
-                thebuf->recv_buf = big_buf;
             }
             //if it does not, return nothing as we are still in progress
             else {
@@ -1040,7 +1043,7 @@ buf_t *udp_receive(ni_t *ni)
     } else {
         //this is a small transfer with immediate data, fetch it.
         err =
-            ptl_recvfrom(ni->iface->udp.connect_s, thebuf, sizeof(*thebuf), 0,
+            ptl_recvfrom(ni->iface->udp.connect_s, thebuf, BUF_WIRE_SIZE, 0,
                          (struct sockaddr *)&temp_sin, &lensin, ni);
         if (err == -1) {
             if (errno != EAGAIN) {
@@ -1090,6 +1093,7 @@ buf_t *udp_receive(ni_t *ni)
          sizeof(*(thebuf->data)), (int)thebuf->rlength, err);
 
     thebuf->udp.src_addr = temp_sin;
+    thebuf->udp.tgt_done = 0;
     return (buf_t *)thebuf;
 }
 
@@ -1150,7 +1154,7 @@ static int init_connect_udp(ni_t *ni, conn_t *conn)
     int ret;
 
     /* Create a buffer for sending the connection request message */
-    buf_t *conn_buf = (buf_t *)calloc(1, sizeof(buf_t));
+    buf_t *conn_buf = (buf_t *)calloc(1, BUF_WIRE_SIZE);
     conn_buf->type = BUF_UDP_CONN_REQ;
 
     /* Send the connect request. */
@@ -1176,7 +1180,7 @@ static int init_connect_udp(ni_t *ni, conn_t *conn)
     hdr->h1.ni_type = ni->ni_type;
 
     conn_buf->transfer.udp.conn_msg = msg;
-    conn_buf->length = (sizeof(buf_t));
+    conn_buf->length = (BUF_WIRE_SIZE);
     conn_buf->conn = conn;
     conn_buf->udp.dest_addr = &conn->sin;
 
@@ -1207,7 +1211,7 @@ static int init_connect_udp(ni_t *ni, conn_t *conn)
     }
 
     ptl_info("to send msg size: %lu in UDP message size: %lu\n", sizeof(msg),
-             sizeof(buf_t));
+             BUF_WIRE_SIZE);
 
     /* Send the request to the listening socket on the remote node. */
     /* This does not send just the msg, but a buf to maintain compatibility with the progression thread */
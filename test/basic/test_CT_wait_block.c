@@ -0,0 +1,136 @@
+/*
+ * Check that PtlCTWait and PtlCTPoll block once their spin budget is
+ * used up, and are woken by the counting event updates. Rank 0 sends
+ * two puts to rank 1, late enough for rank 1 to be blocked waiting for
+ * them.
+ */
+
+#include <portals4.h>
+#include <portals4_stats.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "testing.h"
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_h;
+    ptl_pt_index_t  pt_index;
+    ptl_process_t   peer;
+    ptl_handle_ct_t cts[2];
+    ptl_size_t      tests[2];
+    ptl_ct_event_t  event;
+    ptl_sr_value_t  blocks;
+    unsigned int    which;
+    int             num_procs;
+    int             rank;
+    uint64_t        value = 0;
+
+    /* block right away */
+    setenv("PTL_CT_WAIT_LOOP_COUNT", "0", 1);
+    setenv("PTL_CT_POLL_LOOP_COUNT", "0", 1);
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    rank = libtest_get_rank();
+    num_procs = libtest_get_size();
+
+    /* This test only succeeds if we have more than one rank */
+    if (num_procs < 2)
+        return 77;
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_h));
+    CHECK_RETURNVAL(PtlSetMap(ni_h, num_procs, libtest_get_mapping(ni_h)));
+
+    CHECK_RETURNVAL(PtlPTAlloc(ni_h, 0, PTL_EQ_NONE, PTL_PT_ANY, &pt_index));
+
+    if (rank == 1) {
+        ptl_le_t le;
+        ptl_handle_le_t le_h;
+
+        CHECK_RETURNVAL(PtlCTAlloc(ni_h, &cts[0]));
+        CHECK_RETURNVAL(PtlCTAlloc(ni_h, &cts[1]));
+
+        le.start = &value;
+        le.length = sizeof(value);
+        le.uid = PTL_UID_ANY;
+        le.options = PTL_LE_OP_PUT | PTL_LE_EVENT_CT_COMM;
+        le.ct_handle = cts[0];
+        CHECK_RETURNVAL(PtlLEAppend(ni_h, pt_index, &le, PTL_PRIORITY_LIST,
+                                    NULL, &le_h));
+
+        libtest_barrier();
+
+        CHECK_RETURNVAL(PtlCTWait(cts[0], 1, &event));
+        assert(event.success == 1);
+
+        /* Nothing ever updates the second counting event. */
+        tests[0] = 1;
+        assert(PtlCTPoll(&cts[1], tests, 1, 50, &event, &which) ==
+               PTL_CT_NONE_REACHED);
+
+        tests[0] = 2;
+        tests[1] = 1;
+        CHECK_RETURNVAL(PtlCTPoll(cts, tests, 2, PTL_TIME_FOREVER, &event,
+                                  &which));
+        assert(which == 0);
+        assert(event.success == 2);
+
+        CHECK_RETURNVAL(PtlNIGetStat(ni_h, PTL_STAT_CT_WAIT_BLOCKS, &blocks));
+        if (blocks < 1) {
+            fprintf(stderr, "no wait blocked\n");
+            return 1;
+        }
+
+        CHECK_RETURNVAL(PtlLEUnlink(le_h));
+        CHECK_RETURNVAL(PtlCTFree(cts[0]));
+        CHECK_RETURNVAL(PtlCTFree(cts[1]));
+    } else {
+        ptl_md_t md;
+        ptl_handle_md_t md_h;
+
+        md.start = &value;
+        md.length = sizeof(value);
+        md.options = 0;
+        md.eq_handle = PTL_EQ_NONE;
+        md.ct_handle = PTL_CT_NONE;
+        CHECK_RETURNVAL(PtlMDBind(ni_h, &md, &md_h));
+
+        peer.rank = 1;
+
+        libtest_barrier();
+
+        if (rank == 0) {
+            usleep(200000);
+            CHECK_RETURNVAL(PtlPut(md_h, 0, sizeof(value), PTL_NO_ACK_REQ,
+                                   peer, pt_index, 0, 0, NULL, 0));
+            usleep(200000);
+            CHECK_RETURNVAL(PtlPut(md_h, 0, sizeof(value), PTL_NO_ACK_REQ,
+                                   peer, pt_index, 0, 0, NULL, 0));
+        }
+
+        CHECK_RETURNVAL(PtlMDRelease(md_h));
+    }
+
+    libtest_barrier();
+
+    CHECK_RETURNVAL(PtlPTFree(ni_h, pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return 0;
+}
+
+/* vim:set expandtab: */
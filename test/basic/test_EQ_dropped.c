@@ -0,0 +1,139 @@
+/*
+ * Let the events of a stream of puts overflow a small event queue,
+ * then drain it: the first event returned must report PTL_EQ_DROPPED,
+ * the following ones must not, and the events left must be the most
+ * recent ones, in order.
+ */
+
+#include <portals4.h>
+#include <support.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "testing.h"
+
+#define NUM_PUTS        1000
+#define EQ_SIZE         8
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_h;
+    ptl_pt_index_t  pt_index;
+    ptl_process_t   peer;
+    ptl_event_t     event;
+    ptl_ct_event_t  ct_event;
+    int             num_procs;
+    int             rank;
+    int             numfail = 0;
+    uint64_t        value = 0;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    rank = libtest_get_rank();
+    num_procs = libtest_get_size();
+
+    /* This test only succeeds if we have more than one rank */
+    if (num_procs < 2)
+        return 77;
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_h));
+    CHECK_RETURNVAL(PtlSetMap(ni_h, num_procs, libtest_get_mapping(ni_h)));
+
+    CHECK_RETURNVAL(PtlPTAlloc(ni_h, 0, PTL_EQ_NONE, PTL_PT_ANY, &pt_index));
+
+    if (rank == 1) {
+        ptl_le_t le;
+        ptl_handle_le_t le_h;
+
+        le.start = &value;
+        le.length = sizeof(value);
+        le.uid = PTL_UID_ANY;
+        le.options = PTL_LE_OP_PUT;
+        le.ct_handle = PTL_CT_NONE;
+        CHECK_RETURNVAL(PtlLEAppend(ni_h, pt_index, &le, PTL_PRIORITY_LIST,
+                                    NULL, &le_h));
+
+        libtest_barrier();
+        libtest_barrier();
+
+        CHECK_RETURNVAL(PtlLEUnlink(le_h));
+    } else {
+        ptl_md_t md;
+        ptl_handle_md_t md_h;
+        uintptr_t i, last;
+        int ret;
+
+        CHECK_RETURNVAL(PtlEQAlloc(ni_h, EQ_SIZE, &md.eq_handle));
+        CHECK_RETURNVAL(PtlCTAlloc(ni_h, &md.ct_handle));
+
+        md.start = &value;
+        md.length = sizeof(value);
+        md.options = PTL_MD_EVENT_CT_SEND;
+        CHECK_RETURNVAL(PtlMDBind(ni_h, &md, &md_h));
+
+        peer.rank = 1;
+
+        libtest_barrier();
+
+        if (rank == 0) {
+            for (i = 0; i < NUM_PUTS; i++) {
+                CHECK_RETURNVAL(PtlPut(md_h, 0, sizeof(value),
+                                       PTL_NO_ACK_REQ, peer, pt_index, 0, 0,
+                                       (void *)(i + 1), 0));
+            }
+            CHECK_RETURNVAL(PtlCTWait(md.ct_handle, NUM_PUTS, &ct_event));
+
+            ret = PtlEQGet(md.eq_handle, &event);
+            if (ret != PTL_EQ_DROPPED) {
+                printf("first event returned %d, expected PTL_EQ_DROPPED\n",
+                       ret);
+                numfail++;
+            }
+            last = (uintptr_t)event.user_ptr;
+
+            while ((ret = PtlEQGet(md.eq_handle, &event)) == PTL_OK) {
+                if ((uintptr_t)event.user_ptr != last + 1) {
+                    printf("event %lu follows event %lu\n",
+                           (unsigned long)(uintptr_t)event.user_ptr,
+                           (unsigned long)last);
+                    numfail++;
+                }
+                last = (uintptr_t)event.user_ptr;
+            }
+
+            if (ret != PTL_EQ_EMPTY) {
+                printf("drain returned %d, expected PTL_EQ_EMPTY\n", ret);
+                numfail++;
+            }
+            if (last != NUM_PUTS) {
+                printf("last event is %lu, expected %d\n",
+                       (unsigned long)last, NUM_PUTS);
+                numfail++;
+            }
+        }
+
+        libtest_barrier();
+
+        CHECK_RETURNVAL(PtlMDRelease(md_h));
+        CHECK_RETURNVAL(PtlCTFree(md.ct_handle));
+        CHECK_RETURNVAL(PtlEQFree(md.eq_handle));
+    }
+
+    CHECK_RETURNVAL(PtlPTFree(ni_h, pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return numfail ? 1 : 0;
+}
+
+/* vim:set expandtab: */
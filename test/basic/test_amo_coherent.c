@@ -0,0 +1,236 @@
+/*
+ * Check that remote atomics on an NI with PTL_COHERENT_ATOMICS are
+ * atomic with respect to processor atomics done by the target itself
+ * on the same memory.
+ */
+
+#include <portals4.h>
+#include <support.h>
+
+#include <sched.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "testing.h"
+
+const int tries = 500;
+
+struct vars {
+    int64_t counter;            /* PTL_SUM and __atomic_fetch_add */
+    uint32_t cswap;             /* PTL_CSWAP and __atomic_compare_exchange */
+    uint32_t pad;
+    int64_t max;                /* PTL_MAX */
+    int64_t done;               /* ranks that are done */
+};
+
+int main(int argc, char *argv[])
+{
+    struct vars *vars;
+    int numfail = 0;
+    long local = 0;
+    int rank, num_procs;
+    long i;
+    ptl_handle_ni_t ni_h;
+    ptl_ni_limits_t desired;
+    ptl_ni_limits_t actual;
+    ptl_pt_index_t pt_index;
+    ptl_le_t le;
+    ptl_handle_le_t le_h;
+    ptl_md_t write_md, read_md;
+    ptl_handle_md_t write_md_h, read_md_h;
+    ptl_ct_event_t ctc;
+    ptl_process_t peer;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    rank = libtest_get_rank();
+    num_procs = libtest_get_size();
+
+    /* This test only succeeds if we have more than one rank */
+    if (num_procs < 2)
+        return 77;
+
+    memset(&desired, 0, sizeof(desired));
+    desired.max_entries = 1024;
+    desired.max_unexpected_headers = 1024;
+    desired.max_mds = 1024;
+    desired.max_cts = 1024;
+    desired.max_eqs = 1024;
+    desired.max_pt_index = 63;
+    desired.max_iovecs = 1024;
+    desired.max_list_size = 1024;
+    desired.max_triggered_ops = 1024;
+    desired.max_msg_size = 1UL << 30;
+    desired.max_atomic_size = 512;
+    desired.max_fetch_atomic_size = 512;
+    desired.max_waw_ordered_size = 8;
+    desired.max_war_ordered_size = 8;
+    desired.max_volatile_size = 8;
+    desired.features = PTL_COHERENT_ATOMICS;
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, &desired, &actual, &ni_h));
+    CHECK_RETURNVAL(PtlSetMap(ni_h, num_procs, libtest_get_mapping(ni_h)));
+
+    CHECK_RETURNVAL(PtlPTAlloc(ni_h, 0, PTL_EQ_NONE, PTL_PT_ANY, &pt_index));
+
+    vars = calloc(1, sizeof(*vars));
+    if (!vars)
+        abort();
+
+    le.start = vars;
+    le.length = sizeof(*vars);
+    le.uid = PTL_UID_ANY;
+    le.options = PTL_LE_OP_PUT | PTL_LE_OP_GET;
+    le.ct_handle = PTL_CT_NONE;
+    CHECK_RETURNVAL(PtlLEAppend(ni_h, 0, &le, PTL_PRIORITY_LIST, NULL,
+                                &le_h));
+
+    libtest_barrier();
+
+    if (!(actual.features & PTL_COHERENT_ATOMICS)) {
+        /* Not supported by this build. */
+        numfail = -1;
+    } else if (rank == 0) {
+        /* Hammer the same words with processor atomics while the other
+         * ranks are running, then wait for them to finish. */
+        while (local < tries ||
+               __atomic_load_n(&vars->done, __ATOMIC_SEQ_CST) <
+               num_procs - 1) {
+            if (local < tries) {
+                uint32_t old = __atomic_load_n(&vars->cswap,
+                                               __ATOMIC_SEQ_CST);
+
+                __atomic_fetch_add(&vars->counter, 1, __ATOMIC_SEQ_CST);
+
+                while (!__atomic_compare_exchange_n(&vars->cswap, &old,
+                                                    old + 1, 0,
+                                                    __ATOMIC_SEQ_CST,
+                                                    __ATOMIC_SEQ_CST)) ;
+
+                local++;
+            }
+            sched_yield();
+        }
+    } else {
+        union {
+            int64_t s64;
+            uint32_t u32;
+        } in, out;
+        uint32_t expect = 0;
+        int64_t last = -1;
+        ptl_size_t nreply = 0;
+
+        peer.rank = 0;
+
+        write_md.start = &in;
+        write_md.length = sizeof(in);
+        write_md.options = PTL_MD_EVENT_CT_ACK;
+        write_md.eq_handle = PTL_EQ_NONE;
+        CHECK_RETURNVAL(PtlCTAlloc(ni_h, &write_md.ct_handle));
+        CHECK_RETURNVAL(PtlMDBind(ni_h, &write_md, &write_md_h));
+
+        read_md.start = &out;
+        read_md.length = sizeof(out);
+        read_md.options = PTL_MD_EVENT_CT_REPLY;
+        read_md.eq_handle = PTL_EQ_NONE;
+        CHECK_RETURNVAL(PtlCTAlloc(ni_h, &read_md.ct_handle));
+        CHECK_RETURNVAL(PtlMDBind(ni_h, &read_md, &read_md_h));
+
+        /* Fetch and add, checking the fetched values increase. */
+        for (i = 0; i < tries; i++) {
+            in.s64 = 1;
+            CHECK_RETURNVAL(PtlFetchAtomic(read_md_h, 0, write_md_h, 0,
+                                           sizeof(int64_t), peer, pt_index,
+                                           0, offsetof(struct vars, counter),
+                                           NULL, 0, PTL_SUM, PTL_INT64_T));
+            CHECK_RETURNVAL(PtlCTWait(read_md.ct_handle, ++nreply, &ctc));
+            if (out.s64 <= last) {
+                printf("error: fetch and add returned %ld after %ld\n",
+                       (long)out.s64, (long)last);
+                numfail++;
+            }
+            last = out.s64;
+        }
+
+        /* Compare and swap increments. */
+        for (i = 0; i < tries;) {
+            uint32_t operand = expect;
+
+            in.u32 = expect + 1;
+            CHECK_RETURNVAL(PtlSwap(read_md_h, 0, write_md_h, 0,
+                                    sizeof(uint32_t), peer, pt_index, 0,
+                                    offsetof(struct vars, cswap), NULL, 0,
+                                    &operand, PTL_CSWAP, PTL_UINT32_T));
+            CHECK_RETURNVAL(PtlCTWait(read_md.ct_handle, ++nreply, &ctc));
+            if (out.u32 == expect) {
+                expect++;
+                i++;
+            } else {
+                expect = out.u32;
+            }
+        }
+
+        /* A maximum, applied with a compare and swap loop. */
+        for (i = 0; i < tries; i++) {
+            in.s64 = (i * 7919) % tries;
+            CHECK_RETURNVAL(PtlAtomic(write_md_h, 0, sizeof(int64_t),
+                                      PTL_CT_ACK_REQ, peer, pt_index, 0,
+                                      offsetof(struct vars, max), NULL, 0,
+                                      PTL_MAX, PTL_INT64_T));
+            CHECK_RETURNVAL(PtlCTWait(write_md.ct_handle, i + 1, &ctc));
+        }
+
+        in.s64 = 1;
+        CHECK_RETURNVAL(PtlAtomic(write_md_h, 0, sizeof(int64_t),
+                                  PTL_CT_ACK_REQ, peer, pt_index, 0,
+                                  offsetof(struct vars, done), NULL, 0,
+                                  PTL_SUM, PTL_INT64_T));
+        CHECK_RETURNVAL(PtlCTWait(write_md.ct_handle, tries + 1, &ctc));
+
+        CHECK_RETURNVAL(PtlMDRelease(write_md_h));
+        CHECK_RETURNVAL(PtlMDRelease(read_md_h));
+        CHECK_RETURNVAL(PtlCTFree(write_md.ct_handle));
+        CHECK_RETURNVAL(PtlCTFree(read_md.ct_handle));
+    }
+
+    libtest_barrier();
+
+    if (rank == 0 && numfail == 0) {
+        long expect = (long)tries * num_procs;
+
+        if (vars->counter != expect) {
+            printf("error: counter is %ld, expected %ld\n",
+                   (long)vars->counter, expect);
+            numfail++;
+        }
+        if (vars->cswap != (uint32_t)expect) {
+            printf("error: cswap is %u, expected %ld\n", vars->cswap,
+                   expect);
+            numfail++;
+        }
+        if (vars->max != tries - 1) {
+            printf("error: max is %ld, expected %d\n", (long)vars->max,
+                   tries - 1);
+            numfail++;
+        }
+    }
+
+    CHECK_RETURNVAL(PtlLEUnlink(le_h));
+    CHECK_RETURNVAL(PtlPTFree(ni_h, pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    free(vars);
+
+    if (numfail < 0)
+        return 77;
+
+    return numfail ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Create and destroy many NIs, more than the objects they allocate
+ * would allow if handle indexes were never reused, and check that a
+ * handle of a destroyed object is not accepted once its index has been
+ * given to a new object.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <portals4.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "testing.h"
+
+#define CYCLES          600
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_h;
+    ptl_handle_eq_t eq_h;
+    ptl_handle_eq_t old_eq_h = PTL_EQ_NONE;
+    ptl_event_t     event;
+    int             numfail = 0;
+    int             i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    for (i = 0; i < CYCLES; i++) {
+        CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                                  PTL_NI_NO_MATCHING | PTL_NI_PHYSICAL,
+                                  PTL_PID_ANY, NULL, NULL, &ni_h));
+
+        CHECK_RETURNVAL(PtlEQAlloc(ni_h, 16, &eq_h));
+
+#ifndef NO_ARG_VALIDATION
+        if (old_eq_h != PTL_EQ_NONE &&
+            PtlEQGet(old_eq_h, &event) != PTL_ARG_INVALID) {
+            printf("cycle %d: handle %x of a freed EQ was accepted\n", i,
+                   old_eq_h);
+            numfail++;
+        }
+#endif
+
+        CHECK_RETURNVAL(PtlEQFree(eq_h));
+        CHECK_RETURNVAL(PtlNIFini(ni_h));
+
+        old_eq_h = eq_h;
+    }
+
+    PtlFini();
+
+    return numfail ? 1 : 0;
+}
+
+/* vim:set expandtab: */
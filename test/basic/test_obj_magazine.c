@@ -0,0 +1,120 @@
+/*
+ * Bind and release MDs from several threads at once, so that objects
+ * move between the per thread magazines and the pool free list, and
+ * check the magazine hit and miss statistics.
+ */
+
+#include <portals4.h>
+#include <portals4_stats.h>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "testing.h"
+
+#define NUM_THREADS     4
+#define ITERATIONS      20000
+#define BATCH           48              /* more than a magazine holds */
+
+static ptl_handle_ni_t ni_h;
+static char buffer[64];
+
+static void *worker(void *arg)
+{
+    ptl_handle_md_t md_h[BATCH];
+    ptl_md_t md;
+    long failures = 0;
+    int i, j;
+
+    md.start = buffer;
+    md.length = sizeof(buffer);
+    md.options = 0;
+    md.eq_handle = PTL_EQ_NONE;
+    md.ct_handle = PTL_CT_NONE;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        /* Mostly one MD at a time, which the magazine serves, and now
+         * and then enough to overflow it. */
+        int n = (i % 64) ? 1 : BATCH;
+
+        for (j = 0; j < n; j++) {
+            if (PtlMDBind(ni_h, &md, &md_h[j]) != PTL_OK)
+                failures++;
+        }
+
+        for (j = 0; j < n; j++) {
+            if (PtlMDRelease(md_h[j]) != PTL_OK)
+                failures++;
+        }
+    }
+
+    return (void *)failures;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    pthread_t threads[NUM_THREADS];
+    ptl_sr_value_t hits, misses;
+    ptl_ni_limits_t desired;
+    int numfail = 0;
+    int i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    desired.max_entries = 1024;
+    desired.max_unexpected_headers = 1024;
+    desired.max_mds = 1024;
+    desired.max_cts = 1024;
+    desired.max_eqs = 1024;
+    desired.max_pt_index = 63;
+    desired.max_iovecs = 1024;
+    desired.max_list_size = 1024;
+    desired.max_triggered_ops = 1024;
+    desired.max_msg_size = 1024;
+    desired.max_atomic_size = 512;
+    desired.max_fetch_atomic_size = 512;
+    desired.max_waw_ordered_size = 8;
+    desired.max_war_ordered_size = 8;
+    desired.max_volatile_size = 8;
+    desired.features = 0;
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_PHYSICAL,
+                              PTL_PID_ANY, &desired, NULL, &ni_h));
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        if (pthread_create(&threads[i], NULL, worker, NULL)) {
+            fprintf(stderr, "pthread_create failed\n");
+            return 1;
+        }
+    }
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        void *failures;
+
+        pthread_join(threads[i], &failures);
+        if (failures) {
+            printf("thread %d: %ld calls failed\n", i, (long)failures);
+            numfail++;
+        }
+    }
+
+    CHECK_RETURNVAL(PtlNIGetStat(ni_h, PTL_STAT_OBJ_MAGAZINE_HITS, &hits));
+    CHECK_RETURNVAL(PtlNIGetStat(ni_h, PTL_STAT_OBJ_MAGAZINE_MISSES, &misses));
+
+    /* With the default magazine size, most allocations are hits. */
+    if (misses > hits) {
+        printf("%d magazine hits for %d misses\n", hits, misses);
+        numfail++;
+    }
+
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    PtlFini();
+
+    return numfail ? 1 : 0;
+}
+
+/* vim:set expandtab: */
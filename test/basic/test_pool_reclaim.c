@@ -0,0 +1,124 @@
+/*
+ * Bind MDs until the MD pool reaches its size limit, release them, and
+ * check that PtlNIReclaim gives the memory back and that the freed
+ * slabs can be allocated again.
+ */
+
+#include <portals4.h>
+#include <portals4_stats.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "testing.h"
+
+#define MAX_MDS         65536
+#define POOL_MAX_SIZE   "1048576"
+
+static ptl_handle_md_t md_h[MAX_MDS];
+static char buffer[64];
+
+static int bind_all(ptl_handle_ni_t ni_h, int *num_p)
+{
+    ptl_md_t md;
+    int ret = PTL_OK;
+    int i;
+
+    md.start = buffer;
+    md.length = sizeof(buffer);
+    md.options = 0;
+    md.eq_handle = PTL_EQ_NONE;
+    md.ct_handle = PTL_CT_NONE;
+
+    for (i = 0; i < MAX_MDS; i++) {
+        ret = PtlMDBind(ni_h, &md, &md_h[i]);
+        if (ret != PTL_OK)
+            break;
+    }
+
+    *num_p = i;
+    return ret;
+}
+
+static void release_all(int num)
+{
+    int i;
+
+    for (i = 0; i < num; i++)
+        PtlMDRelease(md_h[i]);
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_h;
+    ptl_ni_limits_t desired;
+    ptl_sr_value_t full, reclaimed, refilled;
+    int num, renum;
+    int ret;
+    int numfail = 0;
+
+    setenv("PTL_POOL_MAX_SIZE", POOL_MAX_SIZE, 1);
+
+    CHECK_RETURNVAL(PtlInit());
+
+    desired.max_entries = 1024;
+    desired.max_unexpected_headers = 1024;
+    desired.max_mds = MAX_MDS;
+    desired.max_cts = 1024;
+    desired.max_eqs = 1024;
+    desired.max_pt_index = 63;
+    desired.max_iovecs = 1024;
+    desired.max_list_size = 1024;
+    desired.max_triggered_ops = 1024;
+    desired.max_msg_size = 1024;
+    desired.max_atomic_size = 512;
+    desired.max_fetch_atomic_size = 512;
+    desired.max_waw_ordered_size = 8;
+    desired.max_war_ordered_size = 8;
+    desired.max_volatile_size = 8;
+    desired.features = 0;
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_PHYSICAL,
+                              PTL_PID_ANY, &desired, NULL, &ni_h));
+
+    /* The MD pool stops growing at its limit. */
+    ret = bind_all(ni_h, &num);
+    if (ret != PTL_NO_SPACE) {
+        printf("bound %d MDs, last PtlMDBind returned %d\n", num, ret);
+        numfail++;
+    }
+
+    CHECK_RETURNVAL(PtlNIGetStat(ni_h, PTL_STAT_POOL_MEMORY, &full));
+
+    release_all(num);
+    CHECK_RETURNVAL(PtlNIReclaim(ni_h));
+    CHECK_RETURNVAL(PtlNIGetStat(ni_h, PTL_STAT_POOL_MEMORY, &reclaimed));
+
+    /* All the MD slabs but the ones holding the magazine are free. */
+    if (reclaimed > full / 2) {
+        printf("pools hold %d KiB with %d MDs, %d KiB after reclaim\n",
+               full, num, reclaimed);
+        numfail++;
+    }
+
+    /* The reclaimed slabs are reused. */
+    ret = bind_all(ni_h, &renum);
+    CHECK_RETURNVAL(PtlNIGetStat(ni_h, PTL_STAT_POOL_MEMORY, &refilled));
+    if (ret != PTL_NO_SPACE || renum != num || refilled != full) {
+        printf("bound %d MDs and %d KiB again, expected %d and %d KiB\n",
+               renum, refilled, num, full);
+        numfail++;
+    }
+
+    release_all(renum);
+
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    PtlFini();
+
+    return numfail ? 1 : 0;
+}
+
+/* vim:set expandtab: */
@@ -0,0 +1,68 @@
+/*
+ * Build a long cascade of triggered operations on a single counting
+ * event: the operation posted with threshold n increments the counting
+ * event to n + 1, which fires the next one. A single PtlCTInc must run
+ * the whole chain without recursing once per operation.
+ */
+
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "testing.h"
+
+#define CHAIN_LENGTH    100000
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_logical;
+    int             num_procs;
+    ptl_handle_ct_t ct;
+    ptl_ct_event_t  test;
+    int             i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    num_procs = libtest_get_size();
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT, PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_logical));
+
+    CHECK_RETURNVAL(PtlSetMap(ni_logical, num_procs,
+                              libtest_get_mapping(ni_logical)));
+
+    CHECK_RETURNVAL(PtlCTAlloc(ni_logical, &ct));
+
+    libtest_barrier();
+
+    for (i = 1; i <= CHAIN_LENGTH; i++) {
+        CHECK_RETURNVAL(PtlTriggeredCTInc(ct, (ptl_ct_event_t) { 1, 0 },
+                                          ct, i));
+    }
+
+    CHECK_RETURNVAL(PtlCTGet(ct, &test));
+    assert(test.success == 0);
+
+    CHECK_RETURNVAL(PtlCTInc(ct, (ptl_ct_event_t) { 1, 0 }));
+
+    CHECK_RETURNVAL(PtlCTWait(ct, CHAIN_LENGTH + 1, &test));
+    assert(test.success == CHAIN_LENGTH + 1);
+    assert(test.failure == 0);
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlCTFree(ct));
+    CHECK_RETURNVAL(PtlNIFini(ni_logical));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return 0;
+}
+
+/* vim:set expandtab: */
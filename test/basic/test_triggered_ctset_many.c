@@ -0,0 +1,100 @@
+/*
+ * Post many triggered CT sets on one counting event, with thresholds
+ * in random order and many of them equal. The operations must fire in
+ * threshold order, and in posting order for equal thresholds, so the
+ * target always holds the value of the last operation posted with the
+ * highest threshold reached.
+ */
+
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "testing.h"
+
+#define NUM_OPS         512
+#define MAX_THRESHOLD   64
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_logical;
+    int             num_procs;
+    ptl_handle_ct_t trigger, target;
+    ptl_ct_event_t  test;
+    ptl_size_t      last[MAX_THRESHOLD + 1] = { 0 };
+    ptl_size_t      expect = 0;
+    int             numfail = 0;
+    int             i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    num_procs = libtest_get_size();
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT, PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_logical));
+
+    CHECK_RETURNVAL(PtlSetMap(ni_logical, num_procs,
+                              libtest_get_mapping(ni_logical)));
+
+    CHECK_RETURNVAL(PtlCTAlloc(ni_logical, &trigger));
+    CHECK_RETURNVAL(PtlCTAlloc(ni_logical, &target));
+
+    libtest_barrier();
+
+    srand(1);
+    for (i = 1; i <= NUM_OPS; i++) {
+        ptl_size_t threshold = 1 + rand() % MAX_THRESHOLD;
+
+        CHECK_RETURNVAL(PtlTriggeredCTSet(target, (ptl_ct_event_t) { i, 0 },
+                                          trigger, threshold));
+        last[threshold] = i;
+    }
+
+    /* Reach the first half of the thresholds one at a time. */
+    for (i = 1; i <= MAX_THRESHOLD / 2; i++) {
+        CHECK_RETURNVAL(PtlCTInc(trigger, (ptl_ct_event_t) { 1, 0 }));
+        if (last[i])
+            expect = last[i];
+
+        CHECK_RETURNVAL(PtlCTGet(target, &test));
+        if (test.success != expect) {
+            fprintf(stderr, "at %d: target is %lu, expected %lu\n", i,
+                    (unsigned long)test.success, (unsigned long)expect);
+            numfail++;
+        }
+    }
+
+    /* Then all the others at once. */
+    CHECK_RETURNVAL(PtlCTInc(trigger,
+                             (ptl_ct_event_t) { MAX_THRESHOLD / 2, 0 }));
+    for (i = MAX_THRESHOLD / 2 + 1; i <= MAX_THRESHOLD; i++) {
+        if (last[i])
+            expect = last[i];
+    }
+
+    CHECK_RETURNVAL(PtlCTGet(target, &test));
+    if (test.success != expect) {
+        fprintf(stderr, "at %d: target is %lu, expected %lu\n",
+                MAX_THRESHOLD, (unsigned long)test.success,
+                (unsigned long)expect);
+        numfail++;
+    }
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlCTFree(trigger));
+    CHECK_RETURNVAL(PtlCTFree(target));
+    CHECK_RETURNVAL(PtlNIFini(ni_logical));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return numfail ? 1 : 0;
+}
+
+/* vim:set expandtab: */
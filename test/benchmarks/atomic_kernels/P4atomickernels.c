@@ -0,0 +1,237 @@
+/*
+ * Atomic kernel benchmark.
+ *
+ * Runs the kernels that apply an atomic operation to a target array,
+ * as used by the target of PtlAtomic, PtlFetchAtomic and PtlSwap, on
+ * local memory. For each kernel and array length, it prints the rate
+ * at which target data is processed, in GB/s, for the portable kernel
+ * and for each vector version the CPU supports. The vector results are
+ * checked against the portable ones first. Long double and complex
+ * product kernels only have a portable version.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <portals4.h>
+
+#include <complex.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "ptl_atomic_kernels.h"
+
+#ifdef HAVE_X86_TARGET_ATTRIBUTE
+#include <xmmintrin.h>
+#endif
+
+enum {
+    ISA_PORTABLE,
+    ISA_SSE2,
+    ISA_AVX2,
+    ISA_AVX512,
+    ISA_LAST,
+};
+
+static const char *isa_name[ISA_LAST] = {
+    "portable", "sse2", "avx2", "avx512",
+};
+
+typedef int (*kernel_t) (void *dst, void *src, ptl_size_t length);
+
+struct kernel {
+    const char *name;
+    kernel_t fn[ISA_LAST];
+};
+
+#ifdef HAVE_X86_TARGET_ATTRIBUTE
+#define KERNEL(arg, name, op, type)					\
+	{ #name, { name, name##_sse2, name##_avx2, name##_avx512 } },
+#else
+#define KERNEL(arg, name, op, type)					\
+	{ #name, { name } },
+#endif
+
+#define PORTABLE_KERNEL(arg, name, op, type)				\
+	{ #name, { name } },
+
+static const struct kernel kernels[] = {
+    ATOM_VECTOR_KERNELS(KERNEL, 0)
+    ATOM_SCALAR_KERNELS(PORTABLE_KERNEL, 0)
+    ATOM_UNALIGNED_KERNELS(PORTABLE_KERNEL, 0)
+};
+
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+#define CHECK_LENGTH 1000
+
+static double timer(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/*
+ * Random bytes below 0x40 keep floating point values small and finite,
+ * so products never overflow into infinities or NaNs.
+ */
+static void fill(unsigned char *p, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++)
+        p[i] = rand() & 0x3f;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: P4atomickernels [OPTION]...\n\n");
+    fprintf(stderr, "  -h           Display this help message and exit\n");
+    fprintf(stderr, "  -k <name>    Only run kernels whose name starts with <name>\n");
+    fprintf(stderr, "  -l <bytes>   Smallest array length (default 4096)\n");
+    fprintf(stderr, "  -L <bytes>   Largest array length (default 16777216)\n");
+    fprintf(stderr, "  -t <msec>    Time spent on each measurement (default 20)\n");
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    const char    *prefix     = "";
+    size_t         min_length = 4096;
+    size_t         max_length = 16 << 20;
+    double         duration   = 0.02;
+    int            supported[ISA_LAST] = { 1 };
+    unsigned char *src, *dst, *ref;
+    size_t         length;
+    unsigned int   k;
+    int            isa;
+    int            ch;
+    int            errors = 0;
+
+    while ((ch = getopt(argc, argv, "k:l:L:t:h")) != -1) {
+        switch (ch) {
+            case 'k':
+                prefix = optarg;
+                break;
+            case 'l':
+                min_length = strtoul(optarg, NULL, 0);
+                break;
+            case 'L':
+                max_length = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                duration = strtol(optarg, NULL, 0) * 1e-3;
+                break;
+            case 'h':
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    if (min_length < CHECK_LENGTH)
+        min_length = CHECK_LENGTH;
+    if (max_length < min_length)
+        max_length = min_length;
+
+#ifdef HAVE_X86_TARGET_ATTRIBUTE
+    __builtin_cpu_init();
+    supported[ISA_SSE2]   = __builtin_cpu_supports("sse2");
+    supported[ISA_AVX2]   = __builtin_cpu_supports("avx2");
+    supported[ISA_AVX512] = __builtin_cpu_supports("avx512bw");
+#endif
+
+    src = malloc(max_length);
+    dst = malloc(max_length);
+    ref = malloc(max_length);
+    if (!src || !dst || !ref) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    fill(src, max_length);
+
+    /* Check the vector kernels against the portable ones, with a
+     * length that leaves a remainder. */
+    for (k = 0; k < NUM_KERNELS; k++) {
+        const struct kernel *kernel = &kernels[k];
+
+        for (isa = 1; isa < ISA_LAST; isa++) {
+            if (!supported[isa] || !kernel->fn[isa])
+                continue;
+
+            fill(ref, CHECK_LENGTH);
+            memcpy(dst, ref, CHECK_LENGTH);
+            kernel->fn[ISA_PORTABLE] (ref, src, CHECK_LENGTH);
+            kernel->fn[isa] (dst, src, CHECK_LENGTH);
+            if (memcmp(dst, ref, CHECK_LENGTH)) {
+                printf("error: %s %s differs from %s\n", kernel->name,
+                       isa_name[isa], isa_name[ISA_PORTABLE]);
+                errors++;
+            }
+        }
+    }
+
+#ifdef HAVE_X86_TARGET_ATTRIBUTE
+    /* Flush denormals to zero, so that repeatedly applying a product
+     * to the same array does not end up in the slow path. */
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+
+    printf("%-10s %10s", "kernel", "length");
+    for (isa = 0; isa < ISA_LAST; isa++)
+        printf(" %10s", isa_name[isa]);
+    printf("      (GB/s)\n");
+
+    for (k = 0; k < NUM_KERNELS; k++) {
+        const struct kernel *kernel = &kernels[k];
+
+        if (strncmp(kernel->name, prefix, strlen(prefix)))
+            continue;
+
+        for (length = min_length; length <= max_length; length *= 16) {
+            printf("%-10s %10zu", kernel->name, length);
+
+            for (isa = 0; isa < ISA_LAST; isa++) {
+                double start, elapsed;
+                long iters = 0;
+
+                if (!supported[isa] || !kernel->fn[isa]) {
+                    printf(" %10s", "-");
+                    continue;
+                }
+
+                fill(dst, length);
+
+                /* warm up */
+                kernel->fn[isa] (dst, src, length);
+
+                start = timer();
+                do {
+                    kernel->fn[isa] (dst, src, length);
+                    iters++;
+                    elapsed = timer() - start;
+                } while (elapsed < duration);
+
+                printf(" %10.2f", (double)length * iters / elapsed / 1e9);
+            }
+
+            printf("\n");
+        }
+    }
+
+    free(src);
+    free(dst);
+    free(ref);
+
+    return errors ? 1 : 0;
+}
+
+/* vim:set expandtab: */
@@ -0,0 +1,244 @@
+/*
+ * Match depth benchmark.
+ *
+ * Rank 1 pre-posts a number of MEs that never match, followed by one
+ * persistent ME that does. Rank 0 then sends a stream of puts aimed at
+ * that last ME. The receive rate shows how the cost of matching grows
+ * with the depth of the priority list.
+ *
+ * Run with PTL_MATCH_INDEX_BUCKETS set to a non zero value to use the
+ * hashed match index, or with PTL_MATCH_SHADOW=1 to use the vector scan
+ * of the compact list copy. Use -w to post the filler MEs with ignore
+ * bits so they always stay on the wildcard list.
+ */
+
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define CHECK_RETURNVAL(x) do { int ret;                                                                                                                              \
+                                switch (ret = x) {                                                                                                                    \
+                                    case PTL_IGNORED: case PTL_OK: break;                                                                                             \
+                                    case PTL_FAIL: fprintf(stderr, "=> %s returned PTL_FAIL (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;               \
+                                    case PTL_NO_SPACE: fprintf(stderr, "=> %s returned PTL_NO_SPACE (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;       \
+                                    case PTL_ARG_INVALID: fprintf(stderr, "=> %s returned PTL_ARG_INVALID (line %u)\n", # x, (unsigned int)__LINE__); abort(); break; \
+                                    case PTL_NO_INIT: fprintf(stderr, "=> %s returned PTL_NO_INIT (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;         \
+                                    default: fprintf(stderr, "=> %s returned failcode %i (line %u)\n", # x, ret, (unsigned int)__LINE__); abort(); break;             \
+                                } } while (0)
+
+#define TARGET_BITS  0x1ULL
+#define FILLER_BITS  0x100000000ULL
+
+static double timer(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: P4matchdepth [OPTION]...\n\n");
+    fprintf(stderr, "  -h           Display this help message and exit\n");
+    fprintf(stderr, "  -d <num>     Maximum list depth (default 16384)\n");
+    fprintf(stderr, "  -m <num>     Number of messages per depth (default 10000)\n");
+    fprintf(stderr, "  -w           Post the filler MEs with ignore bits\n");
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t  ni;
+    ptl_ni_limits_t  desired;
+    ptl_ni_limits_t  actual;
+    ptl_pt_index_t   pt_index;
+    ptl_process_t    myself;
+    ptl_process_t    peer;
+    ptl_handle_me_t *fillers;
+    ptl_handle_me_t  target_handle;
+    ptl_handle_md_t  md_handle;
+    ptl_handle_ct_t  ct_handle;
+    ptl_me_t         me;
+    ptl_md_t         md;
+    ptl_ct_event_t   ctc;
+    ptl_size_t       received = 0;
+    int              max_depth = 16384;
+    int              nmsgs     = 10000;
+    int              wildcard  = 0;
+    int              num_procs;
+    int              depth;
+    int              ch;
+    int              i;
+    char             buf[8];
+
+    while ((ch = getopt(argc, argv, "d:m:wh")) != -1) {
+        switch (ch) {
+            case 'd':
+                max_depth = strtol(optarg, NULL, 0);
+                break;
+            case 'm':
+                nmsgs = strtol(optarg, NULL, 0);
+                break;
+            case 'w':
+                wildcard = 1;
+                break;
+            case 'h':
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    num_procs = libtest_get_size();
+    if (num_procs != 2) {
+        fprintf(stderr, "P4matchdepth must run on 2 ranks\n");
+        return 77;
+    }
+
+    /* Leave room for the filler MEs on top of the default limits. */
+    memset(&desired, 0, sizeof(desired));
+    desired.max_entries            = max_depth + 64;
+    desired.max_unexpected_headers = 1024;
+    desired.max_mds                = 1024;
+    desired.max_cts                = 1024;
+    desired.max_eqs                = 1024;
+    desired.max_pt_index           = 63;
+    desired.max_iovecs             = 1024;
+    desired.max_list_size          = max_depth + 64;
+    desired.max_triggered_ops      = 1024;
+    desired.max_msg_size           = 1UL << 30;
+    desired.max_atomic_size        = 512;
+    desired.max_fetch_atomic_size  = 512;
+    desired.max_waw_ordered_size   = 8;
+    desired.max_war_ordered_size   = 8;
+    desired.max_volatile_size      = 8;
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_MATCHING | PTL_NI_LOGICAL, PTL_PID_ANY,
+                              &desired, &actual, &ni));
+
+    CHECK_RETURNVAL(PtlSetMap(ni, num_procs, libtest_get_mapping(ni)));
+
+    CHECK_RETURNVAL(PtlGetId(ni, &myself));
+
+    if (actual.max_list_size < max_depth + 1) {
+        max_depth = actual.max_list_size - 1;
+    }
+
+    CHECK_RETURNVAL(PtlPTAlloc(ni, 0, PTL_EQ_NONE, PTL_PT_ANY, &pt_index));
+
+    fillers = malloc(max_depth * sizeof(ptl_handle_me_t));
+    assert(fillers);
+
+    peer.rank = 1 - myself.rank;
+
+    if (myself.rank == 0) {
+        md.start     = buf;
+        md.length    = sizeof(buf);
+        md.options   = 0;
+        md.eq_handle = PTL_EQ_NONE;
+        md.ct_handle = PTL_CT_NONE;
+        CHECK_RETURNVAL(PtlMDBind(ni, &md, &md_handle));
+
+        printf("%10s %15s %15s\n", "depth", "msgs/s", "usec/msg");
+    } else {
+        CHECK_RETURNVAL(PtlCTAlloc(ni, &ct_handle));
+    }
+
+    depth = 0;
+    for (;;) {
+        double start, elapsed;
+
+        if (myself.rank == 1) {
+            me.start       = buf;
+            me.length      = sizeof(buf);
+            me.uid         = PTL_UID_ANY;
+            me.match_id    = peer;
+            me.min_free    = 0;
+            me.options     = PTL_ME_OP_PUT | PTL_ME_EVENT_LINK_DISABLE;
+            me.ct_handle   = PTL_CT_NONE;
+            me.ignore_bits = wildcard ? 0x1 : 0;
+
+            for (i = 0; i < depth; i++) {
+                me.match_bits = FILLER_BITS + ((ptl_match_bits_t)i << 1);
+                CHECK_RETURNVAL(PtlMEAppend(ni, pt_index, &me,
+                                            PTL_PRIORITY_LIST, NULL,
+                                            &fillers[i]));
+            }
+
+            me.options     = PTL_ME_OP_PUT | PTL_ME_EVENT_LINK_DISABLE |
+                             PTL_ME_EVENT_CT_COMM;
+            me.ct_handle   = ct_handle;
+            me.match_bits  = TARGET_BITS;
+            me.ignore_bits = 0;
+            CHECK_RETURNVAL(PtlMEAppend(ni, pt_index, &me, PTL_PRIORITY_LIST,
+                                        NULL, &target_handle));
+        }
+
+        libtest_barrier();
+
+        start = timer();
+
+        if (myself.rank == 0) {
+            for (i = 0; i < nmsgs; i++) {
+                CHECK_RETURNVAL(PtlPut(md_handle, 0, sizeof(buf),
+                                       PTL_NO_ACK_REQ, peer, pt_index,
+                                       TARGET_BITS, 0, NULL, 0));
+            }
+        } else {
+            received += nmsgs;
+            CHECK_RETURNVAL(PtlCTWait(ct_handle, received, &ctc));
+            assert(ctc.failure == 0);
+        }
+
+        libtest_barrier();
+
+        elapsed = timer() - start;
+
+        if (myself.rank == 0) {
+            printf("%10d %15.0f %15.3f\n", depth, nmsgs / elapsed,
+                   elapsed * 1e6 / nmsgs);
+        } else {
+            CHECK_RETURNVAL(PtlMEUnlink(target_handle));
+            for (i = 0; i < depth; i++) {
+                CHECK_RETURNVAL(PtlMEUnlink(fillers[i]));
+            }
+        }
+
+        if (depth >= max_depth)
+            break;
+
+        depth = depth ? depth * 4 : 16;
+        if (depth > max_depth)
+            depth = max_depth;
+    }
+
+    if (myself.rank == 0) {
+        CHECK_RETURNVAL(PtlMDRelease(md_handle));
+    } else {
+        CHECK_RETURNVAL(PtlCTFree(ct_handle));
+    }
+
+    free(fillers);
+
+    CHECK_RETURNVAL(PtlPTFree(ni, pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return 0;
+}
+
+/* vim:set expandtab: */
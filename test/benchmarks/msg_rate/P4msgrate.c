@@ -48,11 +48,13 @@
 #define RECV_BUF_SIZE	(SEND_BUF_SIZE)
 #define LEwithCT	(0)
 #define MEwithEQ	(1)
+#define MEwithEQMany	(2)
 
 
 /* configuration parameters - setable by command line arguments */
 int ppn;
 int machine_output;
+int eq_many;
 
 
 
@@ -251,7 +253,8 @@ usage(void)
     fprintf(stderr, "  -s <size>    Number of bytes per message\n");
     fprintf(stderr, "  -c <size>    Cache size in bytes\n");
     fprintf(stderr, "  -n <ppn>     Number of procs per node\n");
-    fprintf(stderr, "  -t <test>    0 for LE and CT, 1 for ME and full events\n");
+    fprintf(stderr, "  -t <test>    0 for LE and CT, 1 for ME and full events,\n");
+    fprintf(stderr, "               2 for ME and full events retrieved in batches\n");
     fprintf(stderr, "  -o           Format output to be machine readable\n");
     fprintf(stderr, "  -v           Increase verbosity. Using -v -v or more may impact test results!\n");
     fprintf(stderr, "\nReport bugs to <bwbarre@sandia.gov>\n");
@@ -324,10 +327,14 @@ int test_type;
 		    test_type= LEwithCT;
 		} else if (strcmp("1", optarg) == 0)   {
 		    test_type= MEwithEQ;
+		} else if (strcmp("2", optarg) == 0)   {
+		    test_type= MEwithEQMany;
+		    eq_many= 1;
 		} else   {
 		    if (rank == 0)   {
-			fprintf(stderr, "Unknown test! Use -t 0 for LE with couting events test, and\n");
-			fprintf(stderr, "                  -t 1 for ME with event queue test.\n");
+			fprintf(stderr, "Unknown test! Use -t 0 for LE with couting events test,\n");
+			fprintf(stderr, "                  -t 1 for ME with event queue test, and\n");
+			fprintf(stderr, "                  -t 2 for ME with batched event queue test.\n");
 		    }
 		    start_err= 1;
 		}
@@ -403,7 +410,7 @@ int test_type;
     if (test_type == LEwithCT)   {
 	rc= PtlNIInit(PTL_IFACE_DEFAULT, PTL_NI_NO_MATCHING | PTL_NI_LOGICAL, PTL_PID_ANY, NULL,
 		&actual, &ni_logical);
-    } else if (test_type == MEwithEQ)   {
+    } else if (test_type == MEwithEQ || test_type == MEwithEQMany)   {
 	rc= PtlNIInit(PTL_IFACE_DEFAULT, PTL_NI_MATCHING | PTL_NI_LOGICAL, PTL_PID_ANY, NULL,
 		&actual, &ni_logical);
     } else   {
@@ -447,6 +454,8 @@ int test_type;
 		printf("test:       LE with counting events\n");
 	    } else if (test_type == MEwithEQ)   {
 		printf("test:       ME with event queue\n");
+	    } else if (test_type == MEwithEQMany)   {
+		printf("test:       ME with event queue, batched retrieval\n");
 	    } else   {
 		printf("test:       Invalid\n");
 	    }
@@ -35,6 +35,7 @@
 #define magic_tag 1
 
 extern int machine_output;
+extern int eq_many;
 
 extern int *send_peers;
 extern int *recv_peers;
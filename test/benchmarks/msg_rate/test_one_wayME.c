@@ -1,5 +1,34 @@
 #include "test_one_way.h"
 
+#define EQ_BATCH (32)
+
+/*
+** Wait for nevents events of the given type, one PtlEQWait() at a time,
+** or up to EQ_BATCH at a time with PtlEQPollMany() when eq_many is set.
+*/
+static void
+wait_events(ptl_handle_eq_t eq_handle, int nevents, ptl_event_kind_t type)
+{
+    ptl_event_t events[EQ_BATCH];
+    unsigned int num, which, j;
+
+    while (nevents > 0)   {
+	if (eq_many)   {
+	    ptl_assert( PtlEQPollMany(&eq_handle, 1, PTL_TIME_FOREVER,
+			nevents < EQ_BATCH ? nevents : EQ_BATCH,
+			events, &num, &which), PTL_OK );
+	} else   {
+	    ptl_assert( PtlEQWait(eq_handle, &events[0]), PTL_OK );
+	    num= 1;
+	}
+
+	for (j= 0; j < num; j++)   {
+	    ptl_assert( events[j].type, type );
+	}
+	nevents -= num;
+    }
+}  /* end of wait_events() */
+
 void test_one_wayME(int cache_size, int *cache_buf, ptl_handle_ni_t ni,
 	int npeers, int nmsgs, int nbytes, int niters )
 {
@@ -37,11 +66,7 @@ void test_one_wayME(int cache_size, int *cache_buf, ptl_handle_ni_t ni,
 			TestOneWayIndex, k, offset), PTL_OK );
             }
 
-	    for (k= 0; k < nmsgs; k++)   {
-		ptl_event_t event;
-                ptl_assert( PtlEQWait(md.eq_handle, &event), PTL_OK );
-		ptl_assert( event.type, PTL_EVENT_SEND ); 
-            }
+	    wait_events(md.eq_handle, nmsgs, PTL_EVENT_SEND);
 
 	    total += (timer() - tmp);
         }
@@ -62,8 +87,6 @@ void test_one_wayME(int cache_size, int *cache_buf, ptl_handle_ni_t ni,
 	ptl_assert( index, TestOneWayIndex );
 
         for (i= 0; i < niters; ++i)   {
-            int k;
-
             cache_invalidate(cache_size, cache_buf);
 
 	    ptl_assert( libtest_CreateMEUseOnce(ni, index, recv_buf, nbytes,
@@ -72,11 +95,7 @@ void test_one_wayME(int cache_size, int *cache_buf, ptl_handle_ni_t ni,
             libtest_Barrier();
 	    tmp = timer();
 
-	    for (k= 0; k < nmsgs; k++)   {
-		ptl_event_t event;
-                ptl_assert( PtlEQWait(eq_handle, &event), PTL_OK );
-		ptl_assert( event.type, PTL_EVENT_PUT ); 
-            }
+	    wait_events(eq_handle, nmsgs, PTL_EVENT_PUT);
 
 	    total += (timer() - tmp);
 	}
@@ -0,0 +1,277 @@
+/*
+ * NUMA placement benchmark.
+ *
+ * Each rank binds itself to a NUMA node, spreading the ranks over the
+ * nodes of the host, before initializing Portals. Rank 0 then streams
+ * puts to rank 1. At the end, each rank reads /proc/self/numa_maps and
+ * reports how much of its anonymous and Portals shared memory sits on
+ * its own node and how much on the others, along with the message rate.
+ *
+ * Run once with PTL_NUMA_BIND=0 and once with PTL_NUMA_BIND=1 on a
+ * multi-socket host; the remote share shows the accesses the placement
+ * policy saves, for instance on the bounce buffers that rank 0 would
+ * otherwise touch first for every rank.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#ifdef HAVE_HWLOC
+#include <hwloc.h>
+#endif
+
+#define CHECK_RETURNVAL(x) do { int ret;                                                                                                                              \
+                                switch (ret = x) {                                                                                                                    \
+                                    case PTL_IGNORED: case PTL_OK: break;                                                                                             \
+                                    case PTL_FAIL: fprintf(stderr, "=> %s returned PTL_FAIL (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;               \
+                                    case PTL_NO_SPACE: fprintf(stderr, "=> %s returned PTL_NO_SPACE (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;       \
+                                    case PTL_ARG_INVALID: fprintf(stderr, "=> %s returned PTL_ARG_INVALID (line %u)\n", # x, (unsigned int)__LINE__); abort(); break; \
+                                    case PTL_NO_INIT: fprintf(stderr, "=> %s returned PTL_NO_INIT (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;         \
+                                    default: fprintf(stderr, "=> %s returned failcode %i (line %u)\n", # x, ret, (unsigned int)__LINE__); abort(); break;             \
+                                } } while (0)
+
+#define MAX_NODES 64
+
+static double timer(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: P4numaplace [OPTION]...\n\n");
+    fprintf(stderr, "  -h           Display this help message and exit\n");
+    fprintf(stderr, "  -m <num>     Number of messages (default 20000)\n");
+    fprintf(stderr, "  -s <size>    Message size (default 65536)\n");
+    fprintf(stderr, "  -u           Do not bind the ranks to NUMA nodes\n");
+}
+
+/* Bind the process to the processors of a NUMA node chosen from the
+ * rank. Return the node, or -1. */
+static int bind_to_node(int rank)
+{
+    int node = -1;
+
+#if defined HAVE_HWLOC && HWLOC_API_VERSION >= 0x00020000
+    hwloc_topology_t topo;
+    hwloc_obj_t obj;
+    int num_nodes;
+
+    if (hwloc_topology_init(&topo) || hwloc_topology_load(topo))
+        return -1;
+
+    num_nodes = hwloc_get_nbobjs_by_type(topo, HWLOC_OBJ_NUMANODE);
+    obj = hwloc_get_obj_by_type(topo, HWLOC_OBJ_NUMANODE,
+                                rank % (num_nodes > 0 ? num_nodes : 1));
+    if (obj && hwloc_set_cpubind(topo, obj->cpuset, HWLOC_CPUBIND_PROCESS) == 0)
+        node = obj->os_index;
+
+    hwloc_topology_destroy(topo);
+#endif
+
+    return node;
+}
+
+/* Add up the kilobytes per node of the anonymous memory and of the
+ * Portals shared memory files of the process. */
+static void read_placement(unsigned long *kb)
+{
+    char line[4096];
+    FILE *f;
+
+    memset(kb, 0, MAX_NODES * sizeof(*kb));
+
+    f = fopen("/proc/self/numa_maps", "r");
+    if (!f)
+        return;
+
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long pagesize_kb = 4;
+        char *p;
+
+        if (strstr(line, "file=") && !strstr(line, "portals4"))
+            continue;
+
+        p = strstr(line, "kernelpagesize_kB=");
+        if (p)
+            pagesize_kb = strtoul(p + strlen("kernelpagesize_kB="), NULL, 10);
+
+        for (p = strstr(line, " N"); p; p = strstr(p + 1, " N")) {
+            unsigned int node;
+            unsigned long pages;
+
+            if (sscanf(p, " N%u=%lu", &node, &pages) == 2 &&
+                node < MAX_NODES)
+                kb[node] += pages * pagesize_kb;
+        }
+    }
+
+    fclose(f);
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni;
+    ptl_pt_index_t  pt_index;
+    ptl_process_t   myself;
+    ptl_process_t   peer;
+    ptl_handle_md_t md_handle;
+    ptl_handle_le_t le_handle;
+    ptl_handle_ct_t ct_handle;
+    ptl_le_t        le;
+    ptl_md_t        md;
+    ptl_ct_event_t  ctc;
+    unsigned long   kb[MAX_NODES];
+    unsigned long   local = 0, remote = 0;
+    double          start, elapsed;
+    ptl_size_t      size = 65536;
+    int             nmsgs = 20000;
+    int             bind = 1;
+    int             node = -1;
+    int             num_procs;
+    int             rank;
+    int             ch;
+    int             i;
+    char           *buf;
+
+    while ((ch = getopt(argc, argv, "m:s:uh")) != -1) {
+        switch (ch) {
+            case 'm':
+                nmsgs = strtol(optarg, NULL, 0);
+                break;
+            case 's':
+                size = strtoul(optarg, NULL, 0);
+                break;
+            case 'u':
+                bind = 0;
+                break;
+            case 'h':
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    num_procs = libtest_get_size();
+    if (num_procs != 2) {
+        fprintf(stderr, "P4numaplace must run on 2 ranks\n");
+        return 77;
+    }
+
+    rank = libtest_get_rank();
+    if (bind)
+        node = bind_to_node(rank);
+
+    buf = malloc(size);
+    assert(buf);
+    memset(buf, rank, size);
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni));
+
+    CHECK_RETURNVAL(PtlSetMap(ni, num_procs, libtest_get_mapping(ni)));
+
+    CHECK_RETURNVAL(PtlGetId(ni, &myself));
+
+    CHECK_RETURNVAL(PtlPTAlloc(ni, 0, PTL_EQ_NONE, PTL_PT_ANY, &pt_index));
+
+    peer.rank = 1 - myself.rank;
+
+    if (myself.rank == 0) {
+        md.start     = buf;
+        md.length    = size;
+        md.options   = 0;
+        md.eq_handle = PTL_EQ_NONE;
+        md.ct_handle = PTL_CT_NONE;
+        CHECK_RETURNVAL(PtlMDBind(ni, &md, &md_handle));
+    } else {
+        CHECK_RETURNVAL(PtlCTAlloc(ni, &ct_handle));
+
+        le.start     = buf;
+        le.length    = size;
+        le.uid       = PTL_UID_ANY;
+        le.options   = PTL_LE_OP_PUT | PTL_LE_EVENT_LINK_DISABLE |
+                       PTL_LE_EVENT_CT_COMM;
+        le.ct_handle = ct_handle;
+        CHECK_RETURNVAL(PtlLEAppend(ni, pt_index, &le, PTL_PRIORITY_LIST,
+                                    NULL, &le_handle));
+    }
+
+    libtest_barrier();
+
+    start = timer();
+
+    if (myself.rank == 0) {
+        for (i = 0; i < nmsgs; i++) {
+            CHECK_RETURNVAL(PtlPut(md_handle, 0, size, PTL_NO_ACK_REQ, peer,
+                                   pt_index, 0, 0, NULL, 0));
+        }
+    } else {
+        CHECK_RETURNVAL(PtlCTWait(ct_handle, nmsgs, &ctc));
+        assert(ctc.failure == 0);
+    }
+
+    libtest_barrier();
+
+    elapsed = timer() - start;
+
+    read_placement(kb);
+    for (i = 0; i < MAX_NODES; i++) {
+        if (i == node || node < 0)
+            local += kb[i];
+        else
+            remote += kb[i];
+    }
+
+    for (i = 0; i < num_procs; i++) {
+        if (i == myself.rank)
+            printf("rank %d node %2d: %8lu KiB local %8lu KiB remote "
+                   "(%5.1f%%) %10.0f msgs/s %10.1f MB/s\n", myself.rank,
+                   node, local, remote,
+                   100.0 * remote / (local + remote ? local + remote : 1),
+                   nmsgs / elapsed, nmsgs * (double)size / elapsed / 1e6);
+        fflush(stdout);
+        libtest_barrier();
+    }
+
+    if (myself.rank == 0) {
+        /* The last puts may still hold the MD. */
+        while (PtlMDRelease(md_handle) == PTL_ARG_INVALID)
+            usleep(1000);
+    } else {
+        CHECK_RETURNVAL(PtlLEUnlink(le_handle));
+        CHECK_RETURNVAL(PtlCTFree(ct_handle));
+    }
+
+    CHECK_RETURNVAL(PtlPTFree(ni, pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    free(buf);
+
+    return 0;
+}
+
+/* vim:set expandtab: */
@@ -0,0 +1,221 @@
+/*
+ * Shared memory bandwidth benchmark.
+ *
+ * Rank 0 streams puts (or gets with -g) of increasing sizes to rank
+ * 1, with a window of operations in flight, and reports the bandwidth
+ * for each size. Run it with PTL_SHMEM_CMA=0 to measure the bounce
+ * buffer path of the shared memory transport, for instance with
+ * different PTL_BOUNCE_BUF_SIZE and PTL_BOUNCE_DEPTH values.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define CHECK_RETURNVAL(x) do { int ret;                                                                                                                              \
+                                switch (ret = x) {                                                                                                                    \
+                                    case PTL_IGNORED: case PTL_OK: break;                                                                                             \
+                                    case PTL_FAIL: fprintf(stderr, "=> %s returned PTL_FAIL (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;               \
+                                    case PTL_NO_SPACE: fprintf(stderr, "=> %s returned PTL_NO_SPACE (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;       \
+                                    case PTL_ARG_INVALID: fprintf(stderr, "=> %s returned PTL_ARG_INVALID (line %u)\n", # x, (unsigned int)__LINE__); abort(); break; \
+                                    case PTL_NO_INIT: fprintf(stderr, "=> %s returned PTL_NO_INIT (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;         \
+                                    default: fprintf(stderr, "=> %s returned failcode %i (line %u)\n", # x, ret, (unsigned int)__LINE__); abort(); break;             \
+                                } } while (0)
+
+static double timer(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: P4shmembw [OPTION]...\n\n");
+    fprintf(stderr, "  -h           Display this help message and exit\n");
+    fprintf(stderr, "  -g           Use gets instead of puts\n");
+    fprintf(stderr, "  -m <size>    Smallest message size (default 4096)\n");
+    fprintf(stderr, "  -M <size>    Largest message size (default 4194304)\n");
+    fprintf(stderr, "  -b <bytes>   Bytes transferred per size (default 268435456)\n");
+    fprintf(stderr, "  -w <num>     Operations in flight (default 16)\n");
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni;
+    ptl_pt_index_t  pt_index;
+    ptl_process_t   myself;
+    ptl_process_t   peer;
+    ptl_handle_md_t md_handle;
+    ptl_handle_le_t le_handle;
+    ptl_handle_ct_t ct_handle;
+    ptl_le_t        le;
+    ptl_md_t        md;
+    ptl_ct_event_t  ctc;
+    ptl_size_t      min_size = 4096;
+    ptl_size_t      max_size = 4 * 1024 * 1024;
+    ptl_size_t      total = 256 * 1024 * 1024;
+    ptl_size_t      size;
+    ptl_size_t      done = 0;
+    double          start, elapsed;
+    int             window = 16;
+    int             use_get = 0;
+    int             num_procs;
+    int             ch;
+    char           *buf;
+
+    while ((ch = getopt(argc, argv, "gm:M:b:w:h")) != -1) {
+        switch (ch) {
+            case 'g':
+                use_get = 1;
+                break;
+            case 'm':
+                min_size = strtoul(optarg, NULL, 0);
+                break;
+            case 'M':
+                max_size = strtoul(optarg, NULL, 0);
+                break;
+            case 'b':
+                total = strtoul(optarg, NULL, 0);
+                break;
+            case 'w':
+                window = strtol(optarg, NULL, 0);
+                break;
+            case 'h':
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    if (min_size == 0 || window < 1) {
+        usage();
+        return 1;
+    }
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    num_procs = libtest_get_size();
+    if (num_procs != 2) {
+        fprintf(stderr, "P4shmembw must run on 2 ranks\n");
+        return 77;
+    }
+
+    buf = malloc(max_size);
+    assert(buf);
+    memset(buf, libtest_get_rank(), max_size);
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni));
+
+    CHECK_RETURNVAL(PtlSetMap(ni, num_procs, libtest_get_mapping(ni)));
+
+    CHECK_RETURNVAL(PtlGetId(ni, &myself));
+
+    CHECK_RETURNVAL(PtlPTAlloc(ni, 0, PTL_EQ_NONE, PTL_PT_ANY, &pt_index));
+
+    CHECK_RETURNVAL(PtlCTAlloc(ni, &ct_handle));
+
+    peer.rank = 1 - myself.rank;
+
+    if (myself.rank == 0) {
+        /* Count the acks of the puts or the replies of the gets. */
+        md.start     = buf;
+        md.length    = max_size;
+        md.options   = PTL_MD_EVENT_CT_ACK | PTL_MD_EVENT_CT_REPLY;
+        md.eq_handle = PTL_EQ_NONE;
+        md.ct_handle = ct_handle;
+        CHECK_RETURNVAL(PtlMDBind(ni, &md, &md_handle));
+    } else {
+        le.start     = buf;
+        le.length    = max_size;
+        le.uid       = PTL_UID_ANY;
+        le.options   = PTL_LE_OP_PUT | PTL_LE_OP_GET;
+        le.ct_handle = PTL_CT_NONE;
+        CHECK_RETURNVAL(PtlLEAppend(ni, pt_index, &le, PTL_PRIORITY_LIST,
+                                    NULL, &le_handle));
+    }
+
+    libtest_barrier();
+
+    if (myself.rank == 0)
+        printf("%12s %10s %12s\n", "bytes", "count", "MB/s");
+
+    for (size = min_size; size <= max_size; size *= 2) {
+        ptl_size_t count = total / size;
+        ptl_size_t i;
+
+        if (count < (ptl_size_t)window)
+            count = window;
+
+        libtest_barrier();
+
+        if (myself.rank == 0) {
+            start = timer();
+
+            for (i = 0; i < count; i++) {
+                /* Keep at most window operations in flight. */
+                if (i >= (ptl_size_t)window)
+                    CHECK_RETURNVAL(PtlCTWait(ct_handle,
+                                              done + i - window + 1, &ctc));
+
+                if (use_get)
+                    CHECK_RETURNVAL(PtlGet(md_handle, 0, size, peer,
+                                           pt_index, 0, 0, NULL));
+                else
+                    CHECK_RETURNVAL(PtlPut(md_handle, 0, size,
+                                           PTL_CT_ACK_REQ, peer, pt_index,
+                                           0, 0, NULL, 0));
+            }
+
+            done += count;
+            CHECK_RETURNVAL(PtlCTWait(ct_handle, done, &ctc));
+            assert(ctc.failure == 0);
+
+            elapsed = timer() - start;
+
+            printf("%12llu %10llu %12.1f\n", (unsigned long long)size,
+                   (unsigned long long)count,
+                   count * (double)size / elapsed / 1e6);
+            fflush(stdout);
+        }
+    }
+
+    libtest_barrier();
+
+    if (myself.rank == 0) {
+        /* The last operations may still hold the MD. */
+        while (PtlMDRelease(md_handle) == PTL_ARG_INVALID)
+            usleep(1000);
+    } else {
+        CHECK_RETURNVAL(PtlLEUnlink(le_handle));
+    }
+
+    CHECK_RETURNVAL(PtlCTFree(ct_handle));
+    CHECK_RETURNVAL(PtlPTFree(ni, pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    free(buf);
+
+    return 0;
+}
+
+/* vim:set expandtab: */